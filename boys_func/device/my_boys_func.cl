@@ -1,51 +1,71 @@
 
 #include "vector_config.h"
+
+#if BOYS_PRECISION != BOYS_FLOAT
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
 #include "boys_consts.h"
 
+// Taylor expansion of F_n(x) at the closest short grid point, x < BOYS_SHORTGRID_MAXX
+inline
+TAYLOR_TYPE boys_F_taylor(FLOAT_TYPE x, int n)
+{
+	const int lookup_idx = (int)(BOYS_SHORTGRID_LOOKUPFAC*(x+BOYS_SHORTGRID_LOOKUPFAC2));
+	const FLOAT_TYPE xi = ((FLOAT_TYPE)lookup_idx * BOYS_SHORTGRID_SPACE);
+	const TAYLOR_TYPE dx = (TAYLOR_TYPE) (xi - x);
+
+	int grid_offset = lookup_idx * (BOYS_SHORTGRID_MAXN + 1) + n;
+
+	return boys_shortgrid[grid_offset]
+		   + dx * (                                 boys_shortgrid[grid_offset + 1]
+		   + dx * ( (TAYLOR_TYPE) (1.0/2.0   )   * boys_shortgrid[grid_offset + 2]
+		   + dx * ( (TAYLOR_TYPE) (1.0/6.0   )   * boys_shortgrid[grid_offset + 3]
+		   + dx * ( (TAYLOR_TYPE) (1.0/24.0  )   * boys_shortgrid[grid_offset + 4]
+		   + dx * ( (TAYLOR_TYPE) (1.0/120.0 )   * boys_shortgrid[grid_offset + 5]
+		   + dx * ( (TAYLOR_TYPE) (1.0/720.0 )   * boys_shortgrid[grid_offset + 6]
+		   + dx * ( (TAYLOR_TYPE) (1.0/5040.0)   * boys_shortgrid[grid_offset + 7]
+		   )))))));
+}
+
+// F_j(x) for x >= BOYS_SHORTGRID_MAXX is written to F[j * ldF]
+inline
+void boys_F_long(int order, FLOAT_TYPE x, __global FLOAT_TYPE * restrict F, int ldF)
+{
+	// F_0 = sqrt(pi / x) / 2, erf(sqrt(x)) is 1, then recur up. The pure asymptotic
+	// form longfac[j] * x^-(j+1/2) drops the exp(-x) terms, which are large for
+	// high orders near BOYS_SHORTGRID_MAXX.
+	FLOAT_TYPE x1 = 0.5 / x;
+	FLOAT_TYPE ex = exp(-x);
+	FLOAT_TYPE f  = boys_longfac[0] * sqrt(2.0 * x1);
+	int F_idx = 0;
+
+	for (int j = 0; j <= order; j++)
+	{
+		F[F_idx] = f;
+		F_idx += ldF;
+		f = ((2 * j + 1) * f - ex) * x1;
+	}
+}
+
+// x has BATCH_SIZE values, F_j(x[i]) is written to F[j * ldF + i]
 inline
 void boys_F_split_small_n(
 	int order, __global FLOAT_TYPE * restrict x, 
-	__global FLOAT_TYPE * restrict F
+	__global FLOAT_TYPE * restrict F, int ldF
 )	
 {
 	#pragma unroll
 	for (int i = 0; i < BATCH_SIZE; i++)
 	{
-		if (x[i] < BOYS_SHORTGRID_MAXX)  // boys_F_taylor(&F[i], x[i], order);
+		if (x[i] < BOYS_SHORTGRID_MAXX)
 		{
-			const int lookup_idx = (int)(BOYS_SHORTGRID_LOOKUPFAC*(x[i]+BOYS_SHORTGRID_LOOKUPFAC2));
-			const FLOAT_TYPE xi = ((FLOAT_TYPE)lookup_idx * BOYS_SHORTGRID_SPACE);
-			const FLOAT_TYPE dx = xi - x[i];
-
-			int grid_offset0 = lookup_idx * (BOYS_SHORTGRID_MAXN + 1);
-
 			for (int j = 0; j <= order; ++j)
-			{
-				int grid_offset = grid_offset0 + j;
-
-				F[j * BATCH_SIZE + i] = boys_shortgrid[grid_offset]
-								   + dx * (                  boys_shortgrid[grid_offset + 1]
-								   + dx * ( (1.0/2.0   )   * boys_shortgrid[grid_offset + 2]
-								   + dx * ( (1.0/6.0   )   * boys_shortgrid[grid_offset + 3]
-								   + dx * ( (1.0/24.0  )   * boys_shortgrid[grid_offset + 4]
-								   + dx * ( (1.0/120.0 )   * boys_shortgrid[grid_offset + 5]
-								   + dx * ( (1.0/720.0 )   * boys_shortgrid[grid_offset + 6]
-								   + dx * ( (1.0/5040.0)   * boys_shortgrid[grid_offset + 7]
-								   )))))));
-			}
+				F[j * ldF + i] = boys_F_taylor(x[i], j);
 		}
-		else  // boys_F_long(&F[i], x[i], order);
+		else
 		{
-			FLOAT_TYPE x1 = 1.0 / x[i];
-			FLOAT_TYPE x2 = sqrt(x1);
-			int F_idx = i;
-
-			for (int j = 0; j <= order; j++)
-			{
-				F[F_idx] = boys_longfac[j] * x2;
-				F_idx += BATCH_SIZE;
-				x2 *= x1;
-			}
+			boys_F_long(order, x[i], F + i, ldF);
 		}
 	}
 }
@@ -53,42 +73,15 @@ void boys_F_split_small_n(
 inline
 void boys_F_split_large_n(
 	int order, __global FLOAT_TYPE * restrict x, 
-	__global FLOAT_TYPE * restrict F
+	__global FLOAT_TYPE * restrict F, int ldF
 )	
 {
-	// Order is large - do only the highest, then recur down
+	// Order is large - do only the highest, then recur down. Recurring down from
+	// the upward recursion of x >= BOYS_SHORTGRID_MAXX doubles its rounding error,
+	// so those values are kept.
 	
-	int top_offset = order * BATCH_SIZE;
+	int top_offset = order * ldF;
 	
-	#pragma unroll
-	for(int i = 0; i < BATCH_SIZE; i++)
-	{
-		if (x[i] < BOYS_SHORTGRID_MAXX)  // F[top_offset + i] = boys_F_taylor_single(x[i], order);
-		{
-			const int lookup_idx = (int)(BOYS_SHORTGRID_LOOKUPFAC*(x[i]+BOYS_SHORTGRID_LOOKUPFAC2));
-			const FLOAT_TYPE xi = ((FLOAT_TYPE)lookup_idx * BOYS_SHORTGRID_SPACE);
-			const FLOAT_TYPE dx = xi - x[i];
-
-			int grid_offset = lookup_idx * (BOYS_SHORTGRID_MAXN + 1) + order;
-
-			F[top_offset + i] = boys_shortgrid[grid_offset]
-				   + dx * (                  boys_shortgrid[grid_offset + 1]
-				   + dx * ( (1.0/2.0   )   * boys_shortgrid[grid_offset + 2]
-				   + dx * ( (1.0/6.0   )   * boys_shortgrid[grid_offset + 3]
-				   + dx * ( (1.0/24.0  )   * boys_shortgrid[grid_offset + 4]
-				   + dx * ( (1.0/120.0 )   * boys_shortgrid[grid_offset + 5]
-				   + dx * ( (1.0/720.0 )   * boys_shortgrid[grid_offset + 6]
-				   + dx * ( (1.0/5040.0)   * boys_shortgrid[grid_offset + 7]
-				   )))))));
-		}
-		else  // F[top_offset + i] = boys_F_long_single(x[i], order);
-		{
-			FLOAT_TYPE p = -(2 * order + 1);
-			FLOAT_TYPE x2 = pow(x[i], p);
-			F[top_offset + i] = boys_longfac[order] * sqrt(x2);
-		}
-	}
-
     // factors for the recursion
 	FLOAT_TYPE x2[BATCH_SIZE];
 	FLOAT_TYPE ex[BATCH_SIZE];
@@ -100,21 +93,33 @@ void boys_F_split_large_n(
 		ex[i] = exp(-x[i]);
 	}
 
+	#pragma unroll
+	for(int i = 0; i < BATCH_SIZE; i++)
+	{
+		if (x[i] < BOYS_SHORTGRID_MAXX)
+		{
+			F[top_offset + i] = boys_F_taylor(x[i], order);
+		}
+		else
+		{
+			boys_F_long(order, x[i], F + i, ldF);
+		}
+	}
+
     // Recur down
     for (int n2 = order - 1; n2 >= 0; n2--)
     {
 		FLOAT_TYPE den = 1.0 / (2.0 * n2 + 1);
-		int offset0 = n2 * BATCH_SIZE;
-		int offset1 = (n2 + 1) * BATCH_SIZE;
+		int offset0 = n2 * ldF;
+		int offset1 = (n2 + 1) * ldF;
 		
-		// F[n2] = den * (x2 * F[(n2+1)] + ex)
-		// TODO: Use shift reg to hold F
+		// F[n2] = den * (x2 * F[(n2+1)] + ex), boys_F_range() keeps F on chip instead
 		#pragma unroll
 		for (int i = 0; i < BATCH_SIZE; i++)
 		{
 			FLOAT_TYPE tmp1 = x2[i] * F[offset1 + i];
 			FLOAT_TYPE tmp2 = tmp1 + ex[i];
-			F[offset0 + i]  = den * tmp2;
+			if (x[i] < BOYS_SHORTGRID_MAXX) F[offset0 + i] = den * tmp2;
 		}
     }
 }
@@ -127,6 +132,181 @@ void boys_function(
 	__global FLOAT_TYPE * restrict F
 )
 {	
-	if (order < 4) boys_F_split_small_n(order, x, F);
-	else boys_F_split_large_n(order, x, F);
+	if (order < 4) boys_F_split_small_n(order, x, F, BATCH_SIZE);
+	else boys_F_split_large_n(order, x, F, BATCH_SIZE);
+}
+
+// nbatch batches of BATCH_SIZE x values in one launch, F_j(x[i]) is written to
+// F[j * nbatch * BATCH_SIZE + i]. The host pads x to a multiple of BATCH_SIZE.
+__attribute__((task)) 
+kernel
+void boys_function_batch(
+	int order, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F, int nbatch
+)
+{
+	int ldF = nbatch * BATCH_SIZE;
+	for (int b = 0; b < nbatch; b++)
+	{
+		int offset = b * BATCH_SIZE;
+		if (order < 4) boys_F_split_small_n(order, x + offset, F + offset, ldF);
+		else boys_F_split_large_n(order, x + offset, F + offset, ldF);
+	}
+}
+
+// F_j(x[i]) for nmin <= j <= nmax is written to F[(j - nmin) * BATCH_SIZE + i], x has
+// BATCH_SIZE values. The recursion value stays in a register, and the orders are held
+// in a private array until the whole (nmax - nmin + 1) x BATCH_SIZE block is written
+// in one burst. The array is indexed by the runtime order, so it is implemented in
+// on-chip RAM, not registers, but F is not read back from global memory. The values
+// are the same as boys_F_split_small_n() / _large_n() with order = nmax.
+inline
+void boys_F_range(
+	int nmin, int nmax, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F
+)
+{
+	FLOAT_TYPE F_reg[BOYS_MAX_ORDER + 1][BATCH_SIZE];
+
+	#pragma unroll
+	for (int i = 0; i < BATCH_SIZE; i++)
+	{
+		FLOAT_TYPE xi = x[i];
+		FLOAT_TYPE ex = exp(-xi);
+		if ((xi < BOYS_SHORTGRID_MAXX) && (nmax < 4))
+		{
+			for (int j = nmin; j <= nmax; j++)
+				F_reg[j][i] = boys_F_taylor(xi, j);
+		}
+		else if (xi < BOYS_SHORTGRID_MAXX)
+		{
+			// Only the highest order from the grid, then recur down to nmin
+			FLOAT_TYPE x2 = 2.0 * xi;
+			FLOAT_TYPE f  = boys_F_taylor(xi, nmax);
+			F_reg[nmax][i] = f;
+			for (int n2 = nmax - 1; n2 >= nmin; n2--)
+			{
+				FLOAT_TYPE den = 1.0 / (2.0 * n2 + 1);
+				f = den * (x2 * f + ex);
+				F_reg[n2][i] = f;
+			}
+		}
+		else  // Recur up from F_0 as in boys_F_long()
+		{
+			FLOAT_TYPE x1 = 0.5 / xi;
+			FLOAT_TYPE f  = boys_longfac[0] * sqrt(2.0 * x1);
+			for (int j = 0; j <= nmax; j++)
+			{
+				if (j >= nmin) F_reg[j][i] = f;
+				f = ((2 * j + 1) * f - ex) * x1;
+			}
+		}
+	}
+
+	for (int j = nmin; j <= nmax; j++)
+	{
+		int offset = (j - nmin) * BATCH_SIZE;
+		#pragma unroll
+		for (int i = 0; i < BATCH_SIZE; i++)
+			F[offset + i] = F_reg[j][i];
+	}
+}
+
+// Orders nmin to nmax, 0 <= nmin <= nmax <= BOYS_MAX_ORDER, of nbatch batches. Batch b
+// is a contiguous block: F_j(x[b * BATCH_SIZE + i]) is written to
+// F[(b * (nmax - nmin + 1) + j - nmin) * BATCH_SIZE + i].
+__attribute__((task)) 
+kernel
+void boys_function_range(
+	int nmin, int nmax, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F, int nbatch
+)
+{
+	int block_size = (nmax - nmin + 1) * BATCH_SIZE;
+	for (int b = 0; b < nbatch; b++)
+		boys_F_range(nmin, nmax, x + b * BATCH_SIZE, F + b * block_size);
+}
+
+// Inputs sorted by range: the short kernel only has the short grid datapath and the
+// long kernel only the long range one, so neither instantiates the other BATCH_SIZE
+// times. nbatch batches starting at batch first_batch are evaluated, F_j(x[i]) is
+// written to F[j * ldF + i]. The host pads each range to a multiple of BATCH_SIZE with
+// x values of that range.
+
+// All x < BOYS_SHORTGRID_MAXX
+inline
+void boys_F_short_small_n(
+	int order, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F, int ldF
+)
+{
+	#pragma unroll
+	for (int i = 0; i < BATCH_SIZE; i++)
+	{
+		for (int j = 0; j <= order; ++j)
+			F[j * ldF + i] = boys_F_taylor(x[i], j);
+	}
+}
+
+// All x < BOYS_SHORTGRID_MAXX, same as boys_F_split_large_n() without the long range
+inline
+void boys_F_short_large_n(
+	int order, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F, int ldF
+)
+{
+	int top_offset = order * ldF;
+	FLOAT_TYPE x2[BATCH_SIZE];
+	FLOAT_TYPE ex[BATCH_SIZE];
+	
+	#pragma unroll
+	for (int i = 0; i < BATCH_SIZE; i++)
+	{
+		x2[i] = 2.0 * x[i];
+		ex[i] = exp(-x[i]);
+		F[top_offset + i] = boys_F_taylor(x[i], order);
+	}
+
+	for (int n2 = order - 1; n2 >= 0; n2--)
+	{
+		FLOAT_TYPE den = 1.0 / (2.0 * n2 + 1);
+		int offset0 = n2 * ldF;
+		int offset1 = (n2 + 1) * ldF;
+		
+		#pragma unroll
+		for (int i = 0; i < BATCH_SIZE; i++)
+			F[offset0 + i] = den * (x2[i] * F[offset1 + i] + ex[i]);
+	}
+}
+
+__attribute__((task)) 
+kernel
+void boys_function_short(
+	int order, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F, int ldF, int first_batch, int nbatch
+)
+{
+	for (int b = first_batch; b < first_batch + nbatch; b++)
+	{
+		int offset = b * BATCH_SIZE;
+		if (order < 4) boys_F_short_small_n(order, x + offset, F + offset, ldF);
+		else boys_F_short_large_n(order, x + offset, F + offset, ldF);
+	}
+}
+
+// All x >= BOYS_SHORTGRID_MAXX
+__attribute__((task)) 
+kernel
+void boys_function_long(
+	int order, __global FLOAT_TYPE * restrict x, 
+	__global FLOAT_TYPE * restrict F, int ldF, int first_batch, int nbatch
+)
+{
+	for (int b = first_batch; b < first_batch + nbatch; b++)
+	{
+		int offset = b * BATCH_SIZE;
+		#pragma unroll
+		for (int i = 0; i < BATCH_SIZE; i++)
+			boys_F_long(order, x[offset + i], F + offset + i, ldF);
+	}
 }
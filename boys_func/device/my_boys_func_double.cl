@@ -0,0 +1,3 @@
+// my_boys_func.cl with x, F and all arithmetic in double
+#define BOYS_PRECISION 1  // BOYS_DOUBLE in vector_config.h
+#include "my_boys_func.cl"
@@ -0,0 +1,3 @@
+// my_boys_func.cl with x, F and the recursions in double, the short grid Taylor expansion in float
+#define BOYS_PRECISION 2  // BOYS_MIXED in vector_config.h
+#include "my_boys_func.cl"
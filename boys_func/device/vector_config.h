@@ -1,7 +1,37 @@
 #ifndef __VECTOR_CONFIG_H__
 #define __VECTOR_CONFIG_H__
 
-#define FLOAT_TYPE float
+// Precision of the Boys function, host and device code must be built with the same value:
+//   BOYS_FLOAT  : x, F and all arithmetic in float
+//   BOYS_DOUBLE : x, F and all arithmetic in double
+//   BOYS_MIXED  : x and F in double, the short grid and its Taylor expansion in float,
+//                 the long range formula and the downward recursion in double
+#define BOYS_FLOAT  0
+#define BOYS_DOUBLE 1
+#define BOYS_MIXED  2
+
+#ifndef BOYS_PRECISION
+#define BOYS_PRECISION BOYS_FLOAT
+#endif
+
+#if BOYS_PRECISION == BOYS_FLOAT
+#define FLOAT_TYPE  float
+#define TAYLOR_TYPE float
+#define BOYS_AOCX   "my_boys_func.aocx"
+#elif BOYS_PRECISION == BOYS_DOUBLE
+#define FLOAT_TYPE  double
+#define TAYLOR_TYPE double
+#define BOYS_AOCX   "my_boys_func_double.aocx"
+#elif BOYS_PRECISION == BOYS_MIXED
+#define FLOAT_TYPE  double
+#define TAYLOR_TYPE float
+#define BOYS_AOCX   "my_boys_func_mixed.aocx"
+#else
+#error "BOYS_PRECISION must be BOYS_FLOAT, BOYS_DOUBLE or BOYS_MIXED"
+#endif
+
 #define BATCH_SIZE 8
 
-#endif
\ No newline at end of file
+#define BOYS_MAX_ORDER 31  // Highest order of boys_longfac in boys_consts.h
+
+#endif
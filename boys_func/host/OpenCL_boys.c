@@ -9,7 +9,19 @@
 
 #include "../device/vector_config.h"
 #include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_mem_pool.h"
 #include "boys_func_host.h"
+#include "boys_engine.h"
+
+#define BOYS_ENGINE_TILE 65536
+
+// Max relative difference between device and host results, the mixed mode reads a float
+// grid on both sides so it is checked like float
+#if BOYS_PRECISION == BOYS_DOUBLE
+#define BOYS_CHECK_TOL 1e-12
+#else
+#define BOYS_CHECK_TOL 1e-6
+#endif
 
 void testBoysFunction(int order, FLOAT_TYPE *x, cl_context context, cl_command_queue queue, cl_program program)
 {
@@ -25,10 +37,10 @@ void testBoysFunction(int order, FLOAT_TYPE *x, cl_context context, cl_command_q
 	// Get reference result
 	boys_function_host(order, x, h_F);
 	
-	// Allocate memory on device
+	// Get device buffers from the memory pool
 	cl_int err;
-	cl_mem d_x = clCreateBuffer(context, CL_MEM_READ_WRITE, x_mem_size, NULL, &err);
-	cl_mem d_F = clCreateBuffer(context, CL_MEM_READ_WRITE, F_mem_size, NULL, &err);
+	cl_mem d_x = allocCLPoolBuffer(x_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_F = allocCLPoolBuffer(F_mem_size, CL_MEM_READ_WRITE);
 	
 	// Copy data to device
 	cl_event h2d_copy;
@@ -47,6 +59,7 @@ void testBoysFunction(int order, FLOAT_TYPE *x, cl_context context, cl_command_q
 	cl_event d2h_copy;
 	err = clEnqueueReadBuffer(queue, d_F, CL_TRUE, 0, F_mem_size, hdF, 0, NULL, &d2h_copy);
 	clWaitForEvents(1, &d2h_copy);
+	if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
 	
 	// Check result
 	int passed = 1;
@@ -58,7 +71,7 @@ void testBoysFunction(int order, FLOAT_TYPE *x, cl_context context, cl_command_q
 			FLOAT_TYPE dev_res  = hdF[i * BATCH_SIZE + j];
 			FLOAT_TYPE abs_diff = fabs(dev_res - host_res);
 			FLOAT_TYPE rel_diff = abs_diff / fabs(host_res);
-			if (rel_diff > 1e-6)
+			if (rel_diff > BOYS_CHECK_TOL)
 			{
 				passed = 0;
 				printf("Order %d, x = %f,\tref res = %e, dev res = %e, rel diff = %e \n", i, x[j], host_res, dev_res, rel_diff);
@@ -71,14 +84,115 @@ void testBoysFunction(int order, FLOAT_TYPE *x, cl_context context, cl_command_q
 	
 	// Release resources
 	err = clReleaseKernel(kernel);      
-	err = clReleaseMemObject(d_x);
-	err = clReleaseMemObject(d_F);
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_F);
 	
 	// Free host space
 	free(h_F);
 	free(hdF);
 }
 
+// Evaluate n values with an engine twice, the second call is timed, return the max relative
+// error. nmin < 0 uses evalBoysEngine(), otherwise evalBoysEngineRange() for orders nmin to order.
+static double runBoysEngine(
+	boysEngine_t *engine, const int nmin, const int order, const size_t n, const FLOAT_TYPE *x,
+	const FLOAT_TYPE *ref, FLOAT_TYPE *F, boysEngineStats_t *stats
+)
+{
+	boysEngineStats_t st0;
+	int ret = 0;
+	for (int itest = 0; itest < 2; itest++)
+	{
+		if (itest == 1) getBoysEngineStats(engine, &st0);
+		if (nmin < 0) ret = evalBoysEngine(engine, order, n, x, F);
+		else ret = evalBoysEngineRange(engine, nmin, order, n, x, F);
+	}
+	getBoysEngineStats(engine, stats);
+	stats->nx      -= st0.nx;
+	stats->nF      -= st0.nF;
+	stats->seconds -= st0.seconds;
+	if (ret != 0) return INFINITY;
+
+	// F_j of evalBoysEngineRange() starts at row j - nmin
+	if (nmin > 0) ref += nmin * n;
+	double max_rel_diff = 0.0;
+	for (size_t i = 0; i < n * (order + 1 - (nmin > 0 ? nmin : 0)); i++)
+	{
+		double rel_diff = fabs((double) F[i] - (double) ref[i]) / fabs((double) ref[i]);
+		if (rel_diff > max_rel_diff) max_rel_diff = rel_diff;
+	}
+	return max_rel_diff;
+}
+
+void testBoysEngine(int order, size_t n, cl_program program)
+{
+	printf("Testing batched Boys function engine with order %d, %zu x values\n", order, n);
+	FLOAT_TYPE *x   = (FLOAT_TYPE *) malloc(sizeof(FLOAT_TYPE) * n);
+	FLOAT_TYPE *ref = (FLOAT_TYPE *) malloc(sizeof(FLOAT_TYPE) * n * (order + 1));
+	FLOAT_TYPE *F   = (FLOAT_TYPE *) malloc(sizeof(FLOAT_TYPE) * n * (order + 1));
+	for (size_t i = 0; i < n; i++) x[i] = (FLOAT_TYPE) (50.0 * (double) rand() / (double) RAND_MAX);
+	boys_function_host_array_scalar(order, n, x, ref);
+	
+	// The device kernel is used even if the device is not an FPGA
+	setenv("BOYS_CPU_FALLBACK", "0", 0);
+	boysEngineStats_t stats;
+	boysEngine_t *engine;
+	
+	// boys_function_batch on unsorted tiles, then boys_function_short and boys_function_long
+	// on tiles sorted by range
+	const char *binned_name[2] = {"unbinned", "binned  "};
+	char *binned_env = getenv("BOYS_BINNED");
+	if (binned_env != NULL) binned_env = strdup(binned_env);
+	for (int binned = 0; binned <= 1; binned++)
+	{
+		setenv("BOYS_BINNED", binned ? "1" : "0", 1);
+		engine = (program != NULL) ? createBoysEngine(program, order, BOYS_ENGINE_TILE) : NULL;
+		if (engine == NULL) break;
+		
+		// Math functions on device are not correctly rounded, allow a few more ulps than the single batch test
+		double max_rel_diff = runBoysEngine(engine, -1, order, n, x, ref, F, &stats);
+		printf(
+			"%s device %s: max rel diff = %e, %.3lf (s), %.3e x values / s, %.3e F values / s\n",
+			(max_rel_diff <= 10 * BOYS_CHECK_TOL) ? "Check passed" : "Check failed", binned_name[binned],
+			max_rel_diff, stats.seconds, (double) stats.nx / stats.seconds, (double) stats.nF / stats.seconds
+		);
+		destroyBoysEngine(engine);
+	}
+	if (binned_env != NULL) setenv("BOYS_BINNED", binned_env, 1);
+	else unsetenv("BOYS_BINNED");
+	free(binned_env);
+	
+	// boys_function_range for all orders and for the upper half of them
+	engine = (program != NULL) ? createBoysEngine(program, order, BOYS_ENGINE_TILE) : NULL;
+	const int range_nmin[2] = {0, (order + 1) / 2};
+	for (int k = 0; (engine != NULL) && (k < 2); k++)
+	{
+		int nmin = range_nmin[k];
+		double max_rel_diff = runBoysEngine(engine, nmin, order, n, x, ref, F, &stats);
+		printf(
+			"%s device F_%d..F_%d: max rel diff = %e, %.3lf (s), %.3e x values / s, %.3e F values / s\n",
+			(max_rel_diff <= 10 * BOYS_CHECK_TOL) ? "Check passed" : "Check failed", nmin, order,
+			max_rel_diff, stats.seconds, (double) stats.nx / stats.seconds, (double) stats.nF / stats.seconds
+		);
+	}
+	destroyBoysEngine(engine);
+	
+	// Without a program the engine runs the vectorized boys_function_host_array(), which
+	// has its own exp() and uses the downward recursion for all orders
+	engine = createBoysEngine(NULL, order, BOYS_ENGINE_TILE);
+	double max_rel_diff = runBoysEngine(engine, -1, order, n, x, ref, F, &stats);
+	printf(
+		"%s host:            max rel diff = %e, %.3lf (s), %.3e x values / s, %.3e F values / s\n",
+		(max_rel_diff <= 10 * BOYS_CHECK_TOL) ? "Check passed" : "Check failed", max_rel_diff, stats.seconds,
+		(double) stats.nx / stats.seconds, (double) stats.nF / stats.seconds
+	);
+	destroyBoysEngine(engine);
+	
+	free(x);
+	free(ref);
+	free(F);
+}
+
 int main(int argc, char **argv)
 {
 	FLOAT_TYPE x[BATCH_SIZE] = {1.2, 3.4, 5.6, 7.8, 41.1, 42.2, 43.3, 44.4};
@@ -91,13 +205,17 @@ int main(int argc, char **argv)
 	cl_program program;
 	initCLFPGASimpleEnvironment(
 		&FPGA_devices, &numDevices, &context, 
-		&queue, &program, "my_boys_func.aocx"
+		&queue, &program, BOYS_AOCX
 	);
 
 	// Test boys function on device, order < 4 and > 4 has different code path
 	testBoysFunction(3, x, context, queue, program);
 	testBoysFunction(6, x, context, queue, program);
 	
+	// Test the batched engine with millions of x values
+	testBoysEngine(3, 1 << 22, program);
+	testBoysEngine(6, 1 << 22, program);
+	
 	// Free device resources
 	clReleaseProgram(program);    // Release the program object
 	clReleaseCommandQueue(queue); // Release Command queue
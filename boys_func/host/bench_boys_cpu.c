@@ -0,0 +1,92 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <math.h>
+
+#include "../device/vector_config.h"
+#include "boys_func_host.h"
+
+// Seconds per call of boys_function_host_array() or its scalar version, after a warm up
+// call so that page faults of a fresh F are not counted
+static double timeBoysArray(
+	const int simd, const int nthreads, const int order, const size_t n,
+	const FLOAT_TYPE *x, FLOAT_TYPE *F, const int ntest
+)
+{
+	int max_threads = omp_get_max_threads();
+	omp_set_num_threads(nthreads);
+	if (simd) boys_function_host_array(order, n, x, F);
+	else boys_function_host_array_scalar(order, n, x, F);
+	double st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++)
+	{
+		if (simd) boys_function_host_array(order, n, x, F);
+		else boys_function_host_array_scalar(order, n, x, F);
+	}
+	double et = omp_get_wtime();
+	omp_set_num_threads(max_threads);
+	return (et - st) / (double) ntest;
+}
+
+// Max relative error of the first nref x values against boys_function_reference(), where the
+// result is a normal number: F underflows for high orders and large x in float
+static double getBoysMaxRelErr(const int order, const size_t n, const size_t nref, const FLOAT_TYPE *x, const FLOAT_TYPE *F)
+{
+	double max_rerr = 0.0;
+	for (size_t i = 0; i < nref; i++)
+		for (int j = 0; j <= order; j++)
+		{
+			long double ref = boys_function_reference(j, x[i]);
+			if (!isnormal((FLOAT_TYPE) ref)) continue;
+			double rerr = (double) fabsl((F[j * n + i] - ref) / ref);
+			if (!(rerr <= max_rerr)) max_rerr = rerr;
+		}
+	return max_rerr;
+}
+
+static void benchBoysOrder(const int order, const size_t n, const FLOAT_TYPE *x, const int ntest)
+{
+	size_t F_size = n * (order + 1);
+	size_t nref   = (n < 4096) ? n : 4096;
+	FLOAT_TYPE *F0 = (FLOAT_TYPE*) malloc(sizeof(FLOAT_TYPE) * F_size);
+	FLOAT_TYPE *F1 = (FLOAT_TYPE*) malloc(sizeof(FLOAT_TYPE) * F_size);
+	int nthreads = omp_get_max_threads();
+
+	double scalar_t = timeBoysArray(0, 1,        order, n, x, F0, ntest);
+	double simd1_t  = timeBoysArray(1, 1,        order, n, x, F1, ntest);
+	double simdp_t  = timeBoysArray(1, nthreads, order, n, x, F1, ntest);
+	printf(
+		"%5d | scalar %.3e x/s | SIMD 1 thread %.3e x/s (%5.2lfx) | SIMD %d threads %.3e x/s (%5.2lfx)"
+		" | max rel err scalar %.2e, SIMD %.2e\n",
+		order, (double) n / scalar_t, (double) n / simd1_t, scalar_t / simd1_t,
+		nthreads, (double) n / simdp_t, scalar_t / simdp_t,
+		getBoysMaxRelErr(order, n, nref, x, F0), getBoysMaxRelErr(order, n, nref, x, F1)
+	);
+
+	free(F0);
+	free(F1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t n = (size_t) 1 << 22;
+	if (argc >= 2) n = (size_t) atoll(argv[1]);
+	if (n < 1)
+	{
+		printf("Usage: %s <number of x values, default 2^22>\n", argv[0]);
+		return 255;
+	}
+
+	// x is uniform in [0, 50], both the short grid and the long range formula are used
+	FLOAT_TYPE *x = (FLOAT_TYPE*) malloc(sizeof(FLOAT_TYPE) * n);
+	for (size_t i = 0; i < n; i++) x[i] = (FLOAT_TYPE) (50.0 * (double) rand() / (double) RAND_MAX);
+
+	printf("CPU Boys function, %zu x values in [0, 50], %d threads\n", n, omp_get_max_threads());
+	const int orders[] = {0, 1, 3, 6, 12, 24};
+	for (int i = 0; i < (int) (sizeof(orders) / sizeof(orders[0])); i++)
+		benchBoysOrder(orders[i], n, x, 3);
+
+	free(x);
+	return 0;
+}
@@ -0,0 +1,351 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/vector_config.h"
+#include "boys_func_host.h"
+#include "boys_engine.h"
+
+// Slot s uses runtime queue BOYS_ENGINE_QUEUE + s, queue 0 is left to the caller
+#define BOYS_ENGINE_QUEUE 1
+#define BOYS_ENGINE_SLOTS 2
+
+struct boysEngine
+{
+	int        use_cpu;
+	int        binned;
+	int        max_order;
+	size_t     tile_size;  // A multiple of BATCH_SIZE
+	boysEngineStats_t stats;
+
+	// Device path, a slot holds one tile from its copy in to its copy out
+	cl_command_queue queue[BOYS_ENGINE_SLOTS];
+	cl_kernel  kernel[BOYS_ENGINE_SLOTS];
+	cl_kernel  kernel_short[BOYS_ENGINE_SLOTS], kernel_long[BOYS_ENGINE_SLOTS];
+	cl_kernel  kernel_range[BOYS_ENGINE_SLOTS];  // NULL if the program does not have boys_function_range
+	cl_mem     d_x[BOYS_ENGINE_SLOTS], d_F[BOYS_ENGINE_SLOTS];
+	FLOAT_TYPE *h_x[BOYS_ENGINE_SLOTS], *h_F[BOYS_ENGINE_SLOTS];  // Pinned staging buffers
+	cl_event   done[BOYS_ENGINE_SLOTS];
+	size_t     tile_spos[BOYS_ENGINE_SLOTS], tile_leng[BOYS_ENGINE_SLOTS], tile_ldF[BOYS_ENGINE_SLOTS];
+
+	// Binned path, h_x[s][p] is x[tile_spos[s] + perm[s][p]], perm[s][p] is -1 for padding
+	int        *perm[BOYS_ENGINE_SLOTS];
+};
+
+void destroyBoysEngine(boysEngine_t *engine)
+{
+	if (engine == NULL) return;
+	for (int s = 0; s < BOYS_ENGINE_SLOTS; s++)
+	{
+		if (engine->done[s]   != NULL) clReleaseEvent(engine->done[s]);
+		if (engine->kernel[s] != NULL) clReleaseKernel(engine->kernel[s]);
+		if (engine->kernel_short[s] != NULL) clReleaseKernel(engine->kernel_short[s]);
+		if (engine->kernel_long[s]  != NULL) clReleaseKernel(engine->kernel_long[s]);
+		if (engine->kernel_range[s] != NULL) clReleaseKernel(engine->kernel_range[s]);
+		freeCLPoolBuffer(engine->d_x[s]);
+		freeCLPoolBuffer(engine->d_F[s]);
+		freeCLPinnedHost(engine->h_x[s]);
+		freeCLPinnedHost(engine->h_F[s]);
+		free(engine->perm[s]);
+	}
+	free(engine);
+}
+
+// Kernels and scatter index of the binned path for slot s, returns 0 if the program
+// was built before boys_function_short and boys_function_long existed
+static int createBoysEngineBinKernels(boysEngine_t *engine, cl_program program, const int s, const size_t tile)
+{
+	cl_int err;
+	engine->kernel_short[s] = clCreateKernel(program, "boys_function_short", &err);
+	if (err != CL_SUCCESS) engine->kernel_short[s] = NULL;
+	engine->kernel_long[s]  = clCreateKernel(program, "boys_function_long", &err);
+	if (err != CL_SUCCESS) engine->kernel_long[s] = NULL;
+	engine->perm[s] = (int*) malloc(sizeof(int) * (tile + BATCH_SIZE));
+	if ((engine->kernel_short[s] == NULL) || (engine->kernel_long[s] == NULL) || (engine->perm[s] == NULL))
+	{
+		printf("[INFO] Boys function engine: no boys_function_short / boys_function_long, binning is off\n");
+		return 0;
+	}
+	
+	cl_kernel kernels[2] = {engine->kernel_short[s], engine->kernel_long[s]};
+	for (int k = 0; k < 2; k++)
+	{
+		err  = clSetKernelArg(kernels[k], 1, sizeof(cl_mem), (void*) &engine->d_x[s]);
+		err |= clSetKernelArg(kernels[k], 2, sizeof(cl_mem), (void*) &engine->d_F[s]);
+		if (err != CL_SUCCESS) return 0;
+	}
+	return 1;
+}
+
+boysEngine_t *createBoysEngine(cl_program program, const int max_order, const size_t tile_size)
+{
+	if ((max_order < 0) || (max_order > BOYS_MAX_ORDER) || (tile_size == 0)) return NULL;
+
+	// The kernel indexes F with int. Both bins of a tile may need a padded batch.
+	size_t tile = (tile_size + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+	if ((tile + BATCH_SIZE) * (max_order + 1) > 0x7FFFFFFFULL) return NULL;
+
+	boysEngine_t *engine = (boysEngine_t*) calloc(1, sizeof(boysEngine_t));
+	if (engine == NULL) return NULL;
+	engine->max_order = max_order;
+	engine->tile_size = tile;
+
+	// CPU fallback, the OpenCL device is not an FPGA
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("BOYS_CPU_FALLBACK");
+	engine->use_cpu = (rt == NULL) || (program == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (program != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) engine->use_cpu = 0;
+	if (engine->use_cpu) return engine;
+
+	// Sort each tile into short grid and long range bins for boys_function_short and
+	// boys_function_long, unless $BOYS_BINNED is 0 or the program does not have them
+	const char *binned = getenv("BOYS_BINNED");
+	engine->binned = (binned == NULL) || (strcmp(binned, "0") != 0);
+
+	size_t x_bytes = sizeof(FLOAT_TYPE) * (tile + BATCH_SIZE);
+	size_t F_bytes = sizeof(FLOAT_TYPE) * (tile + BATCH_SIZE) * (max_order + 1);
+	for (int s = 0; s < BOYS_ENGINE_SLOTS; s++)
+	{
+		cl_int err;
+		engine->queue[s]  = getCLRuntimeQueue(BOYS_ENGINE_QUEUE + s);
+		engine->kernel[s] = clCreateKernel(program, "boys_function_batch", &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clCreateKernel() failed for boys_function_batch, returned status = %d\n", err);
+			engine->kernel[s] = NULL;
+			destroyBoysEngine(engine);
+			return NULL;
+		}
+		engine->d_x[s] = allocCLPoolBuffer(x_bytes, CL_MEM_READ_ONLY);
+		engine->d_F[s] = allocCLPoolBuffer(F_bytes, CL_MEM_WRITE_ONLY);
+		engine->h_x[s] = (FLOAT_TYPE*) allocCLPinnedHost(x_bytes, NULL);
+		engine->h_F[s] = (FLOAT_TYPE*) allocCLPinnedHost(F_bytes, NULL);
+		if ((engine->d_x[s] == NULL) || (engine->d_F[s] == NULL) || (engine->h_x[s] == NULL) || (engine->h_F[s] == NULL))
+		{
+			destroyBoysEngine(engine);
+			return NULL;
+		}
+		err  = clSetKernelArg(engine->kernel[s], 1, sizeof(cl_mem), (void*) &engine->d_x[s]);
+		err |= clSetKernelArg(engine->kernel[s], 2, sizeof(cl_mem), (void*) &engine->d_F[s]);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clSetKernelArg() failed, returned status = %d\n", err);
+			destroyBoysEngine(engine);
+			return NULL;
+		}
+		if (engine->binned) engine->binned = createBoysEngineBinKernels(engine, program, s, tile);
+
+		engine->kernel_range[s] = clCreateKernel(program, "boys_function_range", &err);
+		if (err != CL_SUCCESS) engine->kernel_range[s] = NULL;
+		if (engine->kernel_range[s] != NULL)
+		{
+			err  = clSetKernelArg(engine->kernel_range[s], 2, sizeof(cl_mem), (void*) &engine->d_x[s]);
+			err |= clSetKernelArg(engine->kernel_range[s], 3, sizeof(cl_mem), (void*) &engine->d_F[s]);
+			if (err != CL_SUCCESS)
+			{
+				printf("[ERROR] clSetKernelArg() failed, returned status = %d\n", err);
+				destroyBoysEngine(engine);
+				return NULL;
+			}
+		}
+	}
+	return engine;
+}
+
+// Wait for the tile in a slot and copy its F rows nmin to nmax to their place in F
+static cl_int finishBoysEngineSlot(
+	boysEngine_t *engine, const int s, const int range, const int nmin, const int nmax,
+	const size_t n, FLOAT_TYPE *F
+)
+{
+	if (engine->done[s] == NULL) return CL_SUCCESS;
+	cl_int err = clWaitForEvents(1, &engine->done[s]);
+	clReleaseEvent(engine->done[s]);
+	engine->done[s] = NULL;
+	if (err != CL_SUCCESS) return err;
+
+	size_t spos = engine->tile_spos[s], leng = engine->tile_leng[s], ldF = engine->tile_ldF[s];
+	if (range)
+	{
+		// boys_function_range writes one block of nmax - nmin + 1 rows per batch
+		size_t nrow = nmax - nmin + 1;
+		for (size_t b = 0; b * BATCH_SIZE < leng; b++)
+		{
+			size_t len_b = (leng - b * BATCH_SIZE < BATCH_SIZE) ? leng - b * BATCH_SIZE : BATCH_SIZE;
+			const FLOAT_TYPE *hF_b = engine->h_F[s] + b * nrow * BATCH_SIZE;
+			for (size_t j = 0; j < nrow; j++)
+				memcpy(F + j * n + spos + b * BATCH_SIZE, hF_b + j * BATCH_SIZE, sizeof(FLOAT_TYPE) * len_b);
+		}
+		return CL_SUCCESS;
+	}
+	if (engine->binned)
+	{
+		const int *perm = engine->perm[s];
+		for (int j = nmin; j <= nmax; j++)
+		{
+			FLOAT_TYPE *F_j = F + (j - nmin) * n + spos;
+			const FLOAT_TYPE *hF_j = engine->h_F[s] + j * ldF;
+			for (size_t p = 0; p < ldF; p++)
+				if (perm[p] >= 0) F_j[perm[p]] = hF_j[p];
+		}
+		return CL_SUCCESS;
+	}
+	for (int j = nmin; j <= nmax; j++)
+		memcpy(F + (j - nmin) * n + spos, engine->h_F[s] + j * ldF, sizeof(FLOAT_TYPE) * leng);
+	return CL_SUCCESS;
+}
+
+// Launch a bin kernel on batches [first_batch, first_batch + nbatch) of a tile
+static cl_int enqueueBoysBinKernel(
+	cl_command_queue queue, cl_kernel kernel, cl_int order, cl_int ldF, 
+	cl_int first_batch, cl_int nbatch
+)
+{
+	if (nbatch == 0) return CL_SUCCESS;
+	cl_int err;
+	err  = clSetKernelArg(kernel, 0, sizeof(cl_int), (void*) &order);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*) &ldF);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_int), (void*) &first_batch);
+	err |= clSetKernelArg(kernel, 5, sizeof(cl_int), (void*) &nbatch);
+	err |= clEnqueueTask(queue, kernel, 0, NULL, NULL);
+	return err;
+}
+
+// Copy in, evaluate and copy out one tile on the queue of slot s without waiting. With
+// range the tile runs boys_function_range for orders nmin to nmax, otherwise it runs
+// the batch or bin kernels for orders 0 to nmax.
+static cl_int startBoysEngineSlot(
+	boysEngine_t *engine, const int s, const int range, const int nmin, const int nmax,
+	const FLOAT_TYPE *x, const size_t spos, const size_t leng
+)
+{
+	cl_int  _nmin  = nmin;
+	cl_int  _order = nmax;
+	size_t  nrow   = range ? (size_t) (nmax - nmin + 1) : (size_t) (nmax + 1);
+	cl_int  nbatch = (cl_int) ((leng + BATCH_SIZE - 1) / BATCH_SIZE);
+	size_t  ldF    = (size_t) nbatch * BATCH_SIZE;
+	size_t  long_spos = ldF;
+
+	if (engine->binned && !range)
+	{
+		long_spos = boys_bin_x(leng, x + spos, BATCH_SIZE, engine->h_x[s], engine->perm[s], &ldF);
+		nbatch    = (cl_int) (ldF / BATCH_SIZE);
+	} else {
+		// The last batch is padded with x = 0, which is in the short grid
+		memcpy(engine->h_x[s], x + spos, sizeof(FLOAT_TYPE) * leng);
+		for (size_t i = leng; i < ldF; i++) engine->h_x[s][i] = 0;
+	}
+	engine->tile_spos[s] = spos;
+	engine->tile_leng[s] = leng;
+	engine->tile_ldF[s]  = ldF;
+
+	cl_int err;
+	err = clEnqueueWriteBuffer(engine->queue[s], engine->d_x[s], CL_FALSE, 0, sizeof(FLOAT_TYPE) * ldF, engine->h_x[s], 0, NULL, NULL);
+	if (range)
+	{
+		err |= clSetKernelArg(engine->kernel_range[s], 0, sizeof(cl_int), (void*) &_nmin);
+		err |= clSetKernelArg(engine->kernel_range[s], 1, sizeof(cl_int), (void*) &_order);
+		err |= clSetKernelArg(engine->kernel_range[s], 4, sizeof(cl_int), (void*) &nbatch);
+		err |= clEnqueueTask(engine->queue[s], engine->kernel_range[s], 0, NULL, NULL);
+	} else if (engine->binned) {
+		cl_int nbatch_short = (cl_int) (long_spos / BATCH_SIZE);
+		err |= enqueueBoysBinKernel(engine->queue[s], engine->kernel_short[s], _order, (cl_int) ldF, 0, nbatch_short);
+		err |= enqueueBoysBinKernel(engine->queue[s], engine->kernel_long[s],  _order, (cl_int) ldF, nbatch_short, nbatch - nbatch_short);
+	} else {
+		err |= clSetKernelArg(engine->kernel[s], 0, sizeof(cl_int), (void*) &_order);
+		err |= clSetKernelArg(engine->kernel[s], 3, sizeof(cl_int), (void*) &nbatch);
+		err |= clEnqueueTask(engine->queue[s], engine->kernel[s], 0, NULL, NULL);
+	}
+	err |= clEnqueueReadBuffer(
+		engine->queue[s], engine->d_F[s], CL_FALSE, 0, sizeof(FLOAT_TYPE) * ldF * nrow,
+		engine->h_F[s], 0, NULL, &engine->done[s]
+	);
+	clFlush(engine->queue[s]);
+	return err;
+}
+
+// F[(j - nmin) * n + i] = F_j(x[i]) for nmin <= j <= nmax, see startBoysEngineSlot() for range
+static int evalBoysEngineTiles(
+	boysEngine_t *engine, const int range, const int nmin, const int nmax,
+	const size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F
+)
+{
+	double st = omp_get_wtime();
+	cl_int err = CL_SUCCESS;
+	size_t ntiles = (n + engine->tile_size - 1) / engine->tile_size;
+	for (size_t t = 0; t < ntiles; t++)
+	{
+		size_t spos = t * engine->tile_size;
+		size_t leng = (spos + engine->tile_size <= n) ? engine->tile_size : n - spos;
+
+		// F rows of a tile are strided by n in the output, by the tile length in F_tile
+		if (engine->use_cpu)
+		{
+			FLOAT_TYPE *F_tile = (FLOAT_TYPE*) malloc(sizeof(FLOAT_TYPE) * leng * (nmax + 1));
+			if (F_tile == NULL) return -1;
+			boys_function_host_array(nmax, leng, x + spos, F_tile);
+			for (int j = nmin; j <= nmax; j++)
+				memcpy(F + (j - nmin) * n + spos, F_tile + j * leng, sizeof(FLOAT_TYPE) * leng);
+			free(F_tile);
+			continue;
+		}
+
+		int s = (int) (t % BOYS_ENGINE_SLOTS);
+		err = finishBoysEngineSlot(engine, s, range, nmin, nmax, n, F);
+		if (err == CL_SUCCESS) err = startBoysEngineSlot(engine, s, range, nmin, nmax, x, spos, leng);
+		if (err != CL_SUCCESS) break;
+	}
+
+	// The slots are drained in tile order
+	for (size_t t = ntiles; t < ntiles + BOYS_ENGINE_SLOTS; t++)
+	{
+		if (engine->use_cpu) break;
+		cl_int err1 = finishBoysEngineSlot(engine, (int) (t % BOYS_ENGINE_SLOTS), range, nmin, nmax, n, F);
+		if (err == CL_SUCCESS) err = err1;
+	}
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] Boys function engine failed, returned status = %d\n", err);
+		return -1;
+	}
+
+	engine->stats.nx      += n;
+	engine->stats.nF      += (unsigned long long) n * (nmax - nmin + 1);
+	engine->stats.seconds += omp_get_wtime() - st;
+	return 0;
+}
+
+int evalBoysEngine(boysEngine_t *engine, const int order, const size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F)
+{
+	if ((engine == NULL) || (order < 0) || (order > engine->max_order)) return -1;
+	if (n == 0) return 0;
+	if ((x == NULL) || (F == NULL)) return -1;
+	return evalBoysEngineTiles(engine, 0, 0, order, n, x, F);
+}
+
+int evalBoysEngineRange(
+	boysEngine_t *engine, const int nmin, const int nmax, const size_t n,
+	const FLOAT_TYPE *x, FLOAT_TYPE *F
+)
+{
+	if ((engine == NULL) || (nmin < 0) || (nmin > nmax) || (nmax > engine->max_order)) return -1;
+	if (n == 0) return 0;
+	if ((x == NULL) || (F == NULL)) return -1;
+	if (!engine->use_cpu && (engine->kernel_range[0] == NULL))
+	{
+		printf("[ERROR] Boys function engine: the program has no boys_function_range kernel\n");
+		return -1;
+	}
+	return evalBoysEngineTiles(engine, 1, nmin, nmax, n, x, F);
+}
+
+int getBoysEngineStats(boysEngine_t *engine, boysEngineStats_t *stats)
+{
+	if ((engine == NULL) || (stats == NULL)) return -1;
+	*stats = engine->stats;
+	return 0;
+}
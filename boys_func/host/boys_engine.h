@@ -0,0 +1,59 @@
+#ifndef __BOYS_ENGINE_H__
+#define __BOYS_ENGINE_H__
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+#include "../device/vector_config.h"
+
+// Batched Boys function evaluation for x arrays of any length with the
+// boys_function_batch kernel. The engine keeps its kernels, device buffers and pinned
+// staging buffers between calls. Each call is cut into tiles of at most tile_size
+// values, which go through two slots on two queues, so copying one tile overlaps
+// with evaluating the other. On the device path each tile is sorted into short grid
+// and long range bins by boys_bin_x(), which run boys_function_short and
+// boys_function_long, and the results are scattered back to the input order. Set
+// $BOYS_BINNED to 0 to use boys_function_batch on the unsorted tile instead.
+
+typedef struct
+{
+	unsigned long long nx;  // x values evaluated so far
+	unsigned long long nF;  // F values evaluated so far, nx * (order + 1) summed over calls
+	double seconds;         // Time spent in evalBoysEngine()
+} boysEngineStats_t;
+
+typedef struct boysEngine boysEngine_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Create an engine for orders up to max_order (<= BOYS_MAX_ORDER), program should be
+// built from BOYS_AOCX with the same BOYS_PRECISION. If there is no FPGA (or program is
+// NULL), the engine uses boys_function_host_array() instead; set $BOYS_CPU_FALLBACK to 0
+// to use the OpenCL device anyway. Returns NULL on error.
+boysEngine_t *createBoysEngine(cl_program program, const int max_order, const size_t tile_size);
+
+// F[j * n + i] = F_j(x[i]) for 0 <= j <= order <= max_order and 0 <= i < n.
+// Returns 0 on success and -1 on error.
+int evalBoysEngine(boysEngine_t *engine, const int order, const size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F);
+
+// F[(j - nmin) * n + i] = F_j(x[i]) for 0 <= nmin <= j <= nmax <= max_order and 0 <= i < n.
+// The device path runs boys_function_range, which keeps the orders of a batch on chip
+// and writes them in one block. Returns 0 on success and -1 on error.
+int evalBoysEngineRange(
+	boysEngine_t *engine, const int nmin, const int nmax, const size_t n,
+	const FLOAT_TYPE *x, FLOAT_TYPE *F
+);
+
+// Counters of all evalBoysEngine() and evalBoysEngineRange() calls, evaluations per second are nx / seconds and nF / seconds
+int getBoysEngineStats(boysEngine_t *engine, boysEngineStats_t *stats);
+
+// Release the engine
+void destroyBoysEngine(boysEngine_t *engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
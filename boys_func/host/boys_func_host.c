@@ -1,4 +1,6 @@
+#include <stddef.h>
 #include <math.h>
+#include <stdint.h>
 
 #include "../device/vector_config.h"
 #include "boys_func_host.h"
@@ -6,115 +8,299 @@
 
 // TODO: Check if we should use native_{exp, pow} in OpenCL
 
+#define BOYS_SHORTGRID_SIZE (BOYS_SHORTGRID_NPOINT * (BOYS_SHORTGRID_MAXN + 1))
+
+// Taylor expansion of F_n(x) at the closest short grid point, the same expression as
+// boys_F_taylor() on device. The index is clamped so that SIMD lanes with x >= 
+// BOYS_SHORTGRID_MAXX (blended away later) stay in the grid.
+#pragma omp declare simd uniform(n)
+static inline TAYLOR_TYPE boys_F_taylor(FLOAT_TYPE x, int n)
+{
+	int lookup_idx = (int)(BOYS_SHORTGRID_LOOKUPFAC*(x+BOYS_SHORTGRID_LOOKUPFAC2));
+	lookup_idx = (lookup_idx < 0) ? 0 : lookup_idx;
+	lookup_idx = (lookup_idx > BOYS_SHORTGRID_NPOINT - 1) ? BOYS_SHORTGRID_NPOINT - 1 : lookup_idx;
+	const FLOAT_TYPE xi = ((FLOAT_TYPE)lookup_idx * BOYS_SHORTGRID_SPACE);
+	const TAYLOR_TYPE dx = (TAYLOR_TYPE) (xi - x);
+
+	int grid_offset = lookup_idx * (BOYS_SHORTGRID_MAXN + 1) + n;
+	grid_offset = (grid_offset > BOYS_SHORTGRID_SIZE - 8) ? BOYS_SHORTGRID_SIZE - 8 : grid_offset;
+
+	return boys_shortgrid[grid_offset]
+		   + dx * (                                 boys_shortgrid[grid_offset + 1]
+		   + dx * ( (TAYLOR_TYPE) (1.0/2.0   )   * boys_shortgrid[grid_offset + 2]
+		   + dx * ( (TAYLOR_TYPE) (1.0/6.0   )   * boys_shortgrid[grid_offset + 3]
+		   + dx * ( (TAYLOR_TYPE) (1.0/24.0  )   * boys_shortgrid[grid_offset + 4]
+		   + dx * ( (TAYLOR_TYPE) (1.0/120.0 )   * boys_shortgrid[grid_offset + 5]
+		   + dx * ( (TAYLOR_TYPE) (1.0/720.0 )   * boys_shortgrid[grid_offset + 6]
+		   + dx * ( (TAYLOR_TYPE) (1.0/5040.0)   * boys_shortgrid[grid_offset + 7]
+		   )))))));
+}
+
+// x has BATCH_SIZE values, F_j(x[i]) is written to F[j * ldF + i]
 static inline
-void boys_F_split_small_n(int order, FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F)	
+void boys_F_split_small_n(int order, const FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F, int ldF)	
 {
 	for (int i = 0; i < BATCH_SIZE; i++)
 	{
-		if (x[i] < BOYS_SHORTGRID_MAXX)  // boys_F_taylor(&F[i], x[i], order);
+		if (x[i] < BOYS_SHORTGRID_MAXX)
 		{
-			const int lookup_idx = (int)(BOYS_SHORTGRID_LOOKUPFAC*(x[i]+BOYS_SHORTGRID_LOOKUPFAC2));
-			const FLOAT_TYPE xi = ((FLOAT_TYPE)lookup_idx * BOYS_SHORTGRID_SPACE);
-			const FLOAT_TYPE dx = xi - x[i];
-			
-			int grid_offset0 = lookup_idx * (BOYS_SHORTGRID_MAXN + 1);
-
 			for (int j = 0; j <= order; ++j)
-			{
-				int grid_offset = grid_offset0 + j;
-
-				F[j * BATCH_SIZE + i] = boys_shortgrid[grid_offset]
-								   + dx * (                  boys_shortgrid[grid_offset + 1]
-								   + dx * ( (1.0/2.0   )   * boys_shortgrid[grid_offset + 2]
-								   + dx * ( (1.0/6.0   )   * boys_shortgrid[grid_offset + 3]
-								   + dx * ( (1.0/24.0  )   * boys_shortgrid[grid_offset + 4]
-								   + dx * ( (1.0/120.0 )   * boys_shortgrid[grid_offset + 5]
-								   + dx * ( (1.0/720.0 )   * boys_shortgrid[grid_offset + 6]
-								   + dx * ( (1.0/5040.0)   * boys_shortgrid[grid_offset + 7]
-								   )))))));
-			}
+				F[j * ldF + i] = boys_F_taylor(x[i], j);
 		}
 		else  // boys_F_long(&F[i], x[i], order);
 		{
-			FLOAT_TYPE x1 = 1.0 / x[i];
-			FLOAT_TYPE x2 = sqrt(x1);
+			// F_0 = sqrt(pi / x) / 2, erf(sqrt(x)) is 1, then recur up. The pure asymptotic
+			// form longfac[j] * x^-(j+1/2) drops the exp(-x) terms, which are large for
+			// high orders near BOYS_SHORTGRID_MAXX.
+			FLOAT_TYPE x1 = 0.5 / x[i];
+			FLOAT_TYPE ex = exp(-x[i]);
+			FLOAT_TYPE f  = boys_longfac[0] * sqrt(2.0 * x1);
 			int F_idx = i;
 
 			for (int j = 0; j <= order; j++)
 			{
-				F[F_idx] = boys_longfac[j] * x2;
-				F_idx += BATCH_SIZE;
-				x2 *= x1;
+				F[F_idx] = f;
+				F_idx += ldF;
+				f = ((2 * j + 1) * f - ex) * x1;
 			}
 		}
 	}
 }
 
 static inline
-void boys_F_split_large_n(int order, FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F)	
+void boys_F_split_large_n(int order, const FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F, int ldF)	
 {
-	// Order is large - do only the highest, then recur down
+	// Order is large - do only the highest, then recur down. Recurring down from
+	// the upward recursion of x >= BOYS_SHORTGRID_MAXX doubles its rounding error,
+	// so those values are kept.
+	
+	int top_offset = order * ldF;
 	
-	int top_offset = order * BATCH_SIZE;
+    // factors for the recursion
+	FLOAT_TYPE x2[BATCH_SIZE];
+	FLOAT_TYPE ex[BATCH_SIZE];
 	
+	for (int i = 0; i < BATCH_SIZE; i++)
+	{
+		x2[i] = 2.0 * x[i];
+		ex[i] = exp(-x[i]);
+	}
+
 	for(int i = 0; i < BATCH_SIZE; i++)
 	{
-		if (x[i] < BOYS_SHORTGRID_MAXX)  // F[top_offset + i] = boys_F_taylor_single(x[i], order);
+		if (x[i] < BOYS_SHORTGRID_MAXX)
 		{
-			const int lookup_idx = (int)(BOYS_SHORTGRID_LOOKUPFAC*(x[i]+BOYS_SHORTGRID_LOOKUPFAC2));
-			const FLOAT_TYPE xi = ((FLOAT_TYPE)lookup_idx * BOYS_SHORTGRID_SPACE);
-			const FLOAT_TYPE dx = xi - x[i];
-
-			int grid_offset = lookup_idx * (BOYS_SHORTGRID_MAXN + 1) + order;
-
-			F[top_offset + i] = boys_shortgrid[grid_offset]
-				   + dx * (                  boys_shortgrid[grid_offset + 1]
-				   + dx * ( (1.0/2.0   )   * boys_shortgrid[grid_offset + 2]
-				   + dx * ( (1.0/6.0   )   * boys_shortgrid[grid_offset + 3]
-				   + dx * ( (1.0/24.0  )   * boys_shortgrid[grid_offset + 4]
-				   + dx * ( (1.0/120.0 )   * boys_shortgrid[grid_offset + 5]
-				   + dx * ( (1.0/720.0 )   * boys_shortgrid[grid_offset + 6]
-				   + dx * ( (1.0/5040.0)   * boys_shortgrid[grid_offset + 7]
-				   )))))));
+			// Recur down, F[n2] = den * (x2 * F[n2 + 1] + ex), F[n2 + 1] stays in f
+			FLOAT_TYPE f = boys_F_taylor(x[i], order);
+			F[top_offset + i] = f;
+			for (int n2 = order - 1; n2 >= 0; n2--)
+			{
+				FLOAT_TYPE den = 1.0 / (2.0 * n2 + 1);
+				f = den * (x2[i] * f + ex[i]);
+				F[n2 * ldF + i] = f;
+			}
 		}
-		else  // F[top_offset + i] = boys_F_long_single(x[i], order);
+		else  // All orders recur up from F_0 as in boys_F_split_small_n()
 		{
-			FLOAT_TYPE p = -(2 * order + 1);
-			FLOAT_TYPE x2 = pow(x[i], p);
-			F[top_offset + i] = boys_longfac[order] * sqrt(x2);
+			FLOAT_TYPE x1 = 1.0 / x2[i];
+			FLOAT_TYPE f  = boys_longfac[0] * sqrt(2.0 * x1);
+			for (int j = 0; j <= order; j++)
+			{
+				F[j * ldF + i] = f;
+				f = ((2 * j + 1) * f - ex[i]) * x1;
+			}
 		}
 	}
+}
 
-    // factors for the recursion
-	FLOAT_TYPE x2[BATCH_SIZE];
-	FLOAT_TYPE ex[BATCH_SIZE];
+void boys_function_host(int order, FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F)
+{
+	if (order < 4) boys_F_split_small_n(order, x, F, BATCH_SIZE);
+	else           boys_F_split_large_n(order, x, F, BATCH_SIZE);
+}
+
+void boys_function_host_array_scalar(int order, size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F)
+{
+	size_t nfull = n / BATCH_SIZE * BATCH_SIZE;
+	for (size_t i = 0; i < nfull; i += BATCH_SIZE)
+	{
+		if (order < 4) boys_F_split_small_n(order, x + i, F + i, (int) n);
+		else           boys_F_split_large_n(order, x + i, F + i, (int) n);
+	}
 	
-	for (int i = 0; i < BATCH_SIZE; i++)
+	// The last partial batch is padded with x = 0
+	if (nfull < n)
 	{
-		x2[i] = 2.0 * x[i];
-		ex[i] = exp(-x[i]);
+		FLOAT_TYPE x_tail[BATCH_SIZE], F_tail[(BOYS_LONGFAC_MAXN + 1) * BATCH_SIZE];
+		for (int i = 0; i < BATCH_SIZE; i++) x_tail[i] = (nfull + i < n) ? x[nfull + i] : 0;
+		boys_function_host(order, x_tail, F_tail);
+		for (int j = 0; j <= order; j++)
+			for (size_t i = nfull; i < n; i++) F[j * n + i] = F_tail[j * BATCH_SIZE + (i - nfull)];
+	}
+}
+
+// Vectorized version. x is processed in blocks of BOYS_SIMD_BLOCK values and every loop
+// over a block is a "#pragma omp simd" loop without branches: the short grid Taylor
+// expansion (gathered from boys_shortgrid) and the long range formula are both computed
+// and blended in a separate loop, otherwise GCC moves the Taylor expansion back into a
+// branch. Blocks are distributed over OpenMP threads, a block's rows stay in cache.
+
+#define BOYS_SIMD_BLOCK        256
+#define BOYS_SIMD_MIN_PARALLEL 4096  // Shorter arrays are evaluated by one thread
+
+// exp(-x) for 0 <= x <= BOYS_EXP_MAXX without libm, so that it is vectorized:
+// x * log2(e) = k + f with integer k and 0 <= f < 1, exp(-x) = 2^-k * exp(-f * ln(2)).
+// 2^-k is built from its exponent bits, exp(-f * ln(2)) is a Taylor polynomial of
+// degree 9 (float) or 17 (double). BOYS_EXP_MAXX keeps 2^-k a normal number, the
+// caller clamps x in a separate loop: a clamp in here is turned into a branch by GCC.
+#define BOYS_EXP_MAXX ((sizeof(FLOAT_TYPE) == sizeof(float)) ? 87.0 : 708.0)
+static const FLOAT_TYPE boys_exp_inv[18] = {
+	1.0, 1.0, 1.0/2.0, 1.0/3.0, 1.0/4.0, 1.0/5.0, 1.0/6.0, 1.0/7.0, 1.0/8.0, 1.0/9.0, 1.0/10.0,
+	1.0/11.0, 1.0/12.0, 1.0/13.0, 1.0/14.0, 1.0/15.0, 1.0/16.0, 1.0/17.0
+};
+
+#pragma omp declare simd
+static inline FLOAT_TYPE boys_exp_neg(FLOAT_TYPE x)
+{
+	FLOAT_TYPE t = x * (FLOAT_TYPE) 1.44269504088896340736;
+	int k = (int) t;
+	FLOAT_TYPE y = (t - (FLOAT_TYPE) k) * (FLOAT_TYPE) 0.693147180559945309417;
+
+	// Written out, GCC does not unroll a loop here before vectorizing at -O2
+	FLOAT_TYPE p = 1;
+	if (sizeof(FLOAT_TYPE) != sizeof(float))
+	{
+		p = 1 - y * p * boys_exp_inv[17];
+		p = 1 - y * p * boys_exp_inv[16];
+		p = 1 - y * p * boys_exp_inv[15];
+		p = 1 - y * p * boys_exp_inv[14];
+		p = 1 - y * p * boys_exp_inv[13];
+		p = 1 - y * p * boys_exp_inv[12];
+		p = 1 - y * p * boys_exp_inv[11];
+		p = 1 - y * p * boys_exp_inv[10];
+	}
+	p = 1 - y * p * boys_exp_inv[9];
+	p = 1 - y * p * boys_exp_inv[8];
+	p = 1 - y * p * boys_exp_inv[7];
+	p = 1 - y * p * boys_exp_inv[6];
+	p = 1 - y * p * boys_exp_inv[5];
+	p = 1 - y * p * boys_exp_inv[4];
+	p = 1 - y * p * boys_exp_inv[3];
+	p = 1 - y * p * boys_exp_inv[2];
+	p = 1 - y * p;
+
+	FLOAT_TYPE scale;
+	if (sizeof(FLOAT_TYPE) == sizeof(float))
+	{
+		union {float f; int32_t i;} u;
+		u.i = (int32_t) (127 - k) << 23;
+		scale = u.f;
+	} else {
+		union {double f; int64_t i;} u;
+		u.i = (int64_t) (1023 - k) << 52;
+		scale = u.f;
+	}
+	return p * scale;
+}
+
+// F_j(x[i]) for 0 <= j <= order and len <= BOYS_SIMD_BLOCK values, written to F[j * ldF + i]
+static void boys_F_block(int order, int len, const FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F, size_t ldF)
+{
+	FLOAT_TYPE ex[BOYS_SIMD_BLOCK], x1[BOYS_SIMD_BLOCK], f[BOYS_SIMD_BLOCK];
+
+	// exp(-x), 0 above the range of boys_exp_neg()
+	#pragma omp simd
+	for (int i = 0; i < len; i++) x1[i] = (x[i] < BOYS_EXP_MAXX) ? x[i] : BOYS_EXP_MAXX;
+	#pragma omp simd
+	for (int i = 0; i < len; i++) ex[i] = boys_exp_neg(x1[i]);
+	#pragma omp simd
+	for (int i = 0; i < len; i++)
+	{
+		ex[i] = (x[i] < BOYS_EXP_MAXX) ? ex[i] : 0;
+		x1[i] = 0.5 / x[i];
+		f[i]  = boys_longfac[0] * sqrt(2.0 * x1[i]);
+	}
+
+	// The long range values of all orders recur up from F_0 as in boys_F_split_small_n()
+	for (int j = 0; j <= order; j++)
+	{
+		FLOAT_TYPE * restrict Fj = F + j * ldF;
+		#pragma omp simd
+		for (int i = 0; i < len; i++)
+		{
+			Fj[i] = f[i];
+			f[i]  = ((2 * j + 1) * f[i] - ex[i]) * x1[i];
+		}
 	}
 
-    // Recur down
-    for (int n2 = order - 1; n2 >= 0; n2--)
-    {
+	// The short grid value of the highest order, then recur down. Unlike boys_function_host(),
+	// low orders also use the recursion: gathers from the grid cost more than the vectorized
+	// exp(). Long range values are kept as in boys_F_split_large_n().
+	FLOAT_TYPE * restrict Fo = F + order * ldF;
+	#pragma omp simd
+	for (int i = 0; i < len; i++) x1[i] = boys_F_taylor(x[i], order);
+	#pragma omp simd
+	for (int i = 0; i < len; i++)
+	{
+		f[i]  = (x[i] < BOYS_SHORTGRID_MAXX) ? x1[i] : Fo[i];
+		Fo[i] = f[i];
+		x1[i] = 2.0 * x[i];
+	}
+
+	for (int n2 = order - 1; n2 >= 0; n2--)
+	{
 		FLOAT_TYPE den = 1.0 / (2.0 * n2 + 1);
-		int offset0 = n2 * BATCH_SIZE;
-		int offset1 = (n2 + 1) * BATCH_SIZE;
-		
-		// F[n2] = den * (x2 * F[(n2+1)] + ex)
-		// TODO: Use shift reg to hold F
-		for (int i = 0; i < BATCH_SIZE; i++)
+		FLOAT_TYPE * restrict Fn = F + n2 * ldF;
+		#pragma omp simd
+		for (int i = 0; i < len; i++)
 		{
-			FLOAT_TYPE tmp1 = x2[i] * F[offset1 + i];
-			FLOAT_TYPE tmp2 = tmp1 + ex[i];
-			F[offset0 + i]  = den * tmp2;
+			f[i]  = (x[i] < BOYS_SHORTGRID_MAXX) ? den * (x1[i] * f[i] + ex[i]) : Fn[i];
+			Fn[i] = f[i];
 		}
-    }
+	}
 }
 
-void boys_function_host(int order, FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F)
+void boys_function_host_array(int order, size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F)
+{
+	size_t nblocks = (n + BOYS_SIMD_BLOCK - 1) / BOYS_SIMD_BLOCK;
+	#pragma omp parallel for schedule(static) if (n >= BOYS_SIMD_MIN_PARALLEL)
+	for (size_t b = 0; b < nblocks; b++)
+	{
+		size_t spos = b * BOYS_SIMD_BLOCK;
+		int    len  = (spos + BOYS_SIMD_BLOCK <= n) ? BOYS_SIMD_BLOCK : (int) (n - spos);
+		boys_F_block(order, len, x + spos, F + spos, n);
+	}
+}
+
+size_t boys_bin_x(size_t n, const FLOAT_TYPE *x, size_t pad, FLOAT_TYPE *x_bin, int *perm, size_t *n_bin)
+{
+	size_t nshort = 0;
+	for (size_t i = 0; i < n; i++)
+		if (x[i] < BOYS_SHORTGRID_MAXX) nshort++;
+	size_t long_spos = (nshort + pad - 1) / pad * pad;
+	size_t long_epos = long_spos + (n - nshort + pad - 1) / pad * pad;
+
+	size_t ps = 0, pl = long_spos;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t p = (x[i] < BOYS_SHORTGRID_MAXX) ? ps++ : pl++;
+		x_bin[p] = x[i];
+		perm[p]  = (int) i;
+	}
+	for (; ps < long_spos; ps++) { x_bin[ps] = 0; perm[ps] = -1; }
+	for (; pl < long_epos; pl++) { x_bin[pl] = BOYS_SHORTGRID_MAXX; perm[pl] = -1; }
+	*n_bin = long_epos;
+	return long_spos;
+}
+
+long double boys_function_reference(int order, long double x)
 {
-	if (order < 4) boys_F_split_small_n(order, x, F);
-	else           boys_F_split_large_n(order, x, F);
+	// F_n(x) = exp(-x) * sum_k (2x)^k / ((2n+1)(2n+3)...(2n+2k+1))
+	long double term = 1.0L / (2 * order + 1), sum = 0.0L;
+	for (int k = 1; term > sum * 1e-21L; k++)
+	{
+		sum  += term;
+		term *= 2.0L * x / (2 * order + 2 * k + 1);
+	}
+	return expl(-x) * sum;
 }
@@ -1,14 +1,35 @@
 #ifndef __BOYS_FUNC_HOST_H__
 #define __BOYS_FUNC_HOST_H__
 
+#include <stddef.h>
+
 #include "../device/vector_config.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// F_j(x[i]) for 0 <= j <= order and BATCH_SIZE values in x, written to F[j * BATCH_SIZE + i]
 void boys_function_host(int order, FLOAT_TYPE * restrict x, FLOAT_TYPE * restrict F);
 
+// Same for n values in x of any length, written to F[j * n + i]. The loops are vectorized
+// with OpenMP SIMD and long arrays are split over OpenMP threads. exp() is replaced by
+// code that can be vectorized, results differ from the scalar version by a few ulps.
+void boys_function_host_array(int order, size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F);
+
+// Scalar version with boys_function_host() on each batch, n * (order + 1) < 2^31
+void boys_function_host_array_scalar(int order, size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F);
+
+// Stable partition of x[0 : n-1] into x_bin by range: x in the short grid first, then
+// the long range x from the returned index on. Both bins are padded to a multiple of pad
+// with x values of their own range, the padded length is written to *n_bin (<= n + 2 * pad).
+// perm[p] is the index in x of x_bin[p], or -1 for padding. n < 2^31.
+size_t boys_bin_x(size_t n, const FLOAT_TYPE *x, size_t pad, FLOAT_TYPE *x_bin, int *perm, size_t *n_bin);
+
+// F_order(x) from its series in long double, about 1e-18 relative error for x <= 100. Slow,
+// for checking the other functions.
+long double boys_function_reference(int order, long double x);
+
 #ifdef __cplusplus
 }
 #endif
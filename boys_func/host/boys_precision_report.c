@@ -0,0 +1,104 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <math.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "../device/vector_config.h"
+#include "boys_func_host.h"
+#include "boys_engine.h"
+
+// Accuracy and throughput of the Boys function in the precision this file is built
+// with, see BOYS_PRECISION in vector_config.h. "make report" builds and runs it once
+// for each precision.
+
+#define REPORT_MAX_X     100.0
+#define REPORT_NX_ACC    10001     // x values on a uniform grid in [0, REPORT_MAX_X] for the accuracy
+#define REPORT_NX_SPEED  (1 << 20) // Random x values in [0, REPORT_MAX_X] for the throughput
+#define REPORT_TILE      65536
+
+static const char *precision_names[3] = {"float", "double", "mixed (float Taylor expansion, double recursion)"};
+
+// Max relative error of F_j, 0 <= j <= order, against boys_function_reference(), where
+// the reference is a normal number in FLOAT_TYPE
+static double getMaxRelErr(const int order, const size_t n, const long double *ref, const FLOAT_TYPE *F)
+{
+	double max_rerr = 0.0;
+	for (size_t i = 0; i < n * (order + 1); i++)
+	{
+		if (!isnormal((FLOAT_TYPE) ref[i])) continue;
+		double rerr = (double) fabsl((F[i] - ref[i]) / ref[i]);
+		if (!(rerr <= max_rerr)) max_rerr = rerr;
+	}
+	return max_rerr;
+}
+
+// x values per second of evalBoysEngine(), the first call is a warm up
+static double getEngineSpeed(boysEngine_t *engine, const int order, const size_t n, const FLOAT_TYPE *x, FLOAT_TYPE *F)
+{
+	boysEngineStats_t st0, st1;
+	if (evalBoysEngine(engine, order, n, x, F) != 0) return 0.0;
+	getBoysEngineStats(engine, &st0);
+	for (int itest = 0; itest < 3; itest++) evalBoysEngine(engine, order, n, x, F);
+	getBoysEngineStats(engine, &st1);
+	return (double) (st1.nx - st0.nx) / (st1.seconds - st0.seconds);
+}
+
+int main(int argc, char **argv)
+{
+	size_t nacc = REPORT_NX_ACC, nspeed = REPORT_NX_SPEED;
+	FLOAT_TYPE  *x_acc   = (FLOAT_TYPE*)  malloc(sizeof(FLOAT_TYPE)  * nacc);
+	FLOAT_TYPE  *x_speed = (FLOAT_TYPE*)  malloc(sizeof(FLOAT_TYPE)  * nspeed);
+	long double *ref     = (long double*) malloc(sizeof(long double) * nacc * (BOYS_MAX_ORDER + 1));
+	FLOAT_TYPE  *F       = (FLOAT_TYPE*)  malloc(sizeof(FLOAT_TYPE)  * nspeed * (BOYS_MAX_ORDER + 1));
+	if ((x_acc == NULL) || (x_speed == NULL) || (ref == NULL) || (F == NULL))
+	{
+		printf("[ERROR] Cannot allocate host arrays\n");
+		return 255;
+	}
+	for (size_t i = 0; i < nacc; i++) x_acc[i] = (FLOAT_TYPE) (REPORT_MAX_X * (double) i / (double) (nacc - 1));
+	for (size_t i = 0; i < nspeed; i++) x_speed[i] = (FLOAT_TYPE) (REPORT_MAX_X * (double) rand() / (double) RAND_MAX);
+	for (int j = 0; j <= BOYS_MAX_ORDER; j++)
+		for (size_t i = 0; i < nacc; i++) ref[j * nacc + i] = boys_function_reference(j, x_acc[i]);
+
+	// The device kernel is used even if the device is not an FPGA
+	setenv("BOYS_CPU_FALLBACK", "0", 0);
+	cl_program program = getCLRuntimeProgram(BOYS_AOCX);
+	if (program == NULL) printf("No OpenCL program for %s, only the host is tested\n", BOYS_AOCX);
+	boysEngine_t *engine = (program != NULL) ? createBoysEngine(program, BOYS_MAX_ORDER, REPORT_TILE) : NULL;
+
+	printf("Boys function in %s, x in [0, %.0lf], %d host threads\n", precision_names[BOYS_PRECISION], REPORT_MAX_X, omp_get_max_threads());
+	printf("Max rel err of F_0, ..., F_order over %zu x values, throughput over %zu x values\n", nacc, nspeed);
+	for (int order = 0; order <= BOYS_MAX_ORDER; order++)
+	{
+		boys_function_host_array(order, nacc, x_acc, F);
+		double host_err = getMaxRelErr(order, nacc, ref, F);
+
+		boys_function_host_array(order, nspeed, x_speed, F);
+		double st = omp_get_wtime();
+		for (int itest = 0; itest < 3; itest++) boys_function_host_array(order, nspeed, x_speed, F);
+		double host_speed = 3.0 * (double) nspeed / (omp_get_wtime() - st);
+		printf("%5d | host %.2e, %.3e x/s", order, host_err, host_speed);
+
+		if (engine != NULL)
+		{
+			if (evalBoysEngine(engine, order, nacc, x_acc, F) == 0)
+			{
+				double dev_err = getMaxRelErr(order, nacc, ref, F);
+				printf(" | device %.2e, %.3e x/s", dev_err, getEngineSpeed(engine, order, nspeed, x_speed, F));
+			} else {
+				printf(" | device FAILED");
+			}
+		}
+		printf("\n");
+	}
+
+	destroyBoysEngine(engine);
+	free(x_acc);
+	free(x_speed);
+	free(ref);
+	free(F);
+	return 0;
+}
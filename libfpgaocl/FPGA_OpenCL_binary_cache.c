@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_binary_cache.h"
+
+#define CL_BINARY_CACHE_DEFAULT_DIR ".fpgaocl_cache"
+
+// Get the cache directory, return NULL if the cache is disabled
+static const char *getCLBinaryCacheDir()
+{
+	const char *cache_dir = getenv("FPGA_OCL_CACHE_DIR");
+	if (cache_dir == NULL) cache_dir = CL_BINARY_CACHE_DEFAULT_DIR;
+	if (cache_dir[0] == 0) return NULL;
+	mkdir(cache_dir, 0755);
+	return cache_dir;
+}
+
+uint64_t hashCLBinary(const void *data, const size_t size, const uint64_t seed)
+{
+	const unsigned char *bytes = (const unsigned char *) data;
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (uint64_t) bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int lookupCLBinaryCacheIndex(const char *file_name, const struct stat *st, uint64_t *hash)
+{
+	const char *cache_dir = getCLBinaryCacheDir();
+	if (cache_dir == NULL) return 0;
+
+	char index_file_name[1024];
+	snprintf(index_file_name, sizeof(index_file_name), "%s/index.txt", cache_dir);
+	FILE *inf = fopen(index_file_name, "r");
+	if (inf == NULL) return 0;
+
+	// Older indexes may have several entries of a file, the last one is the newest
+	int found = 0;
+	char line[2048], name[1024];
+	uint64_t _hash;
+	long long size, mtime;
+	while (fgets(line, sizeof(line), inf) != NULL)
+	{
+		if (sscanf(line, "%" SCNx64 " %lld %lld %1023[^\n]", &_hash, &size, &mtime, name) != 4) continue;
+		if (strcmp(name, file_name) != 0) continue;
+		if ((size == (long long) st->st_size) && (mtime == (long long) st->st_mtime))
+		{
+			*hash = _hash;
+			found = 1;
+		} else {
+			found = 0;
+		}
+	}
+	fclose(inf);
+	return found;
+}
+
+void updateCLBinaryCacheIndex(const char *file_name, const struct stat *st, const uint64_t hash)
+{
+	const char *cache_dir = getCLBinaryCacheDir();
+	if (cache_dir == NULL) return;
+
+	// Copy the other entries to a temporary index and replace the old one with it,
+	// so the index has one line per file and does not grow with every change
+	char index_file_name[1024], tmp_file_name[1100];
+	snprintf(index_file_name, sizeof(index_file_name), "%s/index.txt", cache_dir);
+	snprintf(tmp_file_name, sizeof(tmp_file_name), "%s.%d.tmp", index_file_name, (int) getpid());
+	FILE *ouf = fopen(tmp_file_name, "w");
+	if (ouf == NULL) return;
+	FILE *inf = fopen(index_file_name, "r");
+	if (inf != NULL)
+	{
+		char line[2048], name[1024];
+		uint64_t _hash;
+		long long size, mtime;
+		while (fgets(line, sizeof(line), inf) != NULL)
+		{
+			if (sscanf(line, "%" SCNx64 " %lld %lld %1023[^\n]", &_hash, &size, &mtime, name) != 4) continue;
+			if (strcmp(name, file_name) == 0) continue;
+			fputs(line, ouf);
+		}
+		fclose(inf);
+	}
+	fprintf(
+		ouf, "%016" PRIx64 " %lld %lld %s\n", hash,
+		(long long) st->st_size, (long long) st->st_mtime, file_name
+	);
+	int write_failed = ferror(ouf);
+	fclose(ouf);
+	if (!write_failed) rename(tmp_file_name, index_file_name);
+	else unlink(tmp_file_name);
+}
+
+uint64_t hashCLIncludeDirStamp(const char *include_dir, const uint64_t seed)
+{
+	DIR *dir = opendir(include_dir);
+	if (dir == NULL) return seed;
+
+	// Sum the hash of each header, so the result does not depend on the order of readdir()
+	uint64_t stamp = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		size_t name_len = strlen(entry->d_name);
+		if ((name_len < 3) || (strcmp(entry->d_name + name_len - 2, ".h") != 0)) continue;
+		char header_file_name[1024];
+		struct stat st;
+		snprintf(header_file_name, sizeof(header_file_name), "%s/%s", include_dir, entry->d_name);
+		if (stat(header_file_name, &st) != 0) continue;
+		long long stat_info[2] = {(long long) st.st_size, (long long) st.st_mtime};
+		uint64_t header_hash = hashCLBinary(entry->d_name, name_len, CL_BINARY_HASH_SEED);
+		stamp += hashCLBinary(stat_info, sizeof(stat_info), header_hash);
+	}
+	closedir(dir);
+	return hashCLBinary(&stamp, sizeof(stamp), seed);
+}
+
+int mapCLCachedBinary(const uint64_t key, size_t *size, unsigned char **content)
+{
+	const char *cache_dir = getCLBinaryCacheDir();
+	if (cache_dir == NULL) return -1;
+
+	char bin_file_name[1024];
+	snprintf(bin_file_name, sizeof(bin_file_name), "%s/%016" PRIx64 ".bin", cache_dir, key);
+	if (access(bin_file_name, R_OK) != 0) return -1;
+	return mapCLBinaryKernelFile(bin_file_name, size, content);
+}
+
+void saveCLCachedBinary(const uint64_t key, const size_t size, const unsigned char *content)
+{
+	const char *cache_dir = getCLBinaryCacheDir();
+	if (cache_dir == NULL) return;
+
+	// Write to a temporary file first, so other processes never see a partial binary
+	char bin_file_name[1024], tmp_file_name[1100];
+	snprintf(bin_file_name, sizeof(bin_file_name), "%s/%016" PRIx64 ".bin", cache_dir, key);
+	snprintf(tmp_file_name, sizeof(tmp_file_name), "%s.%d.tmp", bin_file_name, (int) getpid());
+	FILE *ouf = fopen(tmp_file_name, "wb");
+	if (ouf == NULL) return;
+	size_t write_count = fwrite(content, size, 1, ouf);
+	fclose(ouf);
+	if (write_count == 1) rename(tmp_file_name, bin_file_name);
+	else unlink(tmp_file_name);
+}
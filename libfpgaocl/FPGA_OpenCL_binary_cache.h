@@ -0,0 +1,47 @@
+#ifndef __FPGA_OPENCL_BINARY_CACHE_H__
+#define __FPGA_OPENCL_BINARY_CACHE_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+// On-disk cache for kernel binaries. It lives in $FPGA_OCL_CACHE_DIR (default
+// ".fpgaocl_cache") and has two parts:
+//   index.txt    : "<hash> <size> <mtime> <file name>" per line, so an unchanged
+//                  kernel file is identified without reading it again. Each file
+//                  has one line, it is replaced when the file changes.
+//   <key>.bin    : device binaries built from OpenCL source, keyed by the hash
+//                  of the source, the build options and the device name
+// Setting FPGA_OCL_CACHE_DIR to an empty string disables the cache.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 64-bit FNV-1a hash of a memory block, pass the previous hash as seed
+// to hash multiple blocks, or CL_BINARY_HASH_SEED for the first block
+#define CL_BINARY_HASH_SEED 0xcbf29ce484222325ULL
+uint64_t hashCLBinary(const void *data, const size_t size, const uint64_t seed);
+
+// Find the content hash of a kernel file in the cache index, the size and
+// modification time in st must match the recorded ones. Return 1 if found.
+int lookupCLBinaryCacheIndex(const char *file_name, const struct stat *st, uint64_t *hash);
+
+// Record the content hash of a kernel file in the cache index, replacing its old entry
+void updateCLBinaryCacheIndex(const char *file_name, const struct stat *st, const uint64_t hash);
+
+// Hash of the names, sizes and modification times of the headers (*.h) in a directory,
+// changes when a header a kernel source may include is changed. Does not read them.
+uint64_t hashCLIncludeDirStamp(const char *include_dir, const uint64_t seed);
+
+// Map the cached device binary with given key into memory, return 0 if found.
+// Use unmapCLBinaryKernelFile() to release it.
+int mapCLCachedBinary(const uint64_t key, size_t *size, unsigned char **content);
+
+// Save a device binary with given key into the cache
+void saveCLCachedBinary(const uint64_t key, const size_t size, const unsigned char *content);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
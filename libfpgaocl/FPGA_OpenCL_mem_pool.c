@@ -0,0 +1,204 @@
+#include <CL/cl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+
+typedef struct CLPoolEntry
+{
+	cl_mem              buffer;
+	cl_mem_flags        flags;
+	int                 bucket;
+	void               *host_ptr;  // Mapped pointer of a pinned host buffer, NULL for device buffers
+	struct CLPoolEntry *next;
+} CLPoolEntry_t;
+
+static CLPoolEntry_t  *CL_pool_free[CL_MEM_POOL_NUM_BUCKETS];  // Free buffers of each bucket
+static CLPoolEntry_t  *CL_pool_used = NULL;                    // Buffers handed out
+static pthread_mutex_t CL_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Find the smallest bucket that can hold size bytes
+static int getCLPoolBucket(const size_t size)
+{
+	int bucket = 0;
+	while ((bucket < CL_MEM_POOL_NUM_BUCKETS - 1) && (((size_t) 1 << (bucket + CL_MEM_POOL_MIN_BUCKET_BITS)) < size)) bucket++;
+	return bucket;
+}
+
+static size_t getCLPoolBucketSize(const int bucket)
+{
+	return (size_t) 1 << (bucket + CL_MEM_POOL_MIN_BUCKET_BITS);
+}
+
+// Take a free entry with the same flags and pinned-ness from a bucket, or create a new one
+static CLPoolEntry_t *getCLPoolEntry(const size_t size, const cl_mem_flags flags, const int pinned)
+{
+	int bucket = getCLPoolBucket(size);
+
+	pthread_mutex_lock(&CL_pool_lock);
+	CLPoolEntry_t *prev = NULL, *entry = CL_pool_free[bucket];
+	while (entry != NULL)
+	{
+		if ((entry->flags == flags) && ((entry->host_ptr != NULL) == pinned)) break;
+		prev  = entry;
+		entry = entry->next;
+	}
+	if (entry != NULL)
+	{
+		if (prev == NULL) CL_pool_free[bucket] = entry->next;
+		else prev->next = entry->next;
+	}
+	pthread_mutex_unlock(&CL_pool_lock);
+
+	if (entry == NULL)
+	{
+		CLRuntime_t *rt = getCLRuntime();
+		if (rt == NULL) return NULL;
+
+		cl_int err;
+		cl_mem buffer = clCreateBuffer(rt->context, flags, getCLPoolBucketSize(bucket), NULL, &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clCreateBuffer() failed for %zu bytes, returned status = %d\n", getCLPoolBucketSize(bucket), err);
+			return NULL;
+		}
+
+		void *host_ptr = NULL;
+		if (pinned)
+		{
+			host_ptr = clEnqueueMapBuffer(
+				getCLRuntimeQueue(0), buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+				0, getCLPoolBucketSize(bucket), 0, NULL, NULL, &err
+			);
+			if (err != CL_SUCCESS)
+			{
+				printf("[ERROR] clEnqueueMapBuffer() failed, returned status = %d\n", err);
+				clReleaseMemObject(buffer);
+				return NULL;
+			}
+		}
+
+		entry = (CLPoolEntry_t *) malloc(sizeof(CLPoolEntry_t));
+		assert(entry != NULL);
+		entry->buffer   = buffer;
+		entry->flags    = flags;
+		entry->bucket   = bucket;
+		entry->host_ptr = host_ptr;
+	}
+
+	pthread_mutex_lock(&CL_pool_lock);
+	entry->next  = CL_pool_used;
+	CL_pool_used = entry;
+	pthread_mutex_unlock(&CL_pool_lock);
+	return entry;
+}
+
+static void releaseCLPoolEntry(CLPoolEntry_t *entry)
+{
+	if (entry->host_ptr != NULL)
+	{
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		cl_event unmap_event;
+		clEnqueueUnmapMemObject(queue, entry->buffer, entry->host_ptr, 0, NULL, &unmap_event);
+		clWaitForEvents(1, &unmap_event);
+		clReleaseEvent(unmap_event);
+	}
+	clReleaseMemObject(entry->buffer);
+	free(entry);
+}
+
+// Move an entry from the used list back to its bucket. The entry is found by
+// buffer object or by mapped host pointer.
+static void putCLPoolEntry(cl_mem buffer, void *host_ptr)
+{
+	pthread_mutex_lock(&CL_pool_lock);
+	CLPoolEntry_t *prev = NULL, *entry = CL_pool_used;
+	while (entry != NULL)
+	{
+		if ((buffer != NULL) && (entry->buffer == buffer)) break;
+		if ((host_ptr != NULL) && (entry->host_ptr == host_ptr)) break;
+		prev  = entry;
+		entry = entry->next;
+	}
+	if (entry == NULL)
+	{
+		pthread_mutex_unlock(&CL_pool_lock);
+		printf("[WARNING] Freeing a buffer that does not belong to the memory pool.\n");
+		return;
+	}
+	if (prev == NULL) CL_pool_used = entry->next;
+	else prev->next = entry->next;
+
+	int nfree = 0;
+	for (CLPoolEntry_t *p = CL_pool_free[entry->bucket]; p != NULL; p = p->next) nfree++;
+	if (nfree < CL_MEM_POOL_MAX_FREE)
+	{
+		entry->next = CL_pool_free[entry->bucket];
+		CL_pool_free[entry->bucket] = entry;
+		entry = NULL;
+	}
+	pthread_mutex_unlock(&CL_pool_lock);
+
+	// Bucket is full, really release it
+	if (entry != NULL) releaseCLPoolEntry(entry);
+}
+
+cl_mem allocCLPoolBuffer(const size_t size, const cl_mem_flags flags)
+{
+	CLPoolEntry_t *entry = getCLPoolEntry(size, flags, 0);
+	return (entry == NULL) ? NULL : entry->buffer;
+}
+
+void freeCLPoolBuffer(cl_mem buffer)
+{
+	if (buffer != NULL) putCLPoolEntry(buffer, NULL);
+}
+
+void *allocCLPinnedHost(const size_t size, cl_mem *host_buffer)
+{
+	CLPoolEntry_t *entry = getCLPoolEntry(size, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, 1);
+	if (entry == NULL) return NULL;
+	if (host_buffer != NULL) *host_buffer = entry->buffer;
+	return entry->host_ptr;
+}
+
+void freeCLPinnedHost(void *host_ptr)
+{
+	if (host_ptr != NULL) putCLPoolEntry(NULL, host_ptr);
+}
+
+void releaseCLMemPool()
+{
+	// Buffers still handed out belong to the runtime context, which is released next
+	pthread_mutex_lock(&CL_pool_lock);
+	CLPoolEntry_t *used = CL_pool_used;
+	CL_pool_used = NULL;
+	pthread_mutex_unlock(&CL_pool_lock);
+	int nused = 0;
+	while (used != NULL)
+	{
+		CLPoolEntry_t *next = used->next;
+		releaseCLPoolEntry(used);
+		used = next;
+		nused++;
+	}
+	if (nused > 0) printf("[WARNING] %d pool buffers were not freed before the memory pool is released.\n", nused);
+
+	for (int bucket = 0; bucket < CL_MEM_POOL_NUM_BUCKETS; bucket++)
+	{
+		pthread_mutex_lock(&CL_pool_lock);
+		CLPoolEntry_t *entry = CL_pool_free[bucket];
+		CL_pool_free[bucket] = NULL;
+		pthread_mutex_unlock(&CL_pool_lock);
+
+		while (entry != NULL)
+		{
+			CLPoolEntry_t *next = entry->next;
+			releaseCLPoolEntry(entry);
+			entry = next;
+		}
+	}
+}
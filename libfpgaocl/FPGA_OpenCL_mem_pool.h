@@ -0,0 +1,41 @@
+#ifndef __FPGA_OPENCL_MEM_POOL_H__
+#define __FPGA_OPENCL_MEM_POOL_H__
+
+#include <CL/cl.h>
+
+// Buffers are rounded up to power-of-2 size buckets, the smallest bucket is 4 KB.
+// A freed buffer is kept in the pool and handed out again for the same bucket and
+// flags. At most CL_MEM_POOL_MAX_FREE free buffers are kept for each bucket.
+#define CL_MEM_POOL_MIN_BUCKET_BITS 12
+#define CL_MEM_POOL_NUM_BUCKETS     40
+#define CL_MEM_POOL_MAX_FREE        8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Get a device buffer with at least size bytes in the runtime context
+cl_mem allocCLPoolBuffer(const size_t size, const cl_mem_flags flags);
+
+// Return a buffer from allocCLPoolBuffer() to the pool
+void freeCLPoolBuffer(cl_mem buffer);
+
+// Get a pinned host staging buffer with at least size bytes. It is allocated with
+// CL_MEM_ALLOC_HOST_PTR and stays mapped until it is released from the pool, so
+// transfers from / to it do not need another copy through pageable memory.
+// The buffer object is returned in host_buffer if it is not NULL.
+void *allocCLPinnedHost(const size_t size, cl_mem *host_buffer);
+
+// Return a pointer from allocCLPinnedHost() to the pool
+void freeCLPinnedHost(void *host_ptr);
+
+// Release all buffers of the pool, called by releaseCLRuntime(). Every buffer should be
+// freed before this: buffers still in use are released with a warning, and freeing them
+// later only prints a warning, they are not returned to the new pool.
+void releaseCLMemPool();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,524 @@
+#include <CL/cl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_binary_cache.h"
+#include "FPGA_OpenCL_mem_pool.h"
+
+static CLRuntime_t     CL_runtime;
+static int             CL_runtime_ready = 0;
+static pthread_mutex_t CL_runtime_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+// Find the platform and devices to use, prefer FPGA devices
+static int selectCLRuntimeDevices(CLRuntime_t *rt)
+{
+	cl_uint numPlatforms;
+	cl_int  status = clGetPlatformIDs(0, NULL, &numPlatforms);
+	if ((status != CL_SUCCESS) || (numPlatforms == 0))
+	{
+		printf("[ERROR] clGetPlatformIDs() returns 0 available platform, status = %d.\n", status);
+		return -1;
+	}
+	cl_platform_id *platforms = (cl_platform_id *) malloc(numPlatforms * sizeof(cl_platform_id));
+	assert(platforms != NULL);
+	clGetPlatformIDs(numPlatforms, platforms, NULL);
+
+	// Pass 0: accelerator devices only; pass 1: any device
+	const cl_device_type try_types[2] = {CL_DEVICE_TYPE_ACCELERATOR, CL_DEVICE_TYPE_ALL};
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (cl_uint i = 0; i < numPlatforms; i++)
+		{
+			cl_uint numDevices = 0;
+			status = clGetDeviceIDs(platforms[i], try_types[pass], 0, NULL, &numDevices);
+			if ((status != CL_SUCCESS) || (numDevices == 0)) continue;
+
+			rt->platform   = platforms[i];
+			rt->numDevices = numDevices;
+			rt->devices    = (cl_device_id *) malloc(numDevices * sizeof(cl_device_id));
+			assert(rt->devices != NULL);
+			clGetDeviceIDs(platforms[i], try_types[pass], numDevices, rt->devices, NULL);
+			clGetDeviceInfo(rt->devices[0], CL_DEVICE_TYPE, sizeof(cl_device_type), &rt->device_type, NULL);
+			if (pass == 1)
+			{
+				char dev_name[256];
+				clGetDeviceInfo(rt->devices[0], CL_DEVICE_NAME, sizeof(dev_name), dev_name, NULL);
+				printf("[WARNING] No FPGA device found, fall back to device \"%s\".\n", dev_name);
+			}
+			free(platforms);
+			return 0;
+		}
+	}
+
+	printf("[ERROR] clGetDeviceIDs() returns 0 available device on all platforms.\n");
+	free(platforms);
+	return -1;
+}
+
+static CLRuntime_t *getCLRuntimeLocked()
+{
+	if (CL_runtime_ready) return &CL_runtime;
+
+	CLRuntime_t *rt = &CL_runtime;
+	memset(rt, 0, sizeof(CLRuntime_t));
+	if (selectCLRuntimeDevices(rt) != 0) return NULL;
+
+	// Only the first device is used, same as initCLFPGASimpleEnvironment()
+	cl_int errcode;
+	rt->context = clCreateContext(NULL, 1, rt->devices, NULL, NULL, &errcode);
+	if (errcode != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateContext() failed, returned status = %d\n", errcode);
+		free(rt->devices);
+		return NULL;
+	}
+
+	CL_runtime_ready = 1;
+	return rt;
+}
+
+CLRuntime_t *getCLRuntime()
+{
+	pthread_mutex_lock(&CL_runtime_lock);
+	CLRuntime_t *rt = getCLRuntimeLocked();
+	pthread_mutex_unlock(&CL_runtime_lock);
+	return rt;
+}
+
+cl_command_queue getCLRuntimeQueue(const int queue_id)
+{
+	if ((queue_id < 0) || (queue_id >= CL_RUNTIME_MAX_QUEUES))
+	{
+		printf("[ERROR] Invalid queue id %d (max %d).\n", queue_id, CL_RUNTIME_MAX_QUEUES - 1);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&CL_runtime_lock);
+	cl_command_queue queue = NULL;
+	CLRuntime_t *rt = getCLRuntimeLocked();
+	if (rt != NULL)
+	{
+		if (rt->queues[queue_id] == NULL)
+		{
+			cl_int errcode;
+			rt->queues[queue_id] = clCreateCommandQueue(
+				rt->context, rt->devices[0], CL_QUEUE_PROFILING_ENABLE, &errcode
+			);
+			if (errcode != CL_SUCCESS)
+			{
+				printf("[ERROR] clCreateCommandQueue() failed, returned status = %d\n", errcode);
+				rt->queues[queue_id] = NULL;
+			}
+		}
+		queue = rt->queues[queue_id];
+	}
+	pthread_mutex_unlock(&CL_runtime_lock);
+	return queue;
+}
+
+// Check if a string ends with the given suffix
+static int strEndsWith(const char *str, const char *suffix)
+{
+	size_t str_len    = strlen(str);
+	size_t suffix_len = strlen(suffix);
+	if (str_len < suffix_len) return 0;
+	return (strcmp(str + str_len - suffix_len, suffix) == 0);
+}
+
+// Print the build log of the first device
+static void printCLBuildLog(CLRuntime_t *rt, cl_program program)
+{
+	size_t log_size = 0;
+	clGetProgramBuildInfo(program, rt->devices[0], CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+	char *build_log = (char *) malloc(log_size + 1);
+	clGetProgramBuildInfo(program, rt->devices[0], CL_PROGRAM_BUILD_LOG, log_size, build_log, NULL);
+	build_log[log_size] = 0;
+	printf("%s\n", build_log);
+	free(build_log);
+}
+
+// Create a program from a device binary and build it for the first device
+static cl_program buildCLProgramFromBinary(
+	CLRuntime_t *rt, const char *file_name, 
+	const size_t binary_size, const unsigned char *binary_content
+)
+{
+	cl_int binary_status, errcode;
+	cl_program program = clCreateProgramWithBinary(
+		rt->context, 1, rt->devices, &binary_size,
+		&binary_content, &binary_status, &errcode
+	);
+	if ((binary_status != CL_SUCCESS) || (errcode != CL_SUCCESS))
+	{
+		printf("[ERROR] clCreateProgramWithBinary() failed for %s.\n", file_name);
+		if (program != NULL) clReleaseProgram(program);
+		return NULL;
+	}
+
+	errcode = clBuildProgram(program, 1, rt->devices, NULL, NULL, NULL);
+	if (errcode != CL_SUCCESS)
+	{
+		printf("[ERROR] clBuildProgram() failed, returned status = %d\n", errcode);
+		clReleaseProgram(program);
+		return NULL;
+	}
+	return program;
+}
+
+// Hash the files included with #include "xxx" from an OpenCL source, 
+// so a cached binary is not used after a kernel header is changed
+static uint64_t hashCLSourceIncludes(
+	const char *include_dir, const char *src, const size_t src_size, 
+	uint64_t hash, const int depth
+)
+{
+	if (depth > 8) return hash;
+	const char *end = src + src_size;
+	const char *pos = src;
+	while (pos < end)
+	{
+		const char *line_end = memchr(pos, '\n', end - pos);
+		if (line_end == NULL) line_end = end;
+		char line[1024];
+		size_t line_len = line_end - pos;
+		if (line_len >= sizeof(line)) line_len = sizeof(line) - 1;
+		memcpy(line, pos, line_len);
+		line[line_len] = 0;
+		pos = line_end + 1;
+
+		char inc_name[512], inc_file_name[1024];
+		if (sscanf(line, " # include \"%511[^\"]\"", inc_name) != 1) continue;
+		snprintf(inc_file_name, sizeof(inc_file_name), "%s/%s", include_dir, inc_name);
+		size_t inc_size;
+		unsigned char *inc_content;
+		if (mapCLBinaryKernelFile(inc_file_name, &inc_size, &inc_content) != 0) continue;
+		hash = hashCLBinary(inc_content, inc_size, hash);
+		hash = hashCLSourceIncludes(include_dir, (const char *) inc_content, inc_size, hash, depth + 1);
+		unmapCLBinaryKernelFile(inc_size, inc_content);
+	}
+	return hash;
+}
+
+// Headers of an OpenCL source are searched in the directory of the source
+static void getCLSourceIncludeDir(const char *src_file_name, char *include_dir, const size_t len)
+{
+	const char *slash = strrchr(src_file_name, '/');
+	if (slash != NULL) snprintf(include_dir, len, "%.*s", (int) (slash - src_file_name), src_file_name);
+	else snprintf(include_dir, len, ".");
+}
+
+// Stamp of the headers an OpenCL source may include, 0 for binaries
+static uint64_t getCLIncludeStamp(const char *file_name)
+{
+	if (!strEndsWith(file_name, ".cl")) return 0;
+	char include_dir[1024];
+	getCLSourceIncludeDir(file_name, include_dir, sizeof(include_dir));
+	return hashCLIncludeDirStamp(include_dir, CL_BINARY_HASH_SEED);
+}
+
+// Build a program from OpenCL source, headers are searched in the directory of the source.
+// The device binary is saved in the on-disk cache and reused by the next process.
+static cl_program buildCLProgramFromSource(
+	CLRuntime_t *rt, const char *src_file_name, const char *extra_options,
+	const size_t src_size, const unsigned char *src_content
+)
+{
+	char include_dir[1024], build_options[2048];
+	getCLSourceIncludeDir(src_file_name, include_dir, sizeof(include_dir));
+	if (extra_options != NULL) snprintf(build_options, sizeof(build_options), "-I %s %s", include_dir, extra_options);
+	else snprintf(build_options, sizeof(build_options), "-I %s", include_dir);
+
+	// Cache key: source, included headers, build options and target device
+	char dev_name[256], dev_version[256];
+	clGetDeviceInfo(rt->devices[0], CL_DEVICE_NAME,    sizeof(dev_name),    dev_name,    NULL);
+	clGetDeviceInfo(rt->devices[0], CL_DEVICE_VERSION, sizeof(dev_version), dev_version, NULL);
+	uint64_t key = hashCLBinary(src_content, src_size, CL_BINARY_HASH_SEED);
+	key = hashCLSourceIncludes(include_dir, (const char *) src_content, src_size, key, 0);
+	key = hashCLBinary(build_options, strlen(build_options), key);
+	key = hashCLBinary(dev_name,      strlen(dev_name),      key);
+	key = hashCLBinary(dev_version,   strlen(dev_version),   key);
+
+	size_t cached_size;
+	unsigned char *cached_content;
+	if (mapCLCachedBinary(key, &cached_size, &cached_content) == 0)
+	{
+		cl_program program = buildCLProgramFromBinary(rt, src_file_name, cached_size, cached_content);
+		unmapCLBinaryKernelFile(cached_size, cached_content);
+		if (program != NULL) return program;
+		printf("[WARNING] Cached binary for %s is not usable, rebuild from source.\n", src_file_name);
+	}
+
+	cl_int errcode;
+	const char *src_str = (const char *) src_content;
+	cl_program program = clCreateProgramWithSource(rt->context, 1, &src_str, &src_size, &errcode);
+	if (errcode != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateProgramWithSource() failed, returned status = %d\n", errcode);
+		return NULL;
+	}
+
+	errcode = clBuildProgram(program, 1, rt->devices, build_options, NULL, NULL);
+	if (errcode != CL_SUCCESS)
+	{
+		printf("[ERROR] clBuildProgram() failed for %s, returned status = %d\n", src_file_name, errcode);
+		printCLBuildLog(rt, program);
+		clReleaseProgram(program);
+		return NULL;
+	}
+
+	// Program is built for 1 device only, so there is only 1 binary
+	size_t binary_size = 0;
+	clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL);
+	if (binary_size > 0)
+	{
+		unsigned char *binary_content = (unsigned char *) malloc(binary_size);
+		assert(binary_content != NULL);
+		errcode = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binary_content, NULL);
+		if (errcode == CL_SUCCESS) saveCLCachedBinary(key, binary_size, binary_content);
+		free(binary_content);
+	}
+	return program;
+}
+
+// Load a kernel file and build it. Source file content is mapped by the caller.
+static cl_program loadCLRuntimeProgram(
+	CLRuntime_t *rt, const char *file_name, const char *build_options,
+	const size_t file_size, const unsigned char *file_content
+)
+{
+	if (strEndsWith(file_name, ".cl"))
+		return buildCLProgramFromSource(rt, file_name, build_options, file_size, file_content);
+	else
+		return buildCLProgramFromBinary(rt, file_name, file_size, file_content);
+}
+
+// Compare build options, NULL and "" are the same
+static int sameCLBuildOptions(const char *opt1, const char *opt2)
+{
+	if (opt1 == NULL) opt1 = "";
+	if (opt2 == NULL) opt2 = "";
+	return (strcmp(opt1, opt2) == 0);
+}
+
+cl_program getCLRuntimeProgram(const char *file_name)
+{
+	return getCLRuntimeProgramWithOptions(file_name, NULL);
+}
+
+// Index of the entry of a file and build options, -1 if there is none. Caller holds the lock.
+static int findCLRuntimeProgramLocked(CLRuntime_t *rt, const char *file_name, const char *build_options)
+{
+	for (int i = 0; i < rt->numPrograms; i++)
+	{
+		if (strcmp(rt->programs[i].file_name, file_name) != 0) continue;
+		if (!sameCLBuildOptions(rt->programs[i].build_options, build_options)) continue;
+		return i;
+	}
+	return -1;
+}
+
+// Keep a replaced program until releaseCLRuntime(), callers may still use it. Caller holds the lock.
+static void retireCLRuntimeProgramLocked(CLRuntime_t *rt, cl_program program)
+{
+	rt->retired_programs = (cl_program *) realloc(rt->retired_programs, sizeof(cl_program) * (rt->numRetired + 1));
+	assert(rt->retired_programs != NULL);
+	rt->retired_programs[rt->numRetired++] = program;
+}
+
+// Add the entry of a file, or replace it if the file was changed. The caller holds the lock 
+// and passes a reference of program. Other threads may have added the same file or content 
+// while the program was being built, then their program is used and ours is released.
+// Returns the program of the entry, or NULL if the table is full.
+static cl_program setCLRuntimeProgramLocked(
+	CLRuntime_t *rt, const char *file_name, const char *build_options,
+	const struct stat *st, const uint64_t include_stamp, const uint64_t hash, cl_program program
+)
+{
+	for (int i = 0; i < rt->numPrograms; i++)
+	{
+		if ((rt->programs[i].hash != hash) || (rt->programs[i].program == program)) continue;
+		clRetainProgram(rt->programs[i].program);
+		clReleaseProgram(program);
+		program = rt->programs[i].program;
+		break;
+	}
+
+	int prog_idx = findCLRuntimeProgramLocked(rt, file_name, build_options);
+	if ((prog_idx != -1) && (rt->programs[prog_idx].program == program))
+	{
+		// Added by another thread, the entry already holds a reference
+		clReleaseProgram(program);
+	} else {
+		if ((prog_idx == -1) && (rt->numPrograms == CL_RUNTIME_MAX_PROGRAMS))
+		{
+			printf("[ERROR] Too many programs in the runtime (max %d).\n", CL_RUNTIME_MAX_PROGRAMS);
+			clReleaseProgram(program);
+			return NULL;
+		}
+		if (prog_idx == -1)
+		{
+			prog_idx = rt->numPrograms;
+			rt->programs[prog_idx].file_name     = strdup(file_name);
+			rt->programs[prog_idx].build_options = (build_options == NULL) ? NULL : strdup(build_options);
+			rt->numPrograms++;
+		} else {
+			retireCLRuntimeProgramLocked(rt, rt->programs[prog_idx].program);
+		}
+		rt->programs[prog_idx].program = program;
+	}
+	rt->programs[prog_idx].file_size     = (long long) st->st_size;
+	rt->programs[prog_idx].file_mtime    = st->st_mtime;
+	rt->programs[prog_idx].include_stamp = include_stamp;
+	rt->programs[prog_idx].hash          = hash;
+	return program;
+}
+
+cl_program getCLRuntimeProgramWithOptions(const char *file_name, const char *build_options)
+{
+	if ((build_options != NULL) && (build_options[0] == 0)) build_options = NULL;
+
+	// The lock is only held to look up and update the program table. Files are read 
+	// and programs are built without it, so a build does not block the other threads.
+	CLRuntime_t *rt = getCLRuntime();
+	if (rt == NULL) return NULL;
+
+	// No FPGA, build "device/xxx.cl" for "xxx.aocx" instead
+	char src_file_name[1024];
+	const char *load_file_name = file_name;
+	if (!(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR) && strEndsWith(file_name, ".aocx"))
+	{
+		const char *base_name = strrchr(file_name, '/');
+		base_name = (base_name == NULL) ? file_name : base_name + 1;
+		snprintf(
+			src_file_name, sizeof(src_file_name), "device/%.*s.cl",
+			(int) (strlen(base_name) - strlen(".aocx")), base_name
+		);
+		load_file_name = src_file_name;
+	}
+
+	struct stat st;
+	if (stat(load_file_name, &st) != 0)
+	{
+		printf("[Error] Cannot opening kernel file %s\n", load_file_name);
+		return NULL;
+	}
+
+	// 1. Same file and options, and neither the file nor the headers next to a source
+	//    changed since it was loaded: only stat() calls, the files are not read
+	cl_program program = NULL;
+	uint64_t include_stamp = getCLIncludeStamp(load_file_name);
+	pthread_mutex_lock(&CL_runtime_lock);
+	int prog_idx = findCLRuntimeProgramLocked(rt, load_file_name, build_options);
+	if ((prog_idx != -1) && (rt->programs[prog_idx].file_size == (long long) st.st_size) && 
+	    (rt->programs[prog_idx].file_mtime == st.st_mtime) && (rt->programs[prog_idx].include_stamp == include_stamp))
+		program = rt->programs[prog_idx].program;
+	pthread_mutex_unlock(&CL_runtime_lock);
+	if (program != NULL) return program;
+
+	// 2. Get the content hash from the on-disk index, or map the file and hash it
+	uint64_t hash;
+	size_t file_size = 0;
+	unsigned char *file_content = NULL;
+	if (!lookupCLBinaryCacheIndex(load_file_name, &st, &hash))
+	{
+		if (mapCLBinaryKernelFile(load_file_name, &file_size, &file_content) != 0) return NULL;
+		hash = hashCLBinary(file_content, file_size, CL_BINARY_HASH_SEED);
+		updateCLBinaryCacheIndex(load_file_name, &st, hash);
+	}
+	// The same source built with different options or headers is a different program
+	if (build_options != NULL) hash = hashCLBinary(build_options, strlen(build_options), hash);
+	if (include_stamp != 0) hash = hashCLBinary(&include_stamp, sizeof(include_stamp), hash);
+
+	// 3. Same content already built under another name (or before the file was touched)
+	int shared = 0;
+	pthread_mutex_lock(&CL_runtime_lock);
+	for (int i = 0; i < rt->numPrograms; i++)
+	{
+		if (rt->programs[i].hash != hash) continue;
+		clRetainProgram(rt->programs[i].program);
+		program = setCLRuntimeProgramLocked(rt, load_file_name, build_options, &st, include_stamp, hash, rt->programs[i].program);
+		shared = 1;
+		break;
+	}
+	pthread_mutex_unlock(&CL_runtime_lock);
+	if (shared)
+	{
+		unmapCLBinaryKernelFile(file_size, file_content);
+		return program;
+	}
+
+	// 4. Build it
+	if (file_content == NULL)
+	{
+		if (mapCLBinaryKernelFile(load_file_name, &file_size, &file_content) != 0) return NULL;
+	}
+	if (load_file_name != file_name)
+		printf("[WARNING] Not running on FPGA, build %s instead of %s.\n", load_file_name, file_name);
+	program = loadCLRuntimeProgram(rt, load_file_name, build_options, file_size, file_content);
+	unmapCLBinaryKernelFile(file_size, file_content);
+	if (program == NULL) return NULL;
+
+	pthread_mutex_lock(&CL_runtime_lock);
+	program = setCLRuntimeProgramLocked(rt, load_file_name, build_options, &st, include_stamp, hash, program);
+	pthread_mutex_unlock(&CL_runtime_lock);
+	return program;
+}
+
+void releaseCLRuntimeProgram(cl_program program)
+{
+	if (program == NULL) return;
+	pthread_mutex_lock(&CL_runtime_lock);
+	if (CL_runtime_ready)
+	{
+		// Files with the same content share the program, each entry holds a reference
+		CLRuntime_t *rt = &CL_runtime;
+		for (int i = rt->numPrograms - 1; i >= 0; i--)
+		{
+			if (rt->programs[i].program != program) continue;
+			clReleaseProgram(rt->programs[i].program);
+			free(rt->programs[i].file_name);
+			free(rt->programs[i].build_options);
+			rt->numPrograms--;
+			rt->programs[i] = rt->programs[rt->numPrograms];
+		}
+		for (int i = rt->numRetired - 1; i >= 0; i--)
+		{
+			if (rt->retired_programs[i] != program) continue;
+			clReleaseProgram(program);
+			rt->retired_programs[i] = rt->retired_programs[--rt->numRetired];
+		}
+	}
+	pthread_mutex_unlock(&CL_runtime_lock);
+}
+
+void releaseCLRuntime()
+{
+	// Pooled buffers belong to the runtime context and are unmapped with queue 0
+	releaseCLMemPool();
+
+	pthread_mutex_lock(&CL_runtime_lock);
+	if (CL_runtime_ready)
+	{
+		CLRuntime_t *rt = &CL_runtime;
+		for (int i = 0; i < rt->numPrograms; i++)
+		{
+			clReleaseProgram(rt->programs[i].program);
+			free(rt->programs[i].file_name);
+			free(rt->programs[i].build_options);
+		}
+		for (int i = 0; i < rt->numRetired; i++) clReleaseProgram(rt->retired_programs[i]);
+		free(rt->retired_programs);
+		for (int i = 0; i < CL_RUNTIME_MAX_QUEUES; i++)
+			if (rt->queues[i] != NULL) clReleaseCommandQueue(rt->queues[i]);
+		clReleaseContext(rt->context);
+		free(rt->devices);
+		CL_runtime_ready = 0;
+	}
+	pthread_mutex_unlock(&CL_runtime_lock);
+}
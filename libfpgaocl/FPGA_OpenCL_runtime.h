@@ -0,0 +1,80 @@
+#ifndef __FPGA_OPENCL_RUNTIME_H__
+#define __FPGA_OPENCL_RUNTIME_H__
+
+#include <CL/cl.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CL_RUNTIME_MAX_QUEUES   16
+#define CL_RUNTIME_MAX_PROGRAMS 32
+
+typedef struct
+{
+	char       *file_name;
+	char       *build_options;  // Extra options of a program built from source, NULL if none
+	long long   file_size;   // Size and modification time of the kernel file when it was loaded,
+	time_t      file_mtime;  // the program is reloaded if the file is changed
+	uint64_t    include_stamp;  // Stamp of the headers next to an OpenCL source, 0 for binaries
+	uint64_t    hash;        // Content hash of the kernel file, header stamp and build options, programs with the same hash are shared
+	cl_program  program;
+} CLRuntimeProgram_t;
+
+// Process-wide OpenCL objects, created once on first use and shared by all callers
+typedef struct
+{
+	cl_platform_id     platform;
+	cl_device_id      *devices;
+	cl_uint            numDevices;
+	cl_device_type     device_type;   // CL_DEVICE_TYPE_ACCELERATOR unless we fell back to another device
+	cl_context         context;
+	cl_command_queue   queues[CL_RUNTIME_MAX_QUEUES];
+	int                numPrograms;
+	CLRuntimeProgram_t programs[CL_RUNTIME_MAX_PROGRAMS];
+	int                numRetired;
+	cl_program        *retired_programs;  // Programs of changed files, kept until releaseCLRuntime()
+} CLRuntime_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Get the process-wide runtime, initialize it on the first call.
+// FPGA (accelerator) devices are preferred; if there is none on any platform,
+// the first platform with any OpenCL device (e.g. PoCL on CPU) is used.
+// Returns NULL if no OpenCL device is available.
+CLRuntime_t *getCLRuntime();
+
+// Get the in-order command queue with given id (0 <= queue_id < CL_RUNTIME_MAX_QUEUES)
+// on the first device, create it on the first call. Profiling is enabled.
+cl_command_queue getCLRuntimeQueue(const int queue_id);
+
+// Get the built program for a kernel file, load and build it on the first call.
+// On an accelerator the file is an .aocx binary. On other devices "xxx.aocx" is
+// replaced by "device/xxx.cl", which is built from source.
+// Kernel files are mapped instead of read, and programs are shared by all files
+// with the same content. Programs built from source are also saved in the
+// on-disk cache (see FPGA_OpenCL_binary_cache.h) for the next process.
+// The runtime owns the program: it stays valid until releaseCLRuntimeProgram() or
+// releaseCLRuntime(), also after its file is changed and a new program is loaded.
+// Files are read and built without holding the runtime lock.
+cl_program getCLRuntimeProgram(const char *file_name);
+
+// Same as getCLRuntimeProgram(), build_options (e.g. "-DTILE_SIZE=32") are added when
+// the program is built from source. They are ignored for binaries: an .aocx has the 
+// options of the aoc run that produced it. Each file and options pair is a separate program.
+cl_program getCLRuntimeProgramWithOptions(const char *file_name, const char *build_options);
+
+// Drop a program from getCLRuntimeProgram*() and free its slot in the runtime, so that
+// processes building many variants stay under CL_RUNTIME_MAX_PROGRAMS. The program must
+// not be used after this; kernels already created from it keep it alive until they are
+// released. The next get call for the same file loads it again.
+void releaseCLRuntimeProgram(cl_program program);
+
+// Release all objects held by the runtime and the memory pool, the next getCLRuntime() call re-initializes it
+void releaseCLRuntime();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
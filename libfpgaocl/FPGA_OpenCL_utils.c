@@ -3,8 +3,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_runtime.h"
 
 // Get platform from platform lists
 int getCLPlatform(cl_platform_id *platform, const int platform_id)
@@ -58,16 +63,16 @@ int getCLFPGADevicesID(const cl_platform_id platform, cl_device_id **device, cl_
 	}
 }
 
-// Read kernel binary file into a string
+// Read kernel binary file into a string, the caller should free() the string
 int readCLBinaryKernelFile(const char *file_name, size_t *file_size, unsigned char **file_content) 
 {
 	// Open the file
-	FILE *inf = fopen(file_name, "r");
+	FILE *inf = fopen(file_name, "rb");
 	if (inf == NULL) 
 	{
 		printf("[Error] Cannot opening kernel binary file %s\n", file_name);
-		file_content = NULL;
-		file_size = 0;
+		*file_content = NULL;
+		*file_size = 0;
 		return -1;
 	}
 	
@@ -87,66 +92,81 @@ int readCLBinaryKernelFile(const char *file_name, size_t *file_size, unsigned ch
 	return 0;
 }
 
-// Initialize with 1 device, 1 queue and 1 program, for simple tasks
-int initCLFPGASimpleEnvironment(
-	cl_device_id **FPGA_devices, cl_uint *numDevices, 
-	cl_context *context, cl_command_queue *queue, 
-	cl_program *program, const char *FPGA_bin_file_name
-)
+// Map kernel binary file into memory (read-only) instead of copying it
+int mapCLBinaryKernelFile(const char *file_name, size_t *file_size, unsigned char **file_content)
 {
-	int ret;
-	
-	// OpenCL extra step 1: get all platforms and choose the first available one
-	cl_platform_id _platform;
-	ret = getCLPlatform(&_platform, 0);
-	if (ret != 0) return ret;
-	
-	// OpenCL extra step 2: query the platform and get device
-	cl_device_id *_FPGA_devices;
-	cl_uint _numDevices; 
-	getCLFPGADevicesID(_platform, &_FPGA_devices, &_numDevices);
-	if (ret != 0) return ret;
-	
-	// OpenCL extra step 3: create context (on first device)
-	cl_context _context;
-	_context = clCreateContext(NULL, 1, _FPGA_devices, NULL, NULL, NULL);
+	*file_content = NULL;
+	*file_size = 0;
 	
-	// OpenCL extra step 4: create command queue associate with the context
-	// _FPGA_devices[0] means we use the first FPGA device
-	cl_command_queue _queue;
-	_queue = clCreateCommandQueue(_context, _FPGA_devices[0], 0, NULL);
-	
-	// OpenCL extra step 5: create program object
-	cl_int binary_status, errcode;
-	cl_program _program;
-	size_t binary_size;
-	unsigned char *binary_content;
-	
-	ret = readCLBinaryKernelFile(FPGA_bin_file_name, &binary_size, &binary_content);
-	if (ret != 0) return ret;
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("[Error] Cannot opening kernel binary file %s\n", file_name);
+		return -1;
+	}
 	
-	_program = clCreateProgramWithBinary(_context, 1, _FPGA_devices, &binary_size, 
-										(const unsigned char **) &binary_content, &binary_status, &errcode);
-	if ((binary_status != CL_SUCCESS) || (errcode != CL_SUCCESS))
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0))
 	{
-		printf("[ERROR] clCreateProgramWithBinary() failed.\n");
+		printf("[Error] Cannot get the size of kernel binary file %s\n", file_name);
+		close(fd);
 		return -1;
 	}
 	
-	// OpenCL extra step 6: build program
-	// The 2nd and 3rd parameters mean that we use the first FPGA 
-	errcode = clBuildProgram(_program, 1, _FPGA_devices, NULL, NULL, NULL);
-	if (errcode != CL_SUCCESS)
+	// The mapping stays valid after closing the file
+	void *_content = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (_content == MAP_FAILED)
 	{
-		printf("[ERROR] clBuildProgram() failed, returned status = %d\n", errcode);
+		printf("[Error] mmap() failed for kernel binary file %s\n", file_name);
 		return -1;
 	}
 	
+	*file_size = (size_t) st.st_size;
+	*file_content = (unsigned char*) _content;
+	return 0;
+}
+
+// Unmap a file mapped by mapCLBinaryKernelFile()
+void unmapCLBinaryKernelFile(size_t file_size, unsigned char *file_content)
+{
+	if (file_content != NULL) munmap(file_content, file_size);
+}
+
+// Initialize with 1 device, 1 queue and 1 program, for simple tasks
+int initCLFPGASimpleEnvironment(
+	cl_device_id **FPGA_devices, cl_uint *numDevices, 
+	cl_context *context, cl_command_queue *queue, 
+	cl_program *program, const char *FPGA_bin_file_name
+)
+{
+	// OpenCL extra step 1-3: platform, devices and context are created 
+	// only once in a process by the runtime
+	CLRuntime_t *rt = getCLRuntime();
+	if (rt == NULL) return -1;
+	
+	// OpenCL extra step 4: get command queue 0 of the runtime
+	cl_command_queue _queue = getCLRuntimeQueue(0);
+	if (_queue == NULL) return -1;
+	
+	// OpenCL extra step 5-6: get the program, it is loaded and built 
+	// only once for each kernel binary file
+	cl_program _program = getCLRuntimeProgram(FPGA_bin_file_name);
+	if (_program == NULL) return -1;
+	
+	// The caller owns a copy of the device list and a reference of each object
+	cl_device_id *_FPGA_devices = (cl_device_id*) malloc(rt->numDevices * sizeof(cl_device_id));
+	assert(_FPGA_devices != NULL);
+	memcpy(_FPGA_devices, rt->devices, rt->numDevices * sizeof(cl_device_id));
+	clRetainContext(rt->context);
+	clRetainCommandQueue(_queue);
+	clRetainProgram(_program);
+	
 	// Set return values
 	*FPGA_devices = _FPGA_devices;
-	*numDevices   = _numDevices;
-	*context = _context;
+	*numDevices   = rt->numDevices;
+	*context = rt->context;
 	*queue   = _queue;
 	*program = _program;
 	return 0;
-}
\ No newline at end of file
+}
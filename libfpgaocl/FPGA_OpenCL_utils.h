@@ -13,10 +13,18 @@ int getCLPlatform(cl_platform_id *platform, const int platform_id);
 // Query the platform and choose all FPGA devices
 int getCLFPGADevicesID(const cl_platform_id platform, cl_device_id **device, cl_uint *numDevices);
 
-// Read kernel binary file into a string
-int readCLBinearyKernelFile(const char *file_name, size_t *file_size, unsigned char **file_content);
+// Read kernel binary file into a string, the caller should free() the string
+int readCLBinaryKernelFile(const char *file_name, size_t *file_size, unsigned char **file_content);
 
-// Initialize with 1 device, 1 queue and 1 program, for simple tasks
+// Map kernel binary file into memory (read-only) instead of copying it
+int mapCLBinaryKernelFile(const char *file_name, size_t *file_size, unsigned char **file_content);
+
+// Unmap a file mapped by mapCLBinaryKernelFile()
+void unmapCLBinaryKernelFile(size_t file_size, unsigned char *file_content);
+
+// Initialize with 1 device, 1 queue and 1 program, for simple tasks.
+// The objects come from the process-wide runtime (see FPGA_OpenCL_runtime.h)
+// and are retained for the caller, so releasing them afterwards is safe.
 int initCLFPGASimpleEnvironment(
 	cl_device_id **FPGA_devices, cl_uint *numDevices, 
 	cl_context *context, cl_command_queue *queue, 
@@ -0,0 +1,97 @@
+#include <CL/cl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_runtime.h"
+
+// Load and build a kernel file the way initCLFPGASimpleEnvironment() did before
+// the runtime existed: fread() the whole file, then create and build the program
+static double legacyLoadAndBuild(CLRuntime_t *rt, const char *file_name)
+{
+	double st = omp_get_wtime();
+
+	size_t file_size;
+	unsigned char *file_content;
+	if (readCLBinaryKernelFile(file_name, &file_size, &file_content) != 0) return -1.0;
+
+	cl_int errcode, binary_status = CL_SUCCESS;
+	cl_program program;
+	size_t name_len = strlen(file_name);
+	if ((name_len > 3) && (strcmp(file_name + name_len - 3, ".cl") == 0))
+	{
+		char build_options[1024];
+		const char *slash = strrchr(file_name, '/');
+		if (slash != NULL) snprintf(build_options, sizeof(build_options), "-I %.*s", (int) (slash - file_name), file_name);
+		else snprintf(build_options, sizeof(build_options), "-I .");
+		const char *src_str = (const char *) file_content;
+		program = clCreateProgramWithSource(rt->context, 1, &src_str, &file_size, &errcode);
+		errcode = clBuildProgram(program, 1, rt->devices, build_options, NULL, NULL);
+	} else {
+		program = clCreateProgramWithBinary(
+			rt->context, 1, rt->devices, &file_size,
+			(const unsigned char **) &file_content, &binary_status, &errcode
+		);
+		if ((binary_status == CL_SUCCESS) && (errcode == CL_SUCCESS))
+			errcode = clBuildProgram(program, 1, rt->devices, NULL, NULL, NULL);
+	}
+	free(file_content);
+
+	double et = omp_get_wtime();
+	if (program != NULL) clReleaseProgram(program);
+	if ((binary_status != CL_SUCCESS) || (errcode != CL_SUCCESS))
+	{
+		printf("[ERROR] Legacy load and build failed, status = %d\n", errcode);
+		return -1.0;
+	}
+	return et - st;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <kernel file (.aocx or .cl)> <number of repeats>\n", argv[0]);
+		return 255;
+	}
+	const char *file_name = argv[1];
+	int nrepeat = (argc >= 3) ? atoi(argv[2]) : 5;
+	if (nrepeat < 1) nrepeat = 1;
+	printf("Kernel file: %s, %d repeats\n", file_name, nrepeat);
+
+	double st, et;
+
+	st = omp_get_wtime();
+	CLRuntime_t *rt = getCLRuntime();
+	et = omp_get_wtime();
+	if (rt == NULL) return 255;
+	printf("Runtime init (platform, devices, context)  = %lf (s)\n", et - st);
+
+	// Before: every call reads and builds the file again
+	double legacy_ut = 0.0;
+	for (int i = 0; i < nrepeat; i++)
+	{
+		double ut = legacyLoadAndBuild(rt, file_name);
+		if (ut < 0.0) return 255;
+		legacy_ut += ut;
+	}
+	printf("Legacy read + build, average of %d calls   = %lf (s)\n", nrepeat, legacy_ut / (double) nrepeat);
+
+	// After: the first call maps the file (or uses the on-disk cache), the rest are lookups
+	st = omp_get_wtime();
+	cl_program program = getCLRuntimeProgram(file_name);
+	et = omp_get_wtime();
+	if (program == NULL) return 255;
+	printf("Runtime first getCLRuntimeProgram()        = %lf (s)\n", et - st);
+
+	st = omp_get_wtime();
+	for (int i = 0; i < nrepeat; i++) getCLRuntimeProgram(file_name);
+	et = omp_get_wtime();
+	printf("Runtime cached call, average of %d calls   = %lf (s)\n", nrepeat, (et - st) / (double) nrepeat);
+	printf("Run again to see the first call with a warm on-disk cache.\n");
+
+	releaseCLRuntime();
+	return 0;
+}
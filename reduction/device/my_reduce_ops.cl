@@ -0,0 +1,38 @@
+// Instantiate my_reduce_template.cl for all operators of one element type.
+// Expects RED_T, RED_T_NAME, RED_SUM_ACC, RED_T_LOWEST, RED_T_HIGHEST and RED_KAHAN,
+// which are undefined at the end so the next type can be defined.
+
+#define RED_ACC     RED_SUM_ACC
+#define RED_OP      RED_OP_SUM
+#define RED_OP_NAME sum
+#include "my_reduce_template.cl"
+#undef  RED_ACC
+#undef  RED_OP
+#undef  RED_OP_NAME
+
+#define RED_ACC     RED_T
+#define RED_OP      RED_OP_MIN
+#define RED_OP_NAME min
+#include "my_reduce_template.cl"
+#undef  RED_OP
+#undef  RED_OP_NAME
+
+#define RED_OP      RED_OP_MAX
+#define RED_OP_NAME max
+#include "my_reduce_template.cl"
+#undef  RED_OP
+#undef  RED_OP_NAME
+
+#define RED_OP      RED_OP_ARGMAX
+#define RED_OP_NAME argmax
+#include "my_reduce_template.cl"
+#undef  RED_OP
+#undef  RED_OP_NAME
+#undef  RED_ACC
+
+#undef  RED_T
+#undef  RED_T_NAME
+#undef  RED_SUM_ACC
+#undef  RED_T_LOWEST
+#undef  RED_T_HIGHEST
+#undef  RED_KAHAN
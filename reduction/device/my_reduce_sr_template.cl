@@ -0,0 +1,60 @@
+// Template of a single work-item sum with a shift-register accumulator, included by
+// my_reduction.cl once for each element type. Expects SR_T (int or float) and SR_T_NAME.
+// The kernel is named reduction_task_sr_<SR_T_NAME>, it sums x[x_offset : x_offset + length]
+// into res[res_offset]. x_offset must be a multiple of SR_VEC.
+//
+// Each iteration loads one SR_T16 vector and adds its elements with a tree of adders.
+// The vector sum is added to the value SR_DEPTH iterations back instead of the previous
+// one, so a floating-point adder with a latency up to SR_DEPTH cycles does not stall
+// the loop and it still has II = 1. The SR_DEPTH partial sums are added at the end.
+
+#define SR_CAT_(a, b)  a##b
+#define SR_CAT(a, b)   SR_CAT_(a, b)
+#define SR_T2          SR_CAT(SR_T, 2)
+#define SR_T4          SR_CAT(SR_T, 4)
+#define SR_T8          SR_CAT(SR_T, 8)
+#define SR_T16         SR_CAT(SR_T, 16)
+
+__kernel
+__attribute__((task))
+void SR_CAT(reduction_task_sr_, SR_T_NAME)(
+	__global const SR_T16 * restrict x, const ulong x_offset,
+	__global SR_T * restrict res, const int res_offset, const ulong length
+)
+{
+	__global const SR_T16 *xv = x + x_offset / SR_VEC;
+	ulong nvec = length / SR_VEC;
+
+	SR_T shift_reg[SR_DEPTH + 1];
+	#pragma unroll
+	for (int j = 0; j < SR_DEPTH + 1; j++) shift_reg[j] = 0;
+
+	for (ulong i = 0; i < nvec; i++)
+	{
+		SR_T16 v   = xv[i];
+		SR_T8  v8  = v.lo  + v.hi;
+		SR_T4  v4  = v8.lo + v8.hi;
+		SR_T2  v2  = v4.lo + v4.hi;
+
+		shift_reg[SR_DEPTH] = shift_reg[0] + (v2.x + v2.y);
+		#pragma unroll
+		for (int j = 0; j < SR_DEPTH; j++) shift_reg[j] = shift_reg[j + 1];
+	}
+
+	SR_T sum = 0;
+	#pragma unroll
+	for (int j = 0; j < SR_DEPTH; j++) sum += shift_reg[j];
+
+	// Less than SR_VEC elements left
+	__global const SR_T *xs = (__global const SR_T *) (xv + nvec);
+	for (int i = 0; i < (int) (length - nvec * SR_VEC); i++) sum += xs[i];
+
+	res[res_offset] = sum;
+}
+
+#undef SR_CAT_
+#undef SR_CAT
+#undef SR_T2
+#undef SR_T4
+#undef SR_T8
+#undef SR_T16
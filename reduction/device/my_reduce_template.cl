@@ -0,0 +1,148 @@
+// Template of typed single work-item reduction kernels, included by my_reduction.cl
+// once for each element type and operator. Expects:
+//   RED_T, RED_T_NAME    element type and its name in the kernel name
+//   RED_ACC              type of the partial result (e.g. long for int sums)
+//   RED_OP, RED_OP_NAME  one of RED_OP_SUM / MIN / MAX / ARGMAX and its name
+//   RED_T_LOWEST         lowest value of RED_T (identity of max / argmax)
+//   RED_T_HIGHEST        highest value of RED_T (identity of min)
+//   RED_KAHAN            1 to use Kahan compensated summation for sums
+// Two kernels are generated:
+//   reduce_<RED_OP_NAME>_<RED_T_NAME> reduces x[offset : offset + length] into
+//     res_val[res_offset]; argmax also writes the global index to res_idx[res_offset].
+//     Elements are spread over RED_LANES independent lanes, which are combined at the end.
+//   reduce_segments_<RED_OP_NAME>_<RED_T_NAME> reduces each segment
+//     x[offsets[s] : offsets[s + 1]] for seg_begin <= s < seg_end into res_val[s] and
+//     res_idx[s]. Elements of a segment are accumulated one by one in index order, so
+//     the results are the same as a sequential loop on CPU.
+// res_idx is -1 for operators other than argmax and for empty argmax inputs.
+
+#define RED_CAT4(a, b, c, d)  a##b##c##d
+#define RED_NAME(op, t)       RED_CAT4(reduce_, op, _, t)
+#define RED_SEG_NAME(op, t)   RED_CAT4(reduce_segments_, op, _, t)
+
+#if RED_OP == RED_OP_SUM
+#define RED_IDENTITY  0
+#elif RED_OP == RED_OP_MIN
+#define RED_IDENTITY  RED_T_HIGHEST
+#else
+#define RED_IDENTITY  RED_T_LOWEST
+#endif
+
+// Add element v with global index i to partial result acc, Kahan compensation
+// comp and argmax index idx. comp and idx are not used by other operators.
+#if (RED_OP == RED_OP_SUM) && RED_KAHAN
+#define RED_ACCUMULATE(acc, comp, idx, v, i) \
+	{ \
+		RED_ACC _y = (RED_ACC) (v) - (comp); \
+		RED_ACC _t = (acc) + _y; \
+		(comp) = (_t - (acc)) - _y; \
+		(acc)  = _t; \
+	}
+#elif RED_OP == RED_OP_SUM
+#define RED_ACCUMULATE(acc, comp, idx, v, i)  (acc) += (RED_ACC) (v);
+#elif RED_OP == RED_OP_MIN
+#define RED_ACCUMULATE(acc, comp, idx, v, i)  if ((v) < (acc)) (acc) = (v);
+#elif RED_OP == RED_OP_MAX
+#define RED_ACCUMULATE(acc, comp, idx, v, i)  if ((v) > (acc)) (acc) = (v);
+#else
+// Strict compare keeps the first index of equal values
+#define RED_ACCUMULATE(acc, comp, idx, v, i) \
+	if (((idx) == -1) || ((v) > (acc))) \
+	{ \
+		(acc) = (v); \
+		(idx) = (long) (i); \
+	}
+#endif
+
+__kernel
+__attribute__((task))
+__attribute__((num_compute_units(RED_COMPUTE_UNITS)))
+void RED_NAME(RED_OP_NAME, RED_T_NAME)(
+	__global const RED_T * restrict x, const ulong offset, const ulong length,
+	__global RED_ACC * restrict res_val, __global long * restrict res_idx, const int res_offset
+)
+{
+	RED_ACC acc[RED_LANES], comp[RED_LANES];
+	long    idx[RED_LANES];
+
+	#pragma unroll
+	for (int l = 0; l < RED_LANES; l++)
+	{
+		acc[l]  = RED_IDENTITY;
+		comp[l] = 0;
+		idx[l]  = -1;
+	}
+
+	for (ulong base = 0; base < length; base += RED_LANES)
+	{
+		#pragma unroll
+		for (int l = 0; l < RED_LANES; l++)
+		{
+			if (base + l < length)
+			{
+				RED_T v = x[offset + base + l];
+				RED_ACCUMULATE(acc[l], comp[l], idx[l], v, offset + base + l);
+			}
+		}
+	}
+
+	// Combine the lanes
+	RED_ACC res = acc[0];
+	RED_ACC res_comp = comp[0];
+	long    res_i = idx[0];
+	#pragma unroll
+	for (int l = 1; l < RED_LANES; l++)
+	{
+#if (RED_OP == RED_OP_SUM) && RED_KAHAN
+		RED_ACC y = (acc[l] - comp[l]) - res_comp;
+		RED_ACC t = res + y;
+		res_comp = (t - res) - y;
+		res = t;
+#elif RED_OP == RED_OP_ARGMAX
+		if ((idx[l] != -1) && ((res_i == -1) || (acc[l] > res) || ((acc[l] == res) && (idx[l] < res_i))))
+		{
+			res   = acc[l];
+			res_i = idx[l];
+		}
+#else
+		RED_ACCUMULATE(res, res_comp, res_i, acc[l], 0);
+#endif
+	}
+
+	res_val[res_offset] = res;
+	res_idx[res_offset] = res_i;
+}
+
+__kernel
+__attribute__((task))
+__attribute__((num_compute_units(RED_COMPUTE_UNITS)))
+void RED_SEG_NAME(RED_OP_NAME, RED_T_NAME)(
+	__global const RED_T * restrict x, __global const long * restrict offsets,
+	const uint seg_begin, const uint seg_end,
+	__global RED_ACC * restrict res_val, __global long * restrict res_idx
+)
+{
+	for (uint s = seg_begin; s < seg_end; s++)
+	{
+		long spos = offsets[s];
+		long epos = offsets[s + 1];
+
+		RED_ACC acc  = RED_IDENTITY;
+		RED_ACC comp = 0;
+		long    idx  = -1;
+		for (long i = spos; i < epos; i++)
+		{
+			RED_T v = x[i];
+			RED_ACCUMULATE(acc, comp, idx, v, i);
+		}
+
+		res_val[s] = acc;
+		res_idx[s] = idx;
+	}
+}
+
+#undef RED_CAT4
+#undef RED_NAME
+#undef RED_SEG_NAME
+#undef RED_IDENTITY
+#undef RED_ACCUMULATE
@@ -1,44 +1,39 @@
 
 #include "my_reduction.h"
 
-#define WARP_REDUCE(x)	if (tid < (x)) buffer[tid] += buffer[tid + (x)]; \
-						barrier(CLK_LOCAL_MEM_FENCE); 
-
+// Sum of x[0 : length] in each work-group, written to res[group id]. The work-items
+// of all work-groups read the input in a grid-stride loop, so any number of groups
+// covers any length. The reduction is done in two launches of this kernel:
+//   1. ngroups work-groups on the input, one partial sum per group;
+//   2. one work-group on the ngroups partial sums, the total is in res[0].
 __kernel 
-__attribute((reqd_work_group_size(WG_SIZE, 1, 1)))
-void reduction_NDRange(__global int * restrict x, __global int * restrict res, int length)
+__attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+__attribute__((num_simd_work_items(ND_SIMD)))
+__attribute__((num_compute_units(ND_COMPUTE_UNITS)))
+void reduction_NDRange(__global const int * restrict x, __global int * restrict res, int length)
 {
 	__local int buffer[WG_SIZE];
 	
 	int tid   = get_local_id(0);
-	int nstep = length / WG_SIZE;
-	int idx   = tid;
+	int gid   = get_global_id(0);
+	int gsize = get_global_size(0);
+	int nstep = (length - gid + gsize - 1) / gsize;
 	
+	// Adjacent work-items read adjacent elements, so the loads are coalesced
 	int sum = 0;
 	#pragma unroll 4
-	for (int i = 0; i < nstep; i++)
-	{
-		idx = tid + i * WG_SIZE;
-		sum += x[idx];
-	}
-	if (idx + WG_SIZE < length) sum += x[idx + WG_SIZE];
+	for (int i = 0; i < nstep; i++) sum += x[gid + i * gsize];
 	buffer[tid] = sum;
 	barrier(CLK_LOCAL_MEM_FENCE); 
 	
-	WARP_REDUCE(4096);
-	WARP_REDUCE(2048);
-	WARP_REDUCE(1024);
-	WARP_REDUCE(512);
-	WARP_REDUCE(256);
-	WARP_REDUCE(128);
-	WARP_REDUCE(64);
-	WARP_REDUCE(32);
-	WARP_REDUCE(16);
-	WARP_REDUCE(8);
-	WARP_REDUCE(4);
-	WARP_REDUCE(2);
+	#pragma unroll
+	for (int stride = WG_SIZE / 2; stride > 0; stride >>= 1)
+	{
+		if (tid < stride) buffer[tid] += buffer[tid + stride];
+		barrier(CLK_LOCAL_MEM_FENCE); 
+	}
 	
-	if (tid == 0) res[0] = buffer[0] + buffer[1];
+	if (tid == 0) res[get_group_id(0)] = buffer[0];
 }
 
 __attribute__((task)) 
@@ -59,3 +54,111 @@ void reduction_task(
 	
 	res[res_offset] = sum;
 }
+
+
+/* ---------- Shift-register single work-item kernels ---------- */
+// reduction_task_sr_{int,float}, see my_reduce_sr_template.cl
+
+#define SR_T      int
+#define SR_T_NAME int
+#include "my_reduce_sr_template.cl"
+#undef  SR_T
+#undef  SR_T_NAME
+
+#define SR_T      float
+#define SR_T_NAME float
+#include "my_reduce_sr_template.cl"
+#undef  SR_T
+#undef  SR_T_NAME
+
+
+/* ---------- Typed reduction kernels ---------- */
+// reduce_{sum,min,max,argmax}_{int,float,double}, see my_reduce_template.cl. 
+// int sums are accumulated in long, float and double sums use Kahan summation.
+
+#define RED_T         int
+#define RED_T_NAME    int
+#define RED_SUM_ACC   long
+#define RED_T_LOWEST  INT_MIN
+#define RED_T_HIGHEST INT_MAX
+#define RED_KAHAN     0
+#include "my_reduce_ops.cl"
+
+#define RED_T         float
+#define RED_T_NAME    float
+#define RED_SUM_ACC   float
+#define RED_T_LOWEST  (-INFINITY)
+#define RED_T_HIGHEST INFINITY
+#define RED_KAHAN     1
+#include "my_reduce_ops.cl"
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define RED_T         double
+#define RED_T_NAME    double
+#define RED_SUM_ACC   double
+#define RED_T_LOWEST  (-(double) INFINITY)
+#define RED_T_HIGHEST ((double) INFINITY)
+#define RED_KAHAN     1
+#include "my_reduce_ops.cl"
+#endif
+
+
+/* ---------- Reproducible float sum ---------- */
+// reduce_sum_repro_float has the arguments of reduce_sum_float, but res_val gets REPRO_BINS
+// bins at res_val[res_offset * REPRO_BINS] and res_idx[res_offset] gets flags of NaN (1),
+// +INF (2) and -INF (4) inputs. A finite float is m * 2^(e - 150) with an integer m < 2^24
+// and 1 <= e <= 254. m * 2^(e % 4) is added to bin e / 4 with integer adds, so the bins
+// are exact and do not depend on the order of the additions or on how the input is split.
+// The host adds the bins of all chunks and rounds the exact sum once, see reduce.c.
+
+__kernel
+__attribute__((task))
+__attribute__((num_compute_units(RED_COMPUTE_UNITS)))
+void reduce_sum_repro_float(
+	__global const float * restrict x, const ulong offset, const ulong length,
+	__global long * restrict res_val, __global long * restrict res_idx, const int res_offset
+)
+{
+	long bins[REPRO_BINS];
+	long special = 0;
+	#pragma unroll
+	for (int k = 0; k < REPRO_BINS; k++) bins[k] = 0;
+
+	for (ulong base = 0; base < length; base += REPRO_LANES)
+	{
+		int  bin[REPRO_LANES];
+		long val[REPRO_LANES];
+		#pragma unroll
+		for (int l = 0; l < REPRO_LANES; l++)
+		{
+			uint u = (base + l < length) ? as_uint(x[offset + base + l]) : 0;
+			int  e = (u >> 23) & 0xFF;
+			long m = u & 0x7FFFFF;
+			if (e == 0xFF)
+			{
+				special |= (m != 0) ? 1 : (((u >> 31) != 0) ? 4 : 2);
+				m = 0;
+			}
+			if ((e != 0) && (e != 0xFF)) m |= 0x800000;
+			if (e == 0) e = 1;  // Denormals have the exponent of the smallest normal
+			m <<= (e & 3);
+			bin[l] = e >> 2;
+			val[l] = ((u >> 31) != 0) ? -m : m;
+		}
+
+		// Every bin has its own adder, so there is no loop-carried memory dependency
+		#pragma unroll
+		for (int k = 0; k < REPRO_BINS; k++)
+		{
+			long add = 0;
+			#pragma unroll
+			for (int l = 0; l < REPRO_LANES; l++) add += (bin[l] == k) ? val[l] : 0;
+			bins[k] += add;
+		}
+	}
+
+	#pragma unroll
+	for (int k = 0; k < REPRO_BINS; k++) res_val[res_offset * REPRO_BINS + k] = bins[k];
+	res_idx[res_offset] = special;
+}
@@ -1,7 +1,36 @@
 #ifndef __MY_REDUCTION_H__
 #define __MY_REDUCTION_H__
 
-#define WG_SIZE    8192
+#define WG_SIZE    256
 #define PARA_TASKS 16
 
+// NDRange reduction_NDRange kernel
+#define ND_SIMD          8    // SIMD work-items, WG_SIZE must be a multiple of it
+#define ND_COMPUTE_UNITS 2    // Work-groups are distributed over the compute units
+#define ND_MAX_GROUPS    512  // Max number of work-groups in the first stage
+
+// Shift-register single work-item kernels reduction_task_sr_<type>
+#define SR_VEC   16  // Elements per load, the kernels read int16 / float16 vectors
+#define SR_DEPTH 8   // Partial sums in the shift register, at least the latency of the adder
+
+// Streaming reduction kernels in my_reduction_stream.cl, they use SR_VEC and SR_DEPTH too
+#define STREAM_CH_DEPTH 256  // Depth of the data channel in float16 vectors
+
+// Scan kernels in my_scan.cl
+#define SCAN_WG_SIZE 256  // Work-group size of the NDRange scan kernels
+#define SCAN_ITEMS   8    // Elements scanned by each work-item, a block has SCAN_WG_SIZE * SCAN_ITEMS elements
+#define SCAN_VEC     8    // Elements per iteration of the single work-item scan kernel
+
+// Typed reduction kernels reduce_<op>_<type> in my_reduction.cl
+#define RED_OP_SUM        0
+#define RED_OP_MIN        1
+#define RED_OP_MAX        2
+#define RED_OP_ARGMAX     3
+#define RED_LANES         8  // Independent partial results in each kernel
+#define RED_COMPUTE_UNITS 4  // Copies of each typed kernel, a reduction is split into this many chunks
+
+// Reproducible float sum kernel reduce_sum_repro_float in my_reduction.cl
+#define REPRO_BINS  64  // One bin for every 4 float exponents
+#define REPRO_LANES 4   // Elements per iteration, the fast kernels use RED_LANES
+
 #endif
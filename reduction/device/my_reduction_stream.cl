@@ -0,0 +1,149 @@
+#include "my_reduction.h"
+
+// Persistent streaming reduction of float data, sum / min / max / count.
+// Three task kernels are connected with channels:
+//   reduction_stream_reader --> reduction_stream_accumulate --> reduction_stream_emit
+// reduction_stream_accumulate is launched once and runs until the end of the stream,
+// it keeps the running aggregates in registers. For each host chunk, the host launches
+// one reduction_stream_reader, which sends the chunk length and the chunk data, and one
+// reduction_stream_emit, which writes the running aggregates after that chunk to global
+// memory. A chunk with last != 0 ends the stream and is not emitted.
+// This file needs Intel FPGA channels, so it only builds with aoc (or the emulator).
+
+#pragma OPENCL EXTENSION cl_intel_channels : enable
+
+typedef struct
+{
+	uint n;     // Number of elements in the chunk
+	int  last;  // End of the stream
+} stream_ctrl_t;
+
+typedef struct
+{
+	float sum, min, max;  // Running aggregates of all chunks so far
+	float chunk_sum;      // Sum of the last chunk
+	ulong count;          // Number of elements so far
+} stream_agg_t;
+
+typedef union
+{
+	float16 v;
+	float   a[SR_VEC];
+} stream_vec_t;
+
+channel stream_ctrl_t ch_stream_ctrl __attribute__((depth(4)));
+channel float16       ch_stream_data __attribute__((depth(STREAM_CH_DEPTH)));
+channel stream_agg_t  ch_stream_agg  __attribute__((depth(4)));
+
+// x holds n elements, its buffer must have room for n rounded up to SR_VEC elements,
+// the padding is read but ignored by reduction_stream_accumulate.
+__kernel
+__attribute__((task))
+void reduction_stream_reader(__global const float16 * restrict x, const uint n, const int last)
+{
+	stream_ctrl_t ctrl;
+	ctrl.n    = n;
+	ctrl.last = last;
+	write_channel_intel(ch_stream_ctrl, ctrl);
+
+	uint nvec = (n + SR_VEC - 1) / SR_VEC;
+	for (uint i = 0; i < nvec; i++) write_channel_intel(ch_stream_data, x[i]);
+}
+
+__kernel
+__attribute__((task))
+void reduction_stream_accumulate()
+{
+	float run_sum = 0.0f, run_comp = 0.0f;
+	float run_min = INFINITY, run_max = -INFINITY;
+	ulong count   = 0;
+
+	int done = 0;
+	while (!done)
+	{
+		stream_ctrl_t ctrl = read_channel_intel(ch_stream_ctrl);
+		done = ctrl.last;
+
+		// Shift registers as in my_reduce_sr_template.cl, so the floating-point
+		// sum / min / max of a chunk do not limit the II of the inner loop
+		float sr_sum[SR_DEPTH + 1], sr_min[SR_DEPTH + 1], sr_max[SR_DEPTH + 1];
+		#pragma unroll
+		for (int j = 0; j < SR_DEPTH + 1; j++)
+		{
+			sr_sum[j] = 0.0f;
+			sr_min[j] = INFINITY;
+			sr_max[j] = -INFINITY;
+		}
+
+		uint nvec = (ctrl.n + SR_VEC - 1) / SR_VEC;
+		for (uint i = 0; i < nvec; i++)
+		{
+			stream_vec_t in;
+			in.v = read_channel_intel(ch_stream_data);
+
+			// Lanes after the end of the chunk are padding
+			float s = 0.0f, mn = INFINITY, mx = -INFINITY;
+			#pragma unroll
+			for (int l = 0; l < SR_VEC; l++)
+			{
+				float e  = in.a[l];
+				int   ok = (i * SR_VEC + l) < ctrl.n;
+				s += ok ? e : 0.0f;
+				if (ok && (e < mn)) mn = e;
+				if (ok && (e > mx)) mx = e;
+			}
+
+			sr_sum[SR_DEPTH] = sr_sum[0] + s;
+			sr_min[SR_DEPTH] = (mn < sr_min[0]) ? mn : sr_min[0];
+			sr_max[SR_DEPTH] = (mx > sr_max[0]) ? mx : sr_max[0];
+			#pragma unroll
+			for (int j = 0; j < SR_DEPTH; j++)
+			{
+				sr_sum[j] = sr_sum[j + 1];
+				sr_min[j] = sr_min[j + 1];
+				sr_max[j] = sr_max[j + 1];
+			}
+		}
+
+		float chunk_sum = 0.0f;
+		#pragma unroll
+		for (int j = 0; j < SR_DEPTH; j++)
+		{
+			chunk_sum += sr_sum[j];
+			if (sr_min[j] < run_min) run_min = sr_min[j];
+			if (sr_max[j] > run_max) run_max = sr_max[j];
+		}
+
+		// Chunk sums are added with Kahan summation, so the running sum does
+		// not lose precision when the stream is much longer than a chunk
+		float y = chunk_sum - run_comp;
+		float t = run_sum + y;
+		run_comp = (t - run_sum) - y;
+		run_sum  = t;
+		count   += ctrl.n;
+
+		if (!done)
+		{
+			stream_agg_t agg;
+			agg.sum       = run_sum;
+			agg.min       = run_min;
+			agg.max       = run_max;
+			agg.chunk_sum = chunk_sum;
+			agg.count     = count;
+			write_channel_intel(ch_stream_agg, agg);
+		}
+	}
+}
+
+// agg_val = {sum, min, max, chunk sum}, agg_count = {count}
+__kernel
+__attribute__((task))
+void reduction_stream_emit(__global float * restrict agg_val, __global ulong * restrict agg_count)
+{
+	stream_agg_t agg = read_channel_intel(ch_stream_agg);
+	agg_val[0]   = agg.sum;
+	agg_val[1]   = agg.min;
+	agg_val[2]   = agg.max;
+	agg_val[3]   = agg.chunk_sum;
+	agg_count[0] = agg.count;
+}
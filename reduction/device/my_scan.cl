@@ -0,0 +1,135 @@
+#include "my_reduction.h"
+
+// Prefix sums of int arrays, y[i] = x[0] + ... + x[i] (inclusive) or
+// x[0] + ... + x[i - 1] (exclusive, y[0] = 0).
+//
+// NDRange version, block scan then propagate. A block is SCAN_BLOCK consecutive
+// elements and is handled by one work-group:
+//   1. scan_block_sums: the sum of each block;
+//   2. the block sums are scanned (exclusive) the same way, which is a single
+//      block for up to SCAN_BLOCK blocks;
+//   3. scan_blocks: each block is scanned in local memory and the scanned sum of
+//      the blocks before it is added.
+// Each work-item scans SCAN_ITEMS elements sequentially and only the SCAN_WG_SIZE
+// per-item totals are scanned with a tree, so the work is O(n).
+//
+// Single work-item version, scan_task reads SCAN_VEC elements per iteration and
+// carries the running sum, integer adds do not limit the II.
+
+#define SCAN_BLOCK (SCAN_WG_SIZE * SCAN_ITEMS)
+
+__kernel
+__attribute__((reqd_work_group_size(SCAN_WG_SIZE, 1, 1)))
+void scan_block_sums(__global const int * restrict x, __global int * restrict sums, const uint n)
+{
+	__local int buffer[SCAN_WG_SIZE];
+
+	int  tid   = get_local_id(0);
+	uint start = get_group_id(0) * SCAN_BLOCK;
+
+	// Adjacent work-items read adjacent elements
+	int sum = 0;
+	#pragma unroll
+	for (int k = 0; k < SCAN_ITEMS; k++)
+	{
+		uint i = start + k * SCAN_WG_SIZE + tid;
+		if (i < n) sum += x[i];
+	}
+	buffer[tid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	#pragma unroll
+	for (int stride = SCAN_WG_SIZE / 2; stride > 0; stride >>= 1)
+	{
+		if (tid < stride) buffer[tid] += buffer[tid + stride];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (tid == 0) sums[get_group_id(0)] = buffer[0];
+}
+
+// block_offsets[g] is added to block g if use_offsets != 0, otherwise it is not read
+__kernel
+__attribute__((reqd_work_group_size(SCAN_WG_SIZE, 1, 1)))
+void scan_blocks(
+	__global const int * restrict x, __global int * restrict y,
+	__global const int * restrict block_offsets, const uint n,
+	const int exclusive, const int use_offsets
+)
+{
+	__local int block[SCAN_BLOCK];
+	__local int totals[2][SCAN_WG_SIZE];
+
+	int  tid   = get_local_id(0);
+	uint start = get_group_id(0) * SCAN_BLOCK;
+
+	#pragma unroll
+	for (int k = 0; k < SCAN_ITEMS; k++)
+	{
+		uint i = start + k * SCAN_WG_SIZE + tid;
+		block[k * SCAN_WG_SIZE + tid] = (i < n) ? x[i] : 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Sequential scan of this work-item's SCAN_ITEMS elements
+	int vals[SCAN_ITEMS];
+	int total = 0;
+	#pragma unroll
+	for (int k = 0; k < SCAN_ITEMS; k++)
+	{
+		int v   = block[tid * SCAN_ITEMS + k];
+		vals[k] = exclusive ? total : total + v;
+		total  += v;
+	}
+
+	// Inclusive scan of the per-item totals, ping-pong between two buffers
+	int src = 0;
+	totals[0][tid] = total;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	#pragma unroll
+	for (int stride = 1; stride < SCAN_WG_SIZE; stride <<= 1)
+	{
+		int t = totals[src][tid];
+		if (tid >= stride) t += totals[src][tid - stride];
+		totals[1 - src][tid] = t;
+		src = 1 - src;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	int offset = totals[src][tid] - total;
+	if (use_offsets) offset += block_offsets[get_group_id(0)];
+	#pragma unroll
+	for (int k = 0; k < SCAN_ITEMS; k++) block[tid * SCAN_ITEMS + k] = vals[k] + offset;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	#pragma unroll
+	for (int k = 0; k < SCAN_ITEMS; k++)
+	{
+		uint i = start + k * SCAN_WG_SIZE + tid;
+		if (i < n) y[i] = block[k * SCAN_WG_SIZE + tid];
+	}
+}
+
+__kernel
+__attribute__((task))
+void scan_task(
+	__global const int * restrict x, __global int * restrict y,
+	const ulong n, const int exclusive
+)
+{
+	int running = 0;
+	for (ulong base = 0; base < n; base += SCAN_VEC)
+	{
+		int v[SCAN_VEC];
+		#pragma unroll
+		for (int l = 0; l < SCAN_VEC; l++) v[l] = (base + l < n) ? x[base + l] : 0;
+
+		#pragma unroll
+		for (int l = 0; l < SCAN_VEC; l++)
+		{
+			int incl = running + v[l];
+			if (base + l < n) y[base + l] = exclusive ? running : incl;
+			running = incl;
+		}
+	}
+}
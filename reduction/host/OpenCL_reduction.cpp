@@ -8,7 +8,35 @@
 #include <time.h>
 
 #include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
 #include "../device/my_reduction.h"
+#include "reduce.h"
+#include "reduce_stream.h"
+
+// Enqueue the two stages of reduction_NDRange: ngroups work-groups write partial
+// sums of x to part, then one work-group sums them into res[0]. The stages are
+// ordered by the in-order queue, the host does not wait between them.
+static cl_int enqueueReductionNDRange(
+	cl_command_queue queue, cl_kernel kernel, cl_mem x, cl_mem part, cl_mem res, 
+	int n, int ngroups, cl_event *event
+)
+{
+	cl_int err = CL_SUCCESS;
+	const size_t kernel_wg_size[1] = {WG_SIZE};
+	const size_t stage1_ws_size[1] = {(size_t) WG_SIZE * ngroups};
+	err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*) &x);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*) &part);
+	err |= clSetKernelArg(kernel, 2, sizeof(int),    (void*) &n);
+	err |= clEnqueueNDRangeKernel(queue, kernel, 1, NULL, stage1_ws_size, kernel_wg_size, 0, NULL, NULL);
+	
+	// Arguments are captured at enqueue time, so the kernel object can be reused
+	err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*) &part);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*) &res);
+	err |= clSetKernelArg(kernel, 2, sizeof(int),    (void*) &ngroups);
+	err |= clEnqueueNDRangeKernel(queue, kernel, 1, NULL, kernel_wg_size, kernel_wg_size, 0, NULL, event);
+	return err;
+}
 
 void testReductionNDKernel(
 	int *h_x, int n, size_t nBytes, int refres, 
@@ -18,32 +46,36 @@ void testReductionNDKernel(
 	printf("Testing NDRange kernel\n");
 	cl_kernel kernel = clCreateKernel(program, "reduction_NDRange", NULL);
 	
-	// Allocate memory on device
+	// Enough work-groups to fill all compute units, but each work-item should 
+	// still sum several elements so the second stage stays small
+	int ngroups = (n + WG_SIZE * 4 - 1) / (WG_SIZE * 4);
+	if (ngroups > ND_MAX_GROUPS) ngroups = ND_MAX_GROUPS;
+	if (ngroups < 1) ngroups = 1;
+	printf("Work-group size = %d, number of work-groups = %d\n", WG_SIZE, ngroups);
+	
+	// Get device buffers from the memory pool
 	cl_int err;
-	cl_mem d_x = clCreateBuffer(context, CL_MEM_READ_WRITE, nBytes,      NULL, &err);
-	cl_mem res = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int), NULL, &err);
+	cl_mem d_x  = allocCLPoolBuffer(nBytes,                CL_MEM_READ_WRITE);
+	cl_mem part = allocCLPoolBuffer(sizeof(int) * ngroups, CL_MEM_READ_WRITE);
+	cl_mem res  = allocCLPoolBuffer(sizeof(int),           CL_MEM_READ_WRITE);
 	
 	// Copy data to device
 	cl_event h2d_copy;
 	err = clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, h_x, 0, NULL, &h2d_copy);
 	clWaitForEvents(1, &h2d_copy);
 	
-	// Set kernel arguments and launch kernel
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*) &d_x);
-	err = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*) &res);
-	err = clSetKernelArg(kernel, 2, sizeof(int),    (void*) &n);
-	const size_t kernel_wg_size[1] = {WG_SIZE};
-	const size_t kernel_ws_size[1] = {WG_SIZE};
+	// Launch kernel
 	cl_event kernel_exec;
 	double st = omp_get_wtime();
 	for (int i = 0; i < 20; i++)
 	{
-		err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, kernel_ws_size, kernel_wg_size, 0, NULL, &kernel_exec);
+		err = enqueueReductionNDRange(queue, kernel, d_x, part, res, n, ngroups, &kernel_exec);
 		clWaitForEvents(1, &kernel_exec);
 	}
 	double et = omp_get_wtime();
 	double ut = et - st;
 	double bw = nBytes * 20.0 / (ut * 1000000000.0);
+	if (err != CL_SUCCESS) printf("[ERROR] Launching reduction_NDRange failed, returned status = %d\n", err);
 	printf("20 runs used time = %lf (s), effective bandwidth = %lf GB/s \n", ut, bw);
 	
 	// Copy result back to host
@@ -51,6 +83,7 @@ void testReductionNDKernel(
 	cl_event d2h_copy;
 	err = clEnqueueReadBuffer(queue, res, CL_TRUE, 0, sizeof(int), &dev_res, 0, NULL, &d2h_copy);
 	clWaitForEvents(1, &d2h_copy);
+	if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
 	
 	// Check result
 	float abserr = fabs(dev_res - refres);
@@ -64,8 +97,9 @@ void testReductionNDKernel(
 	
 	// Release resources
 	err = clReleaseKernel(kernel);      
-	err = clReleaseMemObject(d_x);
-	err = clReleaseMemObject(res);
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(part);
+	freeCLPoolBuffer(res);
 }
 
 void testReductionSingleTask(
@@ -76,10 +110,10 @@ void testReductionSingleTask(
 	printf("Testing single single work-item kernel\n");
 	cl_kernel kernel = clCreateKernel(program, "reduction_task", NULL);
 	
-	// Allocate memory on device
+	// Get device buffers from the memory pool
 	cl_int err;
-	cl_mem d_x = clCreateBuffer(context, CL_MEM_READ_WRITE, nBytes,      NULL, &err);
-	cl_mem res = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int), NULL, &err);
+	cl_mem d_x = allocCLPoolBuffer(nBytes,      CL_MEM_READ_WRITE);
+	cl_mem res = allocCLPoolBuffer(sizeof(int), CL_MEM_READ_WRITE);
 	
 	// Copy data to device
 	cl_event h2d_copy;
@@ -110,6 +144,7 @@ void testReductionSingleTask(
 	cl_event d2h_copy;
 	err = clEnqueueReadBuffer(queue, res, CL_TRUE, 0, sizeof(int), &dev_res, 0, NULL, &d2h_copy);
 	clWaitForEvents(1, &d2h_copy);
+	if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
 	
 	// Check result
 	float abserr = fabs(dev_res - refres);
@@ -123,43 +158,118 @@ void testReductionSingleTask(
 	
 	// Release resources
 	err = clReleaseKernel(kernel);      
-	err = clReleaseMemObject(d_x);
-	err = clReleaseMemObject(res);
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(res);
+}
+
+void testReductionShiftReg(
+	int *h_x, int n, size_t nBytes, int refres, int use_float, 
+	cl_context context, cl_command_queue queue, cl_program program
+)
+{
+	const char *kernel_name = use_float ? "reduction_task_sr_float" : "reduction_task_sr_int";
+	printf("Testing shift-register single work-item kernel %s, depth = %d\n", kernel_name, SR_DEPTH);
+	cl_kernel kernel = clCreateKernel(program, kernel_name, NULL);
+	
+	// float input has the same values as the int input, the float sum is exact up to 2^24
+	void *h_in = h_x;
+	float *h_xf = NULL;
+	if (use_float)
+	{
+		h_xf = (float*) malloc(sizeof(float) * n);
+		for (int i = 0; i < n; i++) h_xf[i] = (float) h_x[i];
+		h_in = h_xf;
+	}
+	
+	// Get device buffers from the memory pool
+	cl_int err;
+	cl_mem d_x = allocCLPoolBuffer(nBytes,      CL_MEM_READ_WRITE);
+	cl_mem res = allocCLPoolBuffer(sizeof(int), CL_MEM_READ_WRITE);
+	
+	// Copy data to device
+	cl_event h2d_copy;
+	err = clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, h_in, 0, NULL, &h2d_copy);
+	clWaitForEvents(1, &h2d_copy);
+	
+	// Set kernel arguments and launch kernel
+	cl_ulong x_offset = 0, length = (cl_ulong) n;
+	int zero = 0;
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem),   (void*) &d_x);
+	err = clSetKernelArg(kernel, 1, sizeof(cl_ulong), (void*) &x_offset);
+	err = clSetKernelArg(kernel, 2, sizeof(cl_mem),   (void*) &res);
+	err = clSetKernelArg(kernel, 3, sizeof(int),      (void*) &zero);
+	err = clSetKernelArg(kernel, 4, sizeof(cl_ulong), (void*) &length);
+	cl_event kernel_exec;
+	double st = omp_get_wtime();
+	for (int i = 0; i < 20; i++)
+	{
+		err = clEnqueueTask(queue, kernel, 0, NULL, &kernel_exec);
+		clWaitForEvents(1, &kernel_exec);
+	}
+	double et = omp_get_wtime();
+	double ut = et - st;
+	double bw = nBytes * 20.0 / (ut * 1000000000.0);
+	printf("20 runs used time = %lf (s), effective bandwidth = %lf GB/s \n", ut, bw);
+	
+	// Copy result back to host
+	double dev_res;
+	int   dev_res_i;
+	float dev_res_f;
+	cl_event d2h_copy;
+	err = clEnqueueReadBuffer(queue, res, CL_TRUE, 0, sizeof(int), use_float ? (void*) &dev_res_f : (void*) &dev_res_i, 0, NULL, &d2h_copy);
+	clWaitForEvents(1, &d2h_copy);
+	if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+	dev_res = use_float ? (double) dev_res_f : (double) dev_res_i;
+	
+	// Check result, float partial sums are rounded once they are larger than 2^24
+	double abserr = fabs(dev_res - refres);
+	double relerr = abserr / fabs((double) refres);
+	double tol    = use_float ? 1e-5 : 1e-10;
+	if (relerr < tol)
+	{
+		printf("Check passed, ref res = %d, device res = %.1lf, rel err = %e\n", refres, dev_res, relerr);
+	} else {
+		printf("Check failed, ref res = %d, device res = %.1lf, rel err = %e\n", refres, dev_res, relerr);
+	}
+	
+	// Release resources
+	err = clReleaseKernel(kernel);      
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(res);
+	free(h_xf);
 }
 
 void testReductionMultiTask(
-	int *h_x, int n, size_t nBytes, int refres, int nthreads, 
+	int *h_x, int n, size_t nBytes, int refres, int ntasks, 
 	cl_context context, cl_command_queue queue, cl_program program
 )
 {
 	printf("Testing parallel single work-item kernel\n");
-	// Create kernels for each thread
-	cl_kernel *kernels = (cl_kernel*) malloc(sizeof(cl_kernel) * nthreads);
-	for (int i = 0; i < nthreads; i++) 
+	// Create kernels for each partition
+	cl_kernel *kernels = (cl_kernel*) malloc(sizeof(cl_kernel) * ntasks);
+	for (int i = 0; i < ntasks; i++) 
 		kernels[i] = clCreateKernel(program, "reduction_task", NULL);
 	
-	// Allocate memory on device
+	// Get device buffers from the memory pool
 	cl_int err;
-	size_t res_bytes = sizeof(int) * nthreads;
-	cl_mem d_x = clCreateBuffer(context, CL_MEM_READ_WRITE, nBytes,    NULL, &err);
-	cl_mem res = clCreateBuffer(context, CL_MEM_READ_WRITE, res_bytes, NULL, &err);
+	size_t res_bytes = sizeof(int) * ntasks;
+	cl_mem d_x = allocCLPoolBuffer(nBytes,    CL_MEM_READ_WRITE);
+	cl_mem res = allocCLPoolBuffer(res_bytes, CL_MEM_READ_WRITE);
 	
 	// Copy data to device
 	cl_event h2d_copy;
 	err = clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, h_x, 0, NULL, &h2d_copy);
 	clWaitForEvents(1, &h2d_copy);
 	
-	// Set kernel arguments and launch kernels
-	double ut = 0.0;
-	#pragma omp parallel num_threads(nthreads) reduction(max:ut)
+	// Set kernel arguments
+	for (int tid = 0; tid < ntasks; tid++)
 	{
-		int tid  = omp_get_thread_num();
 		long long _spos = (long long) n;
 		_spos *= tid;
-		_spos /= nthreads;
+		_spos /= ntasks;
 		long long _epos = (long long) n;
 		_epos *= (tid + 1);
-		_epos /= nthreads;
+		_epos /= ntasks;
 		int spos = (int) _spos;
 		int epos = (int) _epos;
 		int leng = epos - spos;
@@ -169,33 +279,39 @@ void testReductionMultiTask(
 		clSetKernelArg(kernels[tid], 2, sizeof(cl_mem), (void*) &res);
 		clSetKernelArg(kernels[tid], 3, sizeof(int),    (void*) &tid);
 		clSetKernelArg(kernels[tid], 4, sizeof(int),    (void*) &leng);
-		
-		#pragma omp barrier
-		cl_event kernel_exec;
-		double t_ut = 0.0;
-		for (int i = 0; i < 20; i++)
+	}
+	
+	// Launch all partitions from this thread. Each partition goes to its own 
+	// runtime queue, so the launches overlap on the compute units, and the host 
+	// waits once for all of them.
+	cl_event *kernel_exec = (cl_event*) malloc(sizeof(cl_event) * ntasks);
+	double st = omp_get_wtime();
+	for (int i = 0; i < 20; i++)
+	{
+		for (int tid = 0; tid < ntasks; tid++)
 		{
-			#pragma omp barrier
-			double st = omp_get_wtime();
-			err = clEnqueueTask(queue, kernels[tid], 0, NULL, &kernel_exec);
-			clWaitForEvents(1, &kernel_exec);
-			#pragma omp barrier
-			double et = omp_get_wtime();
-			t_ut += et - st;
+			cl_command_queue task_queue = getCLRuntimeQueue(tid % CL_RUNTIME_MAX_QUEUES);
+			err = clEnqueueTask(task_queue, kernels[tid], 0, NULL, &kernel_exec[tid]);
+			if (err != CL_SUCCESS) printf("[ERROR] clEnqueueTask() failed, returned status = %d\n", err);
 		}
-		
-		ut = t_ut > ut ? t_ut : ut;
+		clWaitForEvents(ntasks, kernel_exec);
+		for (int tid = 0; tid < ntasks; tid++) clReleaseEvent(kernel_exec[tid]);
 	}
+	double et = omp_get_wtime();
+	double ut = et - st;
 	double bw = nBytes * 20.0 / (ut * 1000000000.0);
 	printf("20 runs used time = %lf (s), effective bandwidth = %lf GB/s \n", ut, bw);
+	free(kernel_exec);
 	
 	// Copy result back to host
 	int *dev_res = (int*) malloc(res_bytes);
 	cl_event d2h_copy;
 	err = clEnqueueReadBuffer(queue, res, CL_TRUE, 0, res_bytes, dev_res, 0, NULL, &d2h_copy);
 	clWaitForEvents(1, &d2h_copy);
+	if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
 	int devres = 0;
-	for (int i = 0; i < nthreads; i++) devres += dev_res[i];
+	for (int i = 0; i < ntasks; i++) devres += dev_res[i];
+	free(dev_res);
 	
 	// Check result
 	float abserr = fabs(devres - refres);
@@ -208,9 +324,242 @@ void testReductionMultiTask(
 	}
 	
 	// Release resources
-	for (int i = 0; i < nthreads; i++) clReleaseKernel(kernels[i]);  
-	err = clReleaseMemObject(d_x);
-	err = clReleaseMemObject(res);
+	for (int i = 0; i < ntasks; i++) clReleaseKernel(kernels[i]);  
+	free(kernels);
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(res);
+}
+
+void testReduceEngine(int *h_x, int n, cl_program program)
+{
+	printf("Testing typed reduction kernels\n");
+	float  *h_xf = (float*)  malloc(sizeof(float)  * n);
+	double *h_xd = (double*) malloc(sizeof(double) * n);
+	for (int i = 0; i < n; i++)
+	{
+		h_xf[i] = (float)  h_x[i] + 0.1f * (float) (i % 7);
+		h_xd[i] = (double) h_x[i] + 0.1  * (double) (i % 7);
+	}
+	const void *inputs[3] = {h_x, h_xf, h_xd};
+	const double rtols[3] = {0.0, 1e-6, 1e-13};
+	
+	// The device kernels are used even if the device is not an FPGA
+	setenv("REDUCE_CPU_FALLBACK", "0", 0);
+	const reduceOp_t ops[4] = {ReduceSum, ReduceMin, ReduceMax, ReduceArgmax};
+	for (int t = 0; t < 3; t++)
+	{
+		reduceType_t type = (reduceType_t) t;
+		for (int o = 0; o < 4; o++)
+		{
+			reduceResult_t ref, dev;
+			reduceCPU(ops[o], type, inputs[t], n, &ref);
+			double st = omp_get_wtime();
+			int ret = reduceHost(ops[o], type, inputs[t], n, &dev, program);
+			double ut = omp_get_wtime() - st;
+			
+			double refval = (type == ReduceInt) ? (double) ref.i : ref.f;
+			double devval = (type == ReduceInt) ? (double) dev.i : dev.f;
+			double relerr = fabs(devval - refval) / (fabs(refval) > 0.0 ? fabs(refval) : 1.0);
+			int passed = (ret == 0) && (relerr <= rtols[t]) && (dev.index == ref.index);
+			printf(
+				"%s reduce_%s_%s: ref = %.10g, device = %.10g, index = %lld / %lld, rel err = %e, %lf (s)\n",
+				passed ? "Check passed" : "Check failed", getReduceOpName(ops[o]), getReduceTypeName(type),
+				refval, devval, ref.index, dev.index, relerr, ut
+			);
+		}
+	}
+	
+	free(h_xf);
+	free(h_xd);
+}
+
+void testReduceByKey(int *h_x, int n, cl_program program)
+{
+	// Sorted keys with runs of 1 ~ 64 elements, every 10th key is skipped
+	int *keys = (int*) malloc(sizeof(int) * n);
+	int key = 0;
+	for (int i = 0; i < n; )
+	{
+		int run = 1 + rand() % 64;
+		for (int j = 0; (j < run) && (i < n); j++, i++) keys[i] = key;
+		key += (key % 10 == 9) ? 2 : 1;
+	}
+	float  *h_xf = (float*)  malloc(sizeof(float)  * n);
+	double *h_xd = (double*) malloc(sizeof(double) * n);
+	for (int i = 0; i < n; i++)
+	{
+		h_xf[i] = (float)  h_x[i] + 0.1f * (float) (i % 7);
+		h_xd[i] = (double) h_x[i] + 0.1  * (double) (i % 7);
+	}
+	const void *inputs[3] = {h_x, h_xf, h_xd};
+	
+	int *ref_keys = (int*) malloc(sizeof(int) * n);
+	int *dev_keys = (int*) malloc(sizeof(int) * n);
+	reduceResult_t *ref = (reduceResult_t*) malloc(sizeof(reduceResult_t) * n);
+	reduceResult_t *dev = (reduceResult_t*) malloc(sizeof(reduceResult_t) * n);
+	
+	printf("Testing reduce-by-key kernels\n");
+	setenv("REDUCE_CPU_FALLBACK", "0", 0);
+	const reduceOp_t ops[4] = {ReduceSum, ReduceMin, ReduceMax, ReduceArgmax};
+	for (int t = 0; t < 3; t++)
+	{
+		reduceType_t type = (reduceType_t) t;
+		for (int o = 0; o < 4; o++)
+		{
+			long long ref_nseg = reduceByKeyCPU(ops[o], type, keys, inputs[t], n, ref_keys, ref);
+			double st = omp_get_wtime();
+			long long dev_nseg = reduceByKeyHost(ops[o], type, keys, inputs[t], n, dev_keys, dev, program);
+			double ut = omp_get_wtime() - st;
+			
+			// Device and CPU results should be identical
+			long long nerr = (dev_nseg == ref_nseg) ? 0 : 1;
+			for (long long s = 0; (nerr == 0) && (s < ref_nseg); s++)
+			{
+				if ((dev_keys[s] != ref_keys[s]) || (dev[s].i != ref[s].i) || 
+					(dev[s].f != ref[s].f) || (dev[s].index != ref[s].index)) nerr++;
+			}
+			printf(
+				"%s reduce_segments_%s_%s: %lld segments, %lf (s)\n", nerr == 0 ? "Check passed" : "Check failed", 
+				getReduceOpName(ops[o]), getReduceTypeName(type), dev_nseg, ut
+			);
+		}
+	}
+	
+	free(keys);
+	free(h_xf);
+	free(h_xd);
+	free(ref_keys);
+	free(dev_keys);
+	free(ref);
+	free(dev);
+}
+
+void testReduceRepro(int *h_x, int n, cl_program program)
+{
+	// Mixed signs and magnitudes, so the fast sum depends on the order of additions
+	float *h_xf = (float*) malloc(sizeof(float) * n);
+	float *h_xs = (float*) malloc(sizeof(float) * n);
+	for (int i = 0; i < n; i++)
+	{
+		h_xf[i] = (float) ldexp((double) h_x[i] + 0.1 * (double) (i % 7), (i % 41) - 20);
+		if (i % 3 == 0) h_xf[i] = -h_xf[i];
+		h_xs[i] = h_xf[i];
+	}
+	for (int i = n - 1; i > 0; i--)
+	{
+		int j = rand() % (i + 1);
+		float tmp = h_xs[i];
+		h_xs[i] = h_xs[j];
+		h_xs[j] = tmp;
+	}
+	
+	printf("Testing reproducible float sum\n");
+	int ntest = 10, nthreads = omp_get_max_threads();
+	reduceResult_t fast, repro, res;
+	double st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++) reduceCPU(ReduceSum, ReduceFloat, h_xf, n, &fast);
+	double fast_t = (omp_get_wtime() - st) / (double) ntest;
+	st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++) reduceCPU(ReduceSumRepro, ReduceFloat, h_xf, n, &repro);
+	double repro_t = (omp_get_wtime() - st) / (double) ntest;
+	printf(
+		"CPU sum = %.17g, sum_repro = %.17g, %lf / %lf (s), sum_repro is %.2lf times slower\n",
+		fast.f, repro.f, fast_t, repro_t, repro_t / fast_t
+	);
+	
+	// The result should not change with the thread count or the order of the elements
+	int nerr = 0;
+	for (int nt = 1; nt <= nthreads; nt *= 2)
+	{
+		omp_set_num_threads(nt);
+		reduceCPU(ReduceSumRepro, ReduceFloat, h_xf, n, &res);
+		if (res.f != repro.f) nerr++;
+	}
+	omp_set_num_threads(nthreads);
+	reduceCPU(ReduceSumRepro, ReduceFloat, h_xs, n, &res);
+	if (res.f != repro.f) nerr++;
+	printf("%s CPU sum_repro with 1 ~ %d threads and shuffled input\n", nerr == 0 ? "Check passed" : "Check failed", nthreads);
+	
+	cl_mem d_x = (program != NULL) ? allocCLPoolBuffer(sizeof(float) * n, CL_MEM_READ_ONLY) : NULL;
+	if (d_x != NULL)
+	{
+		// Kernel chunks are not split like the OpenMP threads, but the result is the same
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		reduceResult_t dev_fast, dev_repro, dev_shuffled;
+		clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, sizeof(float) * n, h_xf, 0, NULL, NULL);
+		int ret = reduce(ReduceSum, ReduceFloat, d_x, n, &dev_fast, program);
+		st = omp_get_wtime();
+		for (int itest = 0; itest < ntest; itest++) reduce(ReduceSum, ReduceFloat, d_x, n, &dev_fast, program);
+		fast_t = (omp_get_wtime() - st) / (double) ntest;
+		ret |= reduce(ReduceSumRepro, ReduceFloat, d_x, n, &dev_repro, program);
+		st = omp_get_wtime();
+		for (int itest = 0; itest < ntest; itest++) reduce(ReduceSumRepro, ReduceFloat, d_x, n, &dev_repro, program);
+		repro_t = (omp_get_wtime() - st) / (double) ntest;
+		clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, sizeof(float) * n, h_xs, 0, NULL, NULL);
+		ret |= reduce(ReduceSumRepro, ReduceFloat, d_x, n, &dev_shuffled, program);
+		
+		int passed = (ret == 0) && (dev_repro.f == repro.f) && (dev_shuffled.f == repro.f);
+		printf(
+			"%s device sum = %.17g, sum_repro = %.17g, %lf / %lf (s), sum_repro is %.2lf times slower\n",
+			passed ? "Check passed" : "Check failed", dev_fast.f, dev_repro.f, fast_t, repro_t, repro_t / fast_t
+		);
+		freeCLPoolBuffer(d_x);
+	}
+	
+	free(h_xf);
+	free(h_xs);
+}
+
+void testReductionStream(int *h_x, int n, int refres, cl_program program)
+{
+	// Chunk size is not a multiple of the vector width, and the pieces pushed 
+	// by the host do not match the chunks
+	size_t chunk_size = (size_t) n / 5 + 13;
+	size_t piece_size = (size_t) n / 3 + 1;
+	printf("Testing streaming reduction kernels, chunk size = %zu\n", chunk_size);
+	
+	float *h_xf = (float*) malloc(sizeof(float) * n);
+	float refmin = INFINITY, refmax = -INFINITY;
+	for (int i = 0; i < n; i++) 
+	{
+		h_xf[i] = (float) h_x[i];
+		if (h_xf[i] < refmin) refmin = h_xf[i];
+		if (h_xf[i] > refmax) refmax = h_xf[i];
+	}
+	
+	reduceStream_t *stream = createReduceStream(program, chunk_size);
+	if (stream == NULL)
+	{
+		printf("Check failed, cannot create the stream\n");
+		free(h_xf);
+		return;
+	}
+	
+	// The data is pushed 3 times, the running sum after each round is checked
+	int passed = 1;
+	reduceStreamResult_t res;
+	double st = omp_get_wtime();
+	for (int r = 1; r <= 3; r++)
+	{
+		for (size_t spos = 0; spos < (size_t) n; spos += piece_size)
+		{
+			size_t leng = (size_t) n - spos;
+			if (leng > piece_size) leng = piece_size;
+			if (pushReduceStream(stream, h_xf + spos, leng) != 0) passed = 0;
+		}
+		getReduceStreamResult(stream, &res);
+		double relerr = fabs(res.sum - (double) refres * r) / fabs((double) refres * r);
+		if ((relerr > 1e-6) || (res.count != (unsigned long long) n * r)) passed = 0;
+		printf("Round %d: sum = %.1lf, ref sum = %.1lf, count = %llu, rel err = %e\n", r, res.sum, (double) refres * r, res.count, relerr);
+	}
+	if (finishReduceStream(stream, &res) != 0) passed = 0;
+	double ut = omp_get_wtime() - st;
+	double bw = sizeof(float) * (double) n * 3.0 / (ut * 1000000000.0);
+	if ((res.min != refmin) || (res.max != refmax)) passed = 0;
+	printf("3 rounds used time = %lf (s), effective bandwidth (including host copies) = %lf GB/s \n", ut, bw);
+	printf("%s, min = %f / %f, max = %f / %f\n", passed ? "Check passed" : "Check failed", res.min, refmin, res.max, refmax);
+	
+	free(h_xf);
 }
 
 int main(int argc, char **argv)
@@ -242,14 +591,27 @@ int main(int argc, char **argv)
 	);
 	
 	// Test traditional NDRange kernel
-	//testReductionNDKernel(x, n, nBytes, refres, context, queue, program);
+	testReductionNDKernel(x, n, nBytes, refres, context, queue, program);
 	
 	// Test single work-item kernel with 1 thread
 	testReductionSingleTask(x, n, nBytes, refres, context, queue, program);
 	
-	// Test single work-item kernel with 1 thread
+	// Test single work-item kernels with a shift-register accumulator, one compute unit
+	testReductionShiftReg(x, n, nBytes, refres, 0, context, queue, program);
+	testReductionShiftReg(x, n, nBytes, refres, 1, context, queue, program);
+	
+	// Test single work-item kernel with PARA_TASKS compute units
 	testReductionMultiTask(x, n, nBytes, refres, PARA_TASKS, context, queue, program);
 	
+	// Test typed reduction kernels
+	testReduceEngine(x, n, program);
+	testReduceByKey(x, n, program);
+	testReduceRepro(x, n, program);
+	
+	// Test streaming reduction kernels, they are in a separate kernel file
+	cl_program stream_program = getCLRuntimeProgram("my_reduction_stream.aocx");
+	testReductionStream(x, n, refres, stream_program);
+	
 	// Free device resources
 	clReleaseProgram(program);    // Release the program object
 	clReleaseCommandQueue(queue); // Release Command queue
@@ -0,0 +1,150 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <time.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/my_reduction.h"
+#include "scan.h"
+
+#define SCAN_BLOCK (SCAN_WG_SIZE * SCAN_ITEMS)  // Same as in scan.c
+
+// Bytes moved by one scan of n ints, x is read once and y is written once
+#define SCAN_BYTES(n) (2.0 * sizeof(int) * (double) (n))
+
+// Repeat small sizes so each measurement takes a while
+static int getScanBenchRepeats(const size_t n)
+{
+	size_t ntest = ((size_t) 1 << 26) / n;
+	if (ntest < 1)   ntest = 1;
+	if (ntest > 100) ntest = 100;
+	return (int) ntest;
+}
+
+static void benchScanDevice(
+	const scanMethod_t method, const char *method_name, const int *x, const int *ref, int *y,
+	const size_t n, cl_program program
+)
+{
+	size_t nBytes = sizeof(int) * n;
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_mem d_x = allocCLPoolBuffer(nBytes, CL_MEM_READ_ONLY);
+	cl_mem d_y = allocCLPoolBuffer(nBytes, CL_MEM_WRITE_ONLY);
+	if ((d_x == NULL) || (d_y == NULL))
+	{
+		printf(" | %s: out of device memory", method_name);
+		freeCLPoolBuffer(d_x);
+		freeCLPoolBuffer(d_y);
+		return;
+	}
+	clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, x, 0, NULL, NULL);
+
+	// Warm up and check
+	int ret = scan(method, 0, d_x, d_y, n, program);
+	if (ret == 0) clEnqueueReadBuffer(queue, d_y, CL_TRUE, 0, nBytes, y, 0, NULL, NULL);
+	int passed = (ret == 0) && (memcmp(y, ref, nBytes) == 0);
+
+	int ntest = getScanBenchRepeats(n);
+	double st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++) scan(method, 0, d_x, d_y, n, program);
+	double ut = (omp_get_wtime() - st) / (double) ntest;
+	printf(" | %s %8.3lf GB/s %s", method_name, SCAN_BYTES(n) / (ut * 1000000000.0), passed ? "ok    " : "FAILED");
+
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_y);
+}
+
+// Inclusive and exclusive scan of n elements on device against scanCPU(), return 1 if
+// both are the same
+static int checkScanDevice(const scanMethod_t method, const size_t n, cl_program program)
+{
+	size_t nBytes = sizeof(int) * n;
+	int *x   = (int*) malloc(nBytes);
+	int *ref = (int*) malloc(nBytes);
+	int *y   = (int*) malloc(nBytes);
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_mem d_x = allocCLPoolBuffer(nBytes, CL_MEM_READ_ONLY);
+	cl_mem d_y = allocCLPoolBuffer(nBytes, CL_MEM_WRITE_ONLY);
+	int passed = (x != NULL) && (ref != NULL) && (y != NULL) && (d_x != NULL) && (d_y != NULL);
+	if (passed)
+	{
+		for (size_t i = 0; i < n; i++) x[i] = rand() % 10;
+		clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, x, 0, NULL, NULL);
+	}
+	for (int exclusive = 0; (exclusive <= 1) && passed; exclusive++)
+	{
+		scanCPU(exclusive, x, ref, n);
+		int ret = scan(method, exclusive, d_x, d_y, n, program);
+		if (ret == 0) clEnqueueReadBuffer(queue, d_y, CL_TRUE, 0, nBytes, y, 0, NULL, NULL);
+		passed = (ret == 0) && (memcmp(y, ref, nBytes) == 0);
+	}
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_y);
+	free(x);
+	free(ref);
+	free(y);
+	return passed;
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_n = (size_t) 1 << 30;
+	if (argc >= 2) max_n = (size_t) atoll(argv[1]);
+	if (max_n < 1024)
+	{
+		printf("Usage: %s <max length, at least 1024, default 2^30>\n", argv[0]);
+		return 255;
+	}
+
+	int *x   = (int*) malloc(sizeof(int) * max_n);
+	int *ref = (int*) malloc(sizeof(int) * max_n);
+	int *y   = (int*) malloc(sizeof(int) * max_n);
+	if ((x == NULL) || (ref == NULL) || (y == NULL))
+	{
+		printf("[ERROR] Cannot allocate host arrays for %zu elements\n", max_n);
+		return 255;
+	}
+	srand(time(NULL));
+	for (size_t i = 0; i < max_n; i++) x[i] = rand() % 10;
+
+	// The kernels are built from device/my_scan.cl on a non-FPGA OpenCL device
+	cl_program program = getCLRuntimeProgram("my_scan.aocx");
+	if (program == NULL) printf("No OpenCL program for my_scan.aocx, only the CPU scan is tested\n");
+
+	// Inclusive and exclusive scan for lengths that are not a multiple of SCAN_BLOCK, the
+	// last one needs more than one level of block sums in ScanBlock
+	const size_t check_n[3] = {1000, 3 * SCAN_BLOCK + 5, (size_t) SCAN_BLOCK * SCAN_BLOCK + SCAN_BLOCK + 17};
+	for (int i = 0; (i < 3) && (program != NULL); i++)
+	{
+		printf("Check inclusive and exclusive scan, n = %zu:", check_n[i]);
+		printf(" block %s,", checkScanDevice(ScanBlock, check_n[i], program) ? "passed" : "FAILED");
+		printf(" task %s\n",  checkScanDevice(ScanTask,  check_n[i], program) ? "passed" : "FAILED");
+	}
+
+	// Inclusive scan, bandwidth counts one read of x and one write of y
+	printf("Inclusive int scan, effective bandwidth:\n");
+	for (size_t n = 1024; n <= max_n; n *= 4)
+	{
+		int ntest = getScanBenchRepeats(n);
+		scanCPU(0, x, ref, n);
+		double st = omp_get_wtime();
+		for (int itest = 0; itest < ntest; itest++) scanCPU(0, x, ref, n);
+		double ut = (omp_get_wtime() - st) / (double) ntest;
+		printf("%11zu | CPU %8.3lf GB/s", n, SCAN_BYTES(n) / (ut * 1000000000.0));
+
+		if (program != NULL)
+		{
+			benchScanDevice(ScanBlock, "block", x, ref, y, n, program);
+			benchScanDevice(ScanTask,  "task",  x, ref, y, n, program);
+		}
+		printf("\n");
+	}
+
+	free(x);
+	free(ref);
+	free(y);
+	return 0;
+}
@@ -0,0 +1,693 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/my_reduction.h"
+#include "reduce.h"
+
+// Inputs shorter than this are reduced by one kernel instead of RED_COMPUTE_UNITS chunks
+#define REDUCE_MIN_CHUNK 4096
+
+const char *getReduceOpName(const reduceOp_t op)
+{
+	switch (op)
+	{
+		case ReduceSum:    return "sum";
+		case ReduceMin:    return "min";
+		case ReduceMax:    return "max";
+		case ReduceArgmax: return "argmax";
+		case ReduceSumRepro: return "sum_repro";
+	}
+	return NULL;
+}
+
+const char *getReduceTypeName(const reduceType_t type)
+{
+	switch (type)
+	{
+		case ReduceInt:    return "int";
+		case ReduceFloat:  return "float";
+		case ReduceDouble: return "double";
+	}
+	return NULL;
+}
+
+size_t getReduceTypeSize(const reduceType_t type)
+{
+	switch (type)
+	{
+		case ReduceInt:    return sizeof(int);
+		case ReduceFloat:  return sizeof(float);
+		case ReduceDouble: return sizeof(double);
+	}
+	return 0;
+}
+
+size_t getReduceAccSize(const reduceOp_t op, const reduceType_t type)
+{
+	if ((type == ReduceInt) && (op == ReduceSum)) return sizeof(cl_long);
+	if (op == ReduceSumRepro) return sizeof(cl_long) * REPRO_BINS;
+	return getReduceTypeSize(type);
+}
+
+// Bins of ReduceSumRepro, bin b has weight 2^(4 * b - 150). Digits are the bins after
+// carrying, extra digits hold the carries out of the top bin.
+#define REPRO_DIGITS (REPRO_BINS + 16)
+#define REPRO_NAN    1
+#define REPRO_PINF   2
+#define REPRO_NINF   4
+
+// Add the bins of float x[i] for spos <= i < epos, as reduce_sum_repro_float
+static void addReproBins(const float *x, const size_t spos, const size_t epos, long long *bins, long long *special)
+{
+	for (size_t i = spos; i < epos; i++)
+	{
+		unsigned int u;
+		memcpy(&u, &x[i], sizeof(u));
+		int e = (u >> 23) & 0xFF;
+		long long m = u & 0x7FFFFF;
+		if (e == 0xFF)
+		{
+			*special |= (m != 0) ? REPRO_NAN : ((u >> 31) ? REPRO_NINF : REPRO_PINF);
+			continue;
+		}
+		if (e != 0) m |= 0x800000;
+		else e = 1;
+		m <<= (e & 3);
+		bins[e >> 2] += (u >> 31) ? -m : m;
+	}
+}
+
+// Round the exact sum in bins to double. The result only depends on the exact sum.
+static double getReproSum(const long long *bins, const long long special)
+{
+	if ((special & REPRO_NAN) || ((special & REPRO_PINF) && (special & REPRO_NINF))) return NAN;
+	if (special & REPRO_PINF) return INFINITY;
+	if (special & REPRO_NINF) return -INFINITY;
+
+	// Carry so that all digits except the top one are in [0, 16)
+	long long d[REPRO_DIGITS];
+	for (int b = 0; b < REPRO_DIGITS; b++) d[b] = (b < REPRO_BINS) ? bins[b] : 0;
+	for (int b = 0; b < REPRO_DIGITS - 1; b++)
+	{
+		long long carry = d[b] >> 4;
+		d[b] -= carry * 16;
+		d[b + 1] += carry;
+	}
+
+	// A negative sum is negated so all digits are non-negative
+	double sign = 1.0;
+	if (d[REPRO_DIGITS - 1] < 0)
+	{
+		sign = -1.0;
+		for (int b = 0; b < REPRO_DIGITS; b++) d[b] = -d[b];
+		for (int b = 0; b < REPRO_DIGITS - 1; b++)
+		{
+			long long carry = d[b] >> 4;
+			d[b] -= carry * 16;
+			d[b + 1] += carry;
+		}
+	}
+
+	// Adding from the most significant digit down is within 1 ulp of the exact sum
+	double sum = 0.0;
+	for (int b = REPRO_DIGITS - 1; b >= 0; b--) sum += ldexp((double) d[b], 4 * b - 150);
+	return sign * sum;
+}
+
+// Result of an empty input
+static void setReduceIdentity(const reduceOp_t op, const reduceType_t type, reduceResult_t *res)
+{
+	res->i = 0;
+	res->f = 0.0;
+	res->index = -1;
+	if (op == ReduceMin)
+	{
+		res->i = INT_MAX;
+		res->f = INFINITY;
+	}
+	if ((op == ReduceMax) || (op == ReduceArgmax))
+	{
+		res->i = INT_MIN;
+		res->f = -INFINITY;
+	}
+}
+
+// Value of partial result i in a buffer of partial results read from device.
+// int sums are long, all other partial results have the element type.
+static void getReducePartial(
+	const reduceOp_t op, const reduceType_t type, const void *val, const size_t i,
+	long long *ival, double *fval
+)
+{
+	*ival = 0;
+	*fval = 0.0;
+	if (type == ReduceInt)
+	{
+		if (op == ReduceSum) *ival = ((const cl_long *) val)[i];
+		else *ival = ((const cl_int *) val)[i];
+	}
+	if (type == ReduceFloat)  *fval = ((const cl_float *)  val)[i];
+	if (type == ReduceDouble) *fval = ((const cl_double *) val)[i];
+}
+
+int reduce(
+	const reduceOp_t op, const reduceType_t type, cl_mem x, const size_t n,
+	reduceResult_t *res, cl_program program
+)
+{
+	if ((getReduceOpName(op) == NULL) || (getReduceTypeName(type) == NULL) || (res == NULL)) return -1;
+	if ((op == ReduceSumRepro) && (type != ReduceFloat)) return -1;
+	setReduceIdentity(op, type, res);
+	if (n == 0) return 0;
+	if ((x == NULL) || (program == NULL)) return -1;
+
+	char kernel_name[64];
+	snprintf(kernel_name, sizeof(kernel_name), "reduce_%s_%s", getReduceOpName(op), getReduceTypeName(type));
+
+	int nchunks = (n < (size_t) REDUCE_MIN_CHUNK * RED_COMPUTE_UNITS) ? 1 : RED_COMPUTE_UNITS;
+	if (nchunks > CL_RUNTIME_MAX_QUEUES) nchunks = CL_RUNTIME_MAX_QUEUES;
+	size_t val_bytes = getReduceAccSize(op, type);
+
+	cl_int err;
+	cl_kernel kernels[CL_RUNTIME_MAX_QUEUES];
+	for (int c = 0; c < nchunks; c++)
+	{
+		kernels[c] = clCreateKernel(program, kernel_name, &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clCreateKernel() failed for %s, returned status = %d\n", kernel_name, err);
+			for (int i = 0; i < c; i++) clReleaseKernel(kernels[i]);
+			return -1;
+		}
+	}
+	cl_mem d_val = allocCLPoolBuffer(val_bytes * nchunks,       CL_MEM_READ_WRITE);
+	cl_mem d_idx = allocCLPoolBuffer(sizeof(cl_long) * nchunks, CL_MEM_READ_WRITE);
+
+	// Launch all chunks on separate queues so they run on different compute units
+	cl_event kernel_exec[CL_RUNTIME_MAX_QUEUES];
+	int nlaunched = 0;
+	err = ((d_val == NULL) || (d_idx == NULL)) ? CL_OUT_OF_RESOURCES : CL_SUCCESS;
+	for (int c = 0; (c < nchunks) && (err == CL_SUCCESS); c++)
+	{
+		cl_ulong spos = (cl_ulong) (n * c / nchunks);
+		cl_ulong epos = (cl_ulong) (n * (c + 1) / nchunks);
+		cl_ulong leng = epos - spos;
+		cl_int   cidx = c;
+		err |= clSetKernelArg(kernels[c], 0, sizeof(cl_mem),   (void*) &x);
+		err |= clSetKernelArg(kernels[c], 1, sizeof(cl_ulong), (void*) &spos);
+		err |= clSetKernelArg(kernels[c], 2, sizeof(cl_ulong), (void*) &leng);
+		err |= clSetKernelArg(kernels[c], 3, sizeof(cl_mem),   (void*) &d_val);
+		err |= clSetKernelArg(kernels[c], 4, sizeof(cl_mem),   (void*) &d_idx);
+		err |= clSetKernelArg(kernels[c], 5, sizeof(cl_int),   (void*) &cidx);
+		if (err == CL_SUCCESS) err = clEnqueueTask(getCLRuntimeQueue(c), kernels[c], 0, NULL, &kernel_exec[c]);
+		if (err == CL_SUCCESS) nlaunched++;
+	}
+	if (nlaunched > 0) clWaitForEvents(nlaunched, kernel_exec);
+	for (int c = 0; c < nlaunched; c++) clReleaseEvent(kernel_exec[c]);
+	if (err != CL_SUCCESS) printf("[ERROR] Launching %s failed, returned status = %d\n", kernel_name, err);
+
+	// Combine the partial results of all chunks
+	cl_long h_val[REPRO_BINS * CL_RUNTIME_MAX_QUEUES];
+	cl_long h_idx[CL_RUNTIME_MAX_QUEUES];
+	if (err == CL_SUCCESS)
+	{
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		err  = clEnqueueReadBuffer(queue, d_val, CL_TRUE, 0, val_bytes * nchunks,       h_val, 0, NULL, NULL);
+		err |= clEnqueueReadBuffer(queue, d_idx, CL_TRUE, 0, sizeof(cl_long) * nchunks, h_idx, 0, NULL, NULL);
+		if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+	}
+	if ((err == CL_SUCCESS) && (op == ReduceSumRepro))
+	{
+		// Integer adds of the bins, the order of the chunks does not matter
+		long long bins[REPRO_BINS] = {0}, special = 0;
+		for (int c = 0; c < nchunks; c++)
+		{
+			for (int k = 0; k < REPRO_BINS; k++) bins[k] += h_val[c * REPRO_BINS + k];
+			special |= h_idx[c];
+		}
+		res->f = getReproSum(bins, special);
+	}
+	if ((err == CL_SUCCESS) && (op != ReduceSumRepro))
+	{
+		double comp = 0.0;
+		for (int c = 0; c < nchunks; c++)
+		{
+			long long ival;
+			double    fval;
+			getReducePartial(op, type, h_val, c, &ival, &fval);
+			if (op == ReduceSum)
+			{
+				res->i += ival;
+				double y = fval - comp;
+				double t = res->f + y;
+				comp   = (t - res->f) - y;
+				res->f = t;
+			}
+			if (op == ReduceMin)
+			{
+				if (ival < res->i) res->i = ival;
+				if (fval < res->f) res->f = fval;
+			}
+			if (op == ReduceMax)
+			{
+				if (ival > res->i) res->i = ival;
+				if (fval > res->f) res->f = fval;
+			}
+			// Chunks are in index order, so the strict compare keeps the first maximum
+			if ((op == ReduceArgmax) && (h_idx[c] != -1))
+			{
+				int better = (type == ReduceInt) ? (ival > res->i) : (fval > res->f);
+				if ((res->index == -1) || better)
+				{
+					res->i = ival;
+					res->f = fval;
+					res->index = h_idx[c];
+				}
+			}
+		}
+		if (type != ReduceInt) res->i = 0;
+		else res->f = 0.0;
+	}
+
+	for (int c = 0; c < nchunks; c++) clReleaseKernel(kernels[c]);
+	freeCLPoolBuffer(d_val);
+	freeCLPoolBuffer(d_idx);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+int reduceHost(
+	const reduceOp_t op, const reduceType_t type, const void *x, const size_t n,
+	reduceResult_t *res, cl_program program
+)
+{
+	// CPU fallback, the OpenCL device is not an FPGA
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("REDUCE_CPU_FALLBACK");
+	int use_cpu = (rt == NULL) || (program == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (program != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) use_cpu = 0;
+	if (use_cpu) return reduceCPU(op, type, x, n, res);
+
+	if ((getReduceTypeName(type) == NULL) || ((x == NULL) && (n > 0))) return -1;
+	if (n == 0) return reduce(op, type, NULL, 0, res, program);
+
+	size_t nBytes = getReduceTypeSize(type) * n;
+	cl_mem d_x = allocCLPoolBuffer(nBytes, CL_MEM_READ_ONLY);
+	if (d_x == NULL) return -1;
+	cl_int err = clEnqueueWriteBuffer(getCLRuntimeQueue(0), d_x, CL_TRUE, 0, nBytes, x, 0, NULL, NULL);
+	int ret = -1;
+	if (err == CL_SUCCESS) ret = reduce(op, type, d_x, n, res, program);
+	else printf("[ERROR] clEnqueueWriteBuffer() failed, returned status = %d\n", err);
+	freeCLPoolBuffer(d_x);
+	return ret;
+}
+
+// Get element i of x as an integer or a floating point value
+static inline void getReduceElement(
+	const reduceType_t type, const void *x, const size_t i,
+	long long *ival, double *fval
+)
+{
+	*ival = 0;
+	*fval = 0.0;
+	if (type == ReduceInt)    *ival = ((const int *) x)[i];
+	if (type == ReduceFloat)  *fval = ((const float *) x)[i];
+	if (type == ReduceDouble) *fval = ((const double *) x)[i];
+}
+
+int reduceCPU(
+	const reduceOp_t op, const reduceType_t type, const void *x, const size_t n,
+	reduceResult_t *res
+)
+{
+	if ((getReduceOpName(op) == NULL) || (getReduceTypeName(type) == NULL) || (res == NULL)) return -1;
+	if ((x == NULL) && (n > 0)) return -1;
+	if ((op == ReduceSumRepro) && (type != ReduceFloat)) return -1;
+	setReduceIdentity(op, type, res);
+	if (n == 0) return 0;
+
+	if (op == ReduceSumRepro)
+	{
+		long long bins[REPRO_BINS] = {0}, special = 0;
+		#pragma omp parallel
+		{
+			long long t_bins[REPRO_BINS] = {0}, t_special = 0;
+			int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+			addReproBins((const float *) x, n * tid / nt, n * (tid + 1) / nt, t_bins, &t_special);
+			#pragma omp critical
+			{
+				for (int k = 0; k < REPRO_BINS; k++) bins[k] += t_bins[k];
+				special |= t_special;
+			}
+		}
+		res->f = getReproSum(bins, special);
+		return 0;
+	}
+
+	int nthreads = omp_get_max_threads();
+	reduceResult_t *part = (reduceResult_t*) malloc(sizeof(reduceResult_t) * nthreads);
+	double *comp = (double*) malloc(sizeof(double) * nthreads);
+	if ((part == NULL) || (comp == NULL))
+	{
+		free(part);
+		free(comp);
+		return -1;
+	}
+
+	// Each thread reduces a contiguous block, blocks are combined in index order
+	#pragma omp parallel num_threads(nthreads)
+	{
+		int tid = omp_get_thread_num();
+		size_t spos = n * tid / nthreads;
+		size_t epos = n * (tid + 1) / nthreads;
+		reduceResult_t r;
+		double c = 0.0;
+		setReduceIdentity(op, type, &r);
+		for (size_t i = spos; i < epos; i++)
+		{
+			long long ival;
+			double    fval;
+			getReduceElement(type, x, i, &ival, &fval);
+			if (op == ReduceSum)
+			{
+				r.i += ival;
+				double y = fval - c;
+				double t = r.f + y;
+				c   = (t - r.f) - y;
+				r.f = t;
+			}
+			if (op == ReduceMin)
+			{
+				if (ival < r.i) r.i = ival;
+				if (fval < r.f) r.f = fval;
+			}
+			if (op == ReduceMax)
+			{
+				if (ival > r.i) r.i = ival;
+				if (fval > r.f) r.f = fval;
+			}
+			if (op == ReduceArgmax)
+			{
+				int better = (type == ReduceInt) ? (ival > r.i) : (fval > r.f);
+				if ((r.index == -1) || better)
+				{
+					r.i = ival;
+					r.f = fval;
+					r.index = (long long) i;
+				}
+			}
+		}
+		part[tid] = r;
+		comp[tid] = c;
+	}
+
+	double c = 0.0;
+	for (int t = 0; t < nthreads; t++)
+	{
+		if (op == ReduceSum)
+		{
+			res->i += part[t].i;
+			double y = (part[t].f - comp[t]) - c;
+			double s = res->f + y;
+			c = (s - res->f) - y;
+			res->f = s;
+		}
+		if (op == ReduceMin)
+		{
+			if (part[t].i < res->i) res->i = part[t].i;
+			if (part[t].f < res->f) res->f = part[t].f;
+		}
+		if (op == ReduceMax)
+		{
+			if (part[t].i > res->i) res->i = part[t].i;
+			if (part[t].f > res->f) res->f = part[t].f;
+		}
+		if ((op == ReduceArgmax) && (part[t].index != -1))
+		{
+			int better = (type == ReduceInt) ? (part[t].i > res->i) : (part[t].f > res->f);
+			if ((res->index == -1) || better) *res = part[t];
+		}
+	}
+	if (type != ReduceInt) res->i = 0;
+	else res->f = 0.0;
+
+	free(part);
+	free(comp);
+	return 0;
+}
+
+int reduceSegments(
+	const reduceOp_t op, const reduceType_t type, cl_mem x, cl_mem offsets, const size_t nseg,
+	cl_mem res_val, cl_mem res_idx, cl_program program
+)
+{
+	if ((getReduceOpName(op) == NULL) || (getReduceTypeName(type) == NULL) || (op == ReduceSumRepro)) return -1;
+	if (nseg == 0) return 0;
+	if ((x == NULL) || (offsets == NULL) || (res_val == NULL) || (res_idx == NULL) || (program == NULL)) return -1;
+	if (nseg > 0xFFFFFFFFULL - 1) return -1;
+
+	char kernel_name[64];
+	snprintf(kernel_name, sizeof(kernel_name), "reduce_segments_%s_%s", getReduceOpName(op), getReduceTypeName(type));
+
+	int nchunks = (nseg < (size_t) 64 * RED_COMPUTE_UNITS) ? 1 : RED_COMPUTE_UNITS;
+	if (nchunks > CL_RUNTIME_MAX_QUEUES) nchunks = CL_RUNTIME_MAX_QUEUES;
+
+	cl_int err;
+	cl_kernel kernels[CL_RUNTIME_MAX_QUEUES];
+	for (int c = 0; c < nchunks; c++)
+	{
+		kernels[c] = clCreateKernel(program, kernel_name, &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clCreateKernel() failed for %s, returned status = %d\n", kernel_name, err);
+			for (int i = 0; i < c; i++) clReleaseKernel(kernels[i]);
+			return -1;
+		}
+	}
+
+	cl_event kernel_exec[CL_RUNTIME_MAX_QUEUES];
+	int nlaunched = 0;
+	err = CL_SUCCESS;
+	for (int c = 0; (c < nchunks) && (err == CL_SUCCESS); c++)
+	{
+		cl_uint seg_begin = (cl_uint) (nseg * c / nchunks);
+		cl_uint seg_end   = (cl_uint) (nseg * (c + 1) / nchunks);
+		err |= clSetKernelArg(kernels[c], 0, sizeof(cl_mem),  (void*) &x);
+		err |= clSetKernelArg(kernels[c], 1, sizeof(cl_mem),  (void*) &offsets);
+		err |= clSetKernelArg(kernels[c], 2, sizeof(cl_uint), (void*) &seg_begin);
+		err |= clSetKernelArg(kernels[c], 3, sizeof(cl_uint), (void*) &seg_end);
+		err |= clSetKernelArg(kernels[c], 4, sizeof(cl_mem),  (void*) &res_val);
+		err |= clSetKernelArg(kernels[c], 5, sizeof(cl_mem),  (void*) &res_idx);
+		if (err == CL_SUCCESS) err = clEnqueueTask(getCLRuntimeQueue(c), kernels[c], 0, NULL, &kernel_exec[c]);
+		if (err == CL_SUCCESS) nlaunched++;
+	}
+	if (nlaunched > 0) clWaitForEvents(nlaunched, kernel_exec);
+	for (int c = 0; c < nlaunched; c++) clReleaseEvent(kernel_exec[c]);
+	if (err != CL_SUCCESS) printf("[ERROR] Launching %s failed, returned status = %d\n", kernel_name, err);
+
+	for (int c = 0; c < nchunks; c++) clReleaseKernel(kernels[c]);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+// Check that offsets has nseg + 1 non-decreasing entries starting from 0
+static int checkReduceSegments(const long long *offsets, const size_t nseg)
+{
+	if (offsets == NULL) return -1;
+	if (offsets[0] != 0) return -1;
+	for (size_t s = 0; s < nseg; s++)
+		if (offsets[s + 1] < offsets[s]) return -1;
+	return 0;
+}
+
+int reduceSegmentsHost(
+	const reduceOp_t op, const reduceType_t type, const void *x, const long long *offsets,
+	const size_t nseg, reduceResult_t *res, cl_program program
+)
+{
+	// CPU fallback, the OpenCL device is not an FPGA
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("REDUCE_CPU_FALLBACK");
+	int use_cpu = (rt == NULL) || (program == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (program != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) use_cpu = 0;
+	if (use_cpu) return reduceSegmentsCPU(op, type, x, offsets, nseg, res);
+
+	if ((getReduceOpName(op) == NULL) || (getReduceTypeName(type) == NULL) || (op == ReduceSumRepro)) return -1;
+	if ((checkReduceSegments(offsets, nseg) != 0) || ((res == NULL) && (nseg > 0))) return -1;
+	if (nseg == 0) return 0;
+	size_t n = (size_t) offsets[nseg];
+	if ((x == NULL) && (n > 0)) return -1;
+
+	// Buffers are not allowed to be empty
+	size_t x_bytes   = getReduceTypeSize(type) * (n > 0 ? n : 1);
+	size_t off_bytes = sizeof(cl_long) * (nseg + 1);
+	size_t val_bytes = getReduceAccSize(op, type) * nseg;
+	size_t idx_bytes = sizeof(cl_long) * nseg;
+	cl_mem d_x   = allocCLPoolBuffer(x_bytes,   CL_MEM_READ_ONLY);
+	cl_mem d_off = allocCLPoolBuffer(off_bytes, CL_MEM_READ_ONLY);
+	cl_mem d_val = allocCLPoolBuffer(val_bytes, CL_MEM_READ_WRITE);
+	cl_mem d_idx = allocCLPoolBuffer(idx_bytes, CL_MEM_READ_WRITE);
+	void    *h_val = malloc(val_bytes);
+	cl_long *h_idx = (cl_long*) malloc(idx_bytes);
+
+	int ret = -1;
+	if ((d_x != NULL) && (d_off != NULL) && (d_val != NULL) && (d_idx != NULL) && (h_val != NULL) && (h_idx != NULL))
+	{
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		cl_int err = CL_SUCCESS;
+		if (n > 0) err |= clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, getReduceTypeSize(type) * n, x, 0, NULL, NULL);
+		err |= clEnqueueWriteBuffer(queue, d_off, CL_TRUE, 0, off_bytes, offsets, 0, NULL, NULL);
+		if (err != CL_SUCCESS) printf("[ERROR] clEnqueueWriteBuffer() failed, returned status = %d\n", err);
+		if (err == CL_SUCCESS) ret = reduceSegments(op, type, d_x, d_off, nseg, d_val, d_idx, program);
+		if (ret == 0)
+		{
+			err  = clEnqueueReadBuffer(queue, d_val, CL_TRUE, 0, val_bytes, h_val, 0, NULL, NULL);
+			err |= clEnqueueReadBuffer(queue, d_idx, CL_TRUE, 0, idx_bytes, h_idx, 0, NULL, NULL);
+			if (err != CL_SUCCESS)
+			{
+				printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+				ret = -1;
+			}
+		}
+		for (size_t s = 0; (ret == 0) && (s < nseg); s++)
+		{
+			getReducePartial(op, type, h_val, s, &res[s].i, &res[s].f);
+			res[s].index = h_idx[s];
+		}
+	}
+
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_off);
+	freeCLPoolBuffer(d_val);
+	freeCLPoolBuffer(d_idx);
+	free(h_val);
+	free(h_idx);
+	return ret;
+}
+
+// Reduce x[spos : epos] one element after another, the same way as the
+// reduce_segments_<op>_<type> kernels, T is the element type and ACC the partial
+// result type of sums
+#define DEFINE_REDUCE_SEGMENT_CPU(name, T, ACC, KAHAN, LOWEST, HIGHEST) \
+static void name( \
+	const reduceOp_t op, const T *x, const long long spos, const long long epos, \
+	long long *ival, double *fval, long long *index \
+) \
+{ \
+	*index = -1; \
+	if (op == ReduceSum) \
+	{ \
+		ACC acc = 0, comp = 0; \
+		for (long long i = spos; i < epos; i++) \
+		{ \
+			if (KAHAN) \
+			{ \
+				ACC y = (ACC) x[i] - comp; \
+				ACC t = acc + y; \
+				comp = (t - acc) - y; \
+				acc  = t; \
+			} else { \
+				acc += (ACC) x[i]; \
+			} \
+		} \
+		*ival = (long long) acc; \
+		*fval = (double) acc; \
+		return; \
+	} \
+	T acc = (op == ReduceMin) ? (HIGHEST) : (LOWEST); \
+	for (long long i = spos; i < epos; i++) \
+	{ \
+		if ((op == ReduceMin) && (x[i] < acc)) acc = x[i]; \
+		if ((op == ReduceMax) && (x[i] > acc)) acc = x[i]; \
+		if ((op == ReduceArgmax) && ((*index == -1) || (x[i] > acc))) \
+		{ \
+			acc = x[i]; \
+			*index = i; \
+		} \
+	} \
+	*ival = (long long) acc; \
+	*fval = (double) acc; \
+}
+
+DEFINE_REDUCE_SEGMENT_CPU(reduceSegmentCPUInt,    int,    long long, 0, INT_MIN,   INT_MAX)
+DEFINE_REDUCE_SEGMENT_CPU(reduceSegmentCPUFloat,  float,  float,     1, -INFINITY, INFINITY)
+DEFINE_REDUCE_SEGMENT_CPU(reduceSegmentCPUDouble, double, double,    1, -INFINITY, INFINITY)
+
+int reduceSegmentsCPU(
+	const reduceOp_t op, const reduceType_t type, const void *x, const long long *offsets,
+	const size_t nseg, reduceResult_t *res
+)
+{
+	if ((getReduceOpName(op) == NULL) || (getReduceTypeName(type) == NULL) || (op == ReduceSumRepro)) return -1;
+	if ((checkReduceSegments(offsets, nseg) != 0) || ((res == NULL) && (nseg > 0))) return -1;
+	if ((x == NULL) && (nseg > 0) && (offsets[nseg] > 0)) return -1;
+
+	// Segments can be very different in length
+	#pragma omp parallel for schedule(dynamic, 64)
+	for (size_t s = 0; s < nseg; s++)
+	{
+		long long ival, index;
+		double    fval;
+		if (type == ReduceInt)        reduceSegmentCPUInt   (op, (const int *)    x, offsets[s], offsets[s + 1], &ival, &fval, &index);
+		else if (type == ReduceFloat) reduceSegmentCPUFloat (op, (const float *)  x, offsets[s], offsets[s + 1], &ival, &fval, &index);
+		else                          reduceSegmentCPUDouble(op, (const double *) x, offsets[s], offsets[s + 1], &ival, &fval, &index);
+		res[s].i     = (type == ReduceInt) ? ival : 0;
+		res[s].f     = (type == ReduceInt) ? 0.0  : fval;
+		res[s].index = index;
+	}
+	return 0;
+}
+
+// Find the runs of equal keys, offsets needs room for n + 1 entries. Returns the number of runs.
+static size_t getReduceKeySegments(const int *keys, const size_t n, int *unique_keys, long long *offsets)
+{
+	size_t nseg = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if ((i > 0) && (keys[i] == keys[i - 1])) continue;
+		unique_keys[nseg] = keys[i];
+		offsets[nseg] = (long long) i;
+		nseg++;
+	}
+	offsets[nseg] = (long long) n;
+	return nseg;
+}
+
+static long long reduceByKey(
+	const reduceOp_t op, const reduceType_t type, const int *keys, const void *x, const size_t n,
+	int *unique_keys, reduceResult_t *res, cl_program program, const int use_cpu
+)
+{
+	if ((n > 0) && ((keys == NULL) || (x == NULL) || (unique_keys == NULL) || (res == NULL))) return -1;
+	long long *offsets = (long long*) malloc(sizeof(long long) * (n + 1));
+	if (offsets == NULL) return -1;
+
+	size_t nseg = getReduceKeySegments(keys, n, unique_keys, offsets);
+	int ret;
+	if (use_cpu) ret = reduceSegmentsCPU(op, type, x, offsets, nseg, res);
+	else ret = reduceSegmentsHost(op, type, x, offsets, nseg, res, program);
+
+	free(offsets);
+	return (ret == 0) ? (long long) nseg : -1;
+}
+
+long long reduceByKeyHost(
+	const reduceOp_t op, const reduceType_t type, const int *keys, const void *x, const size_t n,
+	int *unique_keys, reduceResult_t *res, cl_program program
+)
+{
+	return reduceByKey(op, type, keys, x, n, unique_keys, res, program, 0);
+}
+
+long long reduceByKeyCPU(
+	const reduceOp_t op, const reduceType_t type, const int *keys, const void *x, const size_t n,
+	int *unique_keys, reduceResult_t *res
+)
+{
+	return reduceByKey(op, type, keys, x, n, unique_keys, res, NULL, 1);
+}
@@ -0,0 +1,113 @@
+#ifndef __REDUCE_H__
+#define __REDUCE_H__
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+// Typed reductions with the reduce_<op>_<type> kernels in my_reduction.cl.
+// Sums of int are accumulated in 64-bit integers and are exact. Sums of float and
+// double use Kahan compensated summation, min / max / argmax are exact. Argmax
+// returns the index of the first maximum. double kernels are only built if the
+// device supports cl_khr_fp64.
+// ReduceSumRepro is a reproducible sum of float: every element is added exactly into
+// integer bins and the exact sum is rounded once, so the result is bit-identical for
+// any split of the input over compute units, chunks or threads, and for any order of
+// the elements. It is accurate to 1 ulp of the result in double. The kernel handles
+// REPRO_LANES elements per cycle where the fast sum handles RED_LANES, so it is at most
+// RED_LANES / REPRO_LANES (2) times slower when not limited by memory bandwidth. The
+// bins are exact for up to 2^36 elements.
+// Functions return 0 on success and -1 on invalid arguments or OpenCL errors.
+
+typedef enum {ReduceSum = 0, ReduceMin, ReduceMax, ReduceArgmax, ReduceSumRepro} reduceOp_t;
+typedef enum {ReduceInt = 0, ReduceFloat, ReduceDouble} reduceType_t;
+
+typedef struct
+{
+	long long i;      // Result of int reductions
+	double    f;      // Result of float and double reductions
+	long long index;  // Index of the maximum for argmax, -1 for other operators
+} reduceResult_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Name of an operator or a type as used in the kernel names, e.g. "argmax" and "float"
+const char *getReduceOpName(const reduceOp_t op);
+const char *getReduceTypeName(const reduceType_t type);
+
+// Size in bytes of one element of type
+size_t getReduceTypeSize(const reduceType_t type);
+
+// Size in bytes of one partial result on device: 8 for int sums, REPRO_BINS * 8 for
+// ReduceSumRepro, the element size otherwise
+size_t getReduceAccSize(const reduceOp_t op, const reduceType_t type);
+
+// Reduce the first n elements of device buffer x. The input is split into
+// RED_COMPUTE_UNITS chunks, which are reduced on runtime queues 0, 1, ... and
+// combined on host. The call blocks until the result is ready.
+int reduce(
+	const reduceOp_t op, const reduceType_t type, cl_mem x, const size_t n,
+	reduceResult_t *res, cl_program program
+);
+
+// Reduce n elements of host array x on device. If there is no FPGA (or program is
+// NULL), reduceCPU() is used instead; set $REDUCE_CPU_FALLBACK to 0 to use the
+// OpenCL device anyway.
+int reduceHost(
+	const reduceOp_t op, const reduceType_t type, const void *x, const size_t n,
+	reduceResult_t *res, cl_program program
+);
+
+// Reference on CPU with OpenMP. float sums are accumulated in double, double sums
+// use Kahan summation, ReduceSumRepro gives the same result as on device. An empty input gives 0 for sums, the identity of the operator
+// for min / max and index -1 for argmax, as on device.
+int reduceCPU(
+	const reduceOp_t op, const reduceType_t type, const void *x, const size_t n,
+	reduceResult_t *res
+);
+
+// Segmented reductions with the reduce_segments_<op>_<type> kernels. Segment s is
+// x[offsets[s] : offsets[s + 1]], offsets has nseg + 1 non-decreasing entries, and
+// argmax indices are indices in x. Elements of each segment are accumulated one by
+// one in index order with the same types and operations on device and on CPU, so
+// their results are identical. An empty segment gives the result of an empty input.
+// ReduceSumRepro is not supported for segments.
+
+// x and offsets (cl_long) are device buffers. res_val gets nseg partial results of
+// getReduceAccSize() bytes and res_idx gets nseg cl_long indices. Segments are split
+// into RED_COMPUTE_UNITS ranges on runtime queues 0, 1, ... The call blocks.
+int reduceSegments(
+	const reduceOp_t op, const reduceType_t type, cl_mem x, cl_mem offsets, const size_t nseg,
+	cl_mem res_val, cl_mem res_idx, cl_program program
+);
+
+// Host arrays, res has nseg entries. Falls back to reduceSegmentsCPU() as reduceHost().
+int reduceSegmentsHost(
+	const reduceOp_t op, const reduceType_t type, const void *x, const long long *offsets,
+	const size_t nseg, reduceResult_t *res, cl_program program
+);
+
+// Reference on CPU, segments are distributed over OpenMP threads
+int reduceSegmentsCPU(
+	const reduceOp_t op, const reduceType_t type, const void *x, const long long *offsets,
+	const size_t nseg, reduceResult_t *res
+);
+
+// Reduce-by-key, keys[0 : n] are sorted so equal keys are adjacent. Each run of equal
+// keys is a segment, its key is written to unique_keys and its result to res; both
+// need room for n entries. Return the number of segments, or -1 on error.
+long long reduceByKeyHost(
+	const reduceOp_t op, const reduceType_t type, const int *keys, const void *x, const size_t n,
+	int *unique_keys, reduceResult_t *res, cl_program program
+);
+long long reduceByKeyCPU(
+	const reduceOp_t op, const reduceType_t type, const int *keys, const void *x, const size_t n,
+	int *unique_keys, reduceResult_t *res
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
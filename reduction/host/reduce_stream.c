@@ -0,0 +1,273 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/my_reduction.h"
+#include "reduce_stream.h"
+
+// Runtime queues REDUCE_STREAM_QUEUE ~ REDUCE_STREAM_QUEUE+3 run the accumulator,
+// the host to device copies, the readers and the emitters
+#define REDUCE_STREAM_QUEUE 8
+#define REDUCE_STREAM_SLOTS 2
+
+struct reduceStream
+{
+	int        use_cpu;
+	size_t     chunk_size;
+
+	// Device path
+	cl_command_queue acc_queue, copy_queue, read_queue, emit_queue;
+	cl_kernel  acc_kernel, read_kernel, emit_kernel;
+	cl_mem     d_x[REDUCE_STREAM_SLOTS];
+	float     *h_x[REDUCE_STREAM_SLOTS];     // Pinned staging buffers
+	cl_event   copy_done[REDUCE_STREAM_SLOTS];
+	cl_event   read_done[REDUCE_STREAM_SLOTS];
+	cl_event   acc_done, emit_done;
+	cl_mem     d_agg_val, d_agg_count;
+	int        slot;
+
+	// CPU path
+	reduceStreamResult_t cpu_res;
+	double     cpu_comp;
+};
+
+static void releaseReduceStreamEvent(cl_event *event)
+{
+	if (*event != NULL) clReleaseEvent(*event);
+	*event = NULL;
+}
+
+static void freeReduceStream(reduceStream_t *stream)
+{
+	for (int i = 0; i < REDUCE_STREAM_SLOTS; i++)
+	{
+		releaseReduceStreamEvent(&stream->copy_done[i]);
+		releaseReduceStreamEvent(&stream->read_done[i]);
+		freeCLPoolBuffer(stream->d_x[i]);
+		freeCLPinnedHost(stream->h_x[i]);
+	}
+	releaseReduceStreamEvent(&stream->acc_done);
+	releaseReduceStreamEvent(&stream->emit_done);
+	freeCLPoolBuffer(stream->d_agg_val);
+	freeCLPoolBuffer(stream->d_agg_count);
+	if (stream->acc_kernel  != NULL) clReleaseKernel(stream->acc_kernel);
+	if (stream->read_kernel != NULL) clReleaseKernel(stream->read_kernel);
+	if (stream->emit_kernel != NULL) clReleaseKernel(stream->emit_kernel);
+	free(stream);
+}
+
+static void resetReduceStreamResult(reduceStreamResult_t *res)
+{
+	res->sum       = 0.0;
+	res->min       = INFINITY;
+	res->max       = -INFINITY;
+	res->chunk_sum = 0.0;
+	res->count     = 0;
+}
+
+reduceStream_t *createReduceStream(cl_program program, const size_t chunk_size)
+{
+	if ((chunk_size == 0) || (chunk_size > 0xFFFFFFFFULL - SR_VEC)) return NULL;
+
+	reduceStream_t *stream = (reduceStream_t*) calloc(1, sizeof(reduceStream_t));
+	if (stream == NULL) return NULL;
+	stream->chunk_size = chunk_size;
+	resetReduceStreamResult(&stream->cpu_res);
+
+	// CPU fallback, the OpenCL device is not an FPGA
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("REDUCE_CPU_FALLBACK");
+	stream->use_cpu = (rt == NULL) || (program == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (program != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) stream->use_cpu = 0;
+	if (stream->use_cpu) return stream;
+
+	cl_int err, err1 = CL_SUCCESS, err2 = CL_SUCCESS;
+	stream->acc_queue   = getCLRuntimeQueue(REDUCE_STREAM_QUEUE);
+	stream->copy_queue  = getCLRuntimeQueue(REDUCE_STREAM_QUEUE + 1);
+	stream->read_queue  = getCLRuntimeQueue(REDUCE_STREAM_QUEUE + 2);
+	stream->emit_queue  = getCLRuntimeQueue(REDUCE_STREAM_QUEUE + 3);
+	stream->acc_kernel  = clCreateKernel(program, "reduction_stream_accumulate", &err);
+	stream->read_kernel = clCreateKernel(program, "reduction_stream_reader",     &err1);
+	stream->emit_kernel = clCreateKernel(program, "reduction_stream_emit",       &err2);
+	if ((err != CL_SUCCESS) || (err1 != CL_SUCCESS) || (err2 != CL_SUCCESS))
+	{
+		printf("[ERROR] clCreateKernel() failed for streaming reduction kernels\n");
+		freeReduceStream(stream);
+		return NULL;
+	}
+
+	// The reader reads whole float16 vectors, round the chunk buffers up
+	size_t slot_bytes = sizeof(float) * ((chunk_size + SR_VEC - 1) / SR_VEC * SR_VEC);
+	int alloc_failed = 0;
+	for (int i = 0; i < REDUCE_STREAM_SLOTS; i++)
+	{
+		stream->d_x[i] = allocCLPoolBuffer(slot_bytes, CL_MEM_READ_ONLY);
+		stream->h_x[i] = (float*) allocCLPinnedHost(slot_bytes, NULL);
+		if ((stream->d_x[i] == NULL) || (stream->h_x[i] == NULL)) alloc_failed = 1;
+		else memset(stream->h_x[i], 0, slot_bytes);
+	}
+	stream->d_agg_val   = allocCLPoolBuffer(sizeof(cl_float) * 4, CL_MEM_READ_WRITE);
+	stream->d_agg_count = allocCLPoolBuffer(sizeof(cl_ulong),     CL_MEM_READ_WRITE);
+	if (alloc_failed || (stream->d_agg_val == NULL) || (stream->d_agg_count == NULL))
+	{
+		freeReduceStream(stream);
+		return NULL;
+	}
+
+	// The accumulator runs until finishReduceStream()
+	err  = clSetKernelArg(stream->emit_kernel, 0, sizeof(cl_mem), (void*) &stream->d_agg_val);
+	err |= clSetKernelArg(stream->emit_kernel, 1, sizeof(cl_mem), (void*) &stream->d_agg_count);
+	err |= clEnqueueTask(stream->acc_queue, stream->acc_kernel, 0, NULL, &stream->acc_done);
+	clFlush(stream->acc_queue);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] Launching reduction_stream_accumulate failed, returned status = %d\n", err);
+		freeReduceStream(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+// Send one chunk of at most chunk_size elements to the accumulator
+static cl_int pushReduceStreamChunk(reduceStream_t *stream, const float *x, const cl_uint n, const cl_int last)
+{
+	int slot = stream->slot;
+	stream->slot = (slot + 1) % REDUCE_STREAM_SLOTS;
+
+	// The staging buffer of this slot is free once its last copy is done
+	if (stream->copy_done[slot] != NULL) clWaitForEvents(1, &stream->copy_done[slot]);
+	releaseReduceStreamEvent(&stream->copy_done[slot]);
+
+	cl_int err = CL_SUCCESS;
+	cl_event copied = NULL;
+	if (n > 0)
+	{
+		memcpy(stream->h_x[slot], x, sizeof(float) * n);
+		// The device buffer of this slot is free once the last reader of it is done
+		cl_uint nwait = (stream->read_done[slot] != NULL) ? 1 : 0;
+		err = clEnqueueWriteBuffer(
+			stream->copy_queue, stream->d_x[slot], CL_FALSE, 0, sizeof(float) * n,
+			stream->h_x[slot], nwait, nwait ? &stream->read_done[slot] : NULL, &copied
+		);
+		stream->copy_done[slot] = copied;
+		clFlush(stream->copy_queue);
+	}
+	releaseReduceStreamEvent(&stream->read_done[slot]);
+
+	// Chunks are sent to the accumulator in the order of the in-order read queue
+	err |= clSetKernelArg(stream->read_kernel, 0, sizeof(cl_mem), (void*) &stream->d_x[slot]);
+	err |= clSetKernelArg(stream->read_kernel, 1, sizeof(cl_uint), (void*) &n);
+	err |= clSetKernelArg(stream->read_kernel, 2, sizeof(cl_int),  (void*) &last);
+	if (err != CL_SUCCESS) return err;
+	err = clEnqueueTask(stream->read_queue, stream->read_kernel, (copied != NULL) ? 1 : 0, (copied != NULL) ? &copied : NULL, &stream->read_done[slot]);
+	clFlush(stream->read_queue);
+
+	// Every chunk except the last one produces running aggregates, which must be consumed
+	if ((err == CL_SUCCESS) && !last)
+	{
+		releaseReduceStreamEvent(&stream->emit_done);
+		err = clEnqueueTask(stream->emit_queue, stream->emit_kernel, 0, NULL, &stream->emit_done);
+		clFlush(stream->emit_queue);
+	}
+	return err;
+}
+
+int pushReduceStream(reduceStream_t *stream, const float *x, const size_t n)
+{
+	if ((stream == NULL) || ((x == NULL) && (n > 0))) return -1;
+
+	for (size_t spos = 0; spos < n; spos += stream->chunk_size)
+	{
+		size_t leng = n - spos;
+		if (leng > stream->chunk_size) leng = stream->chunk_size;
+
+		if (stream->use_cpu)
+		{
+			reduceStreamResult_t *res = &stream->cpu_res;
+			float  mn = res->min, mx = res->max;
+			double s  = 0.0;
+			#pragma omp parallel for reduction(+:s) reduction(min:mn) reduction(max:mx)
+			for (size_t i = spos; i < spos + leng; i++)
+			{
+				s += x[i];
+				if (x[i] < mn) mn = x[i];
+				if (x[i] > mx) mx = x[i];
+			}
+			double y = s - stream->cpu_comp;
+			double t = res->sum + y;
+			stream->cpu_comp = (t - res->sum) - y;
+			res->sum       = t;
+			res->min       = mn;
+			res->max       = mx;
+			res->chunk_sum = s;
+			res->count    += leng;
+			continue;
+		}
+
+		cl_int err = pushReduceStreamChunk(stream, x + spos, (cl_uint) leng, 0);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] Pushing a chunk to the reduction stream failed, returned status = %d\n", err);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int getReduceStreamResult(reduceStream_t *stream, reduceStreamResult_t *res)
+{
+	if ((stream == NULL) || (res == NULL)) return -1;
+	if (stream->use_cpu)
+	{
+		*res = stream->cpu_res;
+		return 0;
+	}
+
+	resetReduceStreamResult(res);
+	if (stream->emit_done == NULL) return 0;
+
+	// The reads are after the last emitter in the in-order emit queue
+	cl_float agg_val[4];
+	cl_ulong agg_count;
+	cl_int err;
+	err  = clEnqueueReadBuffer(stream->emit_queue, stream->d_agg_val,   CL_TRUE, 0, sizeof(agg_val),   agg_val,    0, NULL, NULL);
+	err |= clEnqueueReadBuffer(stream->emit_queue, stream->d_agg_count, CL_TRUE, 0, sizeof(agg_count), &agg_count, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+		return -1;
+	}
+	res->sum       = agg_val[0];
+	res->min       = agg_val[1];
+	res->max       = agg_val[2];
+	res->chunk_sum = agg_val[3];
+	res->count     = agg_count;
+	return 0;
+}
+
+int finishReduceStream(reduceStream_t *stream, reduceStreamResult_t *res)
+{
+	if (stream == NULL) return -1;
+
+	int ret = 0;
+	if (res != NULL) ret = getReduceStreamResult(stream, res);
+	if (!stream->use_cpu)
+	{
+		// An empty last chunk stops the accumulator
+		cl_int err = pushReduceStreamChunk(stream, NULL, 0, 1);
+		if (err == CL_SUCCESS) err = clWaitForEvents(1, &stream->acc_done);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] Stopping reduction_stream_accumulate failed, returned status = %d\n", err);
+			ret = -1;
+		}
+		clFinish(stream->read_queue);
+		clFinish(stream->copy_queue);
+	}
+	freeReduceStream(stream);
+	return ret;
+}
@@ -0,0 +1,49 @@
+#ifndef __REDUCE_STREAM_H__
+#define __REDUCE_STREAM_H__
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+// Streaming float reduction with the kernels in my_reduction_stream.cl.
+// The accumulator kernel is launched once when the stream is created and keeps the
+// running aggregates on device. Data is pushed in pieces of any length, which are cut
+// into chunks of at most chunk_size elements; each chunk is copied through a pinned
+// staging buffer into one of two device buffers, so copying a chunk overlaps with
+// reducing the previous one. The total length is not limited by device memory.
+
+typedef struct
+{
+	double sum;                // Running sum of all elements pushed so far
+	float  min, max;           // Running min and max, +INF and -INF for an empty stream
+	double chunk_sum;          // Sum of the last chunk
+	unsigned long long count;  // Number of elements pushed so far
+} reduceStreamResult_t;
+
+typedef struct reduceStream reduceStream_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start a stream, program should be built from my_reduction_stream.cl. If there is
+// no FPGA (or program is NULL), the stream is reduced on CPU instead; set
+// $REDUCE_CPU_FALLBACK to 0 to use the OpenCL device anyway. Returns NULL on error.
+reduceStream_t *createReduceStream(cl_program program, const size_t chunk_size);
+
+// Append n elements to the stream. x can be reused when the call returns, the
+// call only waits for the device when both device buffers are in use.
+// Returns 0 on success and -1 on error.
+int pushReduceStream(reduceStream_t *stream, const float *x, const size_t n);
+
+// Wait for all pushed data and get the running aggregates. Returns 0 on success and -1 on error.
+int getReduceStreamResult(reduceStream_t *stream, reduceStreamResult_t *res);
+
+// End the stream, get the final aggregates if res is not NULL and release the stream.
+// Returns 0 on success and -1 on error.
+int finishReduceStream(reduceStream_t *stream, reduceStreamResult_t *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/my_reduction.h"
+#include "scan.h"
+
+#define SCAN_BLOCK      (SCAN_WG_SIZE * SCAN_ITEMS)
+#define SCAN_MAX_LEVELS 8   // Each level reduces the length by SCAN_BLOCK times
+
+typedef struct
+{
+	cl_command_queue queue;
+	cl_kernel sums_kernel, blocks_kernel;
+	int       ntmp;
+	cl_mem    tmp[2 * SCAN_MAX_LEVELS];  // Block sums, released after the last kernel
+} scanBlockCtx_t;
+
+// Enqueue the block scan of x into y, the block sums are scanned recursively
+static cl_int enqueueScanBlocks(scanBlockCtx_t *ctx, cl_mem x, cl_mem y, const cl_uint n, const cl_int exclusive)
+{
+	const size_t wg_size[1] = {SCAN_WG_SIZE};
+	cl_uint nblocks = (n + SCAN_BLOCK - 1) / SCAN_BLOCK;
+	const size_t ws_size[1] = {(size_t) nblocks * SCAN_WG_SIZE};
+
+	cl_int err = CL_SUCCESS;
+	cl_int use_offsets = (nblocks > 1);
+	cl_mem offsets = x;  // Not read if there is only one block
+	if (use_offsets)
+	{
+		if (ctx->ntmp + 2 > 2 * SCAN_MAX_LEVELS) return CL_OUT_OF_RESOURCES;
+		cl_mem sums = allocCLPoolBuffer(sizeof(cl_int) * nblocks, CL_MEM_READ_WRITE);
+		offsets     = allocCLPoolBuffer(sizeof(cl_int) * nblocks, CL_MEM_READ_WRITE);
+		ctx->tmp[ctx->ntmp++] = sums;
+		ctx->tmp[ctx->ntmp++] = offsets;
+		if ((sums == NULL) || (offsets == NULL)) return CL_OUT_OF_RESOURCES;
+
+		err |= clSetKernelArg(ctx->sums_kernel, 0, sizeof(cl_mem),  (void*) &x);
+		err |= clSetKernelArg(ctx->sums_kernel, 1, sizeof(cl_mem),  (void*) &sums);
+		err |= clSetKernelArg(ctx->sums_kernel, 2, sizeof(cl_uint), (void*) &n);
+		err |= clEnqueueNDRangeKernel(ctx->queue, ctx->sums_kernel, 1, NULL, ws_size, wg_size, 0, NULL, NULL);
+		if (err == CL_SUCCESS) err = enqueueScanBlocks(ctx, sums, offsets, nblocks, 1);
+		if (err != CL_SUCCESS) return err;
+	}
+
+	err |= clSetKernelArg(ctx->blocks_kernel, 0, sizeof(cl_mem),  (void*) &x);
+	err |= clSetKernelArg(ctx->blocks_kernel, 1, sizeof(cl_mem),  (void*) &y);
+	err |= clSetKernelArg(ctx->blocks_kernel, 2, sizeof(cl_mem),  (void*) &offsets);
+	err |= clSetKernelArg(ctx->blocks_kernel, 3, sizeof(cl_uint), (void*) &n);
+	err |= clSetKernelArg(ctx->blocks_kernel, 4, sizeof(cl_int),  (void*) &exclusive);
+	err |= clSetKernelArg(ctx->blocks_kernel, 5, sizeof(cl_int),  (void*) &use_offsets);
+	err |= clEnqueueNDRangeKernel(ctx->queue, ctx->blocks_kernel, 1, NULL, ws_size, wg_size, 0, NULL, NULL);
+	return err;
+}
+
+int scan(
+	const scanMethod_t method, const int exclusive, cl_mem x, cl_mem y,
+	const size_t n, cl_program program
+)
+{
+	if ((method != ScanBlock) && (method != ScanTask)) return -1;
+	if (n == 0) return 0;
+	if ((x == NULL) || (y == NULL) || (x == y) || (program == NULL)) return -1;
+	if ((method == ScanBlock) && (n > 0xFFFFFFFFULL - SCAN_BLOCK)) return -1;
+
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_int err = CL_SUCCESS;
+	cl_int excl = exclusive ? 1 : 0;
+	if (method == ScanTask)
+	{
+		cl_kernel kernel = clCreateKernel(program, "scan_task", &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clCreateKernel() failed for scan_task, returned status = %d\n", err);
+			return -1;
+		}
+		cl_ulong _n = n;
+		err |= clSetKernelArg(kernel, 0, sizeof(cl_mem),   (void*) &x);
+		err |= clSetKernelArg(kernel, 1, sizeof(cl_mem),   (void*) &y);
+		err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), (void*) &_n);
+		err |= clSetKernelArg(kernel, 3, sizeof(cl_int),   (void*) &excl);
+		err |= clEnqueueTask(queue, kernel, 0, NULL, NULL);
+		err |= clFinish(queue);
+		clReleaseKernel(kernel);
+	} else {
+		scanBlockCtx_t ctx;
+		cl_int err1 = CL_SUCCESS;
+		ctx.queue = queue;
+		ctx.ntmp  = 0;
+		ctx.sums_kernel   = clCreateKernel(program, "scan_block_sums", &err);
+		ctx.blocks_kernel = clCreateKernel(program, "scan_blocks",     &err1);
+		if ((err != CL_SUCCESS) || (err1 != CL_SUCCESS))
+		{
+			printf("[ERROR] clCreateKernel() failed for scan_block_sums / scan_blocks\n");
+			if (err  == CL_SUCCESS) clReleaseKernel(ctx.sums_kernel);
+			if (err1 == CL_SUCCESS) clReleaseKernel(ctx.blocks_kernel);
+			return -1;
+		}
+
+		// All levels are enqueued on the in-order queue without waiting in between
+		err = enqueueScanBlocks(&ctx, x, y, (cl_uint) n, excl);
+		err |= clFinish(queue);
+		for (int i = 0; i < ctx.ntmp; i++) freeCLPoolBuffer(ctx.tmp[i]);
+		clReleaseKernel(ctx.sums_kernel);
+		clReleaseKernel(ctx.blocks_kernel);
+	}
+
+	if (err != CL_SUCCESS) printf("[ERROR] Scan on device failed, returned status = %d\n", err);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+int scanHost(
+	const scanMethod_t method, const int exclusive, const int *x, int *y,
+	const size_t n, cl_program program
+)
+{
+	// CPU fallback, the OpenCL device is not an FPGA
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("SCAN_CPU_FALLBACK");
+	int use_cpu = (rt == NULL) || (program == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (program != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) use_cpu = 0;
+	if (use_cpu) return scanCPU(exclusive, x, y, n);
+
+	if (n == 0) return 0;
+	if ((x == NULL) || (y == NULL)) return -1;
+
+	size_t nBytes = sizeof(int) * n;
+	cl_mem d_x = allocCLPoolBuffer(nBytes, CL_MEM_READ_ONLY);
+	cl_mem d_y = allocCLPoolBuffer(nBytes, CL_MEM_WRITE_ONLY);
+	int ret = -1;
+	if ((d_x != NULL) && (d_y != NULL))
+	{
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		cl_int err = clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, x, 0, NULL, NULL);
+		if (err == CL_SUCCESS) ret = scan(method, exclusive, d_x, d_y, n, program);
+		else printf("[ERROR] clEnqueueWriteBuffer() failed, returned status = %d\n", err);
+		if (ret == 0)
+		{
+			err = clEnqueueReadBuffer(queue, d_y, CL_TRUE, 0, nBytes, y, 0, NULL, NULL);
+			if (err != CL_SUCCESS)
+			{
+				printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+				ret = -1;
+			}
+		}
+	}
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_y);
+	return ret;
+}
+
+int scanCPU(const int exclusive, const int *x, int *y, const size_t n)
+{
+	if (n == 0) return 0;
+	if ((x == NULL) || (y == NULL)) return -1;
+
+	int nthreads = omp_get_max_threads();
+	if (n < (size_t) nthreads * 4096) nthreads = 1;
+	unsigned int *thread_sums = (unsigned int*) malloc(sizeof(unsigned int) * (nthreads + 1));
+	if (thread_sums == NULL) return -1;
+
+	// Sum of each thread's block, scan of the sums, then scan of each block.
+	// Sums are unsigned so overflow wraps around as on device.
+	#pragma omp parallel num_threads(nthreads)
+	{
+		int tid = omp_get_thread_num();
+		size_t spos = n * tid / nthreads;
+		size_t epos = n * (tid + 1) / nthreads;
+		unsigned int sum = 0;
+		for (size_t i = spos; i < epos; i++) sum += (unsigned int) x[i];
+		thread_sums[tid + 1] = sum;
+
+		#pragma omp barrier
+		#pragma omp single
+		{
+			thread_sums[0] = 0;
+			for (int t = 1; t <= nthreads; t++) thread_sums[t] += thread_sums[t - 1];
+		}
+
+		unsigned int running = thread_sums[tid];
+		for (size_t i = spos; i < epos; i++)
+		{
+			unsigned int v = (unsigned int) x[i];
+			y[i] = (int) (exclusive ? running : running + v);
+			running += v;
+		}
+	}
+
+	free(thread_sums);
+	return 0;
+}
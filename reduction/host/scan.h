@@ -0,0 +1,40 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+// Prefix sums of int arrays with the kernels in my_scan.cl. Inclusive scan gives
+// y[i] = x[0] + ... + x[i], exclusive scan gives y[i] = x[0] + ... + x[i - 1] and
+// y[0] = 0. Sums wrap around on overflow, as int additions on device.
+// Functions return 0 on success and -1 on invalid arguments or OpenCL errors.
+
+typedef enum {ScanBlock = 0, ScanTask} scanMethod_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scan n elements of device buffer x into device buffer y (x != y) on runtime queue 0.
+// ScanBlock uses the NDRange block scan + propagate kernels and needs n < 2^32,
+// ScanTask uses the single work-item kernel. The call blocks until y is ready.
+int scan(
+	const scanMethod_t method, const int exclusive, cl_mem x, cl_mem y,
+	const size_t n, cl_program program
+);
+
+// Scan host arrays on device. If there is no FPGA (or program is NULL), scanCPU()
+// is used instead; set $SCAN_CPU_FALLBACK to 0 to use the OpenCL device anyway.
+int scanHost(
+	const scanMethod_t method, const int exclusive, const int *x, int *y,
+	const size_t n, cl_program program
+);
+
+// Scan on CPU with OpenMP, x and y may be the same array
+int scanCPU(const int exclusive, const int *x, int *y, const size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -61,11 +61,14 @@ void sgemm_1_naive(KernelParameters)
 	C[globalRow * ldc + globalCol] = alpha * accu + beta * C[globalRow * ldc + globalCol];
 }
 
+// address_space(16776960) is only understood by the Intel FPGA compiler
+#ifdef INTELFPGA_CL
 #define POINTER_ALIAS_TEST
+#endif
 
 __kernel
 __attribute((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
-__attribute((num_simd_work_items(4)))
+__attribute((num_simd_work_items(SGEMM_SIMD)))
 void sgemm_2_tiling(KernelParameters)
 {
 	const unsigned int row = get_local_id(1); // Local row ID (max: TILE_SIZE)
@@ -111,7 +114,7 @@ void sgemm_2_tiling(KernelParameters)
 // Corresponding to kernel 6 in https://github.com/EnigmaHuang/my_CUDA_SGEMM
 __kernel
 __attribute((reqd_work_group_size(TILE_SIZE / WPTN, TILE_SIZE / WPTM, 1)))
-__attribute((num_simd_work_items(4)))
+__attribute((num_simd_work_items(SGEMM_SIMD)))
 void sgemm_3_2Dreg(KernelParameters)
 {	
 	// Thread identifiers
@@ -206,3 +209,305 @@ void sgemm_3_2Dreg(KernelParameters)
 	}
 }
 
+
+/* ---------- Padding-free kernels ---------- */
+// Same as sgemm_2_tiling and sgemm_3_2Dreg, but A, B and C do not need to be padded
+// to multiples of TILE_SIZE: elements out of the matrices are loaded as 0 and 
+// results out of C are not stored. The NDRange is still rounded up to whole tiles.
+__kernel
+__attribute((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+__attribute((num_simd_work_items(SGEMM_SIMD)))
+void sgemm_2_tiling_nopad(KernelParameters)
+{
+	const unsigned int row = get_local_id(1); // Local row ID (max: TILE_SIZE)
+	const unsigned int col = get_local_id(0); // Local col ID (max: TILE_SIZE)
+	const unsigned int globalRow = get_global_id(1); // Row ID of C (0..c_height)
+	const unsigned int globalCol = get_global_id(0); // Col ID of C (0..c_width)
+	
+	__local float Asub[TILE_SIZE][TILE_SIZE];
+	__local float Bsub[TILE_SIZE][TILE_SIZE];
+	
+	float accu = 0.0f;
+	
+	const unsigned int numTiles = (common_dim + TILE_SIZE - 1) / TILE_SIZE;
+	for (unsigned int t = 0; t < numTiles; t++) 
+	{
+		// Load one tile of A and B into local memory, 0 for out-of-range elements
+		const unsigned int tiledRow = TILE_SIZE * t + row;
+		const unsigned int tiledCol = TILE_SIZE * t + col;
+		Asub[row][col] = ((globalRow < c_height) && (tiledCol < common_dim)) ? A[globalRow * lda + tiledCol] : 0.0f;
+		Bsub[col][row] = ((tiledRow < common_dim) && (globalCol < c_width))  ? B[tiledRow * ldb + globalCol] : 0.0f;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		
+		// Accumulation 
+		#pragma unroll
+		for (unsigned int k = 0; k < TILE_SIZE; k++)
+			accu += Asub[row][k] * Bsub[col][k];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	if ((globalRow < c_height) && (globalCol < c_width))
+		C[globalRow * ldc + globalCol] = alpha * accu + beta * C[globalRow * ldc + globalCol];
+}
+
+__kernel
+__attribute((reqd_work_group_size(TILE_SIZE / WPTN, TILE_SIZE / WPTM, 1)))
+__attribute((num_simd_work_items(SGEMM_SIMD)))
+void sgemm_3_2Dreg_nopad(KernelParameters)
+{	
+	// Thread identifiers
+	const unsigned int col = get_local_id(0); // Local col ID (max: TILE_SIZE/WPTN == RTSN)
+	const unsigned int row = get_local_id(1); // Local row ID (max: TILE_SIZE/WPTM == RTSM)
+	const unsigned int col_block_id = get_group_id(0);
+	const unsigned int row_block_id = get_group_id(1);
+	const unsigned int globalCol = col_block_id * TILE_SIZE + col;   
+	const unsigned int globalRow = row_block_id * TILE_SIZE + row;   
+
+	// Local memory to fit a tile of TS*TS elements of A and B
+	__local float As[TILE_SIZE][TILE_SIZE];
+	__local float Bs[TILE_SIZE][TILE_SIZE];
+
+	// Initialize the accumulation registers
+	float acc[WPTM][WPTN];
+	float Areg[WPTM], Breg[WPTN];
+	#pragma unroll
+	for (unsigned int wm = 0; wm < WPTM; wm++) 
+		for (unsigned int wn = 0; wn < WPTN; wn++) 
+			acc[wm][wn] = 0;
+	
+	// Loop over all tiles, the last one may be partial
+	const unsigned int numTiles = (common_dim + TILE_SIZE - 1) / TILE_SIZE;
+	for (unsigned int t = 0; t < numTiles; t++) 
+	{
+		// Load A tile and B tile to the shm, 0 for out-of-range elements
+		#pragma unroll
+		for (unsigned int wm = 0; wm < WPTM; wm++)
+		{
+			#pragma unroll
+			for (unsigned int wn = 0; wn < WPTN; wn++)
+			{
+				unsigned int block_row = wm * RTSM + row;
+				unsigned int block_col = wn * RTSN + col;
+				unsigned int A_row = TILE_SIZE * row_block_id + block_row;
+				unsigned int A_col = TILE_SIZE * t + block_col;
+				unsigned int B_row = TILE_SIZE * t + block_row;
+				unsigned int B_col = TILE_SIZE * col_block_id + block_col;
+				As[block_row][block_col] = ((A_row < c_height) && (A_col < common_dim)) ? A[A_row * lda + A_col] : 0.0f;
+				Bs[block_row][block_col] = ((B_row < common_dim) && (B_col < c_width))  ? B[B_row * ldb + B_col] : 0.0f;
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// Perform the computation for a single tile
+		#pragma unroll
+		for (unsigned int k = 0; k < TILE_SIZE; k++) 
+		{
+			#pragma unroll
+			for (unsigned int wm = 0; wm < WPTM; wm++) 
+				Areg[wm] = As[row + wm * RTSM][k];
+			
+			#pragma unroll
+			for (unsigned int wn = 0; wn < WPTN; wn++) 
+				Breg[wn] = Bs[k][col + wn * RTSN];
+			
+			#pragma unroll
+			for (unsigned int wm = 0; wm < WPTM; wm++) 
+			{
+				#pragma unroll
+				for (unsigned int wn = 0; wn < WPTN; wn++)
+					acc[wm][wn] += Areg[wm] * Breg[wn];
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	// Store the results inside C
+	#pragma unroll
+	for (unsigned int wm = 0; wm < WPTM; wm++)
+	{
+		unsigned int c_row = globalRow + wm * RTSM;
+		#pragma unroll
+		for (unsigned int wn = 0; wn < WPTN; wn++)
+		{
+			unsigned int c_col = globalCol + wn * RTSN;
+			if ((c_row < c_height) && (c_col < c_width))
+				C[c_row * ldc + c_col] = alpha * acc[wm][wn] + beta * C[c_row * ldc + c_col];
+		}
+	}
+}
+
+/* ---------- BLAS sgemm kernel ---------- */
+// Row-major C = alpha * op(A) * op(B) + beta * C with op(X) = X or X^T, where 
+// A, B and C start at A_offset, B_offset and C_offset elements of the buffers and 
+// lda, ldb, ldc are leading dimensions, so submatrices can be used in place.
+// Column-major problems are mapped to this kernel by the host, see sgemm_blas.c.
+// Boundary handling is the same as sgemm_3_2Dreg_nopad.
+__kernel
+__attribute((reqd_work_group_size(TILE_SIZE / WPTN, TILE_SIZE / WPTM, 1)))
+__attribute((num_simd_work_items(SGEMM_SIMD)))
+void sgemm_3_2Dreg_blas(
+	KernelParameters,
+	const unsigned int A_offset, const unsigned int B_offset, const unsigned int C_offset,
+	const int transA, const int transB
+)
+{	
+	const unsigned int col = get_local_id(0);
+	const unsigned int row = get_local_id(1);
+	const unsigned int col_block_id = get_group_id(0);
+	const unsigned int row_block_id = get_group_id(1);
+	const unsigned int globalCol = col_block_id * TILE_SIZE + col;   
+	const unsigned int globalRow = row_block_id * TILE_SIZE + row;   
+
+	__local float As[TILE_SIZE][TILE_SIZE];
+	__local float Bs[TILE_SIZE][TILE_SIZE];
+
+	float acc[WPTM][WPTN];
+	float Areg[WPTM], Breg[WPTN];
+	#pragma unroll
+	for (unsigned int wm = 0; wm < WPTM; wm++) 
+		for (unsigned int wn = 0; wn < WPTN; wn++) 
+			acc[wm][wn] = 0;
+	
+	// Strides of op(A) and op(B) in row and column directions
+	const unsigned int A_rs = transA ? 1 : lda;
+	const unsigned int A_cs = transA ? lda : 1;
+	const unsigned int B_rs = transB ? 1 : ldb;
+	const unsigned int B_cs = transB ? ldb : 1;
+	
+	const unsigned int numTiles = (common_dim + TILE_SIZE - 1) / TILE_SIZE;
+	for (unsigned int t = 0; t < numTiles; t++) 
+	{
+		#pragma unroll
+		for (unsigned int wm = 0; wm < WPTM; wm++)
+		{
+			#pragma unroll
+			for (unsigned int wn = 0; wn < WPTN; wn++)
+			{
+				unsigned int block_row = wm * RTSM + row;
+				unsigned int block_col = wn * RTSN + col;
+				unsigned int A_row = TILE_SIZE * row_block_id + block_row;
+				unsigned int A_col = TILE_SIZE * t + block_col;
+				unsigned int B_row = TILE_SIZE * t + block_row;
+				unsigned int B_col = TILE_SIZE * col_block_id + block_col;
+				As[block_row][block_col] = ((A_row < c_height) && (A_col < common_dim)) ? A[A_offset + A_row * A_rs + A_col * A_cs] : 0.0f;
+				Bs[block_row][block_col] = ((B_row < common_dim) && (B_col < c_width))  ? B[B_offset + B_row * B_rs + B_col * B_cs] : 0.0f;
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		#pragma unroll
+		for (unsigned int k = 0; k < TILE_SIZE; k++) 
+		{
+			#pragma unroll
+			for (unsigned int wm = 0; wm < WPTM; wm++) 
+				Areg[wm] = As[row + wm * RTSM][k];
+			
+			#pragma unroll
+			for (unsigned int wn = 0; wn < WPTN; wn++) 
+				Breg[wn] = Bs[k][col + wn * RTSN];
+			
+			#pragma unroll
+			for (unsigned int wm = 0; wm < WPTM; wm++) 
+			{
+				#pragma unroll
+				for (unsigned int wn = 0; wn < WPTN; wn++)
+					acc[wm][wn] += Areg[wm] * Breg[wn];
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	// C is not read when beta == 0, same as BLAS
+	#pragma unroll
+	for (unsigned int wm = 0; wm < WPTM; wm++)
+	{
+		unsigned int c_row = globalRow + wm * RTSM;
+		#pragma unroll
+		for (unsigned int wn = 0; wn < WPTN; wn++)
+		{
+			unsigned int c_col = globalCol + wn * RTSN;
+			unsigned int c_idx = C_offset + c_row * ldc + c_col;
+			if ((c_row < c_height) && (c_col < c_width))
+				C[c_idx] = (beta == 0.0f) ? (alpha * acc[wm][wn]) : (alpha * acc[wm][wn] + beta * C[c_idx]);
+		}
+	}
+}
+
+/* ---------- Batched kernels for small matrices ---------- */
+// One work-group computes one C_i = alpha * A_i * B_i + beta * C_i, row-major 
+// A_i (M * K), B_i (K * N) and C_i (M * N), M, N, K <= SGEMM_BATCH_MAX_DIM.
+// A_i and B_i are loaded into local memory as a whole.
+inline
+void sgemm_batched_one(
+	__global const float * restrict A, __global const float * restrict B, 
+	__global float * restrict C, const float alpha, const float beta,
+	const unsigned int M, const unsigned int N, const unsigned int K,
+	__local float As[SGEMM_BATCH_MAX_DIM][SGEMM_BATCH_MAX_DIM],
+	__local float Bs[SGEMM_BATCH_MAX_DIM][SGEMM_BATCH_MAX_DIM]
+)
+{
+	const unsigned int col = get_local_id(0);
+	const unsigned int row = get_local_id(1);
+	
+	for (unsigned int r = row; r < M; r += SGEMM_BATCH_WG)
+		for (unsigned int c = col; c < K; c += SGEMM_BATCH_WG)
+			As[r][c] = A[r * K + c];
+	for (unsigned int r = row; r < K; r += SGEMM_BATCH_WG)
+		for (unsigned int c = col; c < N; c += SGEMM_BATCH_WG)
+			Bs[r][c] = B[r * N + c];
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	for (unsigned int r = row; r < M; r += SGEMM_BATCH_WG)
+	{
+		for (unsigned int c = col; c < N; c += SGEMM_BATCH_WG)
+		{
+			float accu = 0.0f;
+			for (unsigned int k = 0; k < K; k++) accu += As[r][k] * Bs[k][c];
+			// C is not read when beta == 0, same as BLAS
+			if (beta == 0.0f) C[r * N + c] = alpha * accu;
+			else C[r * N + c] = alpha * accu + beta * C[r * N + c];
+		}
+	}
+}
+
+// Matrix i starts at A + i * stride_A, B + i * stride_B, C + i * stride_C
+__kernel
+__attribute((reqd_work_group_size(SGEMM_BATCH_WG, SGEMM_BATCH_WG, 1)))
+void sgemm_batched_strided(
+	const unsigned int M, const unsigned int N, const unsigned int K,
+	__global const float * restrict A, const unsigned int stride_A,
+	__global const float * restrict B, const unsigned int stride_B,
+	__global float * restrict C, const unsigned int stride_C,
+	const float alpha, const float beta
+)
+{
+	__local float As[SGEMM_BATCH_MAX_DIM][SGEMM_BATCH_MAX_DIM];
+	__local float Bs[SGEMM_BATCH_MAX_DIM][SGEMM_BATCH_MAX_DIM];
+	
+	const unsigned int i = get_group_id(0);
+	sgemm_batched_one(
+		A + i * stride_A, B + i * stride_B, C + i * stride_C, 
+		alpha, beta, M, N, K, As, Bs
+	);
+}
+
+// Matrix i starts at A + offsets[3 * i], B + offsets[3 * i + 1], C + offsets[3 * i + 2],
+// so different i can share the same A or B
+__kernel
+__attribute((reqd_work_group_size(SGEMM_BATCH_WG, SGEMM_BATCH_WG, 1)))
+void sgemm_batched_offsets(
+	const unsigned int M, const unsigned int N, const unsigned int K,
+	__global const float * restrict A, __global const float * restrict B, 
+	__global float * restrict C, __global const unsigned int * restrict offsets,
+	const float alpha, const float beta
+)
+{
+	__local float As[SGEMM_BATCH_MAX_DIM][SGEMM_BATCH_MAX_DIM];
+	__local float Bs[SGEMM_BATCH_MAX_DIM][SGEMM_BATCH_MAX_DIM];
+	
+	const unsigned int i = get_group_id(0);
+	sgemm_batched_one(
+		A + offsets[3 * i], B + offsets[3 * i + 1], C + offsets[3 * i + 2], 
+		alpha, beta, M, N, K, As, Bs
+	);
+}
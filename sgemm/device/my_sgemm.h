@@ -1,10 +1,40 @@
 #ifndef __MY_SGEMM_H__
 #define __MY_SGEMM_H__
 
+// Tile parameters can be overridden with -D when building the kernels, see 
+// host/sgemm_tuning.h. The host gets them at runtime from the tuning table, 
+// so the values here are only the defaults.
+#ifndef TILE_SIZE
 #define TILE_SIZE  64  // Tile size for loading into shared memory
+#endif
+#ifndef WPTM
 #define WPTM       8   // Work per thread on dimension M (the height of C), == TILE_SIZE / RTSM
+#endif
+#ifndef WPTN
 #define WPTN       4   // Work per thread on dimension N (the width of C),  == TILE_SIZE / RTSN
-#define RTSM       8   // Reduced tile size on dimension M 
-#define RTSN       16  // Reduced tile size on dimension N, should not be smaller than 16 for coalesced memory accessing 
+#endif
+#ifndef RTSM
+#define RTSM       (TILE_SIZE / WPTM)  // Reduced tile size on dimension M 
+#endif
+#ifndef RTSN
+#define RTSN       (TILE_SIZE / WPTN)  // Reduced tile size on dimension N, should not be smaller than 16 for coalesced memory accessing 
+#endif
+#ifndef SGEMM_SIMD
+#define SGEMM_SIMD 4   // num_simd_work_items of the tiled kernels, should divide the work-group size on dimension 0
+#endif
+
+#define SGEMM_BATCH_MAX_DIM 64  // Max M, N, K of a matrix in sgemm_batched_* kernels
+#define SGEMM_BATCH_WG      8   // sgemm_batched_* work-group size is SGEMM_BATCH_WG * SGEMM_BATCH_WG, 1 group per matrix
+
+// Systolic array in my_sgemm_systolic.cl. Each PE accumulates SYS_IL_M * SYS_IL_N
+// elements of C in a rotating shift register, which should not be shorter than
+// the floating-point adder latency so the PE loop runs with II = 1.
+#define SYS_PE_ROWS 4   // Number of PE rows
+#define SYS_PE_COLS 4   // Number of PE columns
+#define SYS_IL_M    4   // Interleaved rows of C per PE
+#define SYS_IL_N    4   // Interleaved columns of C per PE
+#define SYS_KB      32  // Number of k values in an A / B tile held by the feeders
+#define SYS_BLOCK_M (SYS_PE_ROWS * SYS_IL_M)  // Block of C computed by the array in one pass
+#define SYS_BLOCK_N (SYS_PE_COLS * SYS_IL_N)
 
 #endif
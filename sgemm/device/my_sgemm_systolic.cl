@@ -0,0 +1,230 @@
+#include "my_sgemm.h"
+
+// Single-work-item systolic array SGEMM, C = alpha * A * B + beta * C, row-major.
+// Four task kernels run at the same time and are connected with channels:
+//   sgemm_sys_load_A / sgemm_sys_load_B --> sgemm_sys_pe --> sgemm_sys_drain_C
+// C is computed in SYS_BLOCK_M * SYS_BLOCK_N blocks. PE (r, c) owns elements 
+// C[ii * SYS_PE_ROWS + r][jj * SYS_PE_COLS + c] of a block. A values move to the
+// right along PE rows and B values move down along PE columns, one PE per cycle.
+// This file needs Intel FPGA channels, so it only builds with aoc (or the emulator).
+
+#pragma OPENCL EXTENSION cl_intel_channels : enable
+
+#define SYS_IL      (SYS_IL_M * SYS_IL_N)
+#define SYS_LINE    (SYS_PE_ROWS + SYS_PE_COLS - 1)
+
+typedef struct { float v[SYS_PE_ROWS]; } sys_col_t;  // One value for each PE row
+typedef struct { float v[SYS_PE_COLS]; } sys_row_t;  // One value for each PE column
+
+channel sys_col_t ch_sys_A __attribute__((depth(64)));
+channel sys_row_t ch_sys_B __attribute__((depth(64)));
+channel sys_row_t ch_sys_C __attribute__((depth(64)));
+
+#define SYS_NUM_BLOCKS(x, b) (((x) + (b) - 1) / (b))
+
+// For each block of C and each SYS_KB slice of K, load the A tile once and send 
+// one column of PE row inputs per step. Steps are ordered as (k, ii, jj).
+__kernel
+__attribute__((task))
+void sgemm_sys_load_A(
+	__global const float * restrict A, const unsigned int lda,
+	const unsigned int M, const unsigned int N, const unsigned int K
+)
+{
+	const unsigned int nblk_m = SYS_NUM_BLOCKS(M, SYS_BLOCK_M);
+	const unsigned int nblk_n = SYS_NUM_BLOCKS(N, SYS_BLOCK_N);
+	const unsigned int nkt    = SYS_NUM_BLOCKS(K, SYS_KB);
+	
+	__local float As[SYS_BLOCK_M][SYS_KB];
+	
+	for (unsigned int bi = 0; bi < nblk_m; bi++)
+	for (unsigned int bj = 0; bj < nblk_n; bj++)
+	for (unsigned int kt = 0; kt < nkt; kt++)
+	{
+		for (unsigned int m = 0; m < SYS_BLOCK_M; m++)
+		{
+			unsigned int row = bi * SYS_BLOCK_M + m;
+			#pragma unroll 8
+			for (unsigned int k = 0; k < SYS_KB; k++)
+			{
+				unsigned int col = kt * SYS_KB + k;
+				As[m][k] = ((row < M) && (col < K)) ? A[row * lda + col] : 0.0f;
+			}
+		}
+		
+		for (unsigned int k = 0; k < SYS_KB; k++)
+		for (unsigned int ii = 0; ii < SYS_IL_M; ii++)
+		for (unsigned int jj = 0; jj < SYS_IL_N; jj++)
+		{
+			sys_col_t a;
+			#pragma unroll
+			for (unsigned int r = 0; r < SYS_PE_ROWS; r++) a.v[r] = As[ii * SYS_PE_ROWS + r][k];
+			write_channel_intel(ch_sys_A, a);
+		}
+	}
+}
+
+// Same as sgemm_sys_load_A for B, one row of PE column inputs per step
+__kernel
+__attribute__((task))
+void sgemm_sys_load_B(
+	__global const float * restrict B, const unsigned int ldb,
+	const unsigned int M, const unsigned int N, const unsigned int K
+)
+{
+	const unsigned int nblk_m = SYS_NUM_BLOCKS(M, SYS_BLOCK_M);
+	const unsigned int nblk_n = SYS_NUM_BLOCKS(N, SYS_BLOCK_N);
+	const unsigned int nkt    = SYS_NUM_BLOCKS(K, SYS_KB);
+	
+	__local float Bs[SYS_KB][SYS_BLOCK_N];
+	
+	for (unsigned int bi = 0; bi < nblk_m; bi++)
+	for (unsigned int bj = 0; bj < nblk_n; bj++)
+	for (unsigned int kt = 0; kt < nkt; kt++)
+	{
+		for (unsigned int k = 0; k < SYS_KB; k++)
+		{
+			unsigned int row = kt * SYS_KB + k;
+			#pragma unroll 8
+			for (unsigned int n = 0; n < SYS_BLOCK_N; n++)
+			{
+				unsigned int col = bj * SYS_BLOCK_N + n;
+				Bs[k][n] = ((row < K) && (col < N)) ? B[row * ldb + col] : 0.0f;
+			}
+		}
+		
+		for (unsigned int k = 0; k < SYS_KB; k++)
+		for (unsigned int ii = 0; ii < SYS_IL_M; ii++)
+		for (unsigned int jj = 0; jj < SYS_IL_N; jj++)
+		{
+			sys_row_t b;
+			#pragma unroll
+			for (unsigned int c = 0; c < SYS_PE_COLS; c++) b.v[c] = Bs[k][jj * SYS_PE_COLS + c];
+			write_channel_intel(ch_sys_B, b);
+		}
+	}
+}
+
+// The PE array. Input of PE row r is delayed by r cycles and input of PE column c
+// by c cycles, so PE (r, c) sees step t - r - c of both A and B at cycle t. Zeros
+// are shifted in after the last step, so skewed-out PEs just add 0. Step s goes to
+// accumulator slot (s + r + c) % SYS_IL, the shift registers rotate once per cycle.
+__kernel
+__attribute__((task))
+void sgemm_sys_pe(const unsigned int M, const unsigned int N, const unsigned int K)
+{
+	const unsigned int nblk = SYS_NUM_BLOCKS(M, SYS_BLOCK_M) * SYS_NUM_BLOCKS(N, SYS_BLOCK_N);
+	const unsigned int nstep = SYS_NUM_BLOCKS(K, SYS_KB) * SYS_KB * SYS_IL;
+	const unsigned int ncycle = nstep + SYS_PE_ROWS + SYS_PE_COLS - 2;
+	
+	for (unsigned int blk = 0; blk < nblk; blk++)
+	{
+		float acc[SYS_PE_ROWS][SYS_PE_COLS][SYS_IL];
+		float a_line[SYS_PE_ROWS][SYS_LINE];
+		float b_line[SYS_PE_COLS][SYS_LINE];
+		
+		#pragma unroll
+		for (unsigned int r = 0; r < SYS_PE_ROWS; r++)
+			#pragma unroll
+			for (unsigned int c = 0; c < SYS_PE_COLS; c++)
+				#pragma unroll
+				for (unsigned int l = 0; l < SYS_IL; l++) acc[r][c][l] = 0.0f;
+		#pragma unroll
+		for (unsigned int d = 0; d < SYS_LINE; d++)
+		{
+			#pragma unroll
+			for (unsigned int r = 0; r < SYS_PE_ROWS; r++) a_line[r][d] = 0.0f;
+			#pragma unroll
+			for (unsigned int c = 0; c < SYS_PE_COLS; c++) b_line[c][d] = 0.0f;
+		}
+		
+		for (unsigned int t = 0; t < ncycle; t++)
+		{
+			sys_col_t a_in;
+			sys_row_t b_in;
+			#pragma unroll
+			for (unsigned int r = 0; r < SYS_PE_ROWS; r++) a_in.v[r] = 0.0f;
+			#pragma unroll
+			for (unsigned int c = 0; c < SYS_PE_COLS; c++) b_in.v[c] = 0.0f;
+			if (t < nstep)
+			{
+				a_in = read_channel_intel(ch_sys_A);
+				b_in = read_channel_intel(ch_sys_B);
+			}
+			
+			// a_line[r][d] and b_line[c][d] hold the input of d cycles ago
+			#pragma unroll
+			for (unsigned int d = SYS_LINE - 1; d > 0; d--)
+			{
+				#pragma unroll
+				for (unsigned int r = 0; r < SYS_PE_ROWS; r++) a_line[r][d] = a_line[r][d - 1];
+				#pragma unroll
+				for (unsigned int c = 0; c < SYS_PE_COLS; c++) b_line[c][d] = b_line[c][d - 1];
+			}
+			#pragma unroll
+			for (unsigned int r = 0; r < SYS_PE_ROWS; r++) a_line[r][0] = a_in.v[r];
+			#pragma unroll
+			for (unsigned int c = 0; c < SYS_PE_COLS; c++) b_line[c][0] = b_in.v[c];
+			
+			#pragma unroll
+			for (unsigned int r = 0; r < SYS_PE_ROWS; r++)
+			{
+				#pragma unroll
+				for (unsigned int c = 0; c < SYS_PE_COLS; c++)
+				{
+					float sum = acc[r][c][SYS_IL - 1] + a_line[r][r + c] * b_line[c][r + c];
+					#pragma unroll
+					for (unsigned int l = SYS_IL - 1; l > 0; l--) acc[r][c][l] = acc[r][c][l - 1];
+					acc[r][c][0] = sum;
+				}
+			}
+		}
+		
+		// Slot q is at position (ncycle - 1 - q) % SYS_IL after the last cycle
+		for (unsigned int ii = 0; ii < SYS_IL_M; ii++)
+		for (unsigned int r = 0; r < SYS_PE_ROWS; r++)
+		for (unsigned int jj = 0; jj < SYS_IL_N; jj++)
+		{
+			sys_row_t out;
+			unsigned int l = ii * SYS_IL_N + jj;
+			#pragma unroll
+			for (unsigned int c = 0; c < SYS_PE_COLS; c++)
+				out.v[c] = acc[r][c][(ncycle - 1 - (l + r + c)) % SYS_IL];
+			write_channel_intel(ch_sys_C, out);
+		}
+	}
+}
+
+// Write each block of C in the order the PE array drains it: 
+// row ii * SYS_PE_ROWS + r, columns jj * SYS_PE_COLS + [0, SYS_PE_COLS)
+__kernel
+__attribute__((task))
+void sgemm_sys_drain_C(
+	__global float * restrict C, const unsigned int ldc,
+	const float alpha, const float beta,
+	const unsigned int M, const unsigned int N
+)
+{
+	const unsigned int nblk_m = SYS_NUM_BLOCKS(M, SYS_BLOCK_M);
+	const unsigned int nblk_n = SYS_NUM_BLOCKS(N, SYS_BLOCK_N);
+	
+	for (unsigned int bi = 0; bi < nblk_m; bi++)
+	for (unsigned int bj = 0; bj < nblk_n; bj++)
+	for (unsigned int ii = 0; ii < SYS_IL_M; ii++)
+	for (unsigned int r = 0; r < SYS_PE_ROWS; r++)
+	for (unsigned int jj = 0; jj < SYS_IL_N; jj++)
+	{
+		sys_row_t out = read_channel_intel(ch_sys_C);
+		unsigned int row = bi * SYS_BLOCK_M + ii * SYS_PE_ROWS + r;
+		#pragma unroll
+		for (unsigned int c = 0; c < SYS_PE_COLS; c++)
+		{
+			unsigned int col = bj * SYS_BLOCK_N + jj * SYS_PE_COLS + c;
+			if ((row < M) && (col < N))
+			{
+				unsigned int idx = row * ldc + col;
+				C[idx] = (beta == 0.0f) ? (alpha * out.v[c]) : (alpha * out.v[c] + beta * C[idx]);
+			}
+		}
+	}
+}
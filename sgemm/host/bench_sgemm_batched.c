@@ -0,0 +1,142 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <omp.h>
+#include <math.h>
+
+#include "FPGA_OpenCL_utils.h"
+#include "sgemm_batched.h"
+#include "test_sgemm.h"
+
+static int check_batched_result(const float *ref, const float *target, const size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		float diff  = fabs(ref[i] - target[i]);
+		float rdiff = diff / fabs(ref[i]);
+		if ((diff > 1e-6) && (rdiff > 1e-5))
+		{
+			printf("ERROR: position %zu, ref = %e, target = %e, rel diff = %e\n", i, ref[i], target[i], rdiff);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void benchBatchedSize(const int dim, const int batch_size, cl_context context, cl_command_queue queue, cl_program program)
+{
+	const int M = dim, N = dim, K = dim;
+	const size_t mat_size = (size_t) dim * dim;
+	const float alpha = 1.0, beta = 0.5;
+	const int ntest = 5;
+	printf("----- %d GEMMs of size (%d, %d, %d) -----\n", batch_size, M, N, K);
+	
+	float *A     = (float*) malloc(sizeof(float) * mat_size * batch_size);
+	float *B     = (float*) malloc(sizeof(float) * mat_size * batch_size);
+	float *C0    = (float*) malloc(sizeof(float) * mat_size * batch_size);
+	float *C     = (float*) malloc(sizeof(float) * mat_size * batch_size);
+	float *C_ref = (float*) malloc(sizeof(float) * mat_size * batch_size);
+	const float **A_array = (const float**) malloc(sizeof(float*) * batch_size);
+	const float **B_array = (const float**) malloc(sizeof(float*) * batch_size);
+	float **C_array       = (float**) malloc(sizeof(float*) * batch_size);
+	float **C_ref_array   = (float**) malloc(sizeof(float*) * batch_size);
+	for (size_t i = 0; i < mat_size * batch_size; i++)
+	{
+		A[i]  = (float) (rand() % 16) / 16.0f;
+		B[i]  = (float) (rand() % 16) / 16.0f;
+		C0[i] = (float) (rand() % 16) / 16.0f;
+	}
+	
+	// Reference: strided batch
+	memcpy(C_ref, C0, sizeof(float) * mat_size * batch_size);
+	for (int i = 0; i < batch_size; i++)
+	{
+		A_array[i] = A + mat_size * i;
+		B_array[i] = B + mat_size * i;
+		C_ref_array[i] = C_ref + mat_size * i;
+	}
+	sgemm_batched_host(M, N, K, alpha, A_array, B_array, beta, C_ref_array, batch_size);
+	
+	// Strided batch, 1 launch per batch
+	double ut = 0.0;
+	int passed = 1;
+	for (int itest = 0; itest <= ntest; itest++)
+	{
+		memcpy(C, C0, sizeof(float) * mat_size * batch_size);
+		double st = omp_get_wtime();
+		sgemm_batched_strided(M, N, K, alpha, A, mat_size, B, mat_size, beta, C, mat_size, batch_size, program);
+		double et = omp_get_wtime();
+		if (itest > 0) ut += et - st;  // The first run is warm-up
+		passed &= check_batched_result(C_ref, C, mat_size * batch_size);
+	}
+	double gemm_per_sec = (double) batch_size * ntest / ut;
+	printf("sgemm_batched_strided : %.0lf GEMMs/s, %lf GFlops, check %s\n", 
+			gemm_per_sec, gemm_per_sec * 2.0 * M * N * K * 1e-9, passed ? "passed" : "failed");
+	
+	// Pointer array batch, all GEMMs share the first B
+	memcpy(C_ref, C0, sizeof(float) * mat_size * batch_size);
+	for (int i = 0; i < batch_size; i++) B_array[i] = B;
+	sgemm_batched_host(M, N, K, alpha, A_array, B_array, beta, C_ref_array, batch_size);
+	ut = 0.0;
+	passed = 1;
+	for (int itest = 0; itest <= ntest; itest++)
+	{
+		memcpy(C, C0, sizeof(float) * mat_size * batch_size);
+		for (int i = 0; i < batch_size; i++) C_array[i] = C + mat_size * i;
+		double st = omp_get_wtime();
+		sgemm_batched(M, N, K, alpha, A_array, B_array, beta, C_array, batch_size, program);
+		double et = omp_get_wtime();
+		if (itest > 0) ut += et - st;
+		passed &= check_batched_result(C_ref, C, mat_size * batch_size);
+	}
+	gemm_per_sec = (double) batch_size * ntest / ut;
+	printf("sgemm_batched (ptrs)  : %.0lf GEMMs/s, %lf GFlops, check %s\n", 
+			gemm_per_sec, gemm_per_sec * 2.0 * M * N * K * 1e-9, passed ? "passed" : "failed");
+	
+	// One GEMM per call: testKernel2 runs 20 GEMMs
+	memcpy(C, C0, sizeof(float) * mat_size);
+	double st = omp_get_wtime();
+	testKernel2(M, N, K, alpha, 0.0, A, B, C, context, queue, program);
+	double et = omp_get_wtime();
+	gemm_per_sec = 20.0 / (et - st);
+	printf("looping testKernel2   : %.0lf GEMMs/s\n", gemm_per_sec);
+	
+	free(A);
+	free(B);
+	free(C0);
+	free(C);
+	free(C_ref);
+	free(A_array);
+	free(B_array);
+	free(C_array);
+	free(C_ref_array);
+}
+
+int main(int argc, char **argv)
+{
+	int batch_size = (argc >= 2) ? atoi(argv[1]) : 10000;
+	
+	// Initialize Intel FPGA OpenCL environment
+	cl_device_id *FPGA_devices;
+	cl_uint numDevices;
+	cl_context context;
+	cl_command_queue queue;
+	cl_program program;
+	if (initCLFPGASimpleEnvironment(
+		&FPGA_devices, &numDevices, &context, 
+		&queue, &program, "my_sgemm.aocx"
+	) != 0) return 255;
+	
+	const int dims[4] = {8, 16, 32, 64};
+	for (int i = 0; i < 4; i++) benchBatchedSize(dims[i], batch_size, context, queue, program);
+	
+	// Free device resources
+	clReleaseProgram(program);    // Release the program object
+	clReleaseCommandQueue(queue); // Release Command queue
+	clReleaseContext(context);    // Release context
+	free(FPGA_devices);
+	
+	return 0;
+}
@@ -0,0 +1,78 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <math.h>
+
+#include "sgemm_cpu.h"
+
+// The reference loop main.c used before sgemm_cpu()
+static void sgemm_naive(
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const float *B, const float beta, float *C
+)
+{
+	#pragma omp parallel for 
+	for (int i = 0; i < M; i++)
+		for (int j = 0; j < N; j++)
+		{
+			register float accu = 0.0;
+			for (int k = 0; k < K; k++) accu += A[i * K + k] * B[k * N + j];
+			C[i * N + j] = beta * C[i * N + j] + alpha * accu;
+		}
+}
+
+static void benchCPUSize(const int M, const int N, const int K, const int ntest)
+{
+	size_t A_size = (size_t) M * K, B_size = (size_t) K * N, C_size = (size_t) M * N;
+	float *A  = (float*) malloc(sizeof(float) * A_size);
+	float *B  = (float*) malloc(sizeof(float) * B_size);
+	float *C0 = (float*) malloc(sizeof(float) * C_size);
+	float *C1 = (float*) malloc(sizeof(float) * C_size);
+	for (size_t i = 0; i < A_size; i++) A[i] = (float) (rand() % 16) / 16.0f;
+	for (size_t i = 0; i < B_size; i++) B[i] = (float) (rand() % 16) / 16.0f;
+	const float alpha = 1.0, beta = 0.0;
+	double flops = 2.0 * M * N * K * ntest;
+	
+	double st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++) sgemm_naive(M, N, K, alpha, A, B, beta, C0);
+	double et = omp_get_wtime();
+	double naive_gflops = flops / ((et - st) * 1000000000.0);
+	
+	sgemm_cpu(0, 0, M, N, K, alpha, A, K, B, N, beta, C1, N);  // Warm up
+	st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++) sgemm_cpu(0, 0, M, N, K, alpha, A, K, B, N, beta, C1, N);
+	et = omp_get_wtime();
+	double cpu_gflops = flops / ((et - st) * 1000000000.0);
+	
+	float max_rdiff = 0.0;
+	for (size_t i = 0; i < C_size; i++)
+	{
+		float rdiff = fabs(C0[i] - C1[i]) / (fabs(C0[i]) + 1e-30);
+		if (rdiff > max_rdiff) max_rdiff = rdiff;
+	}
+	printf(
+		"%5d %5d %5d | naive %8.2lf GFlops | sgemm_cpu %8.2lf GFlops | speedup %6.2lf | max rel diff %e\n",
+		M, N, K, naive_gflops, cpu_gflops, cpu_gflops / naive_gflops, max_rdiff
+	);
+	
+	free(A);
+	free(B);
+	free(C0);
+	free(C1);
+}
+
+int main(int argc, char **argv)
+{
+	printf("CPU SGEMM micro-kernel: %s, %d threads\n", sgemm_cpu_kernel_name(), omp_get_max_threads());
+	if (argc >= 4)
+	{
+		benchCPUSize(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), 3);
+		return 0;
+	}
+	const int sizes[] = {128, 256, 512, 1024, 2048};
+	for (int i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++)
+		benchCPUSize(sizes[i], sizes[i], sizes[i], (sizes[i] <= 512) ? 10 : 3);
+	benchCPUSize(65, 4097, 33, 10);
+	return 0;
+}
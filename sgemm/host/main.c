@@ -5,9 +5,18 @@
 #include <assert.h>
 #include <omp.h>
 #include <math.h>
+#include <float.h>
 
 #include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_runtime.h"
 #include "test_sgemm.h"
+#include "sgemm_blas.h"
+#include "sgemm_tuning.h"
+#include "sgemm_cpu.h"
+
+// The reference is computed by sgemm_cpu(), which sums over k in a different 
+// order than the device kernels, so results can differ by K rounding errors
+static float check_rtol = 1e-7;
 
 int check_result(float *ref, float *target, int n)
 {
@@ -16,7 +25,7 @@ int check_result(float *ref, float *target, int n)
 	{
 		float diff = fabs(ref[i] - target[i]);
 		float rdiff = diff / fabs(ref[i]);
-		if (rdiff > 1e-7)
+		if (rdiff > check_rtol)
 		{
 			printf("ERROR: position %d, ref = %e, target = %e, abs diff = %e, rel diff = %e\n", 
 					i, ref[i], target[i], diff, rdiff);
@@ -27,8 +36,69 @@ int check_result(float *ref, float *target, int n)
 	return 1;
 }
 
+// Run sgemm_blas() on views with padded leading dimensions for all layout and
+// transpose combinations, compare with sgemm_blas_host() and check that the 
+// padding of C is not touched
+int check_blas(const int M, const int N, const int K, cl_program program)
+{
+	const int pad = 3;
+	int maxd = M > N ? M : N;
+	if (K > maxd) maxd = K;
+	int ld = maxd + pad;
+	size_t mat_size = (size_t) ld * (size_t) maxd;
+	float *A     = (float*) malloc(sizeof(float) * mat_size);
+	float *B     = (float*) malloc(sizeof(float) * mat_size);
+	float *C     = (float*) malloc(sizeof(float) * mat_size);
+	float *C_ref = (float*) malloc(sizeof(float) * mat_size);
+	for (size_t i = 0; i < mat_size; i++)
+	{
+		A[i] = (float) (i % 7) - 3.0f;
+		B[i] = (float) (i % 5) - 2.0f;
+	}
+	
+	// The device kernel is used even if the device is not an FPGA, else the check
+	// would compare the CPU fallback with the CPU reference
+	setenv("SGEMM_CPU_FALLBACK", "0", 0);
+	const sgemmLayout_t layouts[2] = {SgemmRowMajor, SgemmColMajor};
+	const sgemmTrans_t  trans[2]   = {SgemmNoTrans, SgemmTrans};
+	int passed = 1;
+	for (int il = 0; il < 2; il++)
+		for (int ia = 0; ia < 2; ia++)
+			for (int ib = 0; ib < 2; ib++)
+			{
+				for (size_t i = 0; i < mat_size; i++)
+				{
+					C[i]     = (float) (i % 3);
+					C_ref[i] = (float) (i % 3);
+				}
+				sgemm_blas_host(layouts[il], trans[ia], trans[ib], M, N, K, 1.0f, A, ld, B, ld, 1.0f, C_ref, ld);
+				if (sgemm_blas(layouts[il], trans[ia], trans[ib], M, N, K, 1.0f, A, ld, B, ld, 1.0f, C, ld, program) != 0)
+				{
+					passed = 0;
+					continue;
+				}
+				if (!check_result(C_ref, C, (int) mat_size))
+				{
+					printf("sgemm_blas: layout = %d, transA = %d, transB = %d failed\n", layouts[il], trans[ia], trans[ib]);
+					passed = 0;
+				}
+			}
+	
+	free(A);
+	free(B);
+	free(C);
+	free(C_ref);
+	return passed;
+}
+
 int main(int argc, char **argv)
 {
+	if (argc < 4)
+	{
+		printf("Usage: %s <M> <N> <K> <batch size for stream test, 0 to skip> <\"systolic\" to test the systolic array>\n", argv[0]);
+		return 255;
+	}
+	
 	int M, N, K;
 	M = atoi(argv[1]);
 	N = atoi(argv[2]);
@@ -51,14 +121,12 @@ int main(int argc, char **argv)
 	float alpha = 1.0, beta = 0.0;  // Set beta = 0 to allow both multiple run and result check
 	
 	// Compute reference results
-	#pragma omp parallel for 
-	for (int i = 0; i < M; i++)
-		for (int j = 0; j < N; j++)
-		{
-			register float accu = 0.0;
-			for (int k = 0; k < K; k++) accu += h_A[i * K + k] * h_B[k * N + j];
-			C_ref[i * N + j] = beta * C_ref[i * N + j] + alpha * accu;
-		}
+	double st = omp_get_wtime();
+	sgemm_cpu(0, 0, M, N, K, alpha, h_A, K, h_B, N, beta, C_ref, N);
+	double et = omp_get_wtime();
+	printf("CPU reference (%s) used time = %lf (s)\n", sgemm_cpu_kernel_name(), et - st);
+	check_rtol = (float) K * FLT_EPSILON;
+	if (check_rtol < 1e-7) check_rtol = 1e-7;
 		
 	// Initialize Intel FPGA OpenCL environment
 	cl_device_id *FPGA_devices;
@@ -71,6 +139,23 @@ int main(int argc, char **argv)
 		&queue, &program, "my_sgemm.aocx"
 	);
 	
+	// Use the tuned tile parameters for this shape if there is a tuning table
+	if (loadSgemmTuningTable(NULL) > 0)
+	{
+		sgemmTileParams_t params = getSgemmTileParams(M, N, K);
+		cl_program tuned_program = getSgemmTunedProgram(&params);
+		if (tuned_program != NULL)
+		{
+			printf("Tuned tile parameters: TILE_SIZE = %d, WPTM = %d, WPTN = %d, SIMD = %d\n", params.tile_size, params.wptm, params.wptn, params.simd);
+			clReleaseProgram(program);
+			program = tuned_program;
+			clRetainProgram(program);
+			setSgemmActiveTileParams(&params);
+		} else {
+			printf("[WARNING] Tuned SGEMM variant is not available, use the default parameters\n");
+		}
+	}
+	
 	// Test kernel 2
 	testKernel2(
 		M, N, K, alpha, beta, h_A, h_B, h_C,
@@ -89,6 +174,68 @@ int main(int argc, char **argv)
 	// Check result
 	if (check_result(C_ref, h_C, M * N)) printf("Check passed\n"); else printf("Check failed\n");
 	
+	// Test kernel 2 and 3 without padding
+	testKernel2NoPad(
+		M, N, K, alpha, beta, h_A, h_B, h_C,
+		context, queue, program
+	);
+	if (check_result(C_ref, h_C, M * N)) printf("Check passed\n"); else printf("Check failed\n");
+	
+	testKernel3NoPad(
+		M, N, K, alpha, beta, h_A, h_B, h_C,
+		context, queue, program
+	);
+	if (check_result(C_ref, h_C, M * N)) printf("Check passed\n"); else printf("Check failed\n");
+	
+	// Test the BLAS interface with submatrix views
+	if (check_blas(M, N, K, program)) printf("BLAS check passed\n"); else printf("BLAS check failed\n");
+	
+	// Test the systolic array kernels, they are in a separate kernel file
+	if ((argc >= 6) && (strcmp(argv[5], "systolic") == 0))
+	{
+		cl_program sys_program = getCLRuntimeProgram("my_sgemm_systolic.aocx");
+		if (sys_program != NULL)
+		{
+			testKernelSystolic(
+				M, N, K, alpha, beta, h_A, h_B, h_C,
+				context, queue, sys_program
+			);
+			if (check_result(C_ref, h_C, M * N)) printf("Check passed\n"); else printf("Check failed\n");
+		}
+	}
+	
+	// Test streaming a batch of GEMMs with kernel 3
+	int batch_size = (argc >= 5) ? atoi(argv[4]) : 0;
+	if (batch_size > 0)
+	{
+		size_t A_size = (size_t) M * (size_t) K;
+		size_t B_size = (size_t) K * (size_t) N;
+		size_t C_size = (size_t) M * (size_t) N;
+		float *batch_A = (float*) malloc(sizeof(float) * A_size * batch_size);
+		float *batch_B = (float*) malloc(sizeof(float) * B_size * batch_size);
+		float *batch_C = (float*) malloc(sizeof(float) * C_size * batch_size);
+		for (int i = 0; i < batch_size; i++)
+		{
+			memcpy(batch_A + A_size * i, h_A, sizeof(float) * A_size);
+			memcpy(batch_B + B_size * i, h_B, sizeof(float) * B_size);
+			memcpy(batch_C + C_size * i, h_C, sizeof(float) * C_size);
+		}
+		
+		testKernel3Stream(
+			M, N, K, alpha, beta, batch_A, batch_B, batch_C,
+			context, queue, program, batch_size
+		);
+		
+		int passed = 1;
+		for (int i = 0; i < batch_size; i++)
+			passed &= check_result(C_ref, batch_C + C_size * i, M * N);
+		if (passed) printf("Check passed\n"); else printf("Check failed\n");
+		
+		free(batch_A);
+		free(batch_B);
+		free(batch_C);
+	}
+	
 	free(h_A);
 	free(h_B);
 	free(h_C);
@@ -0,0 +1,316 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "sgemm_batched.h"
+#include "../device/my_sgemm.h"
+
+void sgemm_batched_host(
+	const int M, const int N, const int K, const float alpha, 
+	const float **A_array, const float **B_array, 
+	const float beta, float **C_array, const int batch_size
+)
+{
+	#pragma omp parallel for schedule(static)
+	for (int ib = 0; ib < batch_size; ib++)
+	{
+		const float *A = A_array[ib];
+		const float *B = B_array[ib];
+		float *C = C_array[ib];
+		for (int i = 0; i < M; i++)
+		{
+			for (int j = 0; j < N; j++)
+			{
+				float accu = 0.0;
+				for (int k = 0; k < K; k++) accu += A[i * K + k] * B[k * N + j];
+				if (beta == 0.0f) C[i * N + j] = alpha * accu;
+				else C[i * N + j] = alpha * accu + beta * C[i * N + j];
+			}
+		}
+	}
+}
+
+static int checkBatchedSize(const int M, const int N, const int K)
+{
+	if ((M < 1) || (N < 1) || (K < 1) || (M > SGEMM_BATCH_MAX_DIM) || (N > SGEMM_BATCH_MAX_DIM) || (K > SGEMM_BATCH_MAX_DIM))
+	{
+		printf("[ERROR] Batched SGEMM supports 1 <= M, N, K <= %d, got (%d, %d, %d)\n", SGEMM_BATCH_MAX_DIM, M, N, K);
+		return -1;
+	}
+	return 0;
+}
+
+// A stride must not be negative, and must be 0 (A or B only) or cover the matrix, 
+// so the matrices do not overlap. The kernel indexes the batch with unsigned int.
+static int checkBatchedStride(
+	const char *name, const int stride, const size_t mat_size, 
+	const int batch_size, const int allow_zero
+)
+{
+	int valid = (stride >= 0) && ((size_t) stride >= mat_size);
+	if (allow_zero && (stride == 0)) valid = 1;
+	if (batch_size == 1) valid = (stride >= 0);
+	if (!valid)
+	{
+		printf(
+			"[ERROR] Batched SGEMM stride_%s = %d, need %s%zu\n", 
+			name, stride, allow_zero ? "0 or >= " : ">= ", mat_size
+		);
+		return -1;
+	}
+	if ((size_t) stride * (batch_size - 1) + mat_size > UINT_MAX)
+	{
+		printf("[ERROR] Batched SGEMM: batch of %s exceeds %u elements\n", name, UINT_MAX);
+		return -1;
+	}
+	return 0;
+}
+
+int sgemm_batched_strided(
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int stride_A, const float *B, const int stride_B, 
+	const float beta, float *C, const int stride_C, const int batch_size, 
+	cl_program program
+)
+{
+	if (checkBatchedSize(M, N, K) != 0) return -1;
+	if (batch_size < 1) return 0;
+	if ((checkBatchedStride("A", stride_A, (size_t) M * K, batch_size, 1) != 0) ||
+	    (checkBatchedStride("B", stride_B, (size_t) K * N, batch_size, 1) != 0) ||
+	    (checkBatchedStride("C", stride_C, (size_t) M * N, batch_size, 0) != 0)) return -1;
+	
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_int err = CL_SUCCESS;
+	cl_kernel kernel = clCreateKernel(program, "sgemm_batched_strided", &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateKernel() failed for sgemm_batched_strided, returned status = %d\n", err);
+		return -1;
+	}
+	
+	// Only the span covered by the batch is copied
+	size_t A_mem_size = ((size_t) stride_A * (batch_size - 1) + (size_t) M * K) * sizeof(float);
+	size_t B_mem_size = ((size_t) stride_B * (batch_size - 1) + (size_t) K * N) * sizeof(float);
+	size_t C_mem_size = ((size_t) stride_C * (batch_size - 1) + (size_t) M * N) * sizeof(float);
+	cl_mem d_A = allocCLPoolBuffer(A_mem_size, CL_MEM_READ_ONLY);
+	cl_mem d_B = allocCLPoolBuffer(B_mem_size, CL_MEM_READ_ONLY);
+	cl_mem d_C = allocCLPoolBuffer(C_mem_size, CL_MEM_READ_WRITE);
+	
+	cl_event h2d_copy[3];
+	cl_uint nh2d = 2;
+	err |= clEnqueueWriteBuffer(queue, d_A, CL_FALSE, 0, A_mem_size, A, 0, NULL, &h2d_copy[0]);
+	err |= clEnqueueWriteBuffer(queue, d_B, CL_FALSE, 0, B_mem_size, B, 0, NULL, &h2d_copy[1]);
+	if (beta != 0.0f) 
+	{
+		err |= clEnqueueWriteBuffer(queue, d_C, CL_FALSE, 0, C_mem_size, C, 0, NULL, &h2d_copy[2]);
+		nh2d = 3;
+	}
+	
+	unsigned int _M = M, _N = N, _K = K;
+	unsigned int _stride_A = stride_A, _stride_B = stride_B, _stride_C = stride_C;
+	err |= clSetKernelArg(kernel, 0,  sizeof(unsigned int), (void*) &_M);
+	err |= clSetKernelArg(kernel, 1,  sizeof(unsigned int), (void*) &_N);
+	err |= clSetKernelArg(kernel, 2,  sizeof(unsigned int), (void*) &_K);
+	err |= clSetKernelArg(kernel, 3,  sizeof(cl_mem), (void*) &d_A);
+	err |= clSetKernelArg(kernel, 4,  sizeof(unsigned int), (void*) &_stride_A);
+	err |= clSetKernelArg(kernel, 5,  sizeof(cl_mem), (void*) &d_B);
+	err |= clSetKernelArg(kernel, 6,  sizeof(unsigned int), (void*) &_stride_B);
+	err |= clSetKernelArg(kernel, 7,  sizeof(cl_mem), (void*) &d_C);
+	err |= clSetKernelArg(kernel, 8,  sizeof(unsigned int), (void*) &_stride_C);
+	err |= clSetKernelArg(kernel, 9,  sizeof(float), (void*) &alpha);
+	err |= clSetKernelArg(kernel, 10, sizeof(float), (void*) &beta);
+	const size_t wg_size[2] = {SGEMM_BATCH_WG, SGEMM_BATCH_WG};
+	const size_t ws_size[2] = {(size_t) SGEMM_BATCH_WG * batch_size, SGEMM_BATCH_WG};
+	cl_event kernel_exec;
+	err |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ws_size, wg_size, nh2d, h2d_copy, &kernel_exec);
+	if (stride_C > M * N)
+	{
+		// Only the M * N blocks are read back: with beta == 0 the gaps between them were
+		// never uploaded, and they must not be overwritten in the caller's C
+		const size_t origin[3] = {0, 0, 0};
+		const size_t region[3] = {sizeof(float) * M * N, (size_t) batch_size, 1};
+		const size_t row_pitch = sizeof(float) * stride_C;
+		err |= clEnqueueReadBufferRect(
+			queue, d_C, CL_TRUE, origin, origin, region, 
+			row_pitch, 0, row_pitch, 0, C, 1, &kernel_exec, NULL
+		);
+	} else {
+		err |= clEnqueueReadBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, C, 1, &kernel_exec, NULL);
+	}
+	if (err != CL_SUCCESS) printf("[ERROR] sgemm_batched_strided() failed\n");
+	
+	for (cl_uint i = 0; i < nh2d; i++) clReleaseEvent(h2d_copy[i]);
+	clReleaseEvent(kernel_exec);
+	clReleaseKernel(kernel);
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+typedef struct
+{
+	const float *ptr;
+	int idx;
+} batchedPtr_t;
+
+static int cmpBatchedPtr(const void *a, const void *b)
+{
+	const float *pa = ((const batchedPtr_t *) a)->ptr;
+	const float *pb = ((const batchedPtr_t *) b)->ptr;
+	if (pa < pb) return -1;
+	if (pa > pb) return 1;
+	return 0;
+}
+
+// Each C_i is written, so the C matrices must not overlap
+static int checkBatchedOutputs(float **C_array, const int batch_size, const size_t mat_size)
+{
+	batchedPtr_t *sorted = (batchedPtr_t *) malloc(sizeof(batchedPtr_t) * batch_size);
+	assert(sorted != NULL);
+	for (int i = 0; i < batch_size; i++)
+	{
+		sorted[i].ptr = C_array[i];
+		sorted[i].idx = i;
+	}
+	qsort(sorted, batch_size, sizeof(batchedPtr_t), cmpBatchedPtr);
+	int ret = 0;
+	for (int i = 1; i < batch_size; i++)
+	{
+		if (sorted[i].ptr >= sorted[i - 1].ptr + mat_size) continue;
+		printf("[ERROR] Batched SGEMM: C_array[%d] and C_array[%d] overlap\n", sorted[i - 1].idx, sorted[i].idx);
+		ret = -1;
+		break;
+	}
+	free(sorted);
+	return ret;
+}
+
+// Copy the distinct matrices in ptrs into pinned staging memory one after another and
+// set offsets[3 * i + which] to the element offset of matrix i. Return the staging memory.
+static float *packBatchedMatrices(
+	const float **ptrs, const int batch_size, const size_t mat_size, 
+	unsigned int *offsets, const int which, size_t *packed_size
+)
+{
+	batchedPtr_t *sorted = (batchedPtr_t *) malloc(sizeof(batchedPtr_t) * batch_size);
+	assert(sorted != NULL);
+	for (int i = 0; i < batch_size; i++)
+	{
+		sorted[i].ptr = ptrs[i];
+		sorted[i].idx = i;
+	}
+	qsort(sorted, batch_size, sizeof(batchedPtr_t), cmpBatchedPtr);
+	
+	int nuniq = 0;
+	for (int i = 0; i < batch_size; i++)
+	{
+		if ((i == 0) || (sorted[i].ptr != sorted[i - 1].ptr)) nuniq++;
+		offsets[3 * sorted[i].idx + which] = (unsigned int) ((nuniq - 1) * mat_size);
+	}
+	
+	*packed_size = (size_t) nuniq * mat_size * sizeof(float);
+	float *packed = (float *) allocCLPinnedHost(*packed_size, NULL);
+	if (packed != NULL)
+	{
+		for (int i = 0; i < batch_size; i++)
+		{
+			if ((i > 0) && (sorted[i].ptr == sorted[i - 1].ptr)) continue;
+			memcpy(packed + offsets[3 * sorted[i].idx + which], sorted[i].ptr, mat_size * sizeof(float));
+		}
+	}
+	free(sorted);
+	return packed;
+}
+
+int sgemm_batched(
+	const int M, const int N, const int K, const float alpha, 
+	const float **A_array, const float **B_array, 
+	const float beta, float **C_array, const int batch_size, cl_program program
+)
+{
+	if (checkBatchedSize(M, N, K) != 0) return -1;
+	if (batch_size < 1) return 0;
+	if (checkBatchedOutputs(C_array, batch_size, (size_t) M * N) != 0) return -1;
+	
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_int err = CL_SUCCESS;
+	cl_kernel kernel = clCreateKernel(program, "sgemm_batched_offsets", &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateKernel() failed for sgemm_batched_offsets, returned status = %d\n", err);
+		return -1;
+	}
+	
+	// Pack A, B and C into pinned staging memory
+	size_t offsets_mem_size = sizeof(unsigned int) * 3 * batch_size;
+	unsigned int *offsets = (unsigned int *) allocCLPinnedHost(offsets_mem_size, NULL);
+	size_t A_mem_size, B_mem_size;
+	size_t C_size = (size_t) M * N;
+	size_t C_mem_size = C_size * batch_size * sizeof(float);
+	float *pin_A = packBatchedMatrices(A_array, batch_size, (size_t) M * K, offsets, 0, &A_mem_size);
+	float *pin_B = packBatchedMatrices(B_array, batch_size, (size_t) K * N, offsets, 1, &B_mem_size);
+	float *pin_C = (float *) allocCLPinnedHost(C_mem_size, NULL);
+	assert(offsets != NULL && pin_A != NULL && pin_B != NULL && pin_C != NULL);
+	for (int i = 0; i < batch_size; i++)
+	{
+		offsets[3 * i + 2] = (unsigned int) (i * C_size);
+		if (beta != 0.0f) memcpy(pin_C + i * C_size, C_array[i], C_size * sizeof(float));
+	}
+	
+	cl_mem d_A = allocCLPoolBuffer(A_mem_size, CL_MEM_READ_ONLY);
+	cl_mem d_B = allocCLPoolBuffer(B_mem_size, CL_MEM_READ_ONLY);
+	cl_mem d_C = allocCLPoolBuffer(C_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_offsets = allocCLPoolBuffer(offsets_mem_size, CL_MEM_READ_ONLY);
+	
+	cl_event h2d_copy[4];
+	cl_uint nh2d = 3;
+	err |= clEnqueueWriteBuffer(queue, d_A, CL_FALSE, 0, A_mem_size, pin_A, 0, NULL, &h2d_copy[0]);
+	err |= clEnqueueWriteBuffer(queue, d_B, CL_FALSE, 0, B_mem_size, pin_B, 0, NULL, &h2d_copy[1]);
+	err |= clEnqueueWriteBuffer(queue, d_offsets, CL_FALSE, 0, offsets_mem_size, offsets, 0, NULL, &h2d_copy[2]);
+	if (beta != 0.0f)
+	{
+		err |= clEnqueueWriteBuffer(queue, d_C, CL_FALSE, 0, C_mem_size, pin_C, 0, NULL, &h2d_copy[3]);
+		nh2d = 4;
+	}
+	
+	unsigned int _M = M, _N = N, _K = K;
+	err |= clSetKernelArg(kernel, 0, sizeof(unsigned int), (void*) &_M);
+	err |= clSetKernelArg(kernel, 1, sizeof(unsigned int), (void*) &_N);
+	err |= clSetKernelArg(kernel, 2, sizeof(unsigned int), (void*) &_K);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*) &d_A);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*) &d_B);
+	err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), (void*) &d_C);
+	err |= clSetKernelArg(kernel, 6, sizeof(cl_mem), (void*) &d_offsets);
+	err |= clSetKernelArg(kernel, 7, sizeof(float), (void*) &alpha);
+	err |= clSetKernelArg(kernel, 8, sizeof(float), (void*) &beta);
+	const size_t wg_size[2] = {SGEMM_BATCH_WG, SGEMM_BATCH_WG};
+	const size_t ws_size[2] = {(size_t) SGEMM_BATCH_WG * batch_size, SGEMM_BATCH_WG};
+	cl_event kernel_exec;
+	err |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ws_size, wg_size, nh2d, h2d_copy, &kernel_exec);
+	err |= clEnqueueReadBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, pin_C, 1, &kernel_exec, NULL);
+	if (err != CL_SUCCESS) printf("[ERROR] sgemm_batched() failed\n");
+	
+	// Scatter C back
+	for (int i = 0; i < batch_size; i++)
+		memcpy(C_array[i], pin_C + i * C_size, C_size * sizeof(float));
+	
+	for (cl_uint i = 0; i < nh2d; i++) clReleaseEvent(h2d_copy[i]);
+	clReleaseEvent(kernel_exec);
+	clReleaseKernel(kernel);
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	freeCLPoolBuffer(d_offsets);
+	freeCLPinnedHost(pin_A);
+	freeCLPinnedHost(pin_B);
+	freeCLPinnedHost(pin_C);
+	freeCLPinnedHost(offsets);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
@@ -0,0 +1,45 @@
+#ifndef __SGEMM_BATCHED_H__
+#define __SGEMM_BATCHED_H__
+
+#include <CL/cl.h>
+
+// All matrices are row-major and packed: A_i is M * K, B_i is K * N, C_i is M * N.
+// Device functions require M, N, K <= SGEMM_BATCH_MAX_DIM and launch only one 
+// kernel for the whole batch. They return 0 on success.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// C_array[i] = alpha * A_array[i] * B_array[i] + beta * C_array[i] on CPU, for reference
+void sgemm_batched_host(
+	const int M, const int N, const int K, const float alpha, 
+	const float **A_array, const float **B_array, 
+	const float beta, float **C_array, const int batch_size
+);
+
+// C_array[i] = alpha * A_array[i] * B_array[i] + beta * C_array[i] on device.
+// A_array and B_array may repeat the same pointer, each distinct matrix is 
+// uploaded only once. Returns -1 if the C matrices overlap.
+int sgemm_batched(
+	const int M, const int N, const int K, const float alpha, 
+	const float **A_array, const float **B_array, 
+	const float beta, float **C_array, const int batch_size, cl_program program
+);
+
+// C_i = alpha * A_i * B_i + beta * C_i on device, where A_i = A + i * stride_A,
+// B_i = B + i * stride_B and C_i = C + i * stride_C. A stride of 0 uses the same
+// A or B for the whole batch. Returns -1 if a stride is negative, or smaller than 
+// its matrix (M * K, K * N, M * N) so the matrices overlap; only A and B may use 0.
+int sgemm_batched_strided(
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int stride_A, const float *B, const int stride_B, 
+	const float beta, float *C, const int stride_C, const int batch_size, 
+	cl_program program
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
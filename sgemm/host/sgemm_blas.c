@@ -0,0 +1,303 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "sgemm_blas.h"
+#include "sgemm_cpu.h"
+#include "sgemm_tuning.h"
+#include "../device/my_sgemm.h"
+
+#define CEIL_DIV(x, y) (((x) + (y) - 1) / (y))
+
+// A column-major matrix with leading dimension ld is the transpose of a row-major 
+// matrix with the same ld. Since C^T = op(B)^T * op(A)^T, a column-major call is 
+// a row-major call with A and B, M and N, transA and transB swapped. 
+typedef struct
+{
+	int M, N, K, transA, transB;
+	int lda, ldb;
+	int swapAB;
+} sgemmRowMajorCall_t;
+
+static int toRowMajorCall(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const int lda, const int ldb, const int ldc,
+	sgemmRowMajorCall_t *call
+)
+{
+	if ((layout != SgemmRowMajor) && (layout != SgemmColMajor))
+	{
+		printf("[ERROR] sgemm_blas: invalid layout %d\n", layout);
+		return -1;
+	}
+	if (((transA != SgemmNoTrans) && (transA != SgemmTrans)) || ((transB != SgemmNoTrans) && (transB != SgemmTrans)))
+	{
+		printf("[ERROR] sgemm_blas: invalid transA %d or transB %d\n", transA, transB);
+		return -1;
+	}
+	if ((M < 0) || (N < 0) || (K < 0))
+	{
+		printf("[ERROR] sgemm_blas: invalid size (%d, %d, %d)\n", M, N, K);
+		return -1;
+	}
+	
+	// Minimal leading dimensions, same checks as the reference BLAS
+	int row_major = (layout == SgemmRowMajor);
+	int lda_min = ((transA == SgemmNoTrans) == row_major) ? K : M;
+	int ldb_min = ((transB == SgemmNoTrans) == row_major) ? N : K;
+	int ldc_min = row_major ? N : M;
+	if (lda_min < 1) lda_min = 1;
+	if (ldb_min < 1) ldb_min = 1;
+	if (ldc_min < 1) ldc_min = 1;
+	if ((lda < lda_min) || (ldb < ldb_min) || (ldc < ldc_min))
+	{
+		printf("[ERROR] sgemm_blas: lda = %d, ldb = %d, ldc = %d, need at least %d, %d, %d\n", lda, ldb, ldc, lda_min, ldb_min, ldc_min);
+		return -1;
+	}
+	
+	if (row_major)
+	{
+		call->M = M;  call->N = N;  call->K = K;
+		call->transA = (transA == SgemmTrans);
+		call->transB = (transB == SgemmTrans);
+		call->lda = lda;  call->ldb = ldb;
+		call->swapAB = 0;
+	} else {
+		call->M = N;  call->N = M;  call->K = K;
+		call->transA = (transB == SgemmTrans);
+		call->transB = (transA == SgemmTrans);
+		call->lda = ldb;  call->ldb = lda;
+		call->swapAB = 1;
+	}
+	return 0;
+}
+
+int sgemm_blas_host(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int lda, const float *B, const int ldb, 
+	const float beta, float *C, const int ldc
+)
+{
+	sgemmRowMajorCall_t call;
+	if (toRowMajorCall(layout, transA, transB, M, N, K, lda, ldb, ldc, &call) != 0) return -1;
+	const float *_A = call.swapAB ? B : A;
+	const float *_B = call.swapAB ? A : B;
+	
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < call.M; i++)
+	{
+		for (int j = 0; j < call.N; j++)
+		{
+			float accu = 0.0;
+			for (int k = 0; k < call.K; k++)
+			{
+				float a = call.transA ? _A[(size_t) k * call.lda + i] : _A[(size_t) i * call.lda + k];
+				float b = call.transB ? _B[(size_t) j * call.ldb + k] : _B[(size_t) k * call.ldb + j];
+				accu += a * b;
+			}
+			float *c = C + (size_t) i * ldc + j;
+			if (beta == 0.0f) *c = alpha * accu;
+			else *c = alpha * accu + beta * (*c);
+		}
+	}
+	return 0;
+}
+
+int sgemm_blas_cpu(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int lda, const float *B, const int ldb, 
+	const float beta, float *C, const int ldc
+)
+{
+	sgemmRowMajorCall_t call;
+	if (toRowMajorCall(layout, transA, transB, M, N, K, lda, ldb, ldc, &call) != 0) return -1;
+	const float *_A = call.swapAB ? B : A;
+	const float *_B = call.swapAB ? A : B;
+	sgemm_cpu(call.transA, call.transB, call.M, call.N, call.K, alpha, _A, call.lda, _B, call.ldb, beta, C, ldc);
+	return 0;
+}
+
+// Number of elements from the first to the last element of a rows * cols view with leading dimension ld
+static size_t getViewSpan(const int rows, const int cols, const int ld)
+{
+	if ((rows == 0) || (cols == 0)) return 0;
+	return (size_t) (rows - 1) * ld + cols;
+}
+
+int sgemm_blas_dev(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	cl_mem A, const size_t A_offset, const int lda, 
+	cl_mem B, const size_t B_offset, const int ldb, const float beta, 
+	cl_mem C, const size_t C_offset, const int ldc, 
+	cl_command_queue queue, cl_program program, 
+	cl_uint num_wait_events, const cl_event *wait_events, cl_event *event
+)
+{
+	sgemmRowMajorCall_t call;
+	if (toRowMajorCall(layout, transA, transB, M, N, K, lda, ldb, ldc, &call) != 0) return -1;
+	if ((call.M == 0) || (call.N == 0))
+	{
+		if (event != NULL) return (clEnqueueMarkerWithWaitList(queue, num_wait_events, wait_events, event) == CL_SUCCESS) ? 0 : -1;
+		return 0;
+	}
+	
+	// The kernel indexes the matrices with unsigned int, so every view must end below UINT_MAX
+	size_t A_off = call.swapAB ? B_offset : A_offset;
+	size_t B_off = call.swapAB ? A_offset : B_offset;
+	size_t A_end = A_off + getViewSpan(call.transA ? call.K : call.M, call.transA ? call.M : call.K, call.lda);
+	size_t B_end = B_off + getViewSpan(call.transB ? call.N : call.K, call.transB ? call.K : call.N, call.ldb);
+	size_t C_end = C_offset + getViewSpan(call.M, call.N, ldc);
+	if ((A_off > UINT_MAX) || (B_off > UINT_MAX) || (C_offset > UINT_MAX) || 
+	    (A_end > UINT_MAX) || (B_end > UINT_MAX) || (C_end > UINT_MAX))
+	{
+		printf("[ERROR] sgemm_blas_dev: matrix offsets or views exceed %u elements\n", UINT_MAX);
+		return -1;
+	}
+	
+	cl_kernel kernel = clCreateKernel(program, "sgemm_3_2Dreg_blas", NULL);
+	cl_mem _A = call.swapAB ? B : A;
+	cl_mem _B = call.swapAB ? A : B;
+	unsigned int _A_offset = A_off;
+	unsigned int _B_offset = B_off;
+	unsigned int _C_offset = C_offset;
+	unsigned int _lda = call.lda, _ldb = call.ldb, _ldc = ldc;
+	unsigned int common_dim = call.K, c_height = call.M, c_width = call.N;
+	
+	cl_int err = CL_SUCCESS;
+	err |= clSetKernelArg(kernel, 0,  sizeof(cl_mem), (void*) &_A);
+	err |= clSetKernelArg(kernel, 1,  sizeof(unsigned int), (void*) &_lda);
+	err |= clSetKernelArg(kernel, 2,  sizeof(cl_mem), (void*) &_B);
+	err |= clSetKernelArg(kernel, 3,  sizeof(unsigned int), (void*) &_ldb);
+	err |= clSetKernelArg(kernel, 4,  sizeof(cl_mem), (void*) &C);
+	err |= clSetKernelArg(kernel, 5,  sizeof(unsigned int), (void*) &_ldc);
+	err |= clSetKernelArg(kernel, 6,  sizeof(float), (void*) &alpha);
+	err |= clSetKernelArg(kernel, 7,  sizeof(float), (void*) &beta);
+	err |= clSetKernelArg(kernel, 8,  sizeof(unsigned int), (void*) &common_dim);
+	err |= clSetKernelArg(kernel, 9,  sizeof(unsigned int), (void*) &c_height);
+	err |= clSetKernelArg(kernel, 10, sizeof(unsigned int), (void*) &c_width);
+	err |= clSetKernelArg(kernel, 11, sizeof(unsigned int), (void*) &_A_offset);
+	err |= clSetKernelArg(kernel, 12, sizeof(unsigned int), (void*) &_B_offset);
+	err |= clSetKernelArg(kernel, 13, sizeof(unsigned int), (void*) &_C_offset);
+	err |= clSetKernelArg(kernel, 14, sizeof(int), (void*) &call.transA);
+	err |= clSetKernelArg(kernel, 15, sizeof(int), (void*) &call.transB);
+	
+	// Launch geometry follows the tile parameters the program was built with
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	const size_t wg_size[2] = {tp->tile_size / tp->wptn, tp->tile_size / tp->wptm};
+	const size_t ws_size[2] = {CEIL_DIV(c_width, tp->tile_size) * tp->tile_size / tp->wptn, CEIL_DIV(c_height, tp->tile_size) * tp->tile_size / tp->wptm};
+	err |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ws_size, wg_size, num_wait_events, wait_events, event);
+	if (err != CL_SUCCESS) printf("[ERROR] sgemm_blas_dev() failed\n");
+	
+	clReleaseKernel(kernel);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+int sgemm_blas(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int lda, const float *B, const int ldb, 
+	const float beta, float *C, const int ldc, cl_program program
+)
+{
+	// CPU fallback, the OpenCL device is not an FPGA
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("SGEMM_CPU_FALLBACK");
+	int use_cpu = (rt == NULL) || (program == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (program != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) use_cpu = 0;
+	if (use_cpu) return sgemm_blas_cpu(layout, transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+	
+	sgemmRowMajorCall_t call;
+	if (toRowMajorCall(layout, transA, transB, M, N, K, lda, ldb, ldc, &call) != 0) return -1;
+	if ((call.M == 0) || (call.N == 0)) return 0;
+	
+	// Stored (row-major) shapes of A and B after the layout conversion
+	const float *_A = call.swapAB ? B : A;
+	const float *_B = call.swapAB ? A : B;
+	int A_rows = call.transA ? call.K : call.M, A_cols = call.transA ? call.M : call.K;
+	int B_rows = call.transB ? call.N : call.K, B_cols = call.transB ? call.K : call.N;
+	size_t A_span = getViewSpan(A_rows, A_cols, call.lda);
+	size_t B_span = getViewSpan(B_rows, B_cols, call.ldb);
+	size_t C_span = getViewSpan(call.M, call.N, ldc);
+	if (A_span == 0) A_span = 1;
+	if (B_span == 0) B_span = 1;
+	
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_mem d_A = allocCLPoolBuffer(sizeof(float) * A_span, CL_MEM_READ_ONLY);
+	cl_mem d_B = allocCLPoolBuffer(sizeof(float) * B_span, CL_MEM_READ_ONLY);
+	cl_mem d_C = allocCLPoolBuffer(sizeof(float) * C_span, CL_MEM_READ_WRITE);
+	if ((d_A == NULL) || (d_B == NULL) || (d_C == NULL))
+	{
+		freeCLPoolBuffer(d_A);
+		freeCLPoolBuffer(d_B);
+		freeCLPoolBuffer(d_C);
+		return -1;
+	}
+	
+	// The device matrices keep the leading dimensions of the host ones, but only the 
+	// rows of each view are copied, the gaps between them are not read by the kernel
+	const size_t origin[3] = {0, 0, 0};
+	const size_t A_region[3] = {sizeof(float) * A_cols, (size_t) A_rows, 1};
+	const size_t B_region[3] = {sizeof(float) * B_cols, (size_t) B_rows, 1};
+	const size_t C_region[3] = {sizeof(float) * call.N, (size_t) call.M, 1};
+	const size_t A_pitch = sizeof(float) * call.lda;
+	const size_t B_pitch = sizeof(float) * call.ldb;
+	const size_t C_pitch = sizeof(float) * ldc;
+	cl_int err = CL_SUCCESS;
+	cl_event h2d_copy[3];
+	cl_uint nh2d = 0;
+	if (call.K > 0)
+	{
+		err |= clEnqueueWriteBufferRect(
+			queue, d_A, CL_FALSE, origin, origin, A_region, 
+			A_pitch, 0, A_pitch, 0, _A, 0, NULL, &h2d_copy[nh2d++]
+		);
+		err |= clEnqueueWriteBufferRect(
+			queue, d_B, CL_FALSE, origin, origin, B_region, 
+			B_pitch, 0, B_pitch, 0, _B, 0, NULL, &h2d_copy[nh2d++]
+		);
+	}
+	if (beta != 0.0f)
+	{
+		err |= clEnqueueWriteBufferRect(
+			queue, d_C, CL_FALSE, origin, origin, C_region, 
+			C_pitch, 0, C_pitch, 0, C, 0, NULL, &h2d_copy[nh2d++]
+		);
+	}
+	
+	cl_event kernel_exec;
+	if (err == CL_SUCCESS)
+	{
+		err = sgemm_blas_dev(
+			SgemmRowMajor, call.transA ? SgemmTrans : SgemmNoTrans, call.transB ? SgemmTrans : SgemmNoTrans,
+			call.M, call.N, call.K, alpha, d_A, 0, call.lda, d_B, 0, call.ldb, beta, d_C, 0, ldc,
+			queue, program, nh2d, h2d_copy, &kernel_exec
+		);
+	}
+	
+	// Only the M * N view is written back to C
+	if (err == CL_SUCCESS)
+	{
+		err = clEnqueueReadBufferRect(
+			queue, d_C, CL_TRUE, origin, origin, C_region, 
+			C_pitch, 0, C_pitch, 0, C, 1, &kernel_exec, NULL
+		);
+		if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBufferRect() failed, returned status = %d\n", err);
+		clReleaseEvent(kernel_exec);
+	} else {
+		clFinish(queue);
+	}
+	
+	for (cl_uint i = 0; i < nh2d; i++) clReleaseEvent(h2d_copy[i]);
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
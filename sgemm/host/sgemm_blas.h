@@ -0,0 +1,66 @@
+#ifndef __SGEMM_BLAS_H__
+#define __SGEMM_BLAS_H__
+
+#include <CL/cl.h>
+
+// Same values as CBLAS_LAYOUT and CBLAS_TRANSPOSE in cblas.h
+typedef enum {SgemmRowMajor = 101, SgemmColMajor = 102} sgemmLayout_t;
+typedef enum {SgemmNoTrans  = 111, SgemmTrans    = 112} sgemmTrans_t;
+
+// C = alpha * op(A) * op(B) + beta * C, where op(X) = X or X^T, op(A) is M * K, 
+// op(B) is K * N and C is M * N. Arguments follow cblas_sgemm(): lda, ldb and ldc 
+// are the leading dimensions of A, B and C in the given layout, so a submatrix of a 
+// larger matrix can be passed directly. C is not read when beta == 0.
+// Functions return 0 on success and -1 on invalid arguments or OpenCL errors.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Naive reference on CPU
+int sgemm_blas_host(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int lda, const float *B, const int ldb, 
+	const float beta, float *C, const int ldc
+);
+
+// Packed and vectorized CPU implementation, see sgemm_cpu.h
+int sgemm_blas_cpu(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int lda, const float *B, const int ldb, 
+	const float beta, float *C, const int ldc
+);
+
+// On device, A, B and C are device buffers and the matrices start at element 
+// A_offset, B_offset and C_offset. The call is enqueued on queue and does not 
+// wait for it to finish; event may be NULL. Returns -1 if a view ends past 
+// UINT_MAX elements, the kernel uses unsigned int indices.
+int sgemm_blas_dev(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	cl_mem A, const size_t A_offset, const int lda, 
+	cl_mem B, const size_t B_offset, const int ldb, const float beta, 
+	cl_mem C, const size_t C_offset, const int ldc, 
+	cl_command_queue queue, cl_program program, 
+	cl_uint num_wait_events, const cl_event *wait_events, cl_event *event
+);
+
+// On device with host matrices. Only the rows covered by each matrix are copied, 
+// and C is copied back with a rectangular read, so elements of C outside the 
+// M * N view are not modified. If there is no FPGA (or program is NULL), 
+// sgemm_blas_cpu() is used instead; set $SGEMM_CPU_FALLBACK to 0 to use the 
+// OpenCL device anyway.
+int sgemm_blas(
+	const sgemmLayout_t layout, const sgemmTrans_t transA, const sgemmTrans_t transB,
+	const int M, const int N, const int K, const float alpha, 
+	const float *A, const int lda, const float *B, const int ldb, 
+	const float beta, float *C, const int ldc, cl_program program
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,241 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <omp.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "sgemm_cpu.h"
+
+// Blocking follows the usual GotoBLAS / BLIS scheme: B is packed in KC * NC panels
+// that stay in L3, A is packed in MC * KC blocks that stay in L2, and the 
+// micro-kernel computes an MR * NR tile of C in registers from one MR-row sliver
+// of packed A and one NR-column sliver of packed B.
+#if defined(__AVX512F__)
+#define SGEMM_CPU_MR   12
+#define SGEMM_CPU_NR   32
+#define SGEMM_CPU_NAME "AVX-512 12x32"
+#elif defined(__AVX2__) && defined(__FMA__)
+#define SGEMM_CPU_MR   6
+#define SGEMM_CPU_NR   16
+#define SGEMM_CPU_NAME "AVX2 6x16"
+#else
+#define SGEMM_CPU_MR   4
+#define SGEMM_CPU_NR   8
+#define SGEMM_CPU_NAME "generic 4x8"
+#endif
+
+#define SGEMM_CPU_KC 256
+#define SGEMM_CPU_MC (SGEMM_CPU_MR * 16)
+#define SGEMM_CPU_NC (SGEMM_CPU_NR * 128)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CEIL_DIV(x, y) (((x) + (y) - 1) / (y))
+
+const char *sgemm_cpu_kernel_name()
+{
+	return SGEMM_CPU_NAME;
+}
+
+// Pack the MR-row sliver starting at row i0 of op(A)[i0 : i0 + mr, p0 : p0 + kc]. 
+// Layout is k-major, MR values per k. Rows beyond mr are zero.
+static void packSliverA(
+	const int transA, const float *A, const int lda, 
+	const int i0, const int mr, const int p0, const int kc, float *buf
+)
+{
+	for (int k = 0; k < kc; k++)
+	{
+		float *dst = buf + k * SGEMM_CPU_MR;
+		if (transA)
+		{
+			const float *src = A + (size_t) (p0 + k) * lda + i0;
+			for (int r = 0; r < mr; r++) dst[r] = src[r];
+		} else {
+			const float *src = A + (size_t) i0 * lda + p0 + k;
+			for (int r = 0; r < mr; r++) dst[r] = src[(size_t) r * lda];
+		}
+		for (int r = mr; r < SGEMM_CPU_MR; r++) dst[r] = 0.0f;
+	}
+}
+
+// Pack the NR-column sliver op(B)[p0 : p0 + kc, j0 : j0 + nr], NR values per k
+static void packSliverB(
+	const int transB, const float *B, const int ldb, 
+	const int p0, const int kc, const int j0, const int nr, float *buf
+)
+{
+	for (int k = 0; k < kc; k++)
+	{
+		float *dst = buf + k * SGEMM_CPU_NR;
+		if (transB)
+		{
+			const float *src = B + (size_t) j0 * ldb + p0 + k;
+			for (int c = 0; c < nr; c++) dst[c] = src[(size_t) c * ldb];
+		} else {
+			const float *src = B + (size_t) (p0 + k) * ldb + j0;
+			for (int c = 0; c < nr; c++) dst[c] = src[c];
+		}
+		for (int c = nr; c < SGEMM_CPU_NR; c++) dst[c] = 0.0f;
+	}
+}
+
+// AB = packed A sliver * packed B sliver, MR * NR row-major
+static void sgemmMicroKernel(const int kc, const float *Ap, const float *Bp, float *AB)
+{
+#if defined(__AVX512F__)
+	__m512 c0[SGEMM_CPU_MR], c1[SGEMM_CPU_MR];
+	for (int r = 0; r < SGEMM_CPU_MR; r++)
+	{
+		c0[r] = _mm512_setzero_ps();
+		c1[r] = _mm512_setzero_ps();
+	}
+	for (int k = 0; k < kc; k++)
+	{
+		__m512 b0 = _mm512_load_ps(Bp + k * SGEMM_CPU_NR);
+		__m512 b1 = _mm512_load_ps(Bp + k * SGEMM_CPU_NR + 16);
+		const float *a = Ap + k * SGEMM_CPU_MR;
+		#pragma GCC unroll 12
+		for (int r = 0; r < SGEMM_CPU_MR; r++)
+		{
+			__m512 ar = _mm512_set1_ps(a[r]);
+			c0[r] = _mm512_fmadd_ps(ar, b0, c0[r]);
+			c1[r] = _mm512_fmadd_ps(ar, b1, c1[r]);
+		}
+	}
+	for (int r = 0; r < SGEMM_CPU_MR; r++)
+	{
+		_mm512_store_ps(AB + r * SGEMM_CPU_NR,      c0[r]);
+		_mm512_store_ps(AB + r * SGEMM_CPU_NR + 16, c1[r]);
+	}
+#elif defined(__AVX2__) && defined(__FMA__)
+	__m256 c0[SGEMM_CPU_MR], c1[SGEMM_CPU_MR];
+	for (int r = 0; r < SGEMM_CPU_MR; r++)
+	{
+		c0[r] = _mm256_setzero_ps();
+		c1[r] = _mm256_setzero_ps();
+	}
+	for (int k = 0; k < kc; k++)
+	{
+		__m256 b0 = _mm256_load_ps(Bp + k * SGEMM_CPU_NR);
+		__m256 b1 = _mm256_load_ps(Bp + k * SGEMM_CPU_NR + 8);
+		const float *a = Ap + k * SGEMM_CPU_MR;
+		#pragma GCC unroll 6
+		for (int r = 0; r < SGEMM_CPU_MR; r++)
+		{
+			__m256 ar = _mm256_broadcast_ss(a + r);
+			c0[r] = _mm256_fmadd_ps(ar, b0, c0[r]);
+			c1[r] = _mm256_fmadd_ps(ar, b1, c1[r]);
+		}
+	}
+	for (int r = 0; r < SGEMM_CPU_MR; r++)
+	{
+		_mm256_store_ps(AB + r * SGEMM_CPU_NR,     c0[r]);
+		_mm256_store_ps(AB + r * SGEMM_CPU_NR + 8, c1[r]);
+	}
+#else
+	float acc[SGEMM_CPU_MR][SGEMM_CPU_NR];
+	memset(acc, 0, sizeof(acc));
+	for (int k = 0; k < kc; k++)
+	{
+		const float *a = Ap + k * SGEMM_CPU_MR;
+		const float *b = Bp + k * SGEMM_CPU_NR;
+		for (int r = 0; r < SGEMM_CPU_MR; r++)
+			#pragma omp simd
+			for (int c = 0; c < SGEMM_CPU_NR; c++) acc[r][c] += a[r] * b[c];
+	}
+	memcpy(AB, acc, sizeof(acc));
+#endif
+}
+
+// Scale C by beta before accumulating, C = 0 if beta == 0 so C is not read
+static void scaleC(const int M, const int N, const float beta, float *C, const int ldc)
+{
+	if (beta == 1.0f) return;
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < M; i++)
+	{
+		float *c = C + (size_t) i * ldc;
+		if (beta == 0.0f) memset(c, 0, sizeof(float) * N);
+		else for (int j = 0; j < N; j++) c[j] *= beta;
+	}
+}
+
+void sgemm_cpu(
+	const int transA, const int transB, const int M, const int N, const int K,
+	const float alpha, const float *A, const int lda, const float *B, const int ldb,
+	const float beta, float *C, const int ldc
+)
+{
+	if ((M <= 0) || (N <= 0)) return;
+	scaleC(M, N, beta, C, ldc);
+	if ((K <= 0) || (alpha == 0.0f)) return;
+	
+	float *Abuf = NULL, *Bbuf = NULL;
+	int ret = posix_memalign((void**) &Abuf, 64, sizeof(float) * SGEMM_CPU_MC * SGEMM_CPU_KC);
+	ret    |= posix_memalign((void**) &Bbuf, 64, sizeof(float) * SGEMM_CPU_KC * SGEMM_CPU_NC);
+	assert(ret == 0);
+	
+	#pragma omp parallel
+	{
+		float AB[SGEMM_CPU_MR * SGEMM_CPU_NR] __attribute__((aligned(64)));
+		
+		for (int jc = 0; jc < N; jc += SGEMM_CPU_NC)
+		{
+			int nc = MIN(SGEMM_CPU_NC, N - jc);
+			int n_sliver = CEIL_DIV(nc, SGEMM_CPU_NR);
+			for (int pc = 0; pc < K; pc += SGEMM_CPU_KC)
+			{
+				int kc = MIN(SGEMM_CPU_KC, K - pc);
+				
+				#pragma omp for schedule(static)
+				for (int js = 0; js < n_sliver; js++)
+				{
+					int jr = js * SGEMM_CPU_NR;
+					packSliverB(transB, B, ldb, pc, kc, jc + jr, MIN(SGEMM_CPU_NR, nc - jr), Bbuf + (size_t) js * SGEMM_CPU_NR * kc);
+				}
+				
+				for (int ic = 0; ic < M; ic += SGEMM_CPU_MC)
+				{
+					int mc = MIN(SGEMM_CPU_MC, M - ic);
+					int m_sliver = CEIL_DIV(mc, SGEMM_CPU_MR);
+					
+					#pragma omp for schedule(static)
+					for (int is = 0; is < m_sliver; is++)
+					{
+						int ir = is * SGEMM_CPU_MR;
+						packSliverA(transA, A, lda, ic + ir, MIN(SGEMM_CPU_MR, mc - ir), pc, kc, Abuf + (size_t) is * SGEMM_CPU_MR * kc);
+					}
+					
+					// Split the micro tiles of this block among threads
+					#pragma omp for collapse(2) schedule(static)
+					for (int js = 0; js < n_sliver; js++)
+					{
+						for (int is = 0; is < m_sliver; is++)
+						{
+							int ir = is * SGEMM_CPU_MR, jr = js * SGEMM_CPU_NR;
+							int mr = MIN(SGEMM_CPU_MR, mc - ir), nr = MIN(SGEMM_CPU_NR, nc - jr);
+							sgemmMicroKernel(
+								kc, Abuf + (size_t) is * SGEMM_CPU_MR * kc, 
+								Bbuf + (size_t) js * SGEMM_CPU_NR * kc, AB
+							);
+							float *c = C + (size_t) (ic + ir) * ldc + jc + jr;
+							for (int r = 0; r < mr; r++)
+							{
+								#pragma omp simd
+								for (int j = 0; j < nr; j++) 
+									c[(size_t) r * ldc + j] += alpha * AB[r * SGEMM_CPU_NR + j];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	free(Abuf);
+	free(Bbuf);
+}
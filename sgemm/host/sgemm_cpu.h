@@ -0,0 +1,29 @@
+#ifndef __SGEMM_CPU_H__
+#define __SGEMM_CPU_H__
+
+// Packed, register-blocked and OpenMP-parallel SGEMM on CPU. The micro-kernel uses 
+// AVX-512 or AVX2 + FMA when the file is compiled for them (-march=native), 
+// otherwise a plain C micro-kernel is used.
+//
+// Row-major C = alpha * op(A) * op(B) + beta * C, op(X) = X^T if transX != 0.
+// op(A) is M * K, op(B) is K * N, C is M * N, lda, ldb and ldc are leading 
+// dimensions. C is not read when beta == 0.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sgemm_cpu(
+	const int transA, const int transB, const int M, const int N, const int K,
+	const float alpha, const float *A, const int lda, const float *B, const int ldb,
+	const float beta, float *C, const int ldc
+);
+
+// Name of the micro-kernel in use, e.g. "AVX-512 12x32"
+const char *sgemm_cpu_kernel_name();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,201 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "sgemm_tuning.h"
+#include "../device/my_sgemm.h"
+
+typedef struct
+{
+	int M, N, K;
+	sgemmTileParams_t params;
+	double gflops;
+} sgemmTuningEntry_t;
+
+static sgemmTuningEntry_t sgemm_tuning_table[SGEMM_TUNING_MAX_ENTRIES];
+static int sgemm_tuning_nentry = 0;
+static sgemmTileParams_t sgemm_active_params = {TILE_SIZE, WPTM, WPTN, SGEMM_SIMD};
+
+sgemmTileParams_t getSgemmDefaultTileParams()
+{
+	sgemmTileParams_t params = {TILE_SIZE, WPTM, WPTN, SGEMM_SIMD};
+	return params;
+}
+
+int checkSgemmTileParams(const sgemmTileParams_t *params)
+{
+	int T = params->tile_size;
+	if ((T < 1) || (params->wptm < 1) || (params->wptn < 1) || (params->simd < 1)) return -1;
+	if ((T % params->wptm != 0) || (T % params->wptn != 0)) return -1;
+	// num_simd_work_items should divide the work-group size on dimension 0 of all tiled kernels
+	if ((T % params->simd != 0) || ((T / params->wptn) % params->simd != 0)) return -1;
+	return 0;
+}
+
+void getSgemmBuildOptions(const sgemmTileParams_t *params, char *options, const size_t len)
+{
+	snprintf(
+		options, len, "-DTILE_SIZE=%d -DWPTM=%d -DWPTN=%d -DSGEMM_SIMD=%d", 
+		params->tile_size, params->wptm, params->wptn, params->simd
+	);
+}
+
+void getSgemmVariantFileName(const sgemmTileParams_t *params, char *file_name, const size_t len)
+{
+	snprintf(
+		file_name, len, "my_sgemm_t%d_m%d_n%d_s%d.aocx", 
+		params->tile_size, params->wptm, params->wptn, params->simd
+	);
+}
+
+static int sameSgemmTileParams(const sgemmTileParams_t *p1, const sgemmTileParams_t *p2)
+{
+	return ((p1->tile_size == p2->tile_size) && (p1->wptm == p2->wptm) && (p1->wptn == p2->wptn) && (p1->simd == p2->simd));
+}
+
+cl_program getSgemmTunedProgram(const sgemmTileParams_t *params)
+{
+	CLRuntime_t *rt = getCLRuntime();
+	if (rt == NULL) return NULL;
+	if (checkSgemmTileParams(params) != 0) return NULL;
+	
+	// Each .aocx has its parameters built in
+	sgemmTileParams_t default_params = getSgemmDefaultTileParams();
+	if (rt->device_type & CL_DEVICE_TYPE_ACCELERATOR)
+	{
+		char file_name[256];
+		getSgemmVariantFileName(params, file_name, sizeof(file_name));
+		FILE *fp = fopen(file_name, "rb");
+		if (fp != NULL)
+		{
+			fclose(fp);
+			return getCLRuntimeProgram(file_name);
+		}
+		if (sameSgemmTileParams(params, &default_params)) return getCLRuntimeProgram("my_sgemm.aocx");
+		return NULL;
+	}
+	
+	char options[256];
+	getSgemmBuildOptions(params, options, sizeof(options));
+	return getCLRuntimeProgramWithOptions("my_sgemm.aocx", options);
+}
+
+const sgemmTileParams_t *getSgemmActiveTileParams()
+{
+	return &sgemm_active_params;
+}
+
+void setSgemmActiveTileParams(const sgemmTileParams_t *params)
+{
+	sgemm_active_params = *params;
+}
+
+void setSgemmTuningEntry(const int M, const int N, const int K, const sgemmTileParams_t *params, const double gflops)
+{
+	int idx = -1;
+	for (int i = 0; i < sgemm_tuning_nentry; i++)
+	{
+		sgemmTuningEntry_t *e = &sgemm_tuning_table[i];
+		if ((e->M == M) && (e->N == N) && (e->K == K)) idx = i;
+	}
+	if (idx == -1)
+	{
+		if (sgemm_tuning_nentry == SGEMM_TUNING_MAX_ENTRIES)
+		{
+			printf("[WARNING] SGEMM tuning table is full (max %d entries)\n", SGEMM_TUNING_MAX_ENTRIES);
+			return;
+		}
+		idx = sgemm_tuning_nentry++;
+	}
+	sgemm_tuning_table[idx].M = M;
+	sgemm_tuning_table[idx].N = N;
+	sgemm_tuning_table[idx].K = K;
+	sgemm_tuning_table[idx].params = *params;
+	sgemm_tuning_table[idx].gflops = gflops;
+}
+
+static const char *getSgemmTuningTableName(const char *file_name)
+{
+	if (file_name != NULL) return file_name;
+	const char *env_name = getenv("SGEMM_TUNING_TABLE");
+	if ((env_name != NULL) && (env_name[0] != 0)) return env_name;
+	return SGEMM_TUNING_TABLE_DEFAULT;
+}
+
+int loadSgemmTuningTable(const char *file_name)
+{
+	file_name = getSgemmTuningTableName(file_name);
+	FILE *fp = fopen(file_name, "r");
+	if (fp == NULL) return -1;
+	
+	char line[1024];
+	int nload = 0;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#') continue;
+		int M, N, K;
+		double gflops;
+		sgemmTileParams_t params;
+		int nread = sscanf(
+			line, "%d %d %d %d %d %d %d %lf", &M, &N, &K, 
+			&params.tile_size, &params.wptm, &params.wptn, &params.simd, &gflops
+		);
+		if (nread != 8) continue;
+		// checkSgemmTileParams() also rejects tiles not divisible by WPTM / WPTN
+		if ((M < 1) || (N < 1) || (K < 1) || (checkSgemmTileParams(&params) != 0))
+		{
+			printf("[WARNING] Invalid SGEMM tuning entry ignored: %s", line);
+			continue;
+		}
+		setSgemmTuningEntry(M, N, K, &params, gflops);
+		nload++;
+	}
+	fclose(fp);
+	return nload;
+}
+
+int saveSgemmTuningTable(const char *file_name)
+{
+	file_name = getSgemmTuningTableName(file_name);
+	FILE *fp = fopen(file_name, "w");
+	if (fp == NULL)
+	{
+		printf("[ERROR] Cannot write SGEMM tuning table %s\n", file_name);
+		return -1;
+	}
+	fprintf(fp, "# M N K tile_size wptm wptn simd gflops\n");
+	for (int i = 0; i < sgemm_tuning_nentry; i++)
+	{
+		sgemmTuningEntry_t *e = &sgemm_tuning_table[i];
+		fprintf(
+			fp, "%d %d %d %d %d %d %d %.3lf\n", e->M, e->N, e->K, 
+			e->params.tile_size, e->params.wptm, e->params.wptn, e->params.simd, e->gflops
+		);
+	}
+	fclose(fp);
+	return 0;
+}
+
+sgemmTileParams_t getSgemmTileParams(const int M, const int N, const int K)
+{
+	if ((M < 1) || (N < 1) || (K < 1)) return getSgemmDefaultTileParams();
+	int best_idx = -1;
+	double best_dist = 0.0;
+	for (int i = 0; i < sgemm_tuning_nentry; i++)
+	{
+		sgemmTuningEntry_t *e = &sgemm_tuning_table[i];
+		double dist = fabs(log((double) M / (double) e->M)) 
+		            + fabs(log((double) N / (double) e->N)) 
+		            + fabs(log((double) K / (double) e->K));
+		if ((best_idx == -1) || (dist < best_dist))
+		{
+			best_idx  = i;
+			best_dist = dist;
+		}
+	}
+	if (best_idx == -1) return getSgemmDefaultTileParams();
+	return sgemm_tuning_table[best_idx].params;
+}
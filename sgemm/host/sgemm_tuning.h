@@ -0,0 +1,65 @@
+#ifndef __SGEMM_TUNING_H__
+#define __SGEMM_TUNING_H__
+
+#include <CL/cl.h>
+
+// Tile parameters of the sgemm_2_* and sgemm_3_* kernels, see device/my_sgemm.h.
+// RTSM = tile_size / wptm and RTSN = tile_size / wptn.
+typedef struct
+{
+	int tile_size, wptm, wptn, simd;
+} sgemmTileParams_t;
+
+// Tuning table file: one line "M N K tile_size wptm wptn simd gflops" for each 
+// problem shape, lines starting with '#' are comments. The file name is taken 
+// from $SGEMM_TUNING_TABLE, or SGEMM_TUNING_TABLE_DEFAULT if it is not set.
+#define SGEMM_TUNING_TABLE_DEFAULT "sgemm_tuning.txt"
+#define SGEMM_TUNING_MAX_ENTRIES   256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default parameters, the values in my_sgemm.h
+sgemmTileParams_t getSgemmDefaultTileParams();
+
+// Check that the kernels can be built and launched with the parameters, return 0 if valid
+int checkSgemmTileParams(const sgemmTileParams_t *params);
+
+// "-DTILE_SIZE=64 -DWPTM=8 -DWPTN=4 -DSGEMM_SIMD=4"
+void getSgemmBuildOptions(const sgemmTileParams_t *params, char *options, const size_t len);
+
+// "my_sgemm_t64_m8_n4_s4.aocx", the .aocx built with getSgemmBuildOptions()
+void getSgemmVariantFileName(const sgemmTileParams_t *params, char *file_name, const size_t len);
+
+// Get the program built with the parameters. On FPGA this is the variant .aocx file
+// (default parameters may also use my_sgemm.aocx), otherwise my_sgemm.cl is built
+// with the -D options. Returns NULL if the variant is not available.
+cl_program getSgemmTunedProgram(const sgemmTileParams_t *params);
+
+// Parameters of the program used by the host functions (test_sgemm.c, sgemm_blas.c) 
+// to compute launch geometry. They must match the program passed to those functions.
+const sgemmTileParams_t *getSgemmActiveTileParams();
+void setSgemmActiveTileParams(const sgemmTileParams_t *params);
+
+// Load a tuning table, entries are added to the ones already loaded.
+// file_name can be NULL for the default table. Returns the number of entries loaded, 
+// or -1 if the file cannot be opened.
+int loadSgemmTuningTable(const char *file_name);
+
+// Write all loaded entries to a tuning table file, return 0 on success
+int saveSgemmTuningTable(const char *file_name);
+
+// Add an entry or replace the entry of the same shape
+void setSgemmTuningEntry(const int M, const int N, const int K, const sgemmTileParams_t *params, const double gflops);
+
+// Parameters of the closest shape in the loaded table (exact match first, then 
+// the smallest sum of |log(size ratio)| over M, N, K), or the defaults if the 
+// table is empty
+sgemmTileParams_t getSgemmTileParams(const int M, const int N, const int K);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
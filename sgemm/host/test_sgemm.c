@@ -6,11 +6,17 @@
 #include <assert.h>
 #include <omp.h>
 
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
 #include "test_sgemm.h"
+#include "sgemm_tuning.h"
 #include "../device/my_sgemm.h"
 
 #define CEIL_DIV(x, y) (((x) + (y) - 1) / (y))
 
+#define SGEMM_STREAM_NSLOT 2  // Number of device buffer sets used in turn by testKernelStream()
+#define SGEMM_SYS_QUEUE    4  // Runtime queues SGEMM_SYS_QUEUE ~ SGEMM_SYS_QUEUE+3 run the systolic array kernels
+
 #define testKrnlParam1	C_height, C_width, comm_dim, alpha, beta, \
 						h_A, h_B, h_C, context, queue, program
 
@@ -20,17 +26,99 @@
 						cl_context context, cl_command_queue queue, cl_program program, \
 						const char *kernel_name, const size_t *kernel_wg_size, const size_t *kernel_ws_size
 						
+typedef struct
+{
+	cl_mem A, B, C;
+	cl_mem padA, padB, padC;
+} sgemmBuffers_t;
+
+// Events returned by enqueueSgemmPadded(): pad A, pad B, pad C, sgemm, unpad C
+#define SGEMM_PADDED_NEVENTS 5
+
+// Enqueue zero padding of A, B and C, the SGEMM kernel and the removal of padded 
+// zeros of C. Padding of A, B and C waits for h2d_events[0], [1] and [2] respectively.
+// The caller should release the returned events. 
+static cl_int enqueueSgemmPadded(
+	cl_command_queue queue, cl_kernel padzero_krnl, cl_kernel sgemm_kernel, cl_kernel unpadzero_krnl,
+	const unsigned int C_height, const unsigned int C_width, const unsigned int comm_dim, 
+	const float alpha, const float beta, const sgemmBuffers_t *bufs, 
+	const size_t *kernel_wg_size, const size_t *kernel_ws_size,
+	const cl_event *h2d_events, cl_event *events
+)
+{
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	cl_int err;
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	unsigned int pad_comm_dim = CEIL_DIV(comm_dim, tp->tile_size) * tp->tile_size;
+	
+	// Launch kernels for zero padding
+	const size_t wg_size[2] = {tp->tile_size, tp->tile_size};
+	// Pad zero for A
+	err = clSetKernelArg(padzero_krnl, 0, sizeof(unsigned int), (void*) &C_height);
+	err = clSetKernelArg(padzero_krnl, 1, sizeof(unsigned int), (void*) &comm_dim);
+	err = clSetKernelArg(padzero_krnl, 2, sizeof(unsigned int), (void*) &pad_C_height);
+	err = clSetKernelArg(padzero_krnl, 3, sizeof(unsigned int), (void*) &pad_comm_dim);
+	err = clSetKernelArg(padzero_krnl, 4, sizeof(cl_mem), (void*) &bufs->A);
+	err = clSetKernelArg(padzero_krnl, 5, sizeof(cl_mem), (void*) &bufs->padA);
+	const size_t ws_sizeA[2] = {pad_comm_dim, pad_C_height};
+	err = clEnqueueNDRangeKernel(queue, padzero_krnl, 2, NULL, ws_sizeA, wg_size, 1, &h2d_events[0], &events[0]);
+	// Pad zero for B
+	err = clSetKernelArg(padzero_krnl, 0, sizeof(unsigned int), (void*) &comm_dim);
+	err = clSetKernelArg(padzero_krnl, 1, sizeof(unsigned int), (void*) &C_width);
+	err = clSetKernelArg(padzero_krnl, 2, sizeof(unsigned int), (void*) &pad_comm_dim);
+	err = clSetKernelArg(padzero_krnl, 3, sizeof(unsigned int), (void*) &pad_C_width);
+	err = clSetKernelArg(padzero_krnl, 4, sizeof(cl_mem), (void*) &bufs->B);
+	err = clSetKernelArg(padzero_krnl, 5, sizeof(cl_mem), (void*) &bufs->padB);
+	const size_t ws_sizeB[2] = {pad_C_width, pad_comm_dim};
+	err = clEnqueueNDRangeKernel(queue, padzero_krnl, 2, NULL, ws_sizeB, wg_size, 1, &h2d_events[1], &events[1]);
+	// Pad zero for C
+	err = clSetKernelArg(padzero_krnl, 0, sizeof(unsigned int), (void*) &C_height);
+	err = clSetKernelArg(padzero_krnl, 1, sizeof(unsigned int), (void*) &C_width);
+	err = clSetKernelArg(padzero_krnl, 2, sizeof(unsigned int), (void*) &pad_C_height);
+	err = clSetKernelArg(padzero_krnl, 3, sizeof(unsigned int), (void*) &pad_C_width);
+	err = clSetKernelArg(padzero_krnl, 4, sizeof(cl_mem), (void*) &bufs->C);
+	err = clSetKernelArg(padzero_krnl, 5, sizeof(cl_mem), (void*) &bufs->padC);
+	const size_t ws_sizeC[2] = {pad_C_width, pad_C_height};
+	err = clEnqueueNDRangeKernel(queue, padzero_krnl, 2, NULL, ws_sizeC, wg_size, 1, &h2d_events[2], &events[2]);
+	
+	// Launch compute kernel
+	err = clSetKernelArg(sgemm_kernel, 0,  sizeof(cl_mem), (void*) &bufs->padA);
+	err = clSetKernelArg(sgemm_kernel, 1,  sizeof(unsigned int), (void*) &pad_comm_dim);
+	err = clSetKernelArg(sgemm_kernel, 2,  sizeof(cl_mem), (void*) &bufs->padB);
+	err = clSetKernelArg(sgemm_kernel, 3,  sizeof(unsigned int), (void*) &pad_C_width);
+	err = clSetKernelArg(sgemm_kernel, 4,  sizeof(cl_mem), (void*) &bufs->padC);
+	err = clSetKernelArg(sgemm_kernel, 5,  sizeof(unsigned int), (void*) &pad_C_width);
+	err = clSetKernelArg(sgemm_kernel, 6,  sizeof(float), (void*) &alpha);
+	err = clSetKernelArg(sgemm_kernel, 7,  sizeof(float), (void*) &beta);
+	err = clSetKernelArg(sgemm_kernel, 8,  sizeof(unsigned int), (void*) &pad_comm_dim);
+	err = clSetKernelArg(sgemm_kernel, 9,  sizeof(unsigned int), (void*) &pad_C_height);
+	err = clSetKernelArg(sgemm_kernel, 10, sizeof(unsigned int), (void*) &pad_C_width);
+	err = clEnqueueNDRangeKernel(queue, sgemm_kernel, 2, NULL, kernel_ws_size, kernel_wg_size, 3, &events[0], &events[3]);
+	
+	// Launch kernels for removing padded zeros
+	err = clSetKernelArg(unpadzero_krnl, 0, sizeof(unsigned int), (void*) &pad_C_height);
+	err = clSetKernelArg(unpadzero_krnl, 1, sizeof(unsigned int), (void*) &pad_C_width);
+	err = clSetKernelArg(unpadzero_krnl, 2, sizeof(unsigned int), (void*) &C_height);
+	err = clSetKernelArg(unpadzero_krnl, 3, sizeof(unsigned int), (void*) &C_width);
+	err = clSetKernelArg(unpadzero_krnl, 4, sizeof(cl_mem), (void*) &bufs->padC);
+	err = clSetKernelArg(unpadzero_krnl, 5, sizeof(cl_mem), (void*) &bufs->C);
+	err = clEnqueueNDRangeKernel(queue, unpadzero_krnl, 2, NULL, ws_sizeC, wg_size, 1, &events[3], &events[4]);
+	return err;
+}
+
 void testKernel(testKrnlParam2)
 {
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
 	printf("Target kernel: %s\n", kernel_name);
 	
 	cl_kernel padzero_krnl   = clCreateKernel(program, "padZeros_rm", NULL);
 	cl_kernel unpadzero_krnl = clCreateKernel(program, "removePadZeros_rm", NULL);
 	cl_kernel sgemm_kernel   = clCreateKernel(program, kernel_name, NULL);
 	
-	unsigned int pad_C_height = CEIL_DIV(C_height, TILE_SIZE) * TILE_SIZE;
-	unsigned int pad_C_width  = CEIL_DIV(C_width,  TILE_SIZE) * TILE_SIZE;
-	unsigned int pad_comm_dim = CEIL_DIV(comm_dim, TILE_SIZE) * TILE_SIZE;
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	unsigned int pad_comm_dim = CEIL_DIV(comm_dim, tp->tile_size) * tp->tile_size;
 	unsigned int A_mem_size = C_height * comm_dim * sizeof(float);
 	unsigned int B_mem_size = comm_dim * C_width  * sizeof(float);
 	unsigned int C_mem_size = C_height * C_width  * sizeof(float);
@@ -38,14 +126,22 @@ void testKernel(testKrnlParam2)
 	unsigned int padB_mem_size = pad_comm_dim * pad_C_width  * sizeof(float);
 	unsigned int padC_mem_size = pad_C_height * pad_C_width  * sizeof(float);
 	
-	// Allocate memory on device
+	// Get device buffers from the memory pool, they are reused by the next call
 	cl_int err;
-	cl_mem d_A = clCreateBuffer(context, CL_MEM_READ_WRITE, A_mem_size, NULL, &err);
-	cl_mem d_B = clCreateBuffer(context, CL_MEM_READ_WRITE, B_mem_size, NULL, &err);
-	cl_mem d_C = clCreateBuffer(context, CL_MEM_READ_WRITE, C_mem_size, NULL, &err);
-	cl_mem d_padA = clCreateBuffer(context, CL_MEM_READ_WRITE, padA_mem_size, NULL, &err);
-	cl_mem d_padB = clCreateBuffer(context, CL_MEM_READ_WRITE, padB_mem_size, NULL, &err);
-	cl_mem d_padC = clCreateBuffer(context, CL_MEM_READ_WRITE, padC_mem_size, NULL, &err);
+	cl_mem d_A = allocCLPoolBuffer(A_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_B = allocCLPoolBuffer(B_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_C = allocCLPoolBuffer(C_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_padA = allocCLPoolBuffer(padA_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_padB = allocCLPoolBuffer(padB_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_padC = allocCLPoolBuffer(padC_mem_size, CL_MEM_READ_WRITE);
+	
+	// Stage host matrices in pinned memory, transfers from / to them skip the pageable copy
+	float *pin_A = (float*) allocCLPinnedHost(A_mem_size, NULL);
+	float *pin_B = (float*) allocCLPinnedHost(B_mem_size, NULL);
+	float *pin_C = (float*) allocCLPinnedHost(C_mem_size, NULL);
+	memcpy(pin_A, h_A, A_mem_size);
+	memcpy(pin_B, h_B, B_mem_size);
+	memcpy(pin_C, h_C, C_mem_size);
 	
 	printf("Test case size (%d, %d, %d) --padding--> (%d, %d, %d)\n", 
 			C_height, C_width, comm_dim, pad_C_height, pad_C_width, pad_comm_dim);
@@ -56,70 +152,28 @@ void testKernel(testKrnlParam2)
 	{
 		// Copy data to device
 		cl_event h2d_copy[3];
-		err = clEnqueueWriteBuffer(queue, d_A, CL_TRUE, 0, A_mem_size, h_A, 0, NULL, &h2d_copy[0]);
-		err = clEnqueueWriteBuffer(queue, d_B, CL_TRUE, 0, B_mem_size, h_B, 0, NULL, &h2d_copy[1]);
-		err = clEnqueueWriteBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, h_C, 0, NULL, &h2d_copy[2]);
-		
-		// Launch kernels for zero padding
-		cl_event dev_pad0[3];
-		const size_t wg_size[2] = {TILE_SIZE, TILE_SIZE};
-		// Pad zero for A
-		err = clSetKernelArg(padzero_krnl, 0, sizeof(unsigned int), (void*) &C_height);
-		err = clSetKernelArg(padzero_krnl, 1, sizeof(unsigned int), (void*) &comm_dim);
-		err = clSetKernelArg(padzero_krnl, 2, sizeof(unsigned int), (void*) &pad_C_height);
-		err = clSetKernelArg(padzero_krnl, 3, sizeof(unsigned int), (void*) &pad_comm_dim);
-		err = clSetKernelArg(padzero_krnl, 4, sizeof(cl_mem), (void*) &d_A);
-		err = clSetKernelArg(padzero_krnl, 5, sizeof(cl_mem), (void*) &d_padA);
-		const size_t ws_sizeA[2] = {pad_comm_dim, pad_C_height};
-		err = clEnqueueNDRangeKernel(queue, padzero_krnl, 2, NULL, ws_sizeA, wg_size, 1, &h2d_copy[0], &dev_pad0[0]);
-		// Pad zero for B
-		err = clSetKernelArg(padzero_krnl, 0, sizeof(unsigned int), (void*) &comm_dim);
-		err = clSetKernelArg(padzero_krnl, 1, sizeof(unsigned int), (void*) &C_width);
-		err = clSetKernelArg(padzero_krnl, 2, sizeof(unsigned int), (void*) &pad_comm_dim);
-		err = clSetKernelArg(padzero_krnl, 3, sizeof(unsigned int), (void*) &pad_C_width);
-		err = clSetKernelArg(padzero_krnl, 4, sizeof(cl_mem), (void*) &d_B);
-		err = clSetKernelArg(padzero_krnl, 5, sizeof(cl_mem), (void*) &d_padB);
-		const size_t ws_sizeB[2] = {pad_C_width, pad_comm_dim};
-		err = clEnqueueNDRangeKernel(queue, padzero_krnl, 2, NULL, ws_sizeB, wg_size, 1, &h2d_copy[1], &dev_pad0[1]);
-		// Pad zero for C
-		err = clSetKernelArg(padzero_krnl, 0, sizeof(unsigned int), (void*) &C_height);
-		err = clSetKernelArg(padzero_krnl, 1, sizeof(unsigned int), (void*) &C_width);
-		err = clSetKernelArg(padzero_krnl, 2, sizeof(unsigned int), (void*) &pad_C_height);
-		err = clSetKernelArg(padzero_krnl, 3, sizeof(unsigned int), (void*) &pad_C_width);
-		err = clSetKernelArg(padzero_krnl, 4, sizeof(cl_mem), (void*) &d_C);
-		err = clSetKernelArg(padzero_krnl, 5, sizeof(cl_mem), (void*) &d_padC);
-		const size_t ws_sizeC[2] = {pad_C_width, pad_C_height};
-		err = clEnqueueNDRangeKernel(queue, padzero_krnl, 2, NULL, ws_sizeC, wg_size, 1, &h2d_copy[2], &dev_pad0[2]);
-		
-		// Launch compute kernel
-		cl_event sgemm_event;
-		err = clSetKernelArg(sgemm_kernel, 0,  sizeof(cl_mem), (void*) &d_padA);
-		err = clSetKernelArg(sgemm_kernel, 1,  sizeof(unsigned int), (void*) &pad_comm_dim);
-		err = clSetKernelArg(sgemm_kernel, 2,  sizeof(cl_mem), (void*) &d_padB);
-		err = clSetKernelArg(sgemm_kernel, 3,  sizeof(unsigned int), (void*) &pad_C_width);
-		err = clSetKernelArg(sgemm_kernel, 4,  sizeof(cl_mem), (void*) &d_padC);
-		err = clSetKernelArg(sgemm_kernel, 5,  sizeof(unsigned int), (void*) &pad_C_width);
-		err = clSetKernelArg(sgemm_kernel, 6,  sizeof(float), (void*) &alpha);
-		err = clSetKernelArg(sgemm_kernel, 7,  sizeof(float), (void*) &beta);
-		err = clSetKernelArg(sgemm_kernel, 8,  sizeof(unsigned int), (void*) &pad_comm_dim);
-		err = clSetKernelArg(sgemm_kernel, 9,  sizeof(unsigned int), (void*) &pad_C_height);
-		err = clSetKernelArg(sgemm_kernel, 10, sizeof(unsigned int), (void*) &pad_C_width);
-		err = clEnqueueNDRangeKernel(queue, sgemm_kernel, 2, NULL, kernel_ws_size, kernel_wg_size, 3, &dev_pad0[0], &sgemm_event);
+		err = clEnqueueWriteBuffer(queue, d_A, CL_TRUE, 0, A_mem_size, pin_A, 0, NULL, &h2d_copy[0]);
+		err = clEnqueueWriteBuffer(queue, d_B, CL_TRUE, 0, B_mem_size, pin_B, 0, NULL, &h2d_copy[1]);
+		err = clEnqueueWriteBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, pin_C, 0, NULL, &h2d_copy[2]);
 		
-		// Launch kernels for removing padded zeros
-		cl_event unpadC_event;
-		err = clSetKernelArg(unpadzero_krnl, 0, sizeof(unsigned int), (void*) &pad_C_height);
-		err = clSetKernelArg(unpadzero_krnl, 1, sizeof(unsigned int), (void*) &pad_C_width);
-		err = clSetKernelArg(unpadzero_krnl, 2, sizeof(unsigned int), (void*) &C_height);
-		err = clSetKernelArg(unpadzero_krnl, 3, sizeof(unsigned int), (void*) &C_width);
-		err = clSetKernelArg(unpadzero_krnl, 4, sizeof(cl_mem), (void*) &d_padC);
-		err = clSetKernelArg(unpadzero_krnl, 5, sizeof(cl_mem), (void*) &d_C);
-		err = clEnqueueNDRangeKernel(queue, unpadzero_krnl, 2, NULL, ws_sizeC, wg_size, 1, &sgemm_event, &unpadC_event);
+		// Pad A, B, C, compute and remove padded zeros of C
+		cl_event compute_events[SGEMM_PADDED_NEVENTS];
+		sgemmBuffers_t bufs = {d_A, d_B, d_C, d_padA, d_padB, d_padC};
+		err = enqueueSgemmPadded(
+			queue, padzero_krnl, sgemm_kernel, unpadzero_krnl,
+			C_height, C_width, comm_dim, alpha, beta, &bufs,
+			kernel_wg_size, kernel_ws_size, &h2d_copy[0], &compute_events[0]
+		);
 		
 		// Copy C back to the host
 		cl_event d2h_copy;
-		err = clEnqueueReadBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, h_C, 1, &unpadC_event, &d2h_copy);
+		err = clEnqueueReadBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, pin_C, 1, &compute_events[SGEMM_PADDED_NEVENTS - 1], &d2h_copy);
 		clWaitForEvents(1, &d2h_copy);
+		if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+		
+		for (int i = 0; i < 3; i++) clReleaseEvent(h2d_copy[i]);
+		for (int i = 0; i < SGEMM_PADDED_NEVENTS; i++) clReleaseEvent(compute_events[i]);
+		clReleaseEvent(d2h_copy);
 	}
 	
 	double et = omp_get_wtime();
@@ -130,13 +184,18 @@ void testKernel(testKrnlParam2)
 	real_gflops  /= 1000000000.0 * ut;
 	printf("20 runs used time = %lf (s), valid GFlops = %lf, real GFlops = %lf\n", ut, valid_gflops, real_gflops);
 	
-	// Free device memory
-	clReleaseMemObject(d_A);
-	clReleaseMemObject(d_B);
-	clReleaseMemObject(d_C);
-	clReleaseMemObject(d_padA);
-	clReleaseMemObject(d_padB);
-	clReleaseMemObject(d_padC);
+	memcpy(h_C, pin_C, C_mem_size);
+	
+	// Return device and pinned host memory to the pool
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	freeCLPoolBuffer(d_padA);
+	freeCLPoolBuffer(d_padB);
+	freeCLPoolBuffer(d_padC);
+	freeCLPinnedHost(pin_A);
+	freeCLPinnedHost(pin_B);
+	freeCLPinnedHost(pin_C);
 	
 	// Free device kernel
 	err = clReleaseKernel(padzero_krnl);
@@ -144,29 +203,386 @@ void testKernel(testKrnlParam2)
 	err = clReleaseKernel(unpadzero_krnl);
 }
 
+// Same as testKernel(), but the kernel handles matrix boundaries itself, 
+// so A, B and C are used as they are without padding and unpadding
+void testKernelNoPad(testKrnlParam2)
+{
+	printf("Target kernel: %s\n", kernel_name);
+	
+	cl_kernel sgemm_kernel = clCreateKernel(program, kernel_name, NULL);
+	
+	size_t A_mem_size = (size_t) C_height * (size_t) comm_dim * sizeof(float);
+	size_t B_mem_size = (size_t) comm_dim * (size_t) C_width  * sizeof(float);
+	size_t C_mem_size = (size_t) C_height * (size_t) C_width  * sizeof(float);
+	
+	// Get device buffers from the memory pool, they are reused by the next call
+	cl_int err;
+	cl_mem d_A = allocCLPoolBuffer(A_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_B = allocCLPoolBuffer(B_mem_size, CL_MEM_READ_WRITE);
+	cl_mem d_C = allocCLPoolBuffer(C_mem_size, CL_MEM_READ_WRITE);
+	
+	// Stage host matrices in pinned memory, transfers from / to them skip the pageable copy
+	float *pin_A = (float*) allocCLPinnedHost(A_mem_size, NULL);
+	float *pin_B = (float*) allocCLPinnedHost(B_mem_size, NULL);
+	float *pin_C = (float*) allocCLPinnedHost(C_mem_size, NULL);
+	memcpy(pin_A, h_A, A_mem_size);
+	memcpy(pin_B, h_B, B_mem_size);
+	memcpy(pin_C, h_C, C_mem_size);
+	
+	printf("Test case size (%d, %d, %d), no padding\n", C_height, C_width, comm_dim);
+	
+	double st = omp_get_wtime();
+	
+	for (int itest = 0; itest < 20; itest++)
+	{
+		// Copy data to device
+		cl_event h2d_copy[3];
+		err = clEnqueueWriteBuffer(queue, d_A, CL_FALSE, 0, A_mem_size, pin_A, 0, NULL, &h2d_copy[0]);
+		err = clEnqueueWriteBuffer(queue, d_B, CL_FALSE, 0, B_mem_size, pin_B, 0, NULL, &h2d_copy[1]);
+		err = clEnqueueWriteBuffer(queue, d_C, CL_FALSE, 0, C_mem_size, pin_C, 0, NULL, &h2d_copy[2]);
+		
+		// Launch compute kernel, leading dimensions are the real matrix widths
+		cl_event sgemm_event;
+		err = clSetKernelArg(sgemm_kernel, 0,  sizeof(cl_mem), (void*) &d_A);
+		err = clSetKernelArg(sgemm_kernel, 1,  sizeof(unsigned int), (void*) &comm_dim);
+		err = clSetKernelArg(sgemm_kernel, 2,  sizeof(cl_mem), (void*) &d_B);
+		err = clSetKernelArg(sgemm_kernel, 3,  sizeof(unsigned int), (void*) &C_width);
+		err = clSetKernelArg(sgemm_kernel, 4,  sizeof(cl_mem), (void*) &d_C);
+		err = clSetKernelArg(sgemm_kernel, 5,  sizeof(unsigned int), (void*) &C_width);
+		err = clSetKernelArg(sgemm_kernel, 6,  sizeof(float), (void*) &alpha);
+		err = clSetKernelArg(sgemm_kernel, 7,  sizeof(float), (void*) &beta);
+		err = clSetKernelArg(sgemm_kernel, 8,  sizeof(unsigned int), (void*) &comm_dim);
+		err = clSetKernelArg(sgemm_kernel, 9,  sizeof(unsigned int), (void*) &C_height);
+		err = clSetKernelArg(sgemm_kernel, 10, sizeof(unsigned int), (void*) &C_width);
+		err = clEnqueueNDRangeKernel(queue, sgemm_kernel, 2, NULL, kernel_ws_size, kernel_wg_size, 3, &h2d_copy[0], &sgemm_event);
+		
+		// Copy C back to the host
+		cl_event d2h_copy;
+		err = clEnqueueReadBuffer(queue, d_C, CL_TRUE, 0, C_mem_size, pin_C, 1, &sgemm_event, &d2h_copy);
+		clWaitForEvents(1, &d2h_copy);
+		if (err != CL_SUCCESS) printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+		
+		for (int i = 0; i < 3; i++) clReleaseEvent(h2d_copy[i]);
+		clReleaseEvent(sgemm_event);
+		clReleaseEvent(d2h_copy);
+	}
+	
+	double et = omp_get_wtime();
+	double ut = et - st;
+	double valid_gflops = 2.0 * C_height * C_width * comm_dim * 20.0;
+	valid_gflops /= 1000000000.0 * ut;
+	printf("20 runs used time = %lf (s), valid GFlops = %lf\n", ut, valid_gflops);
+	
+	memcpy(h_C, pin_C, C_mem_size);
+	
+	// Return device and pinned host memory to the pool
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	freeCLPinnedHost(pin_A);
+	freeCLPinnedHost(pin_B);
+	freeCLPinnedHost(pin_C);
+	
+	// Free device kernel
+	err = clReleaseKernel(sgemm_kernel);
+}
+
 void testKernel1(testKernelParam)
 {
-	unsigned int pad_C_height = CEIL_DIV(C_height, TILE_SIZE) * TILE_SIZE;
-	unsigned int pad_C_width  = CEIL_DIV(C_width,  TILE_SIZE) * TILE_SIZE;
-	const size_t kernel1_wg_size[2] = {TILE_SIZE, TILE_SIZE};
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	const size_t kernel1_wg_size[2] = {tp->tile_size, tp->tile_size};
 	const size_t kernel1_ws_size[2] = {pad_C_width, pad_C_height};
 	testKernel(testKrnlParam1, "sgemm_1_naive", kernel1_wg_size, kernel1_ws_size);
 }
 
 void testKernel2(testKernelParam)
 {
-	unsigned int pad_C_height = CEIL_DIV(C_height, TILE_SIZE) * TILE_SIZE;
-	unsigned int pad_C_width  = CEIL_DIV(C_width,  TILE_SIZE) * TILE_SIZE;
-	const size_t kernel2_wg_size[2] = {TILE_SIZE, TILE_SIZE};
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	const size_t kernel2_wg_size[2] = {tp->tile_size, tp->tile_size};
 	const size_t kernel2_ws_size[2] = {pad_C_width, pad_C_height};
 	testKernel(testKrnlParam1, "sgemm_2_tiling", kernel2_wg_size, kernel2_ws_size);
 }
 
 void testKernel3(testKernelParam)
 {
-	unsigned int pad_C_height = CEIL_DIV(C_height, TILE_SIZE) * TILE_SIZE;
-	unsigned int pad_C_width  = CEIL_DIV(C_width,  TILE_SIZE) * TILE_SIZE;
-	const size_t kernel3_wg_size[2] = {TILE_SIZE / WPTN, TILE_SIZE / WPTM};
-	const size_t kernel3_ws_size[2] = {pad_C_width / WPTN, pad_C_height / WPTM};
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	const size_t kernel3_wg_size[2] = {tp->tile_size / tp->wptn, tp->tile_size / tp->wptm};
+	const size_t kernel3_ws_size[2] = {pad_C_width / tp->wptn, pad_C_height / tp->wptm};
 	testKernel(testKrnlParam1, "sgemm_3_2Dreg", kernel3_wg_size, kernel3_ws_size);
 }
+
+void testKernel2NoPad(testKernelParam)
+{
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	const size_t kernel2_wg_size[2] = {tp->tile_size, tp->tile_size};
+	const size_t kernel2_ws_size[2] = {CEIL_DIV(C_width, tp->tile_size) * tp->tile_size, CEIL_DIV(C_height, tp->tile_size) * tp->tile_size};
+	testKernelNoPad(testKrnlParam1, "sgemm_2_tiling_nopad", kernel2_wg_size, kernel2_ws_size);
+}
+
+void testKernel3NoPad(testKernelParam)
+{
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	const size_t kernel3_wg_size[2] = {tp->tile_size / tp->wptn, tp->tile_size / tp->wptm};
+	const size_t kernel3_ws_size[2] = {CEIL_DIV(C_width, tp->tile_size) * tp->tile_size / tp->wptn, CEIL_DIV(C_height, tp->tile_size) * tp->tile_size / tp->wptm};
+	testKernelNoPad(testKrnlParam1, "sgemm_3_2Dreg_nopad", kernel3_wg_size, kernel3_ws_size);
+}
+
+// The four systolic array kernels are connected with channels, so they are 
+// launched on different queues to run at the same time
+void testKernelSystolic(testKernelParam)
+{
+	printf("Target kernel: sgemm_sys_* (%d * %d PEs)\n", SYS_PE_ROWS, SYS_PE_COLS);
+	
+	cl_kernel load_A_kernel = clCreateKernel(program, "sgemm_sys_load_A", NULL);
+	cl_kernel load_B_kernel = clCreateKernel(program, "sgemm_sys_load_B", NULL);
+	cl_kernel pe_kernel     = clCreateKernel(program, "sgemm_sys_pe", NULL);
+	cl_kernel drain_kernel  = clCreateKernel(program, "sgemm_sys_drain_C", NULL);
+	cl_command_queue sys_queues[4];
+	for (int i = 0; i < 4; i++) sys_queues[i] = getCLRuntimeQueue(SGEMM_SYS_QUEUE + i);
+	
+	size_t A_mem_size = (size_t) C_height * (size_t) comm_dim * sizeof(float);
+	size_t B_mem_size = (size_t) comm_dim * (size_t) C_width  * sizeof(float);
+	size_t C_mem_size = (size_t) C_height * (size_t) C_width  * sizeof(float);
+	
+	cl_int err;
+	cl_mem d_A = allocCLPoolBuffer(A_mem_size, CL_MEM_READ_ONLY);
+	cl_mem d_B = allocCLPoolBuffer(B_mem_size, CL_MEM_READ_ONLY);
+	cl_mem d_C = allocCLPoolBuffer(C_mem_size, CL_MEM_READ_WRITE);
+	float *pin_A = (float*) allocCLPinnedHost(A_mem_size, NULL);
+	float *pin_B = (float*) allocCLPinnedHost(B_mem_size, NULL);
+	float *pin_C = (float*) allocCLPinnedHost(C_mem_size, NULL);
+	memcpy(pin_A, h_A, A_mem_size);
+	memcpy(pin_B, h_B, B_mem_size);
+	memcpy(pin_C, h_C, C_mem_size);
+	
+	err  = clSetKernelArg(load_A_kernel, 0, sizeof(cl_mem), (void*) &d_A);
+	err |= clSetKernelArg(load_A_kernel, 1, sizeof(unsigned int), (void*) &comm_dim);
+	err |= clSetKernelArg(load_A_kernel, 2, sizeof(unsigned int), (void*) &C_height);
+	err |= clSetKernelArg(load_A_kernel, 3, sizeof(unsigned int), (void*) &C_width);
+	err |= clSetKernelArg(load_A_kernel, 4, sizeof(unsigned int), (void*) &comm_dim);
+	err |= clSetKernelArg(load_B_kernel, 0, sizeof(cl_mem), (void*) &d_B);
+	err |= clSetKernelArg(load_B_kernel, 1, sizeof(unsigned int), (void*) &C_width);
+	err |= clSetKernelArg(load_B_kernel, 2, sizeof(unsigned int), (void*) &C_height);
+	err |= clSetKernelArg(load_B_kernel, 3, sizeof(unsigned int), (void*) &C_width);
+	err |= clSetKernelArg(load_B_kernel, 4, sizeof(unsigned int), (void*) &comm_dim);
+	err |= clSetKernelArg(pe_kernel,     0, sizeof(unsigned int), (void*) &C_height);
+	err |= clSetKernelArg(pe_kernel,     1, sizeof(unsigned int), (void*) &C_width);
+	err |= clSetKernelArg(pe_kernel,     2, sizeof(unsigned int), (void*) &comm_dim);
+	err |= clSetKernelArg(drain_kernel,  0, sizeof(cl_mem), (void*) &d_C);
+	err |= clSetKernelArg(drain_kernel,  1, sizeof(unsigned int), (void*) &C_width);
+	err |= clSetKernelArg(drain_kernel,  2, sizeof(float), (void*) &alpha);
+	err |= clSetKernelArg(drain_kernel,  3, sizeof(float), (void*) &beta);
+	err |= clSetKernelArg(drain_kernel,  4, sizeof(unsigned int), (void*) &C_height);
+	err |= clSetKernelArg(drain_kernel,  5, sizeof(unsigned int), (void*) &C_width);
+	if (err != CL_SUCCESS) printf("[ERROR] clSetKernelArg() failed for systolic kernels\n");
+	
+	printf("Test case size (%d, %d, %d), no padding\n", C_height, C_width, comm_dim);
+	
+	double st = omp_get_wtime();
+	
+	for (int itest = 0; itest < 20; itest++)
+	{
+		// Feeders wait for their inputs, the drain kernel waits for the old C
+		cl_event h2d_copy[3], sys_events[4], d2h_copy;
+		err  = clEnqueueWriteBuffer(sys_queues[0], d_A, CL_FALSE, 0, A_mem_size, pin_A, 0, NULL, &h2d_copy[0]);
+		err |= clEnqueueWriteBuffer(sys_queues[1], d_B, CL_FALSE, 0, B_mem_size, pin_B, 0, NULL, &h2d_copy[1]);
+		err |= clEnqueueWriteBuffer(sys_queues[3], d_C, CL_FALSE, 0, C_mem_size, pin_C, 0, NULL, &h2d_copy[2]);
+		err |= clEnqueueTask(sys_queues[0], load_A_kernel, 1, &h2d_copy[0], &sys_events[0]);
+		err |= clEnqueueTask(sys_queues[1], load_B_kernel, 1, &h2d_copy[1], &sys_events[1]);
+		err |= clEnqueueTask(sys_queues[2], pe_kernel,     0, NULL, &sys_events[2]);
+		err |= clEnqueueTask(sys_queues[3], drain_kernel,  1, &h2d_copy[2], &sys_events[3]);
+		for (int i = 0; i < 4; i++) clFlush(sys_queues[i]);
+		
+		err |= clEnqueueReadBuffer(sys_queues[3], d_C, CL_TRUE, 0, C_mem_size, pin_C, 1, &sys_events[3], &d2h_copy);
+		clWaitForEvents(3, &sys_events[0]);
+		if (err != CL_SUCCESS) printf("[ERROR] Systolic SGEMM failed, returned status = %d\n", err);
+		
+		for (int i = 0; i < 3; i++) clReleaseEvent(h2d_copy[i]);
+		for (int i = 0; i < 4; i++) clReleaseEvent(sys_events[i]);
+		clReleaseEvent(d2h_copy);
+	}
+	
+	double et = omp_get_wtime();
+	double ut = et - st;
+	double valid_gflops = 2.0 * C_height * C_width * comm_dim * 20.0;
+	valid_gflops /= 1000000000.0 * ut;
+	printf("20 runs used time = %lf (s), valid GFlops = %lf\n", ut, valid_gflops);
+	
+	memcpy(h_C, pin_C, C_mem_size);
+	
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	freeCLPinnedHost(pin_A);
+	freeCLPinnedHost(pin_B);
+	freeCLPinnedHost(pin_C);
+	clReleaseKernel(load_A_kernel);
+	clReleaseKernel(load_B_kernel);
+	clReleaseKernel(pe_kernel);
+	clReleaseKernel(drain_kernel);
+}
+
+// Duration of a profiled command in seconds
+static double getCLEventDuration(cl_event event)
+{
+	cl_ulong t_start = 0, t_end = 0;
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &t_start, NULL);
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &t_end,   NULL);
+	return (double) (t_end - t_start) * 1e-9;
+}
+
+// Stream a batch of independent GEMMs. Upload, compute and download run on 3 
+// different queues of the runtime, and SGEMM_STREAM_NSLOT sets of device buffers 
+// are used in turn, so GEMM i+1 is uploaded and GEMM i-1 is downloaded while 
+// GEMM i is being computed. Each buffer set has pinned host buffers, GEMM i is
+// copied to them once GEMM i - SGEMM_STREAM_NSLOT is downloaded and copied out.
+void testKernelStream(testKrnlParam2, const int batch_size)
+{
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	printf("Target kernel: %s, streaming %d GEMMs with %d buffer sets\n", kernel_name, batch_size, SGEMM_STREAM_NSLOT);
+	
+	cl_command_queue h2d_queue  = getCLRuntimeQueue(1);
+	cl_command_queue comp_queue = getCLRuntimeQueue(2);
+	cl_command_queue d2h_queue  = getCLRuntimeQueue(3);
+	
+	cl_kernel padzero_krnl   = clCreateKernel(program, "padZeros_rm", NULL);
+	cl_kernel unpadzero_krnl = clCreateKernel(program, "removePadZeros_rm", NULL);
+	cl_kernel sgemm_kernel   = clCreateKernel(program, kernel_name, NULL);
+	
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	unsigned int pad_comm_dim = CEIL_DIV(comm_dim, tp->tile_size) * tp->tile_size;
+	size_t A_size = (size_t) C_height * (size_t) comm_dim;
+	size_t B_size = (size_t) comm_dim * (size_t) C_width;
+	size_t C_size = (size_t) C_height * (size_t) C_width;
+	size_t A_mem_size = A_size * sizeof(float);
+	size_t B_mem_size = B_size * sizeof(float);
+	size_t C_mem_size = C_size * sizeof(float);
+	size_t padA_mem_size = (size_t) pad_C_height * (size_t) pad_comm_dim * sizeof(float);
+	size_t padB_mem_size = (size_t) pad_comm_dim * (size_t) pad_C_width  * sizeof(float);
+	size_t padC_mem_size = (size_t) pad_C_height * (size_t) pad_C_width  * sizeof(float);
+	
+	sgemmBuffers_t bufs[SGEMM_STREAM_NSLOT];
+	float *pin_A[SGEMM_STREAM_NSLOT], *pin_B[SGEMM_STREAM_NSLOT], *pin_C[SGEMM_STREAM_NSLOT];
+	for (int s = 0; s < SGEMM_STREAM_NSLOT; s++)
+	{
+		bufs[s].A    = allocCLPoolBuffer(A_mem_size, CL_MEM_READ_WRITE);
+		bufs[s].B    = allocCLPoolBuffer(B_mem_size, CL_MEM_READ_WRITE);
+		bufs[s].C    = allocCLPoolBuffer(C_mem_size, CL_MEM_READ_WRITE);
+		bufs[s].padA = allocCLPoolBuffer(padA_mem_size, CL_MEM_READ_WRITE);
+		bufs[s].padB = allocCLPoolBuffer(padB_mem_size, CL_MEM_READ_WRITE);
+		bufs[s].padC = allocCLPoolBuffer(padC_mem_size, CL_MEM_READ_WRITE);
+		pin_A[s] = (float*) allocCLPinnedHost(A_mem_size, NULL);
+		pin_B[s] = (float*) allocCLPinnedHost(B_mem_size, NULL);
+		pin_C[s] = (float*) allocCLPinnedHost(C_mem_size, NULL);
+		assert(pin_A[s] != NULL && pin_B[s] != NULL && pin_C[s] != NULL);
+	}
+	
+	// Keep all events for profiling after the batch is done
+	cl_event *h2d_events  = (cl_event*) malloc(sizeof(cl_event) * 3 * batch_size);
+	cl_event *comp_events = (cl_event*) malloc(sizeof(cl_event) * SGEMM_PADDED_NEVENTS * batch_size);
+	cl_event *d2h_events  = (cl_event*) malloc(sizeof(cl_event) * batch_size);
+	assert(h2d_events != NULL && comp_events != NULL && d2h_events != NULL);
+	
+	cl_int err = CL_SUCCESS;
+	double st = omp_get_wtime();
+	
+	for (int i = 0; i < batch_size; i++)
+	{
+		const int s = i % SGEMM_STREAM_NSLOT;
+		cl_event *h2d_i  = h2d_events  + 3 * i;
+		cl_event *comp_i = comp_events + SGEMM_PADDED_NEVENTS * i;
+		
+		// Buffer set s is free again after GEMM i - SGEMM_STREAM_NSLOT is downloaded
+		if (i >= SGEMM_STREAM_NSLOT)
+		{
+			clWaitForEvents(1, &d2h_events[i - SGEMM_STREAM_NSLOT]);
+			memcpy(h_C + C_size * (i - SGEMM_STREAM_NSLOT), pin_C[s], C_mem_size);
+		}
+		memcpy(pin_A[s], h_A + A_size * i, A_mem_size);
+		memcpy(pin_B[s], h_B + B_size * i, B_mem_size);
+		memcpy(pin_C[s], h_C + C_size * i, C_mem_size);
+		err |= clEnqueueWriteBuffer(h2d_queue, bufs[s].A, CL_FALSE, 0, A_mem_size, pin_A[s], 0, NULL, &h2d_i[0]);
+		err |= clEnqueueWriteBuffer(h2d_queue, bufs[s].B, CL_FALSE, 0, B_mem_size, pin_B[s], 0, NULL, &h2d_i[1]);
+		err |= clEnqueueWriteBuffer(h2d_queue, bufs[s].C, CL_FALSE, 0, C_mem_size, pin_C[s], 0, NULL, &h2d_i[2]);
+		
+		err |= enqueueSgemmPadded(
+			comp_queue, padzero_krnl, sgemm_kernel, unpadzero_krnl,
+			C_height, C_width, comm_dim, alpha, beta, &bufs[s],
+			kernel_wg_size, kernel_ws_size, h2d_i, comp_i
+		);
+		
+		err |= clEnqueueReadBuffer(
+			d2h_queue, bufs[s].C, CL_FALSE, 0, C_mem_size, pin_C[s], 
+			1, &comp_i[SGEMM_PADDED_NEVENTS - 1], &d2h_events[i]
+		);
+		
+		clFlush(h2d_queue);
+		clFlush(comp_queue);
+		clFlush(d2h_queue);
+	}
+	clFinish(d2h_queue);
+	int first_left = (batch_size > SGEMM_STREAM_NSLOT) ? batch_size - SGEMM_STREAM_NSLOT : 0;
+	for (int i = first_left; i < batch_size; i++)
+		memcpy(h_C + C_size * i, pin_C[i % SGEMM_STREAM_NSLOT], C_mem_size);
+	
+	double et = omp_get_wtime();
+	double ut = et - st;
+	if (err != CL_SUCCESS) printf("[ERROR] Enqueuing the streaming GEMMs failed\n");
+	
+	// Time of each stage if they were not overlapped
+	double h2d_ut = 0.0, comp_ut = 0.0, d2h_ut = 0.0;
+	for (int i = 0; i < batch_size; i++)
+	{
+		for (int j = 0; j < 3; j++) h2d_ut += getCLEventDuration(h2d_events[3 * i + j]);
+		for (int j = 0; j < SGEMM_PADDED_NEVENTS; j++) comp_ut += getCLEventDuration(comp_events[SGEMM_PADDED_NEVENTS * i + j]);
+		d2h_ut += getCLEventDuration(d2h_events[i]);
+	}
+	double serial_ut = h2d_ut + comp_ut + d2h_ut;
+	double overlap   = (serial_ut > ut) ? (serial_ut - ut) / serial_ut : 0.0;
+	double valid_gflops = 2.0 * C_height * C_width * comm_dim * (double) batch_size / (1000000000.0 * ut);
+	printf("Stage time: H2D = %lf, compute = %lf, D2H = %lf, sum = %lf (s)\n", h2d_ut, comp_ut, d2h_ut, serial_ut);
+	printf("%d GEMMs used time = %lf (s), overlapped %.1lf%% of stage time, end-to-end GFlops = %lf\n", 
+			batch_size, ut, overlap * 100.0, valid_gflops);
+	
+	// Release events, buffers and kernels
+	for (int i = 0; i < 3 * batch_size; i++) clReleaseEvent(h2d_events[i]);
+	for (int i = 0; i < SGEMM_PADDED_NEVENTS * batch_size; i++) clReleaseEvent(comp_events[i]);
+	for (int i = 0; i < batch_size; i++) clReleaseEvent(d2h_events[i]);
+	free(h2d_events);
+	free(comp_events);
+	free(d2h_events);
+	
+	for (int s = 0; s < SGEMM_STREAM_NSLOT; s++)
+	{
+		freeCLPoolBuffer(bufs[s].A);
+		freeCLPoolBuffer(bufs[s].B);
+		freeCLPoolBuffer(bufs[s].C);
+		freeCLPoolBuffer(bufs[s].padA);
+		freeCLPoolBuffer(bufs[s].padB);
+		freeCLPoolBuffer(bufs[s].padC);
+		freeCLPinnedHost(pin_A[s]);
+		freeCLPinnedHost(pin_B[s]);
+		freeCLPinnedHost(pin_C[s]);
+	}
+	
+	clReleaseKernel(padzero_krnl);
+	clReleaseKernel(sgemm_kernel);
+	clReleaseKernel(unpadzero_krnl);
+}
+
+void testKernel3Stream(testKernelParam, const int batch_size)
+{
+	const sgemmTileParams_t *tp = getSgemmActiveTileParams();
+	unsigned int pad_C_height = CEIL_DIV(C_height, tp->tile_size) * tp->tile_size;
+	unsigned int pad_C_width  = CEIL_DIV(C_width,  tp->tile_size) * tp->tile_size;
+	const size_t kernel3_wg_size[2] = {tp->tile_size / tp->wptn, tp->tile_size / tp->wptm};
+	const size_t kernel3_ws_size[2] = {pad_C_width / tp->wptn, pad_C_height / tp->wptm};
+	testKernelStream(testKrnlParam1, "sgemm_3_2Dreg", kernel3_wg_size, kernel3_ws_size, batch_size);
+}
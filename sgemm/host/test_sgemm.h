@@ -18,6 +18,18 @@ void testKernel2(testKernelParam);
 
 void testKernel3(testKernelParam);
 
+// Same as testKernel2 and testKernel3, without padding A, B and C to TILE_SIZE
+void testKernel2NoPad(testKernelParam);
+
+void testKernel3NoPad(testKernelParam);
+
+// Single-work-item systolic array kernels, program should be built from my_sgemm_systolic.cl
+void testKernelSystolic(testKernelParam);
+
+// Run batch_size independent GEMMs with sgemm_3_2Dreg, overlapping transfers and 
+// computation. h_A, h_B and h_C hold batch_size matrices stored one after another.
+void testKernel3Stream(testKernelParam, const int batch_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,276 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <math.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "sgemm_blas.h"
+#include "sgemm_tuning.h"
+
+#define SGEMM_TUNE_NREP 5  // Number of timed runs for each variant
+
+// Sweep space, invalid combinations are skipped by checkSgemmTileParams()
+static const int tune_tile_sizes[] = {16, 32, 64};
+static const int tune_wpts[]       = {1, 2, 4, 8};
+static const int tune_simds[]      = {1, 2, 4};
+
+#define NELEM(a) ((int) (sizeof(a) / sizeof(a[0])))
+
+// Get all valid parameter combinations in the sweep space
+static int getTuneVariants(sgemmTileParams_t *variants)
+{
+	int nvariant = 0;
+	for (int it = 0; it < NELEM(tune_tile_sizes); it++)
+	for (int im = 0; im < NELEM(tune_wpts); im++)
+	for (int in = 0; in < NELEM(tune_wpts); in++)
+	for (int is = 0; is < NELEM(tune_simds); is++)
+	{
+		sgemmTileParams_t params = {tune_tile_sizes[it], tune_wpts[im], tune_wpts[in], tune_simds[is]};
+		if (checkSgemmTileParams(&params) != 0) continue;
+		variants[nvariant++] = params;
+	}
+	return nvariant;
+}
+
+// Print "file_name build_options" for each variant, used by "make tune_variants"
+// to build the .aocx files with aoc
+static void listTuneVariants()
+{
+	sgemmTileParams_t variants[NELEM(tune_tile_sizes) * NELEM(tune_wpts) * NELEM(tune_wpts) * NELEM(tune_simds)];
+	int nvariant = getTuneVariants(variants);
+	for (int i = 0; i < nvariant; i++)
+	{
+		char file_name[256], options[256];
+		getSgemmVariantFileName(&variants[i], file_name, sizeof(file_name));
+		getSgemmBuildOptions(&variants[i], options, sizeof(options));
+		printf("%s %s\n", file_name, options);
+	}
+}
+
+static int checkTuneResult(const float *ref, const float *target, const size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		float diff  = fabs(ref[i] - target[i]);
+		float rdiff = diff / fabs(ref[i]);
+		if ((diff > 1e-4) && (rdiff > 1e-4)) return 0;
+	}
+	return 1;
+}
+
+// Tiled kernels built with the parameters, sgemm_2_* run TILE_SIZE * TILE_SIZE work-groups,
+// sgemm_3_* run (TILE_SIZE / WPTN) * (TILE_SIZE / WPTM) work-groups
+static const char *tune_kernel_names[] = {
+	"sgemm_2_tiling", "sgemm_2_tiling_nopad", "sgemm_3_2Dreg", "sgemm_3_2Dreg_nopad", "sgemm_3_2Dreg_blas"
+};
+
+static size_t getTuneKernelWGSize(const sgemmTileParams_t *params, const char *kernel_name)
+{
+	size_t T = params->tile_size;
+	if (strncmp(kernel_name, "sgemm_2_", 8) == 0) return T * T;
+	return (T / params->wptm) * (T / params->wptn);
+}
+
+// Check that the device can run the kernels with the parameters, before building them
+static int checkTuneDeviceLimits(const sgemmTileParams_t *params)
+{
+	CLRuntime_t *rt = getCLRuntime();
+	size_t max_wg_size;
+	cl_ulong local_mem_size;
+	clGetDeviceInfo(rt->devices[0], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_wg_size, NULL);
+	clGetDeviceInfo(rt->devices[0], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, NULL);
+	size_t T = params->tile_size;
+	for (int i = 0; i < NELEM(tune_kernel_names); i++)
+		if (getTuneKernelWGSize(params, tune_kernel_names[i]) > max_wg_size) return 0;
+	// All tiled kernels keep one tile of A and one tile of B in local memory
+	if (2 * T * T * sizeof(float) > local_mem_size) return 0;
+	return 1;
+}
+
+// Check the limits of each built kernel, they can be lower than the device limits
+static int checkTuneKernelLimits(const sgemmTileParams_t *params, cl_program program)
+{
+	CLRuntime_t *rt = getCLRuntime();
+	cl_ulong local_mem_size;
+	clGetDeviceInfo(rt->devices[0], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, NULL);
+	int ok = 1;
+	for (int i = 0; (i < NELEM(tune_kernel_names)) && ok; i++)
+	{
+		cl_int err;
+		cl_kernel kernel = clCreateKernel(program, tune_kernel_names[i], &err);
+		if (err != CL_SUCCESS) return 0;
+		size_t kernel_wg_size = 0;
+		cl_ulong kernel_local_mem = 0;
+		err  = clGetKernelWorkGroupInfo(kernel, rt->devices[0], CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_wg_size, NULL);
+		err |= clGetKernelWorkGroupInfo(kernel, rt->devices[0], CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &kernel_local_mem, NULL);
+		if ((err != CL_SUCCESS) || (getTuneKernelWGSize(params, tune_kernel_names[i]) > kernel_wg_size)) ok = 0;
+		if (kernel_local_mem > local_mem_size) ok = 0;
+		clReleaseKernel(kernel);
+	}
+	return ok;
+}
+
+// Time SGEMM of one shape with one variant, return GFlops or a negative value on failure.
+// The variant's program is dropped from the runtime afterwards: the sweep has more
+// variants than CL_RUNTIME_MAX_PROGRAMS.
+static double benchTuneVariant(
+	const sgemmTileParams_t *params, const int M, const int N, const int K,
+	cl_mem d_A, cl_mem d_B, cl_mem d_C, float *h_C, const float *C_ref
+)
+{
+	cl_program program = getSgemmTunedProgram(params);
+	if (program == NULL) return -1.0;
+	if (!checkTuneKernelLimits(params, program))
+	{
+		printf("exceeds kernel limits, ");
+		releaseCLRuntimeProgram(program);
+		return -1.0;
+	}
+	setSgemmActiveTileParams(params);
+	
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_event event;
+	
+	// Functional check first, a variant that gives wrong results is never chosen
+	int ret = sgemm_blas_dev(
+		SgemmRowMajor, SgemmNoTrans, SgemmNoTrans, M, N, K, 1.0f, 
+		d_A, 0, K, d_B, 0, N, 0.0f, d_C, 0, N, queue, program, 0, NULL, &event
+	);
+	if (ret != 0)
+	{
+		releaseCLRuntimeProgram(program);
+		return -1.0;
+	}
+	cl_int err = clEnqueueReadBuffer(queue, d_C, CL_TRUE, 0, sizeof(float) * M * N, h_C, 1, &event, NULL);
+	clReleaseEvent(event);
+	if ((err != CL_SUCCESS) || !checkTuneResult(C_ref, h_C, (size_t) M * N))
+	{
+		printf("wrong result, ");
+		releaseCLRuntimeProgram(program);
+		return -1.0;
+	}
+	
+	double ut = 0.0;
+	for (int irep = 0; irep < SGEMM_TUNE_NREP; irep++)
+	{
+		sgemm_blas_dev(
+			SgemmRowMajor, SgemmNoTrans, SgemmNoTrans, M, N, K, 1.0f, 
+			d_A, 0, K, d_B, 0, N, 0.0f, d_C, 0, N, queue, program, 0, NULL, &event
+		);
+		clWaitForEvents(1, &event);
+		cl_ulong t_start = 0, t_end = 0;
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &t_start, NULL);
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &t_end,   NULL);
+		ut += (double) (t_end - t_start) * 1e-9;
+		clReleaseEvent(event);
+	}
+	releaseCLRuntimeProgram(program);
+	return 2.0 * M * N * K * SGEMM_TUNE_NREP / (ut * 1000000000.0);
+}
+
+static void tuneShape(const int M, const int N, const int K)
+{
+	printf("----- Tuning SGEMM size (%d, %d, %d) -----\n", M, N, K);
+	
+	size_t A_size = (size_t) M * K, B_size = (size_t) K * N, C_size = (size_t) M * N;
+	float *h_A   = (float*) malloc(sizeof(float) * A_size);
+	float *h_B   = (float*) malloc(sizeof(float) * B_size);
+	float *h_C   = (float*) malloc(sizeof(float) * C_size);
+	float *C_ref = (float*) malloc(sizeof(float) * C_size);
+	for (size_t i = 0; i < A_size; i++) h_A[i] = (float) (rand() % 16) / 16.0f;
+	for (size_t i = 0; i < B_size; i++) h_B[i] = (float) (rand() % 16) / 16.0f;
+	sgemm_blas_cpu(SgemmRowMajor, SgemmNoTrans, SgemmNoTrans, M, N, K, 1.0f, h_A, K, h_B, N, 0.0f, C_ref, N);
+	
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_mem d_A = allocCLPoolBuffer(sizeof(float) * A_size, CL_MEM_READ_ONLY);
+	cl_mem d_B = allocCLPoolBuffer(sizeof(float) * B_size, CL_MEM_READ_ONLY);
+	cl_mem d_C = allocCLPoolBuffer(sizeof(float) * C_size, CL_MEM_READ_WRITE);
+	clEnqueueWriteBuffer(queue, d_A, CL_TRUE, 0, sizeof(float) * A_size, h_A, 0, NULL, NULL);
+	clEnqueueWriteBuffer(queue, d_B, CL_TRUE, 0, sizeof(float) * B_size, h_B, 0, NULL, NULL);
+	
+	// benchTuneVariant() activates each variant in turn
+	sgemmTileParams_t saved_params = *getSgemmActiveTileParams();
+	sgemmTileParams_t variants[NELEM(tune_tile_sizes) * NELEM(tune_wpts) * NELEM(tune_wpts) * NELEM(tune_simds)];
+	int nvariant = getTuneVariants(variants);
+	int best_idx = -1;
+	double best_gflops = 0.0;
+	for (int i = 0; i < nvariant; i++)
+	{
+		sgemmTileParams_t *p = &variants[i];
+		printf("TILE_SIZE = %2d, WPTM = %d, WPTN = %d, SIMD = %d: ", p->tile_size, p->wptm, p->wptn, p->simd);
+		if (!checkTuneDeviceLimits(p))
+		{
+			printf("exceeds device limits\n");
+			continue;
+		}
+		double gflops = benchTuneVariant(p, M, N, K, d_A, d_B, d_C, h_C, C_ref);
+		if (gflops < 0.0)
+		{
+			printf("skipped\n");
+			continue;
+		}
+		printf("%.3lf GFlops\n", gflops);
+		if (gflops > best_gflops)
+		{
+			best_idx    = i;
+			best_gflops = gflops;
+		}
+	}
+	
+	if (best_idx != -1)
+	{
+		sgemmTileParams_t *p = &variants[best_idx];
+		printf("Best: TILE_SIZE = %d, WPTM = %d, WPTN = %d, SIMD = %d, %.3lf GFlops\n", p->tile_size, p->wptm, p->wptn, p->simd, best_gflops);
+		setSgemmTuningEntry(M, N, K, p, best_gflops);
+	} else {
+		printf("No usable variant for this shape\n");
+	}
+	setSgemmActiveTileParams(&saved_params);
+	
+	freeCLPoolBuffer(d_A);
+	freeCLPoolBuffer(d_B);
+	freeCLPoolBuffer(d_C);
+	free(h_A);
+	free(h_B);
+	free(h_C);
+	free(C_ref);
+}
+
+int main(int argc, char **argv)
+{
+	if ((argc >= 2) && (strcmp(argv[1], "--list") == 0))
+	{
+		listTuneVariants();
+		return 0;
+	}
+	if (argc < 3)
+	{
+		printf("Usage: %s <tuning table file> <M,N,K> [<M,N,K> ...]\n", argv[0]);
+		printf("       %s --list   (print the .aocx file and aoc options of each variant)\n", argv[0]);
+		return 255;
+	}
+	
+	const char *table_file = argv[1];
+	int nload = loadSgemmTuningTable(table_file);
+	if (nload > 0) printf("Loaded %d entries from %s, tuned shapes will be updated\n", nload, table_file);
+	if (getCLRuntime() == NULL) return 255;
+	
+	for (int i = 2; i < argc; i++)
+	{
+		int M, N, K;
+		if ((sscanf(argv[i], "%d,%d,%d", &M, &N, &K) != 3) || (M < 1) || (N < 1) || (K < 1))
+		{
+			printf("[WARNING] Invalid shape \"%s\" ignored\n", argv[i]);
+			continue;
+		}
+		tuneShape(M, N, K);
+	}
+	
+	int ret = saveSgemmTuningTable(table_file);
+	if (ret == 0) printf("Tuning table written to %s\n", table_file);
+	releaseCLRuntime();
+	return (ret == 0) ? 0 : 255;
+}
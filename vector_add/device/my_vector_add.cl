@@ -1,9 +1,153 @@
-
 #include "my_vector_add.h"
 
-__kernel void vector_add(__global int * restrict a, __global int * restrict b)
+// Work-item i handles elements [i * BLAS_VEC, (i + 1) * BLAS_VEC). A full vector is
+// accessed without bounds checks so the unrolled accesses are coalesced into one
+// BLAS_VEC-wide load / store; only the work-item at the end of the array takes the
+// checked path, so any n works. The host launches ceil(n / BLAS_VEC) work-items
+// rounded up to BLAS_WG_SIZE, the extra work-items do nothing.
+
+#define BLAS_ATTRIBUTES \
+	__attribute__((reqd_work_group_size(BLAS_WG_SIZE, 1, 1))) \
+	__attribute__((num_simd_work_items(BLAS_SIMD))) \
+	__attribute__((num_compute_units(BLAS_COMPUTE_UNITS)))
+
+// a = a + b
+__kernel BLAS_ATTRIBUTES
+void vector_add(__global int * restrict a, __global const int * restrict b, const ulong n)
+{
+	ulong base = get_global_id(0) * BLAS_VEC;
+	if (base + BLAS_VEC <= n)
+	{
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++) a[base + l] += b[base + l];
+	} else {
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++)
+			if (base + l < n) a[base + l] += b[base + l];
+	}
+}
+
+// y = alpha * x + y
+__kernel BLAS_ATTRIBUTES
+void blas_axpy(const float alpha, __global const float * restrict x, __global float * restrict y, const ulong n)
+{
+	ulong base = get_global_id(0) * BLAS_VEC;
+	if (base + BLAS_VEC <= n)
+	{
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++) y[base + l] = alpha * x[base + l] + y[base + l];
+	} else {
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++)
+			if (base + l < n) y[base + l] = alpha * x[base + l] + y[base + l];
+	}
+}
+
+// x = alpha * x
+__kernel BLAS_ATTRIBUTES
+void blas_scal(const float alpha, __global float * restrict x, const ulong n)
+{
+	ulong base = get_global_id(0) * BLAS_VEC;
+	if (base + BLAS_VEC <= n)
+	{
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++) x[base + l] *= alpha;
+	} else {
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++)
+			if (base + l < n) x[base + l] *= alpha;
+	}
+}
+
+// y = x
+__kernel BLAS_ATTRIBUTES
+void blas_copy(__global const float * restrict x, __global float * restrict y, const ulong n)
+{
+	ulong base = get_global_id(0) * BLAS_VEC;
+	if (base + BLAS_VEC <= n)
+	{
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++) y[base + l] = x[base + l];
+	} else {
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++)
+			if (base + l < n) y[base + l] = x[base + l];
+	}
+}
+
+// z = x + y
+__kernel BLAS_ATTRIBUTES
+void blas_add(
+	__global const float * restrict x, __global const float * restrict y,
+	__global float * restrict z, const ulong n
+)
+{
+	ulong base = get_global_id(0) * BLAS_VEC;
+	if (base + BLAS_VEC <= n)
+	{
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++) z[base + l] = x[base + l] + y[base + l];
+	} else {
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++)
+			if (base + l < n) z[base + l] = x[base + l] + y[base + l];
+	}
+}
+
+// z = x .* y
+__kernel BLAS_ATTRIBUTES
+void blas_mul(
+	__global const float * restrict x, __global const float * restrict y,
+	__global float * restrict z, const ulong n
+)
+{
+	ulong base = get_global_id(0) * BLAS_VEC;
+	if (base + BLAS_VEC <= n)
+	{
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++) z[base + l] = x[base + l] * y[base + l];
+	} else {
+		#pragma unroll
+		for (int l = 0; l < BLAS_VEC; l++)
+			if (base + l < n) z[base + l] = x[base + l] * y[base + l];
+	}
+}
+
+// partial[g] = sum of x[i] * y[i] handled by work-group g. At most BLAS_DOT_GROUPS
+// work-groups are launched, each work-item strides over the array; the host adds
+// the partial sums.
+__kernel BLAS_ATTRIBUTES
+void blas_dot(
+	__global const float * restrict x, __global const float * restrict y,
+	__global float * restrict partial, const ulong n
+)
 {
-	int global_thread_id = get_group_id(0) * get_local_size(0) + get_local_id(0);
-	int result = a[global_thread_id] + b[global_thread_id];
-	a[global_thread_id] = result;
+	__local float buffer[BLAS_WG_SIZE];
+	
+	int   tid    = get_local_id(0);
+	ulong stride = get_global_size(0) * BLAS_VEC;
+	float sum    = 0.0f;
+	for (ulong base = get_global_id(0) * BLAS_VEC; base < n; base += stride)
+	{
+		if (base + BLAS_VEC <= n)
+		{
+			#pragma unroll
+			for (int l = 0; l < BLAS_VEC; l++) sum += x[base + l] * y[base + l];
+		} else {
+			#pragma unroll
+			for (int l = 0; l < BLAS_VEC; l++)
+				if (base + l < n) sum += x[base + l] * y[base + l];
+		}
+	}
+	buffer[tid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	#pragma unroll
+	for (int s = BLAS_WG_SIZE / 2; s > 0; s >>= 1)
+	{
+		if (tid < s) buffer[tid] += buffer[tid + s];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	if (tid == 0) partial[get_group_id(0)] = buffer[0];
 }
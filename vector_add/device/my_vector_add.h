@@ -1,6 +1,12 @@
 #ifndef __MY_VECTOR_ADD_H__
 #define __MY_VECTOR_ADD_H__
 
-// This header file is just a place holder
+// All kernels in my_vector_add.cl are NDRange kernels, each work-item handles BLAS_VEC
+// consecutive elements, so one SIMD group reads BLAS_VEC * BLAS_SIMD elements per cycle.
+#define BLAS_WG_SIZE       256  // Work-group size
+#define BLAS_VEC           4    // Elements per work-item
+#define BLAS_SIMD          4    // SIMD work-items, BLAS_WG_SIZE must be a multiple of it
+#define BLAS_COMPUTE_UNITS 2    // Work-groups are distributed over the compute units
+#define BLAS_DOT_GROUPS    256  // Max number of work-groups of blas_dot, each writes one partial sum
 
 #endif
@@ -3,15 +3,204 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <math.h>
+#include <omp.h>
 
 #include "FPGA_OpenCL_utils.h"
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
 #include "../device/my_vector_add.h"
+#include "blas1.h"
+#include "fuse.h"
+
+// Max relative error of y against the CPU result ref
+static double getMaxRelErr(const float *y, const float *ref, const int n)
+{
+	double maxerr = 0.0;
+	for (int i = 0; i < n; i++)
+	{
+		double err = fabs((double) y[i] - (double) ref[i]) / fmax(fabs((double) ref[i]), 1.0);
+		if (err > maxerr) maxerr = err;
+	}
+	return maxerr;
+}
+
+void testBLAS1(int n, cl_program program)
+{
+	size_t nBytes = sizeof(float) * (size_t) n;
+	float *h_x   = (float*) malloc(nBytes);
+	float *h_y   = (float*) malloc(nBytes);
+	float *h_z   = (float*) malloc(nBytes);
+	float *h_ref = (float*) malloc(nBytes);
+	for (int i = 0; i < n; i++)
+	{
+		h_x[i] = 0.5f + (float) (i % 17);
+		h_y[i] = 2.0f - (float) (i % 13);
+	}
+	
+	printf("Testing BLAS-1 kernels\n");
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	cl_mem d_x = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+	cl_mem d_y = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+	cl_mem d_z = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+	clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, h_x, 0, NULL, NULL);
+	
+	const char *names[5] = {"axpy", "scal", "copy", "add", "mul"};
+	for (int op = 0; op < 5; op++)
+	{
+		// y is also an input of axpy, restore it before each operation
+		clEnqueueWriteBuffer(queue, d_y, CL_TRUE, 0, nBytes, h_y, 0, NULL, NULL);
+		memcpy(h_ref, h_y, nBytes);
+		int ret = 0;
+		cl_mem d_res = d_y;
+		switch (op)
+		{
+			case 0: ret = blasAxpy(n, 1.5f, d_x, d_y, program); blasAxpyCPU(n, 1.5f, h_x, h_ref); break;
+			case 1: ret = blasScal(n, 1.5f, d_y, program);      blasScalCPU(n, 1.5f, h_ref);      break;
+			case 2: ret = blasCopy(n, d_x, d_y, program);       blasCopyCPU(n, h_x, h_ref);       break;
+			case 3: ret = blasAdd(n, d_x, d_y, d_z, program);   blasAddCPU(n, h_x, h_y, h_ref);   d_res = d_z; break;
+			case 4: ret = blasMul(n, d_x, d_y, d_z, program);   blasMulCPU(n, h_x, h_y, h_ref);   d_res = d_z; break;
+		}
+		clEnqueueReadBuffer(queue, d_res, CL_TRUE, 0, nBytes, h_z, 0, NULL, NULL);
+		double relerr = getMaxRelErr(h_z, h_ref, n);
+		int passed = (ret == 0) && (relerr <= 1e-6);
+		printf("%s blas_%s: max rel err = %e\n", passed ? "Check passed" : "Check failed", names[op], relerr);
+	}
+	
+	clEnqueueWriteBuffer(queue, d_y, CL_TRUE, 0, nBytes, h_y, 0, NULL, NULL);
+	double ref_dot, dev_dot;
+	blasDotCPU(n, h_x, h_y, &ref_dot);
+	int ret = blasDot(n, d_x, d_y, &dev_dot, program);
+	double relerr = fabs(dev_dot - ref_dot) / fmax(fabs(ref_dot), 1.0);
+	printf(
+		"%s blas_dot: ref = %.10g, device = %.10g, rel err = %e\n", 
+		((ret == 0) && (relerr <= 1e-5)) ? "Check passed" : "Check failed", ref_dot, dev_dot, relerr
+	);
+	
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_y);
+	freeCLPoolBuffer(d_z);
+	free(h_x);
+	free(h_y);
+	free(h_z);
+	free(h_ref);
+}
+
+// Run chains[0] in one pass, or chains[1..nchains-1] one after another through
+// the temporary array t on device with programs[c], or on CPU if programs is NULL,
+// return the average time of 10 runs
+static double runFuseChains(
+	const fuseChain_t *chains, const int nchains, const cl_program *programs, const int n,
+	const float **h_in, float *h_t, float *h_out, cl_mem *d_in, cl_mem d_t, cl_mem d_out
+)
+{
+	int ntest = 10;
+	double st = omp_get_wtime();
+	for (int itest = 0; itest < ntest; itest++)
+	{
+		for (int c = 0; c < nchains; c++)
+		{
+			// The first chain reads the inputs, every later one reads the last output
+			const float *h_src[2] = {(c == 0) ? h_in[0] : h_t, h_in[1]};
+			cl_mem       d_src[2] = {(c == 0) ? d_in[0] : d_t, d_in[1]};
+			float *h_dst = (c == nchains - 1) ? h_out : h_t;
+			cl_mem d_dst = (c == nchains - 1) ? d_out : d_t;
+			if (programs != NULL) runFuseChain(&chains[c], n, d_src, d_dst, programs[c]);
+			else runFuseChainCPU(&chains[c], n, h_src, h_dst);
+		}
+	}
+	return (omp_get_wtime() - st) / (double) ntest;
+}
+
+void testFuseChain(int n, cl_program program)
+{
+	// out = relu(1.5 * (x + y) + 0.5), fused and as 3 separate passes
+	fuseChain_t fused, passes[3];
+	initFuseChain(&fused, 2, FuseFloat);
+	appendFuseOp(&fused, FuseAdd, 1, 0.0f, 0.0f);
+	appendFuseOp(&fused, FuseScale, 0, 1.5f, 0.5f);
+	appendFuseOp(&fused, FuseRelu, 0, 0.0f, 0.0f);
+	for (int c = 0; c < 3; c++)
+	{
+		initFuseChain(&passes[c], (c == 0) ? 2 : 1, FuseFloat);
+		appendFuseOp(&passes[c], fused.ops[c].type, fused.ops[c].input, fused.ops[c].a, fused.ops[c].b);
+	}
+	
+	size_t nBytes = sizeof(float) * (size_t) n;
+	float *h_x   = (float*) malloc(nBytes);
+	float *h_y   = (float*) malloc(nBytes);
+	float *h_t   = (float*) malloc(nBytes);
+	float *h_out = (float*) malloc(nBytes);
+	float *h_ref = (float*) malloc(nBytes);
+	for (int i = 0; i < n; i++)
+	{
+		h_x[i] = (float) (i % 17) - 8.0f;
+		h_y[i] = 0.25f * (float) (i % 13) - 1.0f;
+	}
+	const float *h_in[2] = {h_x, h_y};
+	cl_mem d_in[2] = {NULL, NULL};
+	
+	// Bytes moved: the fused pass reads 2 and writes 1 array, the separate passes 3 + 2 + 2
+	printf("Testing fused elementwise chain, memory traffic is 3 / 7 of separate passes\n");
+	double fused_t = runFuseChains(&fused, 1, NULL, n, h_in, h_t, h_ref, d_in, NULL, NULL);
+	double split_t = runFuseChains(passes, 3, NULL, n, h_in, h_t, h_out, d_in, NULL, NULL);
+	int passed = (memcmp(h_out, h_ref, nBytes) == 0);
+	printf(
+		"%s CPU fused: %lf (s), separate passes: %lf (s), speedup %.2lf\n",
+		passed ? "Check passed" : "Check failed", fused_t, split_t, split_t / fused_t
+	);
+	
+	// Get the programs once, so the timed runs only enqueue kernels
+	cl_program fused_program = NULL, pass_programs[3] = {NULL, NULL, NULL};
+	int have_programs = (program != NULL);
+	if (have_programs) fused_program = getFuseChainProgram(&fused);
+	have_programs = have_programs && (fused_program != NULL);
+	for (int c = 0; c < 3; c++)
+	{
+		if (have_programs) pass_programs[c] = getFuseChainProgram(&passes[c]);
+		have_programs = have_programs && (pass_programs[c] != NULL);
+	}
+	if (have_programs)
+	{
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		d_in[0] = allocCLPoolBuffer(nBytes, CL_MEM_READ_ONLY);
+		d_in[1] = allocCLPoolBuffer(nBytes, CL_MEM_READ_ONLY);
+		cl_mem d_t   = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+		cl_mem d_out = allocCLPoolBuffer(nBytes, CL_MEM_WRITE_ONLY);
+		clEnqueueWriteBuffer(queue, d_in[0], CL_TRUE, 0, nBytes, h_x, 0, NULL, NULL);
+		clEnqueueWriteBuffer(queue, d_in[1], CL_TRUE, 0, nBytes, h_y, 0, NULL, NULL);
+		
+		// The first runs are warm-up, they are not timed
+		runFuseChains(&fused, 1, &fused_program, n, h_in, h_t, h_out, d_in, d_t, d_out);
+		runFuseChains(passes, 3, pass_programs, n, h_in, h_t, h_out, d_in, d_t, d_out);
+		fused_t = runFuseChains(&fused, 1, &fused_program, n, h_in, h_t, h_out, d_in, d_t, d_out);
+		clEnqueueReadBuffer(queue, d_out, CL_TRUE, 0, nBytes, h_out, 0, NULL, NULL);
+		double relerr = getMaxRelErr(h_out, h_ref, n);
+		split_t = runFuseChains(passes, 3, pass_programs, n, h_in, h_t, h_out, d_in, d_t, d_out);
+		printf(
+			"%s device fused: %lf (s), separate passes: %lf (s), speedup %.2lf, max rel err = %e\n",
+			(relerr <= 1e-6) ? "Check passed" : "Check failed", fused_t, split_t, split_t / fused_t, relerr
+		);
+		
+		freeCLPoolBuffer(d_in[0]);
+		freeCLPoolBuffer(d_in[1]);
+		freeCLPoolBuffer(d_t);
+		freeCLPoolBuffer(d_out);
+	}
+	releaseFuseChainProgram(fused_program);
+	for (int c = 0; c < 3; c++) releaseFuseChainProgram(pass_programs[c]);
+	
+	free(h_x);
+	free(h_y);
+	free(h_t);
+	free(h_out);
+	free(h_ref);
+}
 
 int main(int argc, char **argv)
 {
 	int n = atoi(argv[1]);
-	n = (n + 63) / 64 * 64;
-	size_t size_n = (size_t) n;
+	cl_ulong size_n = (cl_ulong) n;
 	size_t nBytes = sizeof(int) * (size_t) n;
 	printf("Vector add, length = %d\n", n);
 	
@@ -53,8 +242,12 @@ int main(int argc, char **argv)
 	// Set kernel arguments and launch kernel
 	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*) &d_a);
 	err = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*) &d_b);
-	const size_t threads_in_workgroup[1] = {64};
-	const size_t workspace_threads[1]	 = {size_n};
+	err = clSetKernelArg(kernel, 2, sizeof(cl_ulong), (void*) &size_n);
+	
+	// Each work-item adds BLAS_VEC elements, the last one checks the bounds
+	size_t nitems = (size_n + BLAS_VEC - 1) / BLAS_VEC;
+	const size_t threads_in_workgroup[1] = {BLAS_WG_SIZE};
+	const size_t workspace_threads[1]	 = {(nitems + BLAS_WG_SIZE - 1) / BLAS_WG_SIZE * BLAS_WG_SIZE};
 	cl_event event;
 	err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, workspace_threads, threads_in_workgroup, 0, NULL, &event);
 	clWaitForEvents(1, &event);
@@ -69,6 +262,9 @@ int main(int argc, char **argv)
 	// Check the results
 	for (int i = 0; i < n; i++) assert(h_a[i] == h_b[i]);
 	printf("Result is correct.\n");
+	
+	testBLAS1(n, program);
+	testFuseChain(n, program);
 
 	// Free host memory
 	free(h_a);
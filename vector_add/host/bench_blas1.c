@@ -0,0 +1,137 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "blas1.h"
+
+#define NUM_BLAS_OPS 6
+
+// Name and bytes moved per element of each operation, every input is read once
+// and every output is written once
+static const char *blas_names[NUM_BLAS_OPS] = {"axpy", "scal", "copy", "add", "mul", "dot"};
+static const int   blas_bytes[NUM_BLAS_OPS] = {12, 8, 8, 12, 12, 8};
+
+// Repeat small sizes so each measurement takes a while
+static int getBLASBenchRepeats(const size_t n)
+{
+	size_t ntest = ((size_t) 1 << 26) / n;
+	if (ntest < 1)   ntest = 1;
+	if (ntest > 100) ntest = 100;
+	return (int) ntest;
+}
+
+static int runBLASDevice(const int op, const size_t n, cl_mem x, cl_mem y, cl_mem z, cl_program program)
+{
+	double dot;
+	switch (op)
+	{
+		case 0: return blasAxpy(n, 1.0001f, x, y, program);
+		case 1: return blasScal(n, 1.0001f, y, program);
+		case 2: return blasCopy(n, x, y, program);
+		case 3: return blasAdd(n, x, y, z, program);
+		case 4: return blasMul(n, x, y, z, program);
+		case 5: return blasDot(n, x, y, &dot, program);
+	}
+	return -1;
+}
+
+static void runBLASCPU(const int op, const size_t n, const float *x, float *y, float *z)
+{
+	double dot;
+	switch (op)
+	{
+		case 0: blasAxpyCPU(n, 1.0001f, x, y); break;
+		case 1: blasScalCPU(n, 1.0001f, y);    break;
+		case 2: blasCopyCPU(n, x, y);          break;
+		case 3: blasAddCPU(n, x, y, z);        break;
+		case 4: blasMulCPU(n, x, y, z);        break;
+		case 5: blasDotCPU(n, x, y, &dot);     break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_n = (size_t) 1 << 26;
+	double peak  = 34.1;
+	if (argc >= 2) max_n = (size_t) atoll(argv[1]);
+	if (argc >= 3) peak  = atof(argv[2]);
+	if ((max_n < 1024) || (peak <= 0.0))
+	{
+		printf("Usage: %s <max length, at least 1024, default 2^26> <peak bandwidth in GB/s, default 34.1>\n", argv[0]);
+		return 255;
+	}
+
+	size_t nBytes = sizeof(float) * max_n;
+	float *x = (float*) malloc(nBytes);
+	float *y = (float*) malloc(nBytes);
+	float *z = (float*) malloc(nBytes);
+	if ((x == NULL) || (y == NULL) || (z == NULL))
+	{
+		printf("[ERROR] Cannot allocate host arrays for %zu elements\n", max_n);
+		return 255;
+	}
+	for (size_t i = 0; i < max_n; i++)
+	{
+		x[i] = (float) (i % 17);
+		y[i] = (float) (i % 13);
+	}
+
+	// The kernels are built from device/my_vector_add.cl on a non-FPGA OpenCL device
+	cl_program program = getCLRuntimeProgram("my_vector_add.aocx");
+	cl_mem d_x = NULL, d_y = NULL, d_z = NULL;
+	if (program != NULL)
+	{
+		d_x = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+		d_y = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+		d_z = allocCLPoolBuffer(nBytes, CL_MEM_READ_WRITE);
+	}
+	int use_device = (d_x != NULL) && (d_y != NULL) && (d_z != NULL);
+	if (use_device)
+	{
+		cl_command_queue queue = getCLRuntimeQueue(0);
+		clEnqueueWriteBuffer(queue, d_x, CL_TRUE, 0, nBytes, x, 0, NULL, NULL);
+		clEnqueueWriteBuffer(queue, d_y, CL_TRUE, 0, nBytes, y, 0, NULL, NULL);
+	} else {
+		printf("No OpenCL program or device memory for my_vector_add.aocx, only the CPU is tested\n");
+	}
+
+	// Lengths are 3 more than a power of 4 (if it fits) so the tail path is used
+	printf("BLAS-1 effective bandwidth, device peak = %.1lf GB/s:\n", peak);
+	for (int op = 0; op < NUM_BLAS_OPS; op++)
+	{
+		printf("%s, %d bytes per element\n", blas_names[op], blas_bytes[op]);
+		for (size_t n = 1024; n <= max_n; n *= 4)
+		{
+			size_t len  = (n + 3 <= max_n) ? n + 3 : n;
+			int   ntest = getBLASBenchRepeats(len);
+			double st = omp_get_wtime();
+			for (int itest = 0; itest < ntest; itest++) runBLASCPU(op, len, x, y, z);
+			double ut = (omp_get_wtime() - st) / (double) ntest;
+			double bytes = (double) blas_bytes[op] * (double) len;
+			printf("%11zu | CPU %8.3lf GB/s", len, bytes / (ut * 1000000000.0));
+
+			if (use_device)
+			{
+				int ret = runBLASDevice(op, len, d_x, d_y, d_z, program);
+				st = omp_get_wtime();
+				for (int itest = 0; itest < ntest; itest++) ret |= runBLASDevice(op, len, d_x, d_y, d_z, program);
+				ut = (omp_get_wtime() - st) / (double) ntest;
+				double gbs = bytes / (ut * 1000000000.0);
+				printf(" | device %8.3lf GB/s, %5.1lf%% of peak %s", gbs, 100.0 * gbs / peak, (ret == 0) ? "" : "FAILED");
+			}
+			printf("\n");
+		}
+	}
+
+	freeCLPoolBuffer(d_x);
+	freeCLPoolBuffer(d_y);
+	freeCLPoolBuffer(d_z);
+	free(x);
+	free(y);
+	free(z);
+	return 0;
+}
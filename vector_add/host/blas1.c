@@ -0,0 +1,184 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/my_vector_add.h"
+#include "blas1.h"
+
+// Run an elementwise kernel on queue 0. The kernel arguments are the nargs buffers or
+// scalars in args followed by n, one work-item handles BLAS_VEC elements.
+static int runBlasKernel(
+	const char *kernel_name, const size_t n, const int nargs, const size_t *arg_sizes,
+	const void **args, cl_program program
+)
+{
+	if (n == 0) return 0;
+	if (program == NULL) return -1;
+
+	cl_int err;
+	cl_kernel kernel = clCreateKernel(program, kernel_name, &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateKernel() failed for %s, returned status = %d\n", kernel_name, err);
+		return -1;
+	}
+
+	cl_ulong _n = n;
+	size_t nitems = (n + BLAS_VEC - 1) / BLAS_VEC;
+	const size_t wg_size[1] = {BLAS_WG_SIZE};
+	const size_t ws_size[1] = {(nitems + BLAS_WG_SIZE - 1) / BLAS_WG_SIZE * BLAS_WG_SIZE};
+	for (int i = 0; i < nargs; i++) err |= clSetKernelArg(kernel, i, arg_sizes[i], args[i]);
+	err |= clSetKernelArg(kernel, nargs, sizeof(cl_ulong), (void*) &_n);
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	err |= clEnqueueNDRangeKernel(queue, kernel, 1, NULL, ws_size, wg_size, 0, NULL, NULL);
+	err |= clFinish(queue);
+	clReleaseKernel(kernel);
+
+	if (err != CL_SUCCESS) printf("[ERROR] %s on device failed, returned status = %d\n", kernel_name, err);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+int blasAxpy(const size_t n, const float alpha, cl_mem x, cl_mem y, cl_program program)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL) || (x == y))) return -1;
+	cl_float _alpha = alpha;
+	const size_t arg_sizes[3] = {sizeof(cl_float), sizeof(cl_mem), sizeof(cl_mem)};
+	const void  *args[3]      = {&_alpha, &x, &y};
+	return runBlasKernel("blas_axpy", n, 3, arg_sizes, args, program);
+}
+
+int blasScal(const size_t n, const float alpha, cl_mem x, cl_program program)
+{
+	if ((n > 0) && (x == NULL)) return -1;
+	cl_float _alpha = alpha;
+	const size_t arg_sizes[2] = {sizeof(cl_float), sizeof(cl_mem)};
+	const void  *args[2]      = {&_alpha, &x};
+	return runBlasKernel("blas_scal", n, 2, arg_sizes, args, program);
+}
+
+int blasCopy(const size_t n, cl_mem x, cl_mem y, cl_program program)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL) || (x == y))) return -1;
+	const size_t arg_sizes[2] = {sizeof(cl_mem), sizeof(cl_mem)};
+	const void  *args[2]      = {&x, &y};
+	return runBlasKernel("blas_copy", n, 2, arg_sizes, args, program);
+}
+
+int blasAdd(const size_t n, cl_mem x, cl_mem y, cl_mem z, cl_program program)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL) || (z == NULL) || (z == x) || (z == y))) return -1;
+	const size_t arg_sizes[3] = {sizeof(cl_mem), sizeof(cl_mem), sizeof(cl_mem)};
+	const void  *args[3]      = {&x, &y, &z};
+	return runBlasKernel("blas_add", n, 3, arg_sizes, args, program);
+}
+
+int blasMul(const size_t n, cl_mem x, cl_mem y, cl_mem z, cl_program program)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL) || (z == NULL) || (z == x) || (z == y))) return -1;
+	const size_t arg_sizes[3] = {sizeof(cl_mem), sizeof(cl_mem), sizeof(cl_mem)};
+	const void  *args[3]      = {&x, &y, &z};
+	return runBlasKernel("blas_mul", n, 3, arg_sizes, args, program);
+}
+
+int blasDot(const size_t n, cl_mem x, cl_mem y, double *res, cl_program program)
+{
+	if (res == NULL) return -1;
+	*res = 0.0;
+	if (n == 0) return 0;
+	if ((x == NULL) || (y == NULL) || (program == NULL)) return -1;
+
+	// Enough work-groups to cover n once, but no more than BLAS_DOT_GROUPS
+	size_t nitems  = (n + BLAS_VEC - 1) / BLAS_VEC;
+	size_t ngroups = (nitems + BLAS_WG_SIZE - 1) / BLAS_WG_SIZE;
+	if (ngroups > BLAS_DOT_GROUPS) ngroups = BLAS_DOT_GROUPS;
+	cl_mem partial = allocCLPoolBuffer(sizeof(cl_float) * ngroups, CL_MEM_WRITE_ONLY);
+	if (partial == NULL) return -1;
+
+	cl_int err;
+	cl_kernel kernel = clCreateKernel(program, "blas_dot", &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateKernel() failed for blas_dot, returned status = %d\n", err);
+		freeCLPoolBuffer(partial);
+		return -1;
+	}
+
+	cl_ulong _n = n;
+	cl_float h_partial[BLAS_DOT_GROUPS];
+	const size_t wg_size[1] = {BLAS_WG_SIZE};
+	const size_t ws_size[1] = {ngroups * BLAS_WG_SIZE};
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	err |= clSetKernelArg(kernel, 0, sizeof(cl_mem),   (void*) &x);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem),   (void*) &y);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem),   (void*) &partial);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_ulong), (void*) &_n);
+	err |= clEnqueueNDRangeKernel(queue, kernel, 1, NULL, ws_size, wg_size, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(queue, partial, CL_TRUE, 0, sizeof(cl_float) * ngroups, h_partial, 0, NULL, NULL);
+	clReleaseKernel(kernel);
+	freeCLPoolBuffer(partial);
+
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] blas_dot on device failed, returned status = %d\n", err);
+		return -1;
+	}
+	double sum = 0.0;
+	for (size_t g = 0; g < ngroups; g++) sum += (double) h_partial[g];
+	*res = sum;
+	return 0;
+}
+
+int blasAxpyCPU(const size_t n, const float alpha, const float *x, float *y)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL))) return -1;
+	#pragma omp parallel for simd
+	for (size_t i = 0; i < n; i++) y[i] = alpha * x[i] + y[i];
+	return 0;
+}
+
+int blasScalCPU(const size_t n, const float alpha, float *x)
+{
+	if ((n > 0) && (x == NULL)) return -1;
+	#pragma omp parallel for simd
+	for (size_t i = 0; i < n; i++) x[i] *= alpha;
+	return 0;
+}
+
+int blasCopyCPU(const size_t n, const float *x, float *y)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL))) return -1;
+	#pragma omp parallel for simd
+	for (size_t i = 0; i < n; i++) y[i] = x[i];
+	return 0;
+}
+
+int blasAddCPU(const size_t n, const float *x, const float *y, float *z)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL) || (z == NULL))) return -1;
+	#pragma omp parallel for simd
+	for (size_t i = 0; i < n; i++) z[i] = x[i] + y[i];
+	return 0;
+}
+
+int blasMulCPU(const size_t n, const float *x, const float *y, float *z)
+{
+	if ((n > 0) && ((x == NULL) || (y == NULL) || (z == NULL))) return -1;
+	#pragma omp parallel for simd
+	for (size_t i = 0; i < n; i++) z[i] = x[i] * y[i];
+	return 0;
+}
+
+int blasDotCPU(const size_t n, const float *x, const float *y, double *res)
+{
+	if (res == NULL) return -1;
+	if ((n > 0) && ((x == NULL) || (y == NULL))) return -1;
+	double sum = 0.0;
+	#pragma omp parallel for simd reduction(+:sum)
+	for (size_t i = 0; i < n; i++) sum += (double) x[i] * (double) y[i];
+	*res = sum;
+	return 0;
+}
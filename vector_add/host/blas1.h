@@ -0,0 +1,46 @@
+#ifndef __BLAS1_H__
+#define __BLAS1_H__
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+// BLAS-1 operations on float device buffers with the kernels in my_vector_add.cl.
+// n can be any length, output buffers must not alias the input buffers. All calls
+// run on runtime queue 0 and block until the result is ready.
+// Functions return 0 on success and -1 on invalid arguments or OpenCL errors.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// y = alpha * x + y
+int blasAxpy(const size_t n, const float alpha, cl_mem x, cl_mem y, cl_program program);
+
+// x = alpha * x
+int blasScal(const size_t n, const float alpha, cl_mem x, cl_program program);
+
+// y = x
+int blasCopy(const size_t n, cl_mem x, cl_mem y, cl_program program);
+
+// z = x + y
+int blasAdd(const size_t n, cl_mem x, cl_mem y, cl_mem z, cl_program program);
+
+// z = x .* y
+int blasMul(const size_t n, cl_mem x, cl_mem y, cl_mem z, cl_program program);
+
+// res = x' * y, the partial sums of the work-groups are added in double on host
+int blasDot(const size_t n, cl_mem x, cl_mem y, double *res, cl_program program);
+
+// References on CPU with OpenMP, the dot product is accumulated in double
+int blasAxpyCPU(const size_t n, const float alpha, const float *x, float *y);
+int blasScalCPU(const size_t n, const float alpha, float *x);
+int blasCopyCPU(const size_t n, const float *x, float *y);
+int blasAddCPU(const size_t n, const float *x, const float *y, float *z);
+int blasMulCPU(const size_t n, const float *x, const float *y, float *z);
+int blasDotCPU(const size_t n, const float *x, const float *y, double *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,413 @@
+#include <CL/cl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
+#include <omp.h>
+
+#include "FPGA_OpenCL_runtime.h"
+#include "FPGA_OpenCL_mem_pool.h"
+#include "../device/my_vector_add.h"
+#include "fuse.h"
+
+#define FUSE_MAX_SOURCE 16384
+#define FUSE_CPU_BLOCK  1024  // Elements per block of the CPU loop, all operations are applied to a block in cache
+
+static const char *fuse_out_types[3] = {"float", "int", "uchar"};
+static const char *fuse_out_codes[3] = {"f", "i", "u"};
+
+// Chain programs got from the runtime, the least recently used one is released for a new chain
+static cl_program fuse_programs[FUSE_MAX_PROGRAMS];
+static unsigned long long fuse_program_uses[FUSE_MAX_PROGRAMS], fuse_use_clock = 0;
+
+// Only FuseScale and FuseClamp have scalar kernel arguments
+static int hasFuseScalars(const fuseOpType_t type)
+{
+	return (type == FuseScale) || (type == FuseClamp);
+}
+
+int initFuseChain(fuseChain_t *chain, const int ninputs, const fuseType_t out_type)
+{
+	if ((chain == NULL) || (ninputs < 1) || (ninputs > FUSE_MAX_INPUTS)) return -1;
+	if ((out_type != FuseFloat) && (out_type != FuseInt) && (out_type != FuseUchar)) return -1;
+	chain->ninputs  = ninputs;
+	chain->out_type = out_type;
+	chain->nops     = 0;
+	return 0;
+}
+
+int appendFuseOp(fuseChain_t *chain, const fuseOpType_t type, const int input, const float a, const float b)
+{
+	if ((chain == NULL) || (chain->nops == FUSE_MAX_OPS)) return -1;
+	if ((type < FuseAdd) || (type > FuseTanh)) return -1;
+	if (((type == FuseAdd) || (type == FuseMul)) && ((input < 0) || (input >= chain->ninputs))) return -1;
+	fuseOp_t *op = &chain->ops[chain->nops++];
+	op->type  = type;
+	op->input = ((type == FuseAdd) || (type == FuseMul)) ? input : 0;
+	op->a     = hasFuseScalars(type) ? a : 0.0f;
+	op->b     = hasFuseScalars(type) ? b : 0.0f;
+	return 0;
+}
+
+int getFuseChainSignature(const fuseChain_t *chain, char *sig, const size_t sig_size)
+{
+	if ((chain == NULL) || (sig == NULL) || (sig_size < FUSE_MAX_SIG_LEN)) return -1;
+	const char op_codes[7] = {'a', 'm', 's', 'c', 'r', 'g', 't'};
+	int len = sprintf(sig, "%di_%s", chain->ninputs, fuse_out_codes[chain->out_type]);
+	for (int k = 0; k < chain->nops; k++)
+	{
+		const fuseOp_t *op = &chain->ops[k];
+		if ((op->type == FuseAdd) || (op->type == FuseMul)) len += sprintf(sig + len, "_%c%d", op_codes[op->type], op->input);
+		else len += sprintf(sig + len, "_%c", op_codes[op->type]);
+	}
+	return 0;
+}
+
+// Append formatted text to src, *len is set to -1 once src is full
+static void appendFuseSource(char *src, const size_t src_size, int *len, const char *fmt, ...)
+{
+	if (*len < 0) return;
+	va_list args;
+	va_start(args, fmt);
+	int ret = vsnprintf(src + *len, src_size - *len, fmt, args);
+	va_end(args);
+	if ((ret < 0) || ((size_t) (*len + ret) >= src_size)) *len = -1;
+	else *len += ret;
+}
+
+int getFuseChainSource(const fuseChain_t *chain, char *src, const size_t src_size)
+{
+	char sig[FUSE_MAX_SIG_LEN];
+	if ((src == NULL) || (getFuseChainSignature(chain, sig, sizeof(sig)) != 0)) return -1;
+	const char *out_type = fuse_out_types[chain->out_type];
+	int len = 0;
+
+	// Operations of one element, the kernel calls it for full vectors and for the tail
+	appendFuseSource(src, src_size, &len, "#include \"my_vector_add.h\"\n\n// Fused chain %s, generated by fuse.c\n\n", sig);
+	appendFuseSource(src, src_size, &len, "inline float fused_%s_element(", sig);
+	for (int k = 0; k < chain->ninputs; k++) appendFuseSource(src, src_size, &len, "%sconst float x%d", (k > 0) ? ", " : "", k);
+	for (int k = 0; k < chain->nops; k++)
+		if (hasFuseScalars(chain->ops[k].type)) appendFuseSource(src, src_size, &len, ", const float a%d, const float b%d", k, k);
+	appendFuseSource(src, src_size, &len, ")\n{\n\tfloat v = x0;\n");
+	for (int k = 0; k < chain->nops; k++)
+	{
+		const fuseOp_t *op = &chain->ops[k];
+		switch (op->type)
+		{
+			case FuseAdd:     appendFuseSource(src, src_size, &len, "\tv = v + x%d;\n", op->input);        break;
+			case FuseMul:     appendFuseSource(src, src_size, &len, "\tv = v * x%d;\n", op->input);        break;
+			case FuseScale:   appendFuseSource(src, src_size, &len, "\tv = a%d * v + b%d;\n", k, k);        break;
+			case FuseClamp:   appendFuseSource(src, src_size, &len, "\tv = fmin(fmax(v, a%d), b%d);\n", k, k); break;
+			case FuseRelu:    appendFuseSource(src, src_size, &len, "\tv = fmax(v, 0.0f);\n");              break;
+			case FuseSigmoid: appendFuseSource(src, src_size, &len, "\tv = 1.0f / (1.0f + exp(-v));\n");    break;
+			case FuseTanh:    appendFuseSource(src, src_size, &len, "\tv = tanh(v);\n");                    break;
+		}
+	}
+	appendFuseSource(src, src_size, &len, "\treturn v;\n}\n\n");
+
+	// Same attributes and work-item layout as the BLAS-1 kernels in my_vector_add.cl
+	appendFuseSource(src, src_size, &len, "__kernel\n");
+	appendFuseSource(src, src_size, &len, "__attribute__((reqd_work_group_size(BLAS_WG_SIZE, 1, 1)))\n");
+	appendFuseSource(src, src_size, &len, "__attribute__((num_simd_work_items(BLAS_SIMD)))\n");
+	appendFuseSource(src, src_size, &len, "__attribute__((num_compute_units(BLAS_COMPUTE_UNITS)))\n");
+	appendFuseSource(src, src_size, &len, "void fused_%s(\n", sig);
+	for (int k = 0; k < chain->ninputs; k++) appendFuseSource(src, src_size, &len, "\t__global const float * restrict in%d,\n", k);
+	appendFuseSource(src, src_size, &len, "\t__global %s * restrict out,\n", out_type);
+	for (int k = 0; k < chain->nops; k++)
+		if (hasFuseScalars(chain->ops[k].type)) appendFuseSource(src, src_size, &len, "\tconst float a%d, const float b%d,\n", k, k);
+	appendFuseSource(src, src_size, &len, "\tconst ulong n\n)\n{\n");
+
+	// out[i] = converted result of element i, same text for both loops
+	char store[1024];
+	int store_len = 0;
+	if (chain->out_type == FuseFloat) appendFuseSource(store, sizeof(store), &store_len, "out[i] = fused_%s_element(", sig);
+	else appendFuseSource(store, sizeof(store), &store_len, "out[i] = convert_%s_sat_rte(fused_%s_element(", out_type, sig);
+	for (int k = 0; k < chain->ninputs; k++) appendFuseSource(store, sizeof(store), &store_len, "%sin%d[i]", (k > 0) ? ", " : "", k);
+	for (int k = 0; k < chain->nops; k++)
+		if (hasFuseScalars(chain->ops[k].type)) appendFuseSource(store, sizeof(store), &store_len, ", a%d, b%d", k, k);
+	appendFuseSource(store, sizeof(store), &store_len, (chain->out_type == FuseFloat) ? ");" : "));");
+	if (store_len < 0) return -1;
+
+	appendFuseSource(src, src_size, &len, "\tulong base = get_global_id(0) * BLAS_VEC;\n");
+	appendFuseSource(src, src_size, &len, "\tif (base + BLAS_VEC <= n)\n\t{\n\t\t#pragma unroll\n");
+	appendFuseSource(src, src_size, &len, "\t\tfor (int l = 0; l < BLAS_VEC; l++)\n\t\t{\n\t\t\tulong i = base + l;\n\t\t\t%s\n\t\t}\n", store);
+	appendFuseSource(src, src_size, &len, "\t} else {\n\t\t#pragma unroll\n");
+	appendFuseSource(src, src_size, &len, "\t\tfor (int l = 0; l < BLAS_VEC; l++)\n\t\t{\n\t\t\tulong i = base + l;\n\t\t\tif (i < n) %s\n\t\t}\n", store);
+	appendFuseSource(src, src_size, &len, "\t}\n}\n");
+	return len;
+}
+
+// Write the kernel source unless the file already has it, so the runtime does not
+// see a changed file and rebuild the program
+static int writeFuseChainSource(const char *file_name, const char *src, const int len)
+{
+	FILE *file = fopen(file_name, "rb");
+	if (file != NULL)
+	{
+		char *old_src = (char*) malloc(len + 1);
+		size_t old_len = (old_src == NULL) ? 0 : fread(old_src, 1, len + 1, file);
+		int same = (old_src != NULL) && (old_len == (size_t) len) && (memcmp(old_src, src, len) == 0);
+		free(old_src);
+		fclose(file);
+		if (same) return 0;
+	}
+
+	file = fopen(file_name, "wb");
+	if (file == NULL)
+	{
+		printf("[ERROR] Cannot write fused kernel file %s\n", file_name);
+		return -1;
+	}
+	size_t written = fwrite(src, 1, len, file);
+	fclose(file);
+	return (written == (size_t) len) ? 0 : -1;
+}
+
+cl_program getFuseChainProgram(const fuseChain_t *chain)
+{
+	CLRuntime_t *rt = getCLRuntime();
+	char sig[FUSE_MAX_SIG_LEN], src_file_name[FUSE_MAX_SIG_LEN + 32], bin_file_name[FUSE_MAX_SIG_LEN + 32];
+	if ((rt == NULL) || (getFuseChainSignature(chain, sig, sizeof(sig)) != 0)) return NULL;
+	snprintf(src_file_name, sizeof(src_file_name), "device/fused_%s.cl", sig);
+	snprintf(bin_file_name, sizeof(bin_file_name), "fused_%s.aocx", sig);
+
+	char *src = (char*) malloc(FUSE_MAX_SOURCE);
+	int len = (src == NULL) ? -1 : getFuseChainSource(chain, src, FUSE_MAX_SOURCE);
+	int ret = (len < 0) ? -1 : writeFuseChainSource(src_file_name, src, len);
+	free(src);
+	if (ret != 0) return NULL;
+
+	// On other devices the runtime builds device/fused_<sig>.cl for fused_<sig>.aocx
+	cl_program program = getCLRuntimeProgram(bin_file_name);
+	if ((program == NULL) && (rt->device_type & CL_DEVICE_TYPE_ACCELERATOR))
+		printf("[WARNING] Fused chain %s is not compiled, run \"make %s\" first\n", sig, bin_file_name);
+	if (program == NULL) return NULL;
+
+	cl_program evicted = NULL;
+	#pragma omp critical (fuse_programs)
+	{
+		// Same program if the chain is kept, else an empty slot or the least recently used one
+		int slot = 0;
+		for (int i = 0; i < FUSE_MAX_PROGRAMS; i++)
+			if (fuse_program_uses[i] < fuse_program_uses[slot]) slot = i;
+		for (int i = 0; i < FUSE_MAX_PROGRAMS; i++)
+			if (fuse_programs[i] == program) slot = i;
+		if (fuse_programs[slot] != program) evicted = fuse_programs[slot];
+		fuse_programs[slot] = program;
+		fuse_program_uses[slot] = ++fuse_use_clock;
+	}
+	releaseCLRuntimeProgram(evicted);
+	return program;
+}
+
+void releaseFuseChainProgram(cl_program program)
+{
+	if (program == NULL) return;
+	#pragma omp critical (fuse_programs)
+	{
+		for (int i = 0; i < FUSE_MAX_PROGRAMS; i++)
+			if (fuse_programs[i] == program) { fuse_programs[i] = NULL; fuse_program_uses[i] = 0; }
+	}
+	releaseCLRuntimeProgram(program);
+}
+
+int runFuseChain(
+	const fuseChain_t *chain, const size_t n, const cl_mem *inputs, cl_mem output,
+	cl_program program
+)
+{
+	char sig[FUSE_MAX_SIG_LEN], kernel_name[FUSE_MAX_SIG_LEN + 8];
+	if (getFuseChainSignature(chain, sig, sizeof(sig)) != 0) return -1;
+	if (n == 0) return 0;
+	if ((inputs == NULL) || (output == NULL) || (program == NULL)) return -1;
+	for (int k = 0; k < chain->ninputs; k++)
+		if ((inputs[k] == NULL) || (inputs[k] == output)) return -1;
+
+	cl_int err;
+	snprintf(kernel_name, sizeof(kernel_name), "fused_%s", sig);
+	cl_kernel kernel = clCreateKernel(program, kernel_name, &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("[ERROR] clCreateKernel() failed for %s, returned status = %d\n", kernel_name, err);
+		return -1;
+	}
+
+	// Inputs, output, the scalars of each FuseScale / FuseClamp, then n
+	int arg = 0;
+	cl_ulong _n = n;
+	for (int k = 0; k < chain->ninputs; k++) err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), (void*) &inputs[k]);
+	err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), (void*) &output);
+	for (int k = 0; k < chain->nops; k++)
+	{
+		if (!hasFuseScalars(chain->ops[k].type)) continue;
+		err |= clSetKernelArg(kernel, arg++, sizeof(cl_float), (void*) &chain->ops[k].a);
+		err |= clSetKernelArg(kernel, arg++, sizeof(cl_float), (void*) &chain->ops[k].b);
+	}
+	err |= clSetKernelArg(kernel, arg++, sizeof(cl_ulong), (void*) &_n);
+
+	size_t nitems = (n + BLAS_VEC - 1) / BLAS_VEC;
+	const size_t wg_size[1] = {BLAS_WG_SIZE};
+	const size_t ws_size[1] = {(nitems + BLAS_WG_SIZE - 1) / BLAS_WG_SIZE * BLAS_WG_SIZE};
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	err |= clEnqueueNDRangeKernel(queue, kernel, 1, NULL, ws_size, wg_size, 0, NULL, NULL);
+	err |= clFinish(queue);
+	clReleaseKernel(kernel);
+
+	if (err != CL_SUCCESS) printf("[ERROR] %s on device failed, returned status = %d\n", kernel_name, err);
+	return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+static size_t getFuseTypeSize(const fuseType_t type)
+{
+	if (type == FuseInt)   return sizeof(int);
+	if (type == FuseUchar) return sizeof(unsigned char);
+	return sizeof(float);
+}
+
+int runFuseChainHost(const fuseChain_t *chain, const size_t n, const float **inputs, void *output)
+{
+	// CPU fallback, the OpenCL device is not an FPGA. Decide it first, the program
+	// is only written and built if the device is used
+	CLRuntime_t *rt = getCLRuntime();
+	const char *fallback = getenv("FUSE_CPU_FALLBACK");
+	int use_cpu = (rt == NULL) || !(rt->device_type & CL_DEVICE_TYPE_ACCELERATOR);
+	if ((rt != NULL) && (fallback != NULL) && (strcmp(fallback, "0") == 0)) use_cpu = 0;
+	cl_program program = use_cpu ? NULL : getFuseChainProgram(chain);
+	if (program == NULL) return runFuseChainCPU(chain, n, inputs, output);
+
+	if (n == 0) return 0;
+	if ((inputs == NULL) || (output == NULL)) return -1;
+
+	cl_command_queue queue = getCLRuntimeQueue(0);
+	size_t in_bytes  = sizeof(float) * n;
+	size_t out_bytes = getFuseTypeSize(chain->out_type) * n;
+	cl_mem d_in[FUSE_MAX_INPUTS] = {NULL};
+	cl_mem d_out = allocCLPoolBuffer(out_bytes, CL_MEM_WRITE_ONLY);
+	cl_int err = (d_out == NULL) ? CL_OUT_OF_RESOURCES : CL_SUCCESS;
+	for (int k = 0; k < chain->ninputs; k++)
+	{
+		d_in[k] = allocCLPoolBuffer(in_bytes, CL_MEM_READ_ONLY);
+		if ((d_in[k] == NULL) || (inputs[k] == NULL)) err = CL_OUT_OF_RESOURCES;
+		else err |= clEnqueueWriteBuffer(queue, d_in[k], CL_FALSE, 0, in_bytes, inputs[k], 0, NULL, NULL);
+	}
+
+	int ret = -1;
+	if (err == CL_SUCCESS) ret = runFuseChain(chain, n, d_in, d_out, program);
+	else printf("[ERROR] Cannot copy fused chain inputs to device, status = %d\n", err);
+	if (ret == 0)
+	{
+		err = clEnqueueReadBuffer(queue, d_out, CL_TRUE, 0, out_bytes, output, 0, NULL, NULL);
+		if (err != CL_SUCCESS)
+		{
+			printf("[ERROR] clEnqueueReadBuffer() failed, returned status = %d\n", err);
+			ret = -1;
+		}
+	}
+
+	for (int k = 0; k < chain->ninputs; k++) freeCLPoolBuffer(d_in[k]);
+	freeCLPoolBuffer(d_out);
+	return ret;
+}
+
+// Round to nearest even and saturate as convert_<type>_sat_rte(), NaN gives 0
+static int convertIntSatRte(const float v)
+{
+	if (v != v) return 0;
+	if (v >=  2147483647.0f) return INT_MAX;
+	if (v <= -2147483648.0f) return INT_MIN;
+	return (int) nearbyintf(v);
+}
+
+static unsigned char convertUcharSatRte(const float v)
+{
+	if (v != v) return 0;
+	if (v >= 255.0f) return 255;
+	if (v <= 0.0f)   return 0;
+	return (unsigned char) nearbyintf(v);
+}
+
+int runFuseChainCPU(const fuseChain_t *chain, const size_t n, const float **inputs, void *output)
+{
+	if ((chain == NULL) || (chain->ninputs < 1) || (chain->ninputs > FUSE_MAX_INPUTS)) return -1;
+	if (n == 0) return 0;
+	if ((inputs == NULL) || (output == NULL)) return -1;
+	for (int k = 0; k < chain->ninputs; k++)
+		if (inputs[k] == NULL) return -1;
+
+	size_t nblocks = (n + FUSE_CPU_BLOCK - 1) / FUSE_CPU_BLOCK;
+	#pragma omp parallel for schedule(static)
+	for (size_t blk = 0; blk < nblocks; blk++)
+	{
+		float v[FUSE_CPU_BLOCK];
+		size_t start = blk * FUSE_CPU_BLOCK;
+		int len = (start + FUSE_CPU_BLOCK <= n) ? FUSE_CPU_BLOCK : (int) (n - start);
+
+		const float *x0 = inputs[0] + start;
+		#pragma omp simd
+		for (int j = 0; j < len; j++) v[j] = x0[j];
+
+		for (int k = 0; k < chain->nops; k++)
+		{
+			const fuseOp_t *op = &chain->ops[k];
+			const float *xk = inputs[op->input] + start;
+			const float a = op->a, b = op->b;
+			switch (op->type)
+			{
+				case FuseAdd:
+					#pragma omp simd
+					for (int j = 0; j < len; j++) v[j] += xk[j];
+					break;
+				case FuseMul:
+					#pragma omp simd
+					for (int j = 0; j < len; j++) v[j] *= xk[j];
+					break;
+				case FuseScale:
+					#pragma omp simd
+					for (int j = 0; j < len; j++) v[j] = a * v[j] + b;
+					break;
+				// Selects instead of fmaxf() / fminf() so the loops are vectorized, NaN
+				// gives the same result as fmax() / fmin() on device
+				case FuseClamp:
+					#pragma omp simd
+					for (int j = 0; j < len; j++)
+					{
+						float t = (v[j] > a) ? v[j] : a;
+						v[j] = (t < b) ? t : b;
+					}
+					break;
+				case FuseRelu:
+					#pragma omp simd
+					for (int j = 0; j < len; j++) v[j] = (v[j] > 0.0f) ? v[j] : 0.0f;
+					break;
+				case FuseSigmoid:
+					#pragma omp simd
+					for (int j = 0; j < len; j++) v[j] = 1.0f / (1.0f + expf(-v[j]));
+					break;
+				case FuseTanh:
+					#pragma omp simd
+					for (int j = 0; j < len; j++) v[j] = tanhf(v[j]);
+					break;
+			}
+		}
+
+		if (chain->out_type == FuseFloat)
+		{
+			float *out = (float*) output + start;
+			#pragma omp simd
+			for (int j = 0; j < len; j++) out[j] = v[j];
+		}
+		if (chain->out_type == FuseInt)
+		{
+			int *out = (int*) output + start;
+			for (int j = 0; j < len; j++) out[j] = convertIntSatRte(v[j]);
+		}
+		if (chain->out_type == FuseUchar)
+		{
+			unsigned char *out = (unsigned char*) output + start;
+			for (int j = 0; j < len; j++) out[j] = convertUcharSatRte(v[j]);
+		}
+	}
+	return 0;
+}
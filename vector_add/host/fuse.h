@@ -0,0 +1,100 @@
+#ifndef __FUSE_H__
+#define __FUSE_H__
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+// Fused chains of elementwise operations. A chain has ninputs float arrays in[0..ninputs-1]
+// and one output array. For each element, v = in[0][i], then each operation of the chain
+// is applied to v in order, and v is converted to the output type and written to out[i].
+// One fused pass reads each input and writes the output once, instead of one pass over
+// global memory (and one launch) per operation.
+//
+// The kernel of a chain is generated as device/fused_<signature>.cl, the signature only
+// depends on the operations and inputs, not on the scalars, which are kernel arguments.
+// The runtime keeps the programs of the last FUSE_MAX_PROGRAMS chains used and the
+// on-disk binary cache keeps every chain for later loads and the next process, so each
+// chain is built once. On an FPGA the source must be compiled offline:
+// "make fused_<signature>.aocx" in this directory.
+// Functions return 0 on success and -1 on invalid arguments or OpenCL errors.
+
+#define FUSE_MAX_OPS     16
+#define FUSE_MAX_INPUTS  4
+#define FUSE_MAX_SIG_LEN (16 + 4 * FUSE_MAX_OPS)
+#define FUSE_MAX_PROGRAMS 8  // Chain programs kept in the runtime, less than CL_RUNTIME_MAX_PROGRAMS
+
+typedef enum
+{
+	FuseAdd = 0,  // v = v + in[input][i]
+	FuseMul,      // v = v * in[input][i]
+	FuseScale,    // v = a * v + b
+	FuseClamp,    // v = min(max(v, a), b)
+	FuseRelu,     // v = max(v, 0)
+	FuseSigmoid,  // v = 1 / (1 + exp(-v))
+	FuseTanh      // v = tanh(v)
+} fuseOpType_t;
+
+// Output types, int and uchar are rounded to nearest even and saturated, NaN gives 0
+typedef enum {FuseFloat = 0, FuseInt, FuseUchar} fuseType_t;
+
+typedef struct
+{
+	fuseOpType_t type;
+	int          input;  // Input array of FuseAdd and FuseMul
+	float        a, b;   // Scalars of FuseScale and FuseClamp
+} fuseOp_t;
+
+typedef struct
+{
+	int        ninputs;
+	fuseType_t out_type;
+	int        nops;
+	fuseOp_t   ops[FUSE_MAX_OPS];
+} fuseChain_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start an empty chain with 1 <= ninputs <= FUSE_MAX_INPUTS
+int initFuseChain(fuseChain_t *chain, const int ninputs, const fuseType_t out_type);
+
+// Append an operation, unused arguments are ignored
+int appendFuseOp(fuseChain_t *chain, const fuseOpType_t type, const int input, const float a, const float b);
+
+// Signature of a chain, e.g. "2i_f_a1_s_r", also the suffix of the kernel name
+int getFuseChainSignature(const fuseChain_t *chain, char *sig, const size_t sig_size);
+
+// Generated OpenCL source of the fused kernel, returns the length or -1 if src is too small
+int getFuseChainSource(const fuseChain_t *chain, char *src, const size_t src_size);
+
+// Get the program of a chain, write its source and build it on first use.
+// Returns NULL if there is no OpenCL device or the program cannot be built.
+// Getting a new chain releases the least recently got program once FUSE_MAX_PROGRAMS are
+// kept, so a program stays valid until that many other chains are got or it is released.
+cl_program getFuseChainProgram(const fuseChain_t *chain);
+
+// Release the program of a chain from the runtime when it is no longer used
+void releaseFuseChainProgram(cl_program program);
+
+// Run a chain on n elements of device buffers, the output must not be an input.
+// Runs on runtime queue 0 and blocks until the output is ready.
+int runFuseChain(
+	const fuseChain_t *chain, const size_t n, const cl_mem *inputs, cl_mem output,
+	cl_program program
+);
+
+// Run a chain on host arrays on device. If there is no FPGA (or the chain has no
+// program), runFuseChainCPU() is used instead; set $FUSE_CPU_FALLBACK to 0 to use
+// the OpenCL device anyway.
+int runFuseChainHost(const fuseChain_t *chain, const size_t n, const float **inputs, void *output);
+
+// Run a chain on CPU with OpenMP. Blocks of elements stay in cache while all operations
+// are applied, so the arrays are also read and written only once.
+int runFuseChainCPU(const fuseChain_t *chain, const size_t n, const float **inputs, void *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif